@@ -0,0 +1,85 @@
+#pragma once
+
+//Harness of the benchmark suite (see "simple-spectral-bench.cpp"): timing of microbenchmarks, and
+//	collection of all results as JSON.
+
+#include "../src/stdafx.hpp"
+
+#include <chrono>
+
+
+
+namespace Bench {
+
+
+
+//Sink for results, so that benchmarked work isn't optimized away.
+extern volatile float sink;
+
+class Suite final {
+	public:
+		//Only benchmarks whose names contain this are run.
+		std::string filter;
+		//Each repetition of a microbenchmark runs for at-least this long (in seconds), and the
+		//	median of `.reps` repetitions is reported.
+		double min_time = 0.1;
+		size_t reps = 5;
+
+		//Name of the rendering mode being benchmarked, recorded with each result.
+		std::string mode;
+
+	private:
+		//Results so far, as JSON objects
+		std::vector<std::string> _results;
+
+	public:
+		bool is_enabled(std::string const& name) const {
+			return name.find(filter)!=std::string::npos;
+		}
+
+		//Run microbenchmark `name`, if enabled: `function(count)` does `count` operations and
+		//	returns a value depending on all of them.  The count is calibrated so that a repetition
+		//	takes about `.min_time`, and the time per operation is reported.
+		template <class Function> void micro(std::string const& name, Function const& function) {
+			if (!is_enabled(name)) return;
+
+			auto time = [&](size_t count) -> double {
+				auto t0 = std::chrono::steady_clock::now();
+				sink = static_cast<float>(function(count));
+				auto t1 = std::chrono::steady_clock::now();
+				return std::chrono::duration<double>(t1-t0).count();
+			};
+
+			//Calibrate (this also warms up caches and lazily-loaded data)
+			size_t count = 1;
+			double seconds;
+			while ((seconds=time(count))<0.125*min_time) count*=2;
+			count = std::max( static_cast<size_t>(static_cast<double>(count)*min_time/seconds), 1_zu );
+
+			std::vector<double> ns_per_op(reps);
+			for (double& value : ns_per_op) value=time(count)*1.0e9/static_cast<double>(count);
+			std::sort(ns_per_op.begin(),ns_per_op.end());
+
+			add( "micro", name, {
+				{ "ns_per_op",     ns_per_op[ns_per_op.size()/2] },
+				{ "min_ns_per_op", ns_per_op[0]                  },
+				{ "ops",           static_cast<double>(count)    },
+				{ "reps",          static_cast<double>(reps)     }
+			});
+			fprintf(stderr,"  %-40s %12.3f ns/op\n",name.c_str(),ns_per_op[ns_per_op.size()/2]);
+		}
+
+		//Record a result of benchmark `name` of kind `kind` ("micro", "macro", or "error" if it
+		//	failed), with the named values `values`.
+		void add(
+			std::string const& kind, std::string const& name,
+			std::vector<std::pair<std::string,double>> const& values
+		);
+
+		//Write the results, as a JSON document, to `file`.
+		void write_json(FILE* file) const;
+};
+
+
+
+}
@@ -0,0 +1,341 @@
+//The benchmarks of the suite (see "simple-spectral-bench.cpp"), for the rendering mode this is
+//	compiled for.
+
+#include "bench.hpp"
+
+#include "../src/util/random.hpp"
+#include "../src/util/spherical-tri.hpp"
+
+#include "../src/framebuffer.hpp"
+#include "../src/simple-spectral.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Number of precomputed inputs a microbenchmark cycles through (a power of two).  Inputs are
+//	precomputed so that their generation isn't timed.
+#define BENCH_INPUTS 4096_zu
+
+//Resolution and samples per pixel of the renders of the macrobenchmarks
+#define BENCH_RENDER_RES 128_zu
+#define BENCH_RENDER_SPP 8_zu
+
+
+
+static void _bench_random(Bench::Suite* suite) {
+	Math::RNG rng;
+
+	suite->micro("random/rand_1f",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) sum+=Math::rand_1f(rng);
+		return sum;
+	});
+	suite->micro("random/rand_1d",[&](size_t count) -> double {
+		double sum = 0.0;
+		for (size_t k=0;k<count;++k) sum+=Math::rand_1d(rng);
+		return sum;
+	});
+
+	suite->micro("sampling/rand_sphere",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) {
+			float pdf;
+			sum += Math::rand_sphere(rng,&pdf).x + pdf;
+		}
+		return sum;
+	});
+	suite->micro("sampling/rand_coshemi",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) {
+			float pdf;
+			sum += Math::rand_coshemi(rng,&pdf).x + pdf;
+		}
+		return sum;
+	});
+	suite->micro("sampling/rand_toward_sphere",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) {
+			float pdf;
+			sum += Math::rand_toward_sphere( rng, Dir(0,0,-5),1.0f, &pdf ).x + pdf;
+		}
+		return sum;
+	});
+	Math::SphericalTriangle tri(
+		glm::normalize(Pos(-1,-1,-2)), glm::normalize(Pos(1,-1,-2)), glm::normalize(Pos(0,1,-2))
+	);
+	suite->micro("sampling/rand_toward_sphericaltri",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) sum+=Math::rand_toward_sphericaltri(rng,tri).x;
+		return sum;
+	});
+}
+
+static void _bench_intersect(Bench::Suite* suite, Scene const* scene) {
+	Math::RNG rng;
+
+	//A single triangle, hit by about half of the rays
+	{
+		MaterialLambertian material;
+		PrimTri tri( &material, { Pos(-1,-1,0), ST(0,0) }, { Pos(1,-1,0), ST(1,0) }, { Pos(0,1,0), ST(0.5f,1) } );
+
+		std::vector<Ray> rays(BENCH_INPUTS);
+		for (Ray& ray : rays) {
+			ray.orig = Pos( 2.0f*Math::rand_1f(rng)-1.0f, 2.0f*Math::rand_1f(rng)-1.0f, 2.0f );
+			Pos target( 3.0f*Math::rand_1f(rng)-1.5f, 3.0f*Math::rand_1f(rng)-1.5f, 0.0f );
+			ray.dir = glm::normalize( target - ray.orig );
+		}
+
+		suite->micro("intersect/prim-tri",[&](size_t count) -> float {
+			float sum = 0.0f;
+			for (size_t k=0;k<count;++k) {
+				HitRecord hitrec;
+				hitrec.dist = INF;
+				if (tri.intersect( rays[k&(BENCH_INPUTS-1)], &hitrec )) sum+=hitrec.dist;
+			}
+			return sum;
+		});
+	}
+
+	//The Cornell box, with coherent rays (through random pixels from its camera) and incoherent
+	//	ones (in random directions from random points inside it)
+	{
+		std::vector<Ray> rays_camera(BENCH_INPUTS);
+		for (Ray& ray : rays_camera) {
+			glm::dvec4 point = scene->camera.matr_PV_inv * glm::dvec4(
+				2.0*Math::rand_1d(rng)-1.0, 2.0*Math::rand_1d(rng)-1.0, 0.0, 1.0
+			);
+			point /= point.w;
+			ray = { scene->camera.pos, Dir(glm::normalize( glm::dvec3(point) - glm::dvec3(scene->camera.pos) )) };
+		}
+		std::vector<Ray> rays_random(BENCH_INPUTS);
+		AABB aabb = scene->bvh->get_aabb();
+		for (Ray& ray : rays_random) {
+			float pdf;
+			ray.orig = aabb.low + Pos(Math::rand_1f(rng),Math::rand_1f(rng),Math::rand_1f(rng))*(aabb.high-aabb.low);
+			ray.dir  = Math::rand_sphere(rng,&pdf);
+		}
+
+		for (auto const& [name,rays] : {
+			std::make_pair("intersect/scene-cornell-camera",&rays_camera),
+			std::make_pair("intersect/scene-cornell-random",&rays_random)
+		}) {
+			suite->micro(name,[&,rays=rays](size_t count) -> float {
+				float sum = 0.0f;
+				for (size_t k=0;k<count;++k) {
+					HitRecord hitrec;
+					if (scene->intersect( (*rays)[k&(BENCH_INPUTS-1)], &hitrec )) sum+=hitrec.dist;
+				}
+				return sum;
+			});
+		}
+	}
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+static void _bench_spectral(Bench::Suite* suite) {
+	Math::RNG rng;
+
+	std::vector<nm> lambdas(BENCH_INPUTS);
+	for (nm& lambda : lambdas) lambda=LAMBDA_MIN+Math::rand_1f(rng)*LAMBDA_STEP;
+
+	suite->micro("spectrum/operator[]",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) sum+=Color::data->D65_rad[ lambdas[k&(BENCH_INPUTS-1)] ][0];
+		return sum;
+	});
+
+	std::vector<SpectralRadiantFlux::HeroSample> fluxes(BENCH_INPUTS);
+	for (auto& flux : fluxes) flux=SpectralRadiantFlux::HeroSample(Math::rand_1f(rng));
+	suite->micro("color/specradflux_to_ciexyz",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) {
+			size_t index = k & (BENCH_INPUTS-1);
+			sum += Color::specradflux_to_ciexyz( fluxes[index], lambdas[index] ).y;
+		}
+		return sum;
+	});
+
+	std::vector<lRGB_F32> lrgbs(BENCH_INPUTS);
+	for (lRGB_F32& lrgb : lrgbs) lrgb=lRGB_F32(Math::rand_1f(rng),Math::rand_1f(rng),Math::rand_1f(rng));
+	suite->micro("color/lrgb_to_specrefl",[&](size_t count) -> float {
+		float sum = 0.0f;
+		for (size_t k=0;k<count;++k) {
+			size_t index = k & (BENCH_INPUTS-1);
+			sum += Color::lrgb_to_specrefl( lrgbs[index], lambdas[index] )[0];
+		}
+		return sum;
+	});
+}
+#endif
+
+static void _bench_texture(Bench::Suite* suite) {
+	if (!suite->is_enabled("texture/")) return;
+
+	Math::RNG rng;
+
+	sRGB_ReflectanceTexture texture("data/scenes/crystal-lizard-512.png");
+	texture.wait();
+
+	class Lookup final { public:
+		ST st;
+		#ifdef RENDER_MODE_SPECTRAL
+		nm lambda_0;
+		#endif
+	};
+	std::vector<Lookup> lookups(BENCH_INPUTS);
+	for (Lookup& lookup : lookups) {
+		lookup.st = ST(Math::rand_1f(rng),Math::rand_1f(rng));
+		#ifdef RENDER_MODE_SPECTRAL
+		lookup.lambda_0 = LAMBDA_MIN + Math::rand_1f(rng)*LAMBDA_STEP;
+		#endif
+	}
+
+	//	Lookups of the full-resolution image, and with footprints of about a pixel of a 128⨯128
+	//		view of the whole texture (so that a smaller MIP level is used)
+	for (auto const& [name,st_width] : {
+		std::make_pair("texture/sample",0.0f), std::make_pair("texture/sample-footprint",1.0f/128.0f)
+	}) {
+		suite->micro(name,[&,st_width=st_width](size_t count) -> float {
+			float sum = 0.0f;
+			for (size_t k=0;k<count;++k) {
+				Lookup const& lookup = lookups[k&(BENCH_INPUTS-1)];
+				#ifdef RENDER_MODE_SPECTRAL
+				sum += texture.sample( lookup.st,st_width, lookup.lambda_0 )[0];
+				#else
+				sum += texture.sample( lookup.st,st_width                  ).r;
+				#endif
+			}
+			return sum;
+		});
+	}
+}
+
+static void _bench_framebuffer(Bench::Suite* suite) {
+	if (!suite->is_enabled("framebuffer/")) return;
+
+	Math::RNG rng;
+
+	size_t const res[2] = { 512, 512 };
+	Framebuffer framebuffer(res);
+	for (size_t j=0;j<res[1];++j) for (size_t i=0;i<res[0];++i) {
+		framebuffer(i,j) = sRGB_A_F32( Math::rand_1f(rng),Math::rand_1f(rng),Math::rand_1f(rng), 1.0f );
+	}
+
+	//	One operation is saving the whole image (to the working directory; the file is removed).
+	for (char const* extension : { "png", "hdr", "pfm", "csv" }) {
+		std::string path = std::string("bench-framebuffer.") + extension;
+		suite->micro(std::string("framebuffer/save-512-")+extension,[&](size_t count) -> float {
+			for (size_t k=0;k<count;++k) {
+				if (!framebuffer.save(path)) throw -1;
+			}
+			return 0.0f;
+		});
+		std::remove(path.c_str());
+	}
+}
+
+static void _bench_render(Bench::Suite* suite) {
+	for (char const* scene_name : { "cornell", "cornell-srgb", "plane-srgb" }) {
+		std::string name = std::string("render/") + scene_name;
+		if (!suite->is_enabled(name)) continue;
+
+		Renderer::Options options;
+		options.scene_name = scene_name;
+		options.res[0] = options.res[1] = BENCH_RENDER_RES;
+		options.spp = BENCH_RENDER_SPP;
+
+		//	(Each scene on its own, so that if one fails to load, e.g. for lack of its textures, the
+		//		others still run.)
+		Scene* scene = nullptr;
+		try {
+			//Load the scene, and wait for its textures, so that loading isn't timed
+			scene = Renderer::get_new_scene(options);
+			for (auto const& iter : scene->materials) {
+				auto material = dynamic_cast<MaterialSimpleAlbedoBase const*>(iter.second);
+				if (material!=nullptr && material->albedo.texture!=nullptr) material->albedo.texture->wait();
+			}
+		} catch (int) {
+			delete scene;
+			fprintf(stderr,"  %-40s failed!\n",name.c_str());
+			suite->add( "error", name, {} );
+			continue;
+		}
+
+		{
+			Renderer renderer(options,scene);
+
+			//Render the first frame (so the samples are seeded the same on every run) into memory
+			std::vector<lRGB_F32> pixels( BENCH_RENDER_RES*BENCH_RENDER_RES );
+			Renderer::Target target;
+			target.format = Renderer::Target::FORMAT::lRGB_F32;
+			target.pixels = pixels.data();
+			target.stride = BENCH_RENDER_RES*sizeof(lRGB_F32);
+
+			auto t0 = std::chrono::steady_clock::now();
+			renderer.render_into(target);
+			auto t1 = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>(t1-t0).count();
+
+			//	Mean of the image, to check that a change meant to be faster didn't change the result
+			double mean = 0.0;
+			for (lRGB_F32 const& pixel : pixels) mean+=static_cast<double>(pixel.r+pixel.g+pixel.b);
+			mean /= static_cast<double>(3*pixels.size());
+
+			double samples = static_cast<double>(BENCH_RENDER_RES*BENCH_RENDER_RES*BENCH_RENDER_SPP);
+			double rays    = static_cast<double>(renderer.get_num_rays());
+			suite->add( "macro", name, {
+				{ "seconds",       seconds                                    },
+				{ "samples_per_s", samples/seconds                            },
+				{ "rays_per_s",    rays   /seconds                            },
+				{ "samples",       samples                                    },
+				{ "rays",          rays                                       },
+				{ "width",         static_cast<double>(options.res[0])        },
+				{ "height",        static_cast<double>(options.res[1])        },
+				{ "spp",           static_cast<double>(options.spp)           },
+				{ "threads",       static_cast<double>(std::max(std::thread::hardware_concurrency(),1u)) },
+				{ "image_mean",    mean                                       }
+			});
+			fprintf(stderr,"\n  %-40s %12.0f samples/s %12.0f rays/s\n",name.c_str(),samples/seconds,rays/seconds);
+		}
+
+		delete scene;
+	}
+}
+
+//Run the benchmarks (those enabled in `suite`), adding their results to it.
+void run_benchmarks(Bench::Suite* suite) {
+	SimpleSpectral::init();
+
+	//Run each group of benchmarks on its own, so that if one fails (e.g. for lack of its data),
+	//	the failure is recorded and the others still run
+	auto run = [&](char const* group, auto const& function) -> void {
+		try {
+			function();
+		} catch (int) {
+			fprintf(stderr,"  %-40s failed!\n",group);
+			suite->add( "error", group, {} );
+		}
+	};
+	run( "random", [&]() { _bench_random(suite); } );
+	run( "intersect", [&]() {
+		if (!suite->is_enabled("intersect/")) return;
+		Scene* scene = Scene::get_new_cornell();
+		_bench_intersect(suite,scene);
+		delete scene;
+	});
+	#ifdef RENDER_MODE_SPECTRAL
+	run( "spectral", [&]() { _bench_spectral(suite); } );
+	#endif
+	run( "texture",     [&]() { _bench_texture    (suite); } );
+	run( "framebuffer", [&]() { _bench_framebuffer(suite); } );
+	run( "render",      [&]() { _bench_render     (suite); } );
+
+	SimpleSpectral::deinit();
+}
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,405 @@
+//Convergence harness of the renderer: renders a scene at increasing sample counts (or to
+//	increasing time budgets), compares each render with a high-spp reference, and writes the curves
+//	of error versus render time.  This judges changes to sampling and to the integrator by their
+//	efficiency (error reached in a given time) rather than by their raw throughput.
+//
+//	Usage: run from the repository root (spectral modes need the data in "data/"):
+//		simple-spectral-convergence --scene=<name> [--res=<pixels>] [--spp=<max>]
+//			[--time-budgets=<s>,<s>,...] [--reference=<path.pfm>] [--reference-spp=<spp>]
+//			[--space=linear|xyz] [--light-sampling=scene|explicit|implicit] [--max-depth=<n>]
+//			[--output=<path.csv>]
+//
+//	The scene is rendered square at `--res` (default 128) with 1, 2, 4, ... samples per pixel, up
+//	to `--spp` (default 256); or, with `--time-budgets`, with as many samples as are estimated to
+//	fit in each budget (from the speed of a 1-spp render).  Each render is timed (wall-clock, on
+//	all threads), and compared with the reference:
+//		rmse      Root-mean-square error over pixels and channels.
+//		relmse    Relative mean-square error, (x-r)²/(r²+0.01), averaged over pixels and channels,
+//		          so that dark regions count as much as bright ones.
+//		flip      A FLIP-like perceptual error in [0,1]: the images are clamped to the display
+//		          range, prefiltered with a Gaussian (σ of one pixel), and compared with the HyAB
+//		          color difference in CIELAB, normalized and compressed as FLIP does.  FLIP's
+//		          feature (edge and point) error is omitted, so it is only an approximation.
+//		efficiency  1/(relmse·seconds), which is constant for an unbiased renderer converging at
+//		          the Monte-Carlo rate; higher is better.
+//	RMSE and relMSE are computed in ℓRGB (BT.709), or with `--space=xyz` in CIE XYZ.
+//
+//	The reference is read from `--reference` if that file exists (e.g. an image saved by
+//	`simple-spectral --output=reference.pfm` with many samples, at-least 64 so that it filters
+//	textures as the renders here do; it must have the same resolution).
+//	Otherwise, it is rendered with `--reference-spp` samples (default 4096), and saved there if a
+//	path was given, so that later runs (e.g. of a modified renderer) compare against the same
+//	reference.  Rendered references use samples disjoint from those of the renders being measured,
+//	so that their errors are independent.  The curves are written as CSV to `--output` (default
+//	"convergence.csv"), e.g. to plot with gnuplot:
+//		plot "convergence.csv" using 2:4 with linespoints (with `set datafile separator ","` and
+//			log-log axes).
+//	Only the rendering mode that "simple-spectral-core" is built for is measured; to compare modes,
+//	configure a build for each.
+
+#include "../src/util/string.hpp"
+
+#include "../src/simple-spectral.hpp"
+
+#include <chrono>
+
+
+
+//First sample index of rendered references (beyond any sample count measured)
+#define CONVERGENCE_REFERENCE_SAMPLE_OFFSET (1_zu<<32)
+
+
+
+//Conversion from ℓRGB (BT.709 primaries, D65 white) to CIE XYZ.  (This is the standard matrix,
+//	rather than `Color::lrgb_to_ciexyz(...)`, which exists only in spectral modes.)
+static glm::vec3 _lrgb_to_xyz(lRGB_F32 const& lrgb) {
+	return glm::vec3(
+		0.4124564f*lrgb.r + 0.3575761f*lrgb.g + 0.1804375f*lrgb.b,
+		0.2126729f*lrgb.r + 0.7151522f*lrgb.g + 0.0721750f*lrgb.b,
+		0.0193339f*lrgb.r + 0.1191920f*lrgb.g + 0.9503041f*lrgb.b
+	);
+}
+//Conversion from ℓRGB to CIELAB (with the D65 white of ℓRGB)
+static glm::vec3 _lrgb_to_lab(lRGB_F32 const& lrgb) {
+	glm::vec3 white = _lrgb_to_xyz(lRGB_F32(1.0f));
+	glm::vec3 xyz = _lrgb_to_xyz(lrgb) / white;
+	auto f = [](float t) -> float {
+		return t>216.0f/24389.0f ? std::cbrt(t) : (24389.0f/27.0f*t+16.0f)/116.0f;
+	};
+	glm::vec3 fxyz( f(xyz.x), f(xyz.y), f(xyz.z) );
+	return glm::vec3( 116.0f*fxyz.y-16.0f, 500.0f*(fxyz.x-fxyz.y), 200.0f*(fxyz.y-fxyz.z) );
+}
+//HyAB color difference of CIELAB colors (as used by FLIP, which suits large differences better
+//	than Euclidean distance)
+static float _hyab(glm::vec3 const& lab0, glm::vec3 const& lab1) {
+	glm::vec3 delta = lab0 - lab1;
+	return std::abs(delta.x) + std::sqrt( delta.y*delta.y + delta.z*delta.z );
+}
+
+//Errors of an image with respect to the reference
+class Errors final { public:
+	double rmse;
+	double relmse;
+	double flip;
+};
+class Comparer final {
+	private:
+		size_t const _res[2];
+		bool const _xyz;
+
+		std::vector<lRGB_F32> const _reference;
+		//	The reference, prefiltered and in CIELAB, for the FLIP-like error
+		std::vector<glm::vec3> _reference_lab;
+
+		//Maximum HyAB difference (between green and blue), by which the FLIP-like error is
+		//	normalized
+		float _hyab_max;
+
+	public:
+		Comparer(size_t const res[2], bool xyz, std::vector<lRGB_F32>&& reference) :
+			_res{res[0],res[1]}, _xyz(xyz), _reference(std::move(reference))
+		{
+			_reference_lab = _get_prefiltered_lab(_reference);
+			_hyab_max = _hyab( _lrgb_to_lab(lRGB_F32(0,1,0)), _lrgb_to_lab(lRGB_F32(0,0,1)) );
+		}
+
+	private:
+		//Clamp `image` to the display range, prefilter it with a Gaussian of σ one pixel (as the
+		//	eye's contrast sensitivity does, roughly, at a typical viewing distance), and convert it
+		//	to CIELAB.
+		std::vector<glm::vec3> _get_prefiltered_lab(std::vector<lRGB_F32> const& image) const {
+			float const weights[4] = { 0.39894228f, 0.24197072f, 0.05399097f, 0.00443185f };
+			float weights_sum = weights[0] + 2.0f*(weights[1]+weights[2]+weights[3]);
+
+			//	Separably, clamping at the edges
+			std::vector<lRGB_F32> temp(image.size()), filtered(image.size());
+			for (int pass=0;pass<2;++pass) {
+				std::vector<lRGB_F32> const& src = pass==0 ? image : temp;
+				std::vector<lRGB_F32>&       dst = pass==0 ? temp  : filtered;
+				for (size_t j=0;j<_res[1];++j) {
+					for (size_t i=0;i<_res[0];++i) {
+						lRGB_F32 sum(0.0f);
+						for (int o=-3;o<=3;++o) {
+							ptrdiff_t x=static_cast<ptrdiff_t>(i), y=static_cast<ptrdiff_t>(j);
+							if (pass==0) x=std::clamp( x+o, ptrdiff_t(0), static_cast<ptrdiff_t>(_res[0])-1 );
+							else         y=std::clamp( y+o, ptrdiff_t(0), static_cast<ptrdiff_t>(_res[1])-1 );
+							lRGB_F32 value = src[ static_cast<size_t>(y)*_res[0] + static_cast<size_t>(x) ];
+							if (pass==0) value=glm::clamp( value, lRGB_F32(0.0f),lRGB_F32(1.0f) );
+							sum += weights[std::abs(o)] * value;
+						}
+						dst[ j*_res[0] + i ] = sum / weights_sum;
+					}
+				}
+			}
+
+			std::vector<glm::vec3> result(image.size());
+			for (size_t k=0;k<image.size();++k) result[k]=_lrgb_to_lab(filtered[k]);
+			return result;
+		}
+
+	public:
+		Errors compare(std::vector<lRGB_F32> const& image) const {
+			double sum_se=0.0, sum_relse=0.0, sum_flip=0.0;
+
+			for (size_t k=0;k<image.size();++k) {
+				glm::vec3 value     = image     [k];
+				glm::vec3 reference = _reference[k];
+				if (_xyz) {
+					value     = _lrgb_to_xyz(value    );
+					reference = _lrgb_to_xyz(reference);
+				}
+				for (int c=0;c<3;++c) {
+					double error = static_cast<double>(value[c]) - static_cast<double>(reference[c]);
+					double ref   = static_cast<double>(reference[c]);
+					sum_se    += error*error;
+					sum_relse += error*error / ( ref*ref + 0.01 );
+				}
+			}
+
+			//	FLIP's compression of color differences: linear up to a fraction `pc` of the
+			//		maximum, where it reaches `pt`, then linear to one
+			std::vector<glm::vec3> lab = _get_prefiltered_lab(image);
+			float const pc=0.4f, pt=0.95f;
+			for (size_t k=0;k<image.size();++k) {
+				float hyab = _hyab( lab[k], _reference_lab[k] );
+				float error;
+				if (hyab<pc*_hyab_max) error = pt/(pc*_hyab_max) * hyab;
+				else                   error = pt + (hyab-pc*_hyab_max)/(_hyab_max-pc*_hyab_max) * (1.0f-pt);
+				sum_flip += static_cast<double>(std::min( error, 1.0f ));
+			}
+
+			double count = static_cast<double>(image.size());
+			return { std::sqrt(sum_se/(3.0*count)), sum_relse/(3.0*count), sum_flip/count };
+		}
+};
+
+//Load an ℓRGB ".pfm" image (as saved by the renderer, whose scanlines are top to bottom; see
+//	`Framebuffer::save(...)`), returning its pixels from top to bottom, or nothing if the file
+//	doesn't exist.
+static std::vector<lRGB_F32> _load_pfm(std::string const& path, size_t res[2]) {
+	std::vector<lRGB_F32> result;
+
+	FILE* file = fopen(path.c_str(),"rb");
+	if (file==nullptr) return result;
+
+	char type[3];
+	unsigned long w, h;
+	double sc;
+	if (
+		fscanf(file,"%2s %lu %lu %lf",type,&w,&h,&sc)!=4 ||
+		std::strcmp(type,"PF")!=0 || w==0 || h==0 || sc>=0.0 //Only little-endian RGB
+	) {
+		fclose(file);
+		fprintf(stderr,"Invalid or unsupported reference image \"%s\"!\n",path.c_str());
+		throw -1;
+	}
+	fgetc(file);
+	res[0]=w; res[1]=h;
+
+	result.resize(res[1]*res[0]);
+	if (fread( result.data(), sizeof(lRGB_F32),result.size(), file )!=result.size()) {
+		fclose(file);
+		fprintf(stderr,"Reference image \"%s\" is truncated!\n",path.c_str());
+		throw -1;
+	}
+
+	fclose(file);
+	return result;
+}
+//Save `pixels` (top to bottom) as an ℓRGB ".pfm" image, as the renderer does.
+static void _save_pfm(std::string const& path, std::vector<lRGB_F32> const& pixels, size_t const res[2]) {
+	FILE* file = fopen(path.c_str(),"wb");
+	if (file!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for writing!\n",path.c_str());
+		throw -1;
+	}
+	fprintf(file,"PF\n%zu %zu\n-1.0\n",res[0],res[1]);
+	fwrite( pixels.data(), sizeof(lRGB_F32),pixels.size(), file );
+	fclose(file);
+}
+
+//Render samples [`first_sample`,`first_sample+spp`) of each pixel of the first frame of `scene`,
+//	returning the pixels (as saved to floating-point images, top to bottom) and the time taken.
+//	`Options::spp` is the same for every render (see `main(...)`), and only the range of samples
+//	differs.
+static std::vector<lRGB_F32> _render(
+	Renderer::Options const& options, Scene* scene, size_t first_sample,size_t spp, double* seconds
+) {
+	assert(first_sample+spp<=options.spp);
+	Renderer renderer(options,scene);
+
+	size_t num_pixels = options.res[0] * options.res[1];
+	std::vector<glm::dvec4> sums(num_pixels);
+	Renderer::WorkRange range = { { 0,options.res[1] }, { first_sample,first_sample+spp } };
+
+	auto t0 = std::chrono::steady_clock::now();
+	renderer.render_sums( range, sums.data() );
+	auto t1 = std::chrono::steady_clock::now();
+	*seconds = std::chrono::duration<double>(t1-t0).count();
+
+	//	(The sums are stored bottom to top; see `Renderer::Target`.)
+	std::vector<lRGB_F32> result(num_pixels);
+	for (size_t j=0;j<options.res[1];++j) {
+		for (size_t i=0;i<options.res[0];++i) {
+			sRGB_A_F32 srgba = Renderer::resolve( sums[ j*options.res[0] + i ], spp );
+			result[ (options.res[1]-1-j)*options.res[0] + i ] = Color::srgb_to_lrgb(sRGB_F32(srgba));
+		}
+	}
+	return result;
+}
+
+static void _run(
+	Renderer::Options const& options, Scene* scene,
+	std::string const& reference_path, size_t reference_spp, bool xyz,
+	size_t max_spp, std::vector<double> const& time_budgets,
+	FILE* output
+) {
+	//Reference
+	size_t ref_res[2] = { 0,0 };
+	std::vector<lRGB_F32> reference;
+	if (!reference_path.empty()) reference=_load_pfm(reference_path,ref_res);
+	if (!reference.empty()) {
+		if (ref_res[0]!=options.res[0] || ref_res[1]!=options.res[1]) {
+			fprintf(stderr,
+				"Reference image \"%s\" is %zux%zu, but the renders are %zux%zu!\n",
+				reference_path.c_str(), ref_res[0],ref_res[1], options.res[0],options.res[1]
+			);
+			throw -1;
+		}
+		fprintf(stderr,"Loaded reference \"%s\".\n",reference_path.c_str());
+	} else {
+		fprintf(stderr,"Rendering reference (%zu spp):\n",reference_spp);
+		double seconds;
+		reference = _render( options, scene, CONVERGENCE_REFERENCE_SAMPLE_OFFSET,reference_spp, &seconds );
+		fprintf(stderr,"\nRendered reference in %.3f s.\n",seconds);
+		if (!reference_path.empty()) _save_pfm( reference_path, reference, options.res );
+	}
+	Comparer comparer( options.res, xyz, std::move(reference) );
+
+	//Curve
+	fprintf(output,"spp,seconds,samples_per_s,rmse,relmse,flip,efficiency\n");
+	auto measure = [&](size_t spp) -> double {
+		double seconds;
+		std::vector<lRGB_F32> image = _render( options, scene, 0,spp, &seconds );
+		Errors errors = comparer.compare(image);
+
+		double samples    = static_cast<double>( options.res[0]*options.res[1]*spp );
+		double efficiency = 1.0 / ( errors.relmse * seconds );
+		fprintf(output,
+			"%zu,%.6f,%.6g,%.9g,%.9g,%.9g,%.9g\n",
+			spp, seconds, samples/seconds, errors.rmse, errors.relmse, errors.flip, efficiency
+		);
+		fflush(output);
+		fprintf(stderr,
+			"\n  %6zu spp %10.3f s   rmse %.6f   relmse %.6f   flip %.6f\n",
+			spp, seconds, errors.rmse, errors.relmse, errors.flip
+		);
+		return seconds;
+	};
+	if (time_budgets.empty()) {
+		for (size_t spp=1;spp<=max_spp;spp*=2) measure(spp);
+	} else {
+		//	(Estimated from a 1-spp render, which is also a point of the curve.)
+		double seconds_per_spp = measure(1);
+		for (double budget : time_budgets) {
+			size_t spp = static_cast<size_t>(std::min( budget/seconds_per_spp, static_cast<double>(CONVERGENCE_REFERENCE_SAMPLE_OFFSET) ));
+			if (spp>1) measure(spp);
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	Renderer::Options options;
+	options.res[0] = options.res[1] = 128;
+
+	std::string reference_path;
+	size_t reference_spp = 4096;
+	bool xyz = false;
+	size_t max_spp = 256;
+	std::vector<double> time_budgets;
+	std::string output_path = "convergence.csv";
+
+	try {
+		for (int i=1;i<argc;++i) {
+			std::string arg = argv[i];
+			if        (Str::startswith(arg,"--scene="        )) {
+				options.scene_name = arg.substr(8);
+			} else if (Str::startswith(arg,"--res="          )) {
+				options.res[0] = options.res[1] = std::stoull(arg.substr(6));
+			} else if (Str::startswith(arg,"--spp="          )) {
+				max_spp = std::stoull(arg.substr(6));
+			} else if (Str::startswith(arg,"--time-budgets=" )) {
+				for (std::string const& budget : Str::split(arg.substr(15),",")) time_budgets.emplace_back(std::stod(budget));
+			} else if (Str::startswith(arg,"--reference="    )) {
+				reference_path = arg.substr(12);
+			} else if (Str::startswith(arg,"--reference-spp=")) {
+				reference_spp = std::stoull(arg.substr(16));
+			} else if (arg=="--space=linear") {
+				xyz = false;
+			} else if (arg=="--space=xyz"   ) {
+				xyz = true;
+			} else if (arg=="--light-sampling=scene"   ) {
+				options.integrator.light_sampling = Renderer::Options::Integrator::LIGHT_SAMPLING::SCENE;
+			} else if (arg=="--light-sampling=explicit") {
+				options.integrator.light_sampling = Renderer::Options::Integrator::LIGHT_SAMPLING::EXPLICIT;
+			} else if (arg=="--light-sampling=implicit") {
+				options.integrator.light_sampling = Renderer::Options::Integrator::LIGHT_SAMPLING::IMPLICIT;
+			} else if (Str::startswith(arg,"--max-depth="    )) {
+				options.integrator.max_depth = static_cast<unsigned>(std::stoul(arg.substr(12)));
+			} else if (Str::startswith(arg,"--output="       )) {
+				output_path = arg.substr(9);
+			} else {
+				fprintf(stderr,"Unrecognized argument \"%s\"!  (See \"bench/convergence.cpp\" for usage.)\n",arg.c_str());
+				return -1;
+			}
+		}
+	} catch (std::logic_error const&) {
+		fprintf(stderr,"Invalid number in arguments!\n");
+		return -1;
+	}
+	if (options.scene_name.empty()) {
+		fprintf(stderr,"A scene must be given with \"--scene=\"!\n");
+		return -1;
+	}
+	if (options.res[0]==0 || max_spp==0 || reference_spp==0) {
+		fprintf(stderr,"Resolution and sample counts must be positive!\n");
+		return -1;
+	}
+	if (max_spp>CONVERGENCE_REFERENCE_SAMPLE_OFFSET) {
+		fprintf(stderr,"At-most %zu samples per pixel can be measured!\n",CONVERGENCE_REFERENCE_SAMPLE_OFFSET);
+		return -1;
+	}
+	//Every render has the same samples per pixel (which affects more than their number, e.g. how
+	//	textures are filtered; see `Renderer::_render_sample(...)`), enough for the reference.  The
+	//	renders differ only in which of those samples they take.
+	options.spp = CONVERGENCE_REFERENCE_SAMPLE_OFFSET + reference_spp;
+
+	FILE* output = fopen(output_path.c_str(),"w");
+	if (output!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for writing!\n",output_path.c_str());
+		return -1;
+	}
+
+	int ret = 0;
+	try {
+		SimpleSpectral::init();
+
+		//Load the scene, and wait for its textures, so that loading isn't timed
+		Scene* scene = Renderer::get_new_scene(options);
+		for (auto const& iter : scene->materials) {
+			auto material = dynamic_cast<MaterialSimpleAlbedoBase const*>(iter.second);
+			if (material!=nullptr && material->albedo.texture!=nullptr) material->albedo.texture->wait();
+		}
+
+		_run( options, scene, reference_path, reference_spp, xyz, max_spp, time_budgets, output );
+
+		delete scene;
+		SimpleSpectral::deinit();
+	} catch (int error) {
+		ret = error;
+	}
+
+	fclose(output);
+
+	return ret;
+}
@@ -0,0 +1,111 @@
+//Benchmark suite of the renderer: microbenchmarks of its hot routines (intersection, spectra,
+//	color conversion, texture lookups, random sampling, image saving), and macrobenchmarks of
+//	whole renders (rays/s and samples/s of the built-in scenes, at fixed seeds).
+//
+//	Usage: run from the repository root (spectral modes need the data in "data/"):
+//		simple-spectral-bench [--filter=<substring>] [--min-time=<seconds>] [--output=<path>]
+//
+//	Only benchmarks whose names contain `--filter` are run (e.g. "render/" for just the
+//	macrobenchmarks).  Each repetition of a microbenchmark runs for at-least `--min-time` seconds
+//	(default 0.1).  The results are written as JSON to `--output`, or else to standard output
+//	(progress is printed to standard error).  With `BUILD_RENDER_VARIANTS`, every rendering mode
+//	built is benchmarked, and each result records its mode.
+
+#include "bench.hpp"
+
+#include "../src/util/console.hpp"
+#include "../src/util/string.hpp"
+
+
+
+volatile float Bench::sink;
+
+void Bench::Suite::add(
+	std::string const& kind, std::string const& name,
+	std::vector<std::pair<std::string,double>> const& values
+) {
+	std::string result = "{\"kind\":\"" + kind + "\",\"name\":\"" + name + "\",\"mode\":\"" + mode + "\"";
+	for (auto const& [key,value] : values) {
+		char buffer[64];
+		//	(JSON has no infinities or NaNs.)
+		if (std::isfinite(value)) snprintf(buffer,sizeof(buffer),"%.9g",value);
+		else                      snprintf(buffer,sizeof(buffer),"null"      );
+		result += ",\"" + key + "\":" + buffer;
+	}
+	result += "}";
+	_results.emplace_back(result);
+}
+void Bench::Suite::write_json(FILE* file) const {
+	fprintf(file,"{\"results\":[\n");
+	for (size_t k=0;k<_results.size();++k) {
+		fprintf(file,"\t%s%s\n", _results[k].c_str(), k+1<_results.size()?",":"");
+	}
+	fprintf(file,"]}\n");
+}
+
+
+
+#ifdef BENCH_VARIANTS
+	//	The variants (see "src/variants.cpp"), each with its own benchmarks
+	#define RENDER_VARIANT_ENTRY(NAME,NAMESPACE,ALGNUM,WAVELENGTHS)\
+		namespace NAMESPACE { void run_benchmarks(Bench::Suite* suite); }
+	#include "render-variants.inl"
+	#undef RENDER_VARIANT_ENTRY
+#else
+	void run_benchmarks(Bench::Suite* suite);
+#endif
+
+int main(int argc, char* argv[]) {
+	Bench::Suite suite;
+	std::string output_path;
+	for (int i=1;i<argc;++i) {
+		std::string arg = argv[i];
+		if      (Str::startswith(arg,"--filter="  )) suite.filter=arg.substr(9);
+		else if (Str::startswith(arg,"--min-time=")) suite.min_time=std::stod(arg.substr(11));
+		else if (Str::startswith(arg,"--output="  )) output_path=arg.substr(9);
+		else {
+			fprintf(stderr,"Unrecognized argument \"%s\"!  (Supported: \"--filter=\", \"--min-time=\", \"--output=\")\n",arg.c_str());
+			return -1;
+		}
+	}
+
+	//The results go to the original standard output (unless written to a file).  Everything else
+	//	printed there (e.g. the renderer's progress) is redirected to standard error, so that it
+	//	can't be mistaken for the results.
+	FILE* stdout_original = Console::take_stdout();
+	FILE* results = output_path.empty() ? stdout_original : fopen(output_path.c_str(),"w");
+	if (results!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for the results!\n",output_path.empty()?"<stdout>":output_path.c_str());
+		return -1;
+	}
+
+	int ret = 0;
+	#ifdef BENCH_VARIANTS
+		#define RENDER_VARIANT_ENTRY(NAME,NAMESPACE,ALGNUM,WAVELENGTHS)\
+			suite.mode = NAME;\
+			fprintf(stderr,"Mode \"%s\":\n",NAME);\
+			try { NAMESPACE::run_benchmarks(&suite); } catch (int error) { ret=error; }
+		#include "render-variants.inl"
+		#undef RENDER_VARIANT_ENTRY
+	#else
+		#if   RENDER_MODE_SPECTRAL_ALGNUM == 1
+			suite.mode = "ours";
+		#elif RENDER_MODE_SPECTRAL_ALGNUM == 2
+			suite.mode = "meng";
+		#elif RENDER_MODE_SPECTRAL_ALGNUM == 3
+			suite.mode = "jh";
+		#else
+			suite.mode = "rgb";
+		#endif
+		#ifdef RENDER_MODE_SPECTRAL
+		if (SAMPLE_WAVELENGTHS!=4) suite.mode+="-"+std::to_string(SAMPLE_WAVELENGTHS);
+		#endif
+		try { run_benchmarks(&suite); } catch (int error) { ret=error; }
+	#endif
+
+	suite.write_json(results);
+	fclose(results);
+	if (stdout_original!=nullptr && stdout_original!=results) fclose(stdout_original);
+
+	return ret;
+}
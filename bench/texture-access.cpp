@@ -0,0 +1,136 @@
+//Microbenchmark of texture lookups, comparing random and coherent access patterns.
+//
+//	Usage: run from the repository root (spectral modes need the data in "data/"):
+//		bench-texture-access [<texture-path>] [<lookups>]
+//
+//	Each pattern is run on the texture's own layout (see `TEXTURE_TILE_SIZE` and
+//	`TEXTURE_HUGE_PAGES`), and, for reference, on a copy of the texels stored as packed 3-byte
+//	scanlines.  "fetch" loads the texel only; "sample" also converts it to a reflectance.
+
+#include "../src/material.hpp"
+
+#include "../src/util/color.hpp"
+
+#include <chrono>
+
+
+
+//Sink for results, so that lookups aren't optimized away.
+static volatile unsigned _sink;
+
+template <class Function>
+static double _time_ns_per(size_t count, Function const& function) {
+	auto t0 = std::chrono::steady_clock::now();
+	function();
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double,std::nano>(t1-t0).count() / static_cast<double>(count);
+}
+
+int main(int argc, char* argv[]) {
+	std::string path = argc>1 ? argv[1] : "data/scenes/crystal-lizard-4096.png";
+	size_t count = argc>2 ? static_cast<size_t>(std::stoull(argv[2])) : 1_zu<<24;
+
+	#ifdef RENDER_MODE_SPECTRAL
+	Color::init();
+	#endif
+
+	int ret = 0;
+	try {
+		sRGB_ReflectanceTexture texture(path);
+		texture.wait();
+		size_t const w=texture.res[0], h=texture.res[1];
+
+		//Reference layout: packed 3-byte scanlines
+		std::vector<sRGB_U8> scanlines(h*w);
+		for (size_t j=0;j<h;++j) for (size_t i=0;i<w;++i) {
+			sRGB_A_U8 const& texel = texture.get_texel(i,j);
+			scanlines[j*w+i] = { texel.r, texel.g, texel.b };
+		}
+
+		//Access patterns, precomputed so their generation isn't timed.  "random" is uniform over the
+		//	texture, like incoherent diffuse bounces.  "coherent" is the primary rays of a 512⨯512
+		//	view of the texture, about one texel per pixel, at a random rotation and offset (changed
+		//	for each view); these are in scanline order, as neighboring pixels are rendered.
+		Math::RNG rng;
+		std::vector<uint32_t> random  (2*count);
+		std::vector<uint32_t> coherent(2*count);
+		for (size_t k=0;k<count;++k) {
+			random[2*k  ] = static_cast<uint32_t>(rand_choice(rng,w));
+			random[2*k+1] = static_cast<uint32_t>(rand_choice(rng,h));
+		}
+		for (size_t k=0;k<count;) {
+			radians angle = rand_1f(rng) * (2.0f*Constants::pi<float>);
+			float c=std::cos(angle), s=std::sin(angle);
+			glm::vec2 offset = glm::vec2( rand_1f(rng)*static_cast<float>(w), rand_1f(rng)*static_cast<float>(h) );
+			for (size_t y=0;y<512&&k<count;++y) {
+				for (size_t x=0;x<512&&k<count;++x,++k) {
+					glm::vec2 uv = offset + glm::vec2(
+						c*static_cast<float>(x) - s*static_cast<float>(y),
+						s*static_cast<float>(x) + c*static_cast<float>(y)
+					);
+					//Wrap around
+					long long i = static_cast<long long>(std::floor(uv.x)) % static_cast<long long>(w);
+					long long j = static_cast<long long>(std::floor(uv.y)) % static_cast<long long>(h);
+					coherent[2*k  ] = static_cast<uint32_t>( i<0 ? i+static_cast<long long>(w) : i );
+					coherent[2*k+1] = static_cast<uint32_t>( j<0 ? j+static_cast<long long>(h) : j );
+				}
+			}
+		}
+
+		printf("Texture \"%s\" (%zu⨯%zu), %zu lookups per test\n",path.c_str(),w,h,count);
+		#ifdef TEXTURE_TILE_SIZE
+		printf("Layout: %zu⨯%zu tiles of 4-byte texels",TEXTURE_TILE_SIZE,TEXTURE_TILE_SIZE);
+		#else
+		printf("Layout: scanlines of 4-byte texels");
+		#endif
+		#ifdef TEXTURE_HUGE_PAGES
+		printf(", huge pages\n");
+		#else
+		printf("\n");
+		#endif
+		printf("  %-9s %-8s %14s %14s\n","pattern","lookup","texture ns/op","scanline ns/op");
+
+		for (auto const& [name,coords] : { std::make_pair("random",&random), std::make_pair("coherent",&coherent) }) {
+			uint32_t const* xy = coords->data();
+
+			double fetch_texture = _time_ns_per(count,[&]() {
+				unsigned sum = 0;
+				for (size_t k=0;k<count;++k) {
+					sRGB_A_U8 const& texel = texture.get_texel(xy[2*k],xy[2*k+1]);
+					sum += texel.r + texel.g + texel.b;
+				}
+				_sink = sum;
+			});
+			double fetch_scanlines = _time_ns_per(count,[&]() {
+				unsigned sum = 0;
+				for (size_t k=0;k<count;++k) {
+					sRGB_U8 const& texel = scanlines[xy[2*k+1]*w+xy[2*k]];
+					sum += texel.r + texel.g + texel.b;
+				}
+				_sink = sum;
+			});
+			printf("  %-9s %-8s %14.3f %14.3f\n",name,"fetch",fetch_texture,fetch_scanlines);
+
+			double sample_texture = _time_ns_per(count,[&]() {
+				float sum = 0.0f;
+				for (size_t k=0;k<count;++k) {
+					#ifdef RENDER_MODE_SPECTRAL
+					sum += texture.sample( xy[2*k],xy[2*k+1], LAMBDA_MIN+static_cast<nm>(k%400) )[0];
+					#else
+					sum += texture.sample( xy[2*k],xy[2*k+1] ).r;
+					#endif
+				}
+				_sink = static_cast<unsigned>(sum);
+			});
+			printf("  %-9s %-8s %14.3f %14s\n",name,"sample",sample_texture,"-");
+		}
+	} catch (int) {
+		ret = -1;
+	}
+
+	#ifdef RENDER_MODE_SPECTRAL
+	Color::deinit();
+	#endif
+
+	return ret;
+}
@@ -0,0 +1,758 @@
+#include "bvh.hpp"
+
+#include "util/mapped-file.hpp"
+#include "util/string.hpp"
+
+#include "geometry.hpp"
+#include "stats.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Tuning parameters for the builders
+//	Number of bins candidate SAH splits are evaluated at
+#define BVH_SAH_BINS 16_zu
+//	Maximum number of primitives in a leaf (it may be more only if they cannot be separated)
+#define BVH_MAX_LEAF_PRIMS 4_zu
+//	Subtrees at-least this large are built as separate tasks
+#define BVH_TASK_MIN_PRIMS 4096_zu
+//	Loops over at-least this many primitives (bounds, binning) are split across threads
+#define BVH_LOOP_MIN_PRIMS 65536_zu
+//	Below this depth, SAH splits that are not balanced give way to median splits.  This bounds
+//		the depth of the tree (and hence the traversal stack) on pathological inputs.
+#define BVH_MAX_SAH_DEPTH 48u
+//	Size of the traversal stack
+#define BVH_STACK_SIZE 128_zu
+//	Version of the cache file format.  Increment whenever the format, `BVH::Node`, or the
+//		builders' output changes.
+#define BVH_CACHE_VERSION 2u
+
+
+
+class BVH::_BuildPrim final {
+	public:
+		AABB aabb;
+		Pos centroid;
+		uint32_t index;
+};
+
+class BVH::_BuildNode final {
+	public:
+		AABB aabb;
+		_BuildNode* children[2];
+		//Range within the builder's `_BuildPrim`s.  Since the range is partitioned in-place, the
+		//	primitives of a leaf are always contiguous.
+		uint32_t prims_offset;
+		uint32_t num_prims; //Zero for interior nodes
+		uint8_t axis;
+};
+
+class BVH::_Builder final {
+	public:
+		std::vector<_BuildPrim> prims;
+
+		//Number of threads available to the build
+		size_t const num_threads;
+		//Depth above which subtrees are spawned as separate tasks
+		unsigned task_depth;
+
+	private:
+		//Build nodes are allocated in blocks.  Each task has its own current block, so that it only
+		//	needs to synchronize to get a new one.
+		#define BVH_BUILD_NODE_BLOCK 4096_zu
+		std::mutex _blocks_mutex;
+		std::vector<_BuildNode*> _blocks;
+
+		std::atomic<size_t> _num_nodes;
+
+	public:
+		class Allocator final {
+			private:
+				_Builder* _builder;
+				_BuildNode* _block;
+				size_t _block_used;
+
+			public:
+				explicit Allocator(_Builder* builder) :
+					_builder(builder), _block(nullptr), _block_used(BVH_BUILD_NODE_BLOCK)
+				{}
+
+				_BuildNode* get() {
+					if (_block_used==BVH_BUILD_NODE_BLOCK) {
+						_block = new _BuildNode[BVH_BUILD_NODE_BLOCK];
+						_block_used = 0;
+						std::lock_guard<std::mutex> lock(_builder->_blocks_mutex);
+						_builder->_blocks.emplace_back(_block);
+					}
+					++_builder->_num_nodes;
+					return _block + _block_used++;
+				}
+		};
+
+	public:
+		explicit _Builder(std::vector<PrimBase*> const& prims) :
+			num_threads(std::max(std::thread::hardware_concurrency(),1u)),
+			_num_nodes(0)
+		{
+			//Enough levels of tasks to keep every thread busy, plus one more to balance load.
+			task_depth = 1u;
+			while ((1_zu<<task_depth)<num_threads) ++task_depth;
+			++task_depth;
+
+			this->prims.resize(prims.size());
+			parallel_for( 0,prims.size(), [&](size_t begin,size_t end) -> void {
+				for (size_t i=begin;i<end;++i) {
+					_BuildPrim& bprim = this->prims[i];
+					bprim.aabb     = prims[i]->get_aabb();
+					bprim.centroid = bprim.aabb.get_center();
+					bprim.index    = static_cast<uint32_t>(i);
+				}
+			});
+		}
+		~_Builder() {
+			for (_BuildNode* block : _blocks) delete[] block;
+		}
+
+		size_t get_num_nodes  () const { return _num_nodes; }
+		size_t get_nodes_bytes() const { return _blocks.size()*BVH_BUILD_NODE_BLOCK*sizeof(_BuildNode); }
+
+		//Call `func(begin,end)` over disjoint subranges covering [`begin`,`end`), using multiple
+		//	threads if the range is large.
+		template <typename Fn> void parallel_for(size_t begin,size_t end, Fn const& func) const {
+			size_t count = end - begin;
+			if (count<BVH_LOOP_MIN_PRIMS || num_threads==1) {
+				func(begin,end);
+				return;
+			}
+			size_t num_chunks = std::min( num_threads, count/(BVH_LOOP_MIN_PRIMS/4) );
+			std::vector<std::thread> threads;
+			for (size_t k=1;k<num_chunks;++k) {
+				threads.emplace_back( func, begin+count*k/num_chunks, begin+count*(k+1)/num_chunks );
+			}
+			func( begin, begin+count/num_chunks );
+			for (std::thread& thread : threads) thread.join();
+		}
+		//Compute `func(begin,end)` over disjoint subranges covering [`begin`,`end`) (using multiple
+		//	threads if the range is large) and combine the results with `combine(a,b)`.
+		template <typename T, typename Fn, typename FnCombine>
+		T parallel_reduce(size_t begin,size_t end, Fn const& func, FnCombine const& combine) const {
+			size_t count = end - begin;
+			if (count<BVH_LOOP_MIN_PRIMS || num_threads==1) return func(begin,end);
+
+			size_t num_chunks = std::min( num_threads, count/(BVH_LOOP_MIN_PRIMS/4) );
+			std::vector<T> results(num_chunks);
+			std::vector<std::thread> threads;
+			for (size_t k=0;k<num_chunks;++k) {
+				threads.emplace_back( [&,k]() -> void {
+					results[k] = func( begin+count*k/num_chunks, begin+count*(k+1)/num_chunks );
+				});
+			}
+			for (std::thread& thread : threads) thread.join();
+
+			T result = results[0];
+			for (size_t k=1;k<num_chunks;++k) result=combine(result,results[k]);
+			return result;
+		}
+
+		//Bounds of the primitives and of their centroids in range [`begin`,`end`).
+		void calc_bounds(size_t begin,size_t end, AABB* aabb,AABB* centroid_aabb) const {
+			typedef std::pair<AABB,AABB> Bounds;
+			Bounds bounds = parallel_reduce<Bounds>( begin,end,
+				[&](size_t begin,size_t end) -> Bounds {
+					Bounds result = { AABB::get_empty(), AABB::get_empty() };
+					for (size_t i=begin;i<end;++i) {
+						result.first .extend(prims[i].aabb    );
+						result.second.extend(prims[i].centroid);
+					}
+					return result;
+				},
+				[](Bounds a, Bounds const& b) -> Bounds {
+					a.first.extend(b.first); a.second.extend(b.second);
+					return a;
+				}
+			);
+			*aabb          = bounds.first;
+			*centroid_aabb = bounds.second;
+		}
+
+		_BuildNode* make_leaf(_BuildNode* node, size_t begin,size_t end) const {
+			node->children[0] = node->children[1] = nullptr;
+			node->prims_offset = static_cast<uint32_t>(begin);
+			node->num_prims    = static_cast<uint32_t>(end-begin);
+			node->axis = 0;
+			return node;
+		}
+
+		//Build the children of an interior node over ranges [`begin`,`mid`) and [`mid`,`end`),
+		//	spawning the first as a separate task if it is large enough and we're high enough in
+		//	the tree.
+		template <typename Fn>
+		void build_children(_BuildNode* node, Allocator& alloc, size_t begin,size_t mid,size_t end, unsigned depth, Fn const& build) {
+			if ( depth<task_depth && end-begin>=BVH_TASK_MIN_PRIMS && num_threads>1 ) {
+				std::thread task([&]() -> void {
+					Allocator alloc_task(this);
+					node->children[0] = build( alloc_task, begin,mid, depth+1u );
+				});
+				node->children[1] = build( alloc, mid,end, depth+1u );
+				task.join();
+			} else {
+				node->children[0] = build( alloc, begin,mid, depth+1u );
+				node->children[1] = build( alloc, mid,end, depth+1u );
+			}
+		}
+
+		//Binned SAH build of range [`begin`,`end`)
+		_BuildNode* build_sah(Allocator& alloc, size_t begin,size_t end, unsigned depth) {
+			_BuildNode* node = alloc.get();
+			size_t count = end - begin;
+
+			AABB centroid_aabb;
+			calc_bounds( begin,end, &node->aabb,&centroid_aabb );
+
+			if (count==1) return make_leaf(node,begin,end);
+
+			size_t axis = centroid_aabb.get_max_axis();
+			node->axis = static_cast<uint8_t>(axis);
+			float axis_low   = centroid_aabb.low [axis];
+			float axis_width = centroid_aabb.high[axis] - axis_low;
+
+			size_t mid;
+			if (axis_width<=0.0f) {
+				//All centroids coincide; there's no meaningful split.
+				if (count<=BVH_MAX_LEAF_PRIMS) return make_leaf(node,begin,end);
+				mid = begin + count/2;
+			} else {
+				auto get_bin = [&](_BuildPrim const& bprim) -> size_t {
+					float frac = (bprim.centroid[axis]-axis_low) / axis_width;
+					return std::min( static_cast<size_t>(frac*static_cast<float>(BVH_SAH_BINS)), BVH_SAH_BINS-1 );
+				};
+
+				//Bin the primitives
+				class Bins final { public:
+					size_t counts[BVH_SAH_BINS];
+					AABB   aabbs [BVH_SAH_BINS];
+				};
+				Bins bins = parallel_reduce<Bins>( begin,end,
+					[&](size_t begin,size_t end) -> Bins {
+						Bins result;
+						for (size_t b=0;b<BVH_SAH_BINS;++b) { result.counts[b]=0; result.aabbs[b]=AABB::get_empty(); }
+						for (size_t i=begin;i<end;++i) {
+							size_t b = get_bin(prims[i]);
+							++result.counts[b];
+							result.aabbs[b].extend(prims[i].aabb);
+						}
+						return result;
+					},
+					[](Bins a, Bins const& b) -> Bins {
+						for (size_t k=0;k<BVH_SAH_BINS;++k) { a.counts[k]+=b.counts[k]; a.aabbs[k].extend(b.aabbs[k]); }
+						return a;
+					}
+				);
+
+				//Evaluate the SAH cost of splitting after each bin, sweeping from both directions.
+				//	Costs are relative to intersecting a primitive, and omit the common factor of
+				//	the node's surface area.
+				float costs_right[BVH_SAH_BINS];
+				size_t counts_right[BVH_SAH_BINS];
+				{
+					AABB aabb = AABB::get_empty(); size_t n=0;
+					for (size_t b=BVH_SAH_BINS-1;b>0;--b) {
+						aabb.extend(bins.aabbs[b]); n+=bins.counts[b];
+						costs_right [b-1] = static_cast<float>(n)*aabb.get_surface_area();
+						counts_right[b-1] = n;
+					}
+				}
+				size_t best_split = 0;
+				float best_cost = std::numeric_limits<float>::infinity();
+				{
+					AABB aabb = AABB::get_empty(); size_t n=0;
+					for (size_t b=0;b<BVH_SAH_BINS-1;++b) {
+						aabb.extend(bins.aabbs[b]); n+=bins.counts[b];
+						if (n==0||counts_right[b]==0) continue;
+						float cost = static_cast<float>(n)*aabb.get_surface_area() + costs_right[b];
+						if (cost<best_cost) { best_cost=cost; best_split=b; }
+					}
+				}
+				float area = node->aabb.get_surface_area();
+				best_cost = 0.125f + ( area>0.0f ? best_cost/area : static_cast<float>(count) );
+
+				//Make a leaf if that's cheaper (and allowed)
+				if ( count<=BVH_MAX_LEAF_PRIMS && best_cost>=static_cast<float>(count) ) {
+					return make_leaf(node,begin,end);
+				}
+
+				if (depth<BVH_MAX_SAH_DEPTH) {
+					mid = static_cast<size_t>( std::partition(
+						prims.begin()+static_cast<ptrdiff_t>(begin), prims.begin()+static_cast<ptrdiff_t>(end),
+						[&](_BuildPrim const& bprim) -> bool { return get_bin(bprim)<=best_split; }
+					) - prims.begin() );
+				} else {
+					mid = begin + count/2;
+					std::nth_element(
+						prims.begin()+static_cast<ptrdiff_t>(begin), prims.begin()+static_cast<ptrdiff_t>(mid), prims.begin()+static_cast<ptrdiff_t>(end),
+						[&](_BuildPrim const& a, _BuildPrim const& b) -> bool { return a.centroid[axis]<b.centroid[axis]; }
+					);
+				}
+				if (mid==begin||mid==end) mid=begin+count/2;
+			}
+
+			node->num_prims = 0;
+			build_children( node, alloc, begin,mid,end, depth,
+				[this](Allocator& alloc, size_t begin,size_t end, unsigned depth) -> _BuildNode* {
+					return build_sah(alloc,begin,end,depth);
+				}
+			);
+			return node;
+		}
+
+		//Linear BVH build of range [`begin`,`end`), whose primitives are sorted by Morton code
+		//	`codes` and all agree on the bits above `bit`.
+		_BuildNode* build_lbvh(Allocator& alloc, std::vector<uint32_t> const& codes, size_t begin,size_t end, int bit, unsigned depth) {
+			size_t count = end - begin;
+			if (count<=BVH_MAX_LEAF_PRIMS) {
+				_BuildNode* node = alloc.get();
+				AABB centroid_aabb;
+				calc_bounds( begin,end, &node->aabb,&centroid_aabb );
+				return make_leaf(node,begin,end);
+			}
+
+			//Find the highest bit at which the range's codes differ.  Since the codes are sorted,
+			//	comparing the first and last suffices.
+			while ( bit>=0 && ((codes[begin]^codes[end-1])&(1u<<bit))==0u ) --bit;
+
+			size_t mid;
+			if (bit>=0) {
+				//First code with the bit set
+				mid = static_cast<size_t>( std::partition_point(
+					codes.begin()+static_cast<ptrdiff_t>(begin), codes.begin()+static_cast<ptrdiff_t>(end),
+					[bit](uint32_t code) -> bool { return (code&(1u<<bit))==0u; }
+				) - codes.begin() );
+			} else {
+				//Identical codes; split arbitrarily.
+				mid = begin + count/2;
+			}
+
+			_BuildNode* node = alloc.get();
+			node->num_prims = 0;
+			//Bits are interleaved as ...zyxzyx, so the split's axis can be read off the bit index.
+			node->axis = static_cast<uint8_t>( bit>=0 ? 2-bit%3 : 0 );
+			build_children( node, alloc, begin,mid,end, depth,
+				[&codes,bit,this](Allocator& alloc, size_t begin,size_t end, unsigned depth) -> _BuildNode* {
+					return build_lbvh(alloc,codes,begin,end,bit-1,depth);
+				}
+			);
+			node->aabb = node->children[0]->aabb;
+			node->aabb.extend(node->children[1]->aabb);
+			return node;
+		}
+		//Compute Morton codes of the primitives' centroids and sort the primitives by them.
+		std::vector<uint32_t> sort_morton() {
+			AABB aabb, centroid_aabb;
+			calc_bounds( 0,prims.size(), &aabb,&centroid_aabb );
+			Dir extent = centroid_aabb.high - centroid_aabb.low;
+			Dir scale = Dir(
+				extent.x>0.0f ? 1023.0f/extent.x : 0.0f,
+				extent.y>0.0f ? 1023.0f/extent.y : 0.0f,
+				extent.z>0.0f ? 1023.0f/extent.z : 0.0f
+			);
+
+			//Insert two zero bits between each of the low ten bits of `x`.
+			auto spread_bits = [](uint32_t x) -> uint32_t {
+				x = (x|(x<<16)) & 0x030000FFu;
+				x = (x|(x<< 8)) & 0x0300F00Fu;
+				x = (x|(x<< 4)) & 0x030C30C3u;
+				x = (x|(x<< 2)) & 0x09249249u;
+				return x;
+			};
+
+			//(Code, primitive) pairs
+			std::vector<uint64_t> keys(prims.size());
+			parallel_for( 0,prims.size(), [&](size_t begin,size_t end) -> void {
+				for (size_t i=begin;i<end;++i) {
+					glm::vec3 q = (prims[i].centroid-centroid_aabb.low) * scale;
+					uint32_t code =
+						(spread_bits(static_cast<uint32_t>(q.x))<<2) |
+						(spread_bits(static_cast<uint32_t>(q.y))<<1) |
+						 spread_bits(static_cast<uint32_t>(q.z))
+					;
+					keys[i] = (static_cast<uint64_t>(code)<<32) | static_cast<uint64_t>(i);
+				}
+			});
+
+			//Least-significant-digit radix sort on the 30-bit codes, in three passes of ten bits.
+			{
+				std::vector<uint64_t> tmp(keys.size());
+				for (unsigned shift=32u;shift<62u;shift+=10u) {
+					size_t offsets[1024] = {};
+					for (uint64_t key : keys) ++offsets[(key>>shift)&1023u];
+					size_t sum = 0;
+					for (size_t& offset : offsets) { size_t n=offset; offset=sum; sum+=n; }
+					for (uint64_t key : keys) tmp[offsets[(key>>shift)&1023u]++]=key;
+					keys.swap(tmp);
+				}
+			}
+
+			std::vector<_BuildPrim> sorted(prims.size());
+			std::vector<uint32_t> codes(prims.size());
+			parallel_for( 0,prims.size(), [&](size_t begin,size_t end) -> void {
+				for (size_t i=begin;i<end;++i) {
+					sorted[i] = prims[ static_cast<size_t>(keys[i]&0xFFFFFFFFull) ];
+					codes [i] = static_cast<uint32_t>(keys[i]>>32);
+				}
+			});
+			prims.swap(sorted);
+			return codes;
+		}
+};
+
+
+
+//Prints a size in bytes in human-readable units.
+static void _print_bytes(size_t bytes) {
+	double value = static_cast<double>(bytes);
+	if      (bytes<(1_zu<<10)) printf("%7.0f B  ",value                );
+	else if (bytes<(1_zu<<20)) printf("%7.1f KiB",value/1024.0         );
+	else if (bytes<(1_zu<<30)) printf("%7.1f MiB",value/1048576.0      );
+	else                       printf("%7.2f GiB",value/1073741824.0   );
+}
+
+void BVH::_build(std::vector<PrimBase*> const& prims, BUILD build) {
+	typedef std::chrono::steady_clock Clock;
+	auto get_ms = [](Clock::time_point t0, Clock::time_point t1) -> double {
+		return static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count() ) * 1.0e-6;
+	};
+
+	//Phase 1: compute per-primitive bounds
+	Clock::time_point time_start = Clock::now();
+	_Builder builder(prims);
+	size_t bytes_bounds = builder.prims.size() * sizeof(_BuildPrim);
+	Clock::time_point time_bounds = Clock::now();
+
+	//Phase 2: build hierarchy
+	_BuildNode* root;
+	size_t bytes_build;
+	{
+		_Builder::Allocator alloc(&builder);
+		if (build==BUILD::SAH) {
+			root = builder.build_sah( alloc, 0,builder.prims.size(), 0u );
+			bytes_build = builder.get_nodes_bytes();
+		} else {
+			std::vector<uint32_t> codes = builder.sort_morton();
+			root = builder.build_lbvh( alloc, codes, 0,builder.prims.size(), 29, 0u );
+			bytes_build = builder.get_nodes_bytes() + codes.size()*(sizeof(uint32_t)+2*sizeof(uint64_t));
+		}
+	}
+	Clock::time_point time_build = Clock::now();
+
+	//Phase 3: flatten into depth-first order
+	_nodes_owned.reserve(builder.get_num_nodes());
+	std::function<void(_BuildNode const*)> flatten = [&](_BuildNode const* bnode) -> void {
+		size_t index = _nodes_owned.size();
+		_nodes_owned.emplace_back();
+		Node& node = _nodes_owned.back();
+		node.aabb = bnode->aabb;
+		node.num_prims = static_cast<uint16_t>(bnode->num_prims);
+		node.axis = bnode->axis;
+		node._pad = 0;
+		if (bnode->num_prims>0) {
+			assert(bnode->num_prims<=std::numeric_limits<uint16_t>::max());
+			node.prims_offset = bnode->prims_offset;
+		} else {
+			flatten(bnode->children[0]);
+			uint32_t child1_index = static_cast<uint32_t>(_nodes_owned.size());
+			_nodes_owned[index].child1_index = child1_index; //Note `node` may have been invalidated
+			flatten(bnode->children[1]);
+		}
+	};
+	flatten(root);
+	_prim_indices_owned.resize(builder.prims.size());
+	for (size_t i=0;i<_prim_indices_owned.size();++i) _prim_indices_owned[i]=builder.prims[i].index;
+	size_t bytes_flat = _nodes_owned.size()*sizeof(Node) + _prim_indices_owned.size()*sizeof(uint32_t);
+	Clock::time_point time_flatten = Clock::now();
+
+	//Report
+	printf(
+		"BVH build (%s, %zu thread(s)): %zu primitive(s), %zu node(s)\n",
+		build==BUILD::SAH?"binned SAH":"LBVH", builder.num_threads,
+		prims.size(), _nodes_owned.size()
+	);
+	printf("  Bounds : %10.3f ms  ",get_ms(time_start, time_bounds )); _print_bytes(bytes_bounds); printf("\n");
+	printf("  Build  : %10.3f ms  ",get_ms(time_bounds,time_build  )); _print_bytes(bytes_build ); printf("\n");
+	printf("  Flatten: %10.3f ms  ",get_ms(time_build, time_flatten)); _print_bytes(bytes_flat  ); printf("\n");
+	printf("  Total  : %10.3f ms  ",get_ms(time_start, time_flatten)); _print_bytes(bytes_flat  ); printf(" resident\n");
+}
+
+/*
+Cache file layout.  All values are in native byte order; files from another platform are rejected
+by the check on `.byte_order` (and `.node_size`).  The sections are packed, and the file ends after
+the last one.
+
+	_CacheHeader
+	`BVH::Node` × `.num_nodes`         (at `.offset_nodes`, directly after the header)
+	`uint32_t`  × `.num_prims`         (at `.offset_prim_indices`, directly after the nodes)
+
+The nodes must form a single tree in depth-first order, as `BVH::Node` describes, no deeper than
+the traversal stack allows, and every index in it must be in range.  Since the file is used in
+place, all of this is checked on loading (see `_is_valid_hierarchy(...)`).
+*/
+class _CacheHeader final {
+	public:
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t node_size;
+		uint32_t _pad;
+		uint64_t key;
+		uint64_t num_prims;
+		uint64_t num_nodes;
+		uint64_t offset_nodes;
+		uint64_t offset_prim_indices;
+};
+static_assert(sizeof(_CacheHeader)==64,"Implementation error!");
+static char const _cache_magic[8] = { 'S','S','-','B','V','H','\0','\0' };
+
+//Whether `nodes` is a well-formed hierarchy over `num_prims` primitives, which traversal can walk
+//	without reading out of bounds or overflowing its stack.
+static bool _is_valid_hierarchy(
+	BVH::Node const* nodes, size_t num_nodes, uint32_t const* prim_indices, size_t num_prims
+) {
+	if (num_nodes==0) return false;
+
+	//Depth of each node, set when its parent is visited.  Parents precede their children, so each
+	//	node must have exactly one by the time it is reached.
+	uint32_t const unset = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> depths( num_nodes, unset );
+	depths[0] = 0u;
+	for (size_t i=0;i<num_nodes;++i) {
+		BVH::Node const& node = nodes[i];
+		uint32_t depth = depths[i];
+		if (depth==unset) return false;
+
+		if (node.num_prims>0) {
+			if (static_cast<size_t>(node.prims_offset)+node.num_prims > num_prims) return false;
+		} else {
+			size_t child0 = i + 1;
+			size_t child1 = node.child1_index;
+			if (child1<=child0 || child1>=num_nodes) return false;
+			if (depths[child0]!=unset || depths[child1]!=unset) return false;
+			if (node.axis>=3u || depth+1u>=BVH_STACK_SIZE) return false;
+			depths[child0] = depth + 1u;
+			depths[child1] = depth + 1u;
+		}
+	}
+
+	for (size_t i=0;i<num_prims;++i) {
+		if (prim_indices[i]>=num_prims) return false;
+	}
+
+	return true;
+}
+
+bool BVH::_load_cache(std::string const& path, uint64_t key, size_t num_prims) {
+	MappedFile* file = new MappedFile( path, MappedFile::MODE::READ );
+	if (!file->is_valid()) { delete file; return false; }
+
+	//Validate the header, then that the file holds exactly the sections it describes (the node
+	//	count is bounded by the file's size first, so that the sizes computed from it can't
+	//	overflow), then the hierarchy itself.
+	bool valid = false;
+	_CacheHeader const* header = static_cast<_CacheHeader const*>(file->get_data());
+	size_t size = file->get_size();
+	if (size>=sizeof(_CacheHeader)) {
+		valid =
+			std::memcmp(header->magic,_cache_magic,8)==0 &&
+			header->version    == BVH_CACHE_VERSION &&
+			header->byte_order == 0x01020304u &&
+			header->node_size  == sizeof(Node) &&
+			header->key        == key &&
+			header->num_prims  == num_prims &&
+			header->num_nodes  <= (size-sizeof(_CacheHeader))/sizeof(Node) &&
+			header->offset_nodes        == sizeof(_CacheHeader) &&
+			header->offset_prim_indices == header->offset_nodes + header->num_nodes*sizeof(Node) &&
+			header->offset_prim_indices + num_prims*sizeof(uint32_t) == size
+		;
+	}
+	if (valid) {
+		uint8_t const* data = static_cast<uint8_t const*>(file->get_data());
+		valid = _is_valid_hierarchy(
+			reinterpret_cast<Node     const*>( data + header->offset_nodes        ), static_cast<size_t>(header->num_nodes),
+			reinterpret_cast<uint32_t const*>( data + header->offset_prim_indices ), num_prims
+		);
+	}
+	if (!valid) {
+		fprintf(stderr,"Warning: ignoring stale or invalid BVH cache file \"%s\"!\n",path.c_str());
+		delete file;
+		return false;
+	}
+
+	//Use the data in-place
+	uint8_t const* data = static_cast<uint8_t const*>(file->get_data());
+	_nodes        = reinterpret_cast<Node     const*>( data + header->offset_nodes        );
+	_num_nodes    = static_cast<size_t>(header->num_nodes);
+	_prim_indices = reinterpret_cast<uint32_t const*>( data + header->offset_prim_indices );
+	_cache = file;
+	return true;
+}
+void BVH::_save_cache(std::string const& path, uint64_t key, size_t num_prims) const {
+	_CacheHeader header;
+	std::memcpy(header.magic,_cache_magic,8);
+	header.version    = BVH_CACHE_VERSION;
+	header.byte_order = 0x01020304u;
+	header.node_size  = sizeof(Node);
+	header._pad       = 0u;
+	header.key        = key;
+	header.num_prims  = num_prims;
+	header.num_nodes  = _nodes_owned.size();
+	header.offset_nodes        = sizeof(_CacheHeader);
+	header.offset_prim_indices = header.offset_nodes + header.num_nodes*sizeof(Node);
+
+	//Write to a temporary file and then move it into place, so that concurrent jobs sharing the
+	//	cache never see a partially-written file.
+	std::string path_tmp = path + "." + std::to_string(std::random_device()()) + ".tmp";
+	FILE* file = fopen(path_tmp.c_str(),"wb");
+	if (file==nullptr) {
+		fprintf(stderr,"Warning: could not write BVH cache file \"%s\"!\n",path.c_str());
+		return;
+	}
+	bool ok =
+		fwrite( &header,                    sizeof(_CacheHeader),1,                          file )==1                          &&
+		fwrite( _nodes_owned       .data(), sizeof(Node        ),_nodes_owned       .size(), file )==_nodes_owned       .size() &&
+		fwrite( _prim_indices_owned.data(), sizeof(uint32_t    ),_prim_indices_owned.size(), file )==_prim_indices_owned.size()
+	;
+	ok = fclose(file)==0 && ok;
+	if (ok) {
+		#ifdef _WIN32
+		std::remove(path.c_str()); //Windows cannot rename over an existing file
+		#endif
+		ok = std::rename(path_tmp.c_str(),path.c_str())==0;
+	}
+	if (ok) {
+		printf("BVH written to cache \"%s\"\n",path.c_str());
+	} else {
+		std::remove(path_tmp.c_str());
+		fprintf(stderr,"Warning: could not write BVH cache file \"%s\"!\n",path.c_str());
+	}
+}
+
+BVH::BVH(std::vector<PrimBase*> const& prims, BuildOptions const& options) :
+	_prims(prims.data()),
+	_nodes(nullptr), _num_nodes(0), _prim_indices(nullptr),
+	_cache(nullptr)
+{
+	if (prims.size()>=static_cast<size_t>(std::numeric_limits<uint32_t>::max())) {
+		fprintf(stderr,"Too many primitives for BVH!\n");
+		throw -1;
+	}
+	if (prims.empty()) return;
+
+	std::string cache_path;
+	uint64_t key = 0;
+	if (!options.cache_dir.empty()) {
+		std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+
+		//The hierarchy depends only on the primitives' bounds (and order), so those are the key.
+		//	Hash them with 64-bit FNV-1a, so that the key is the same on every platform.
+		uint64_t hash = 14695981039346656037ull;
+		auto add_bytes = [&](void const* bytes, size_t count) -> void {
+			for (size_t i=0;i<count;++i) {
+				hash ^= static_cast<uint64_t>(static_cast<uint8_t const*>(bytes)[i]);
+				hash *= 1099511628211ull;
+			}
+		};
+		uint32_t header[3] = {
+			BVH_CACHE_VERSION, static_cast<uint32_t>(options.build), static_cast<uint32_t>(prims.size())
+		};
+		add_bytes( header, sizeof(header) );
+		for (PrimBase const* prim : prims) {
+			AABB aabb = prim->get_aabb();
+			float values[6] = { aabb.low.x,aabb.low.y,aabb.low.z, aabb.high.x,aabb.high.y,aabb.high.z };
+			add_bytes( values, sizeof(values) );
+		}
+		key = hash;
+
+		char name[64];
+		snprintf( name,sizeof(name), "bvh-%016llx.bin", static_cast<unsigned long long>(key) );
+		cache_path = options.cache_dir;
+		if (!Str::endswith(cache_path,"/")&&!Str::endswith(cache_path,"\\")) cache_path+="/";
+		cache_path += name;
+
+		if (_load_cache(cache_path,key,prims.size())) {
+			double ms = static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - time_start
+			).count() ) * 1.0e-6;
+			printf(
+				"BVH loaded from cache \"%s\": %zu primitive(s), %zu node(s) in %.3f ms\n",
+				cache_path.c_str(), prims.size(), _num_nodes, ms
+			);
+			return;
+		}
+	}
+
+	_build(prims,options.build);
+	_nodes        = _nodes_owned       .data();
+	_num_nodes    = _nodes_owned       .size();
+	_prim_indices = _prim_indices_owned.data();
+
+	if (!cache_path.empty()) _save_cache(cache_path,key,prims.size());
+}
+BVH::~BVH() {
+	delete _cache;
+}
+
+bool BVH::intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore,PrimInstance const* ignore_instance) const {
+	if (_num_nodes==0) return false;
+
+	Dir dir_inv = Dir(1.0f) / ray.dir;
+	bool dir_neg[3] = { dir_inv.x<0.0f, dir_inv.y<0.0f, dir_inv.z<0.0f };
+
+	//Slab test.  The far distance is enlarged slightly so that roundoff can't produce false misses.
+	auto hits_aabb = [&](AABB const& aabb) -> bool {
+		Dir t0 = (aabb.low -ray.orig) * dir_inv;
+		Dir t1 = (aabb.high-ray.orig) * dir_inv;
+		Dir t_near = glm::min(t0,t1);
+		Dir t_far  = glm::max(t0,t1);
+		float t_min = std::max({ t_near.x, t_near.y, t_near.z, 0.0f          });
+		float t_max = std::min({ t_far .x, t_far .y, t_far .z, hitrec->dist  }) * 1.00001f;
+		return t_min<=t_max;
+	};
+
+	bool hit = false;
+	uint32_t stack[BVH_STACK_SIZE];
+	size_t stack_size = 0;
+	uint32_t current = 0;
+	while (true) {
+		Node const& node = _nodes[current];
+		STATS_COUNT(TESTS_NODE);
+		if (hits_aabb(node.aabb)) {
+			if (node.num_prims>0) {
+				for (uint32_t k=0;k<node.num_prims;++k) {
+					PrimBase const* prim = _prims[ _prim_indices[node.prims_offset+k] ];
+					if (prim->type==PrimBase::TYPE::INSTANCE) {
+						PrimInstance const* instance = static_cast<PrimInstance const*>(prim);
+						hit |= instance->intersect( ray,hitrec, instance==ignore_instance?ignore:nullptr );
+					} else if ( prim!=ignore || ignore_instance!=nullptr ) {
+						STATS_COUNT(TESTS_PRIM);
+						hit |= prim->intersect(ray,hitrec);
+					}
+				}
+			} else {
+				//Visit the nearer child first
+				assert(stack_size<BVH_STACK_SIZE);
+				if (dir_neg[node.axis]) { stack[stack_size++]=current+1u;         current=node.child1_index; }
+				else                    { stack[stack_size++]=node.child1_index; current=current+1u;         }
+				continue;
+			}
+		}
+		if (stack_size==0) break;
+		current = stack[--stack_size];
+	}
+
+	return hit;
+}
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+
+
+class MappedFile;
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+class PrimBase;
+class PrimInstance;
+
+//Bounding volume hierarchy over a list of primitives, used to accelerate ray intersection.
+class BVH final {
+	public:
+		//Algorithm used to build the hierarchy.
+		enum class BUILD {
+			//Top-down build minimizing the surface area heuristic (SAH), with the candidate splits
+			//	evaluated at the boundaries of a fixed number of bins.  Builds a high-quality tree.
+			SAH,
+			//Linear BVH: primitives are sorted along a Morton (Z-order) curve and the hierarchy is
+			//	emitted from the bits of their codes.  Builds much faster, but the tree is worse.
+			//	Intended for previews.
+			LBVH
+		};
+		//Options controlling how the hierarchy is produced
+		class BuildOptions final {
+			public:
+				BUILD build = BUILD::SAH;
+				//Directory in which built hierarchies are cached between runs (empty to disable).
+				//	Cache files are keyed by a hash of the primitives' bounds, which is all the
+				//	hierarchy depends on, and are mapped directly into memory when loaded.
+				std::string cache_dir;
+		};
+
+		//Node of the flattened hierarchy, stored in depth-first order.  The first child of an
+		//	interior node immediately follows it; the second child is at `.child1_index`.
+		class Node final {
+			public:
+				AABB aabb;
+				union {
+					uint32_t prims_offset; //Leaf node: offset into `._prim_indices`
+					uint32_t child1_index; //Interior node: index of second child
+				};
+				uint16_t num_prims; //Zero for interior nodes
+				uint8_t axis;       //Axis the interior node was split along
+				uint8_t _pad;
+		};
+		static_assert(sizeof(Node)==32,"Implementation error!");
+
+	private:
+		//Primitives the hierarchy was built over (not owned).
+		PrimBase*const* _prims;
+
+		//Flattened hierarchy and the indices (into `._prims`) of the primitives referenced by the
+		//	leaves.  These point either into the owned storage below or into the mapped cache file.
+		Node     const* _nodes;
+		size_t          _num_nodes;
+		uint32_t const* _prim_indices;
+		std::vector<Node>     _nodes_owned;
+		std::vector<uint32_t> _prim_indices_owned;
+		MappedFile* _cache;
+
+		class _BuildPrim;
+		class _BuildNode;
+		class _Builder;
+
+	private:
+		//Build the hierarchy into the owned storage.  Time and memory taken by each phase of the
+		//	build are printed.
+		void _build(std::vector<PrimBase*> const& prims, BUILD build);
+
+		//Map the hierarchy from the cache file at `path`, if it exists, matches `key`, and holds a
+		//	well-formed hierarchy (otherwise, the caller builds it anew).
+		bool _load_cache(std::string const& path, uint64_t key, size_t num_prims);
+		//Write the (owned) hierarchy to the cache file at `path`.
+		void _save_cache(std::string const& path, uint64_t key, size_t num_prims) const;
+
+	public:
+		//Build (or load from the cache) the hierarchy over the primitives `prims`, which must
+		//	outlive it.
+		BVH(std::vector<PrimBase*> const& prims, BuildOptions const& options);
+		BVH(BVH const&) = delete;
+		~BVH();
+
+		AABB get_aabb() const { return _num_nodes==0 ? AABB::get_empty() : _nodes[0].aabb; }
+
+		//Intersect ray `ray` with the primitives in the hierarchy.  Returns whether anything closer
+		//	than `hitrec->dist` was hit, updating `hitrec` if so.  Hits on `ignore` are skipped; if
+		//	`ignore_instance` is not `nullptr`, `ignore` is instead a primitive of its mesh.
+		bool intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore,PrimInstance const* ignore_instance) const;
+};
+
+
+
+RENDER_VARIANT_END
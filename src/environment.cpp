@@ -0,0 +1,226 @@
+#include "environment.hpp"
+
+#include "util/color.hpp"
+#include "util/string.hpp"
+
+#include "stats.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Loads an HDR image from a Radiance ".hdr" (RGBE) or ".pfm" file, returning ℓRGB texels in
+//	scanlines from top to bottom.
+static std::vector<lRGB_F32> _load_hdr_image(std::string const& path, size_t res[2]) {
+	FILE* file = fopen(path.c_str(),"rb");
+	if (file!=nullptr); else {
+		fprintf(stderr,"Could not open environment map \"%s\"!\n",path.c_str());
+		throw -1;
+	}
+	auto fail = [&]() -> void {
+		fclose(file);
+		fprintf(stderr,"Invalid or unsupported environment map \"%s\"!\n",path.c_str());
+		throw -1;
+	};
+	//Read a line, without the trailing newline.
+	auto read_line = [&]() -> std::string {
+		std::string line;
+		int c;
+		while ( (c=fgetc(file))!=EOF && c!='\n' ) line+=static_cast<char>(c);
+		return line;
+	};
+
+	std::vector<lRGB_F32> result;
+	if        (Str::endswith(path,".hdr")) {
+		//	Header
+		std::string line = read_line();
+		if (line!="#?RADIANCE"&&line!="#?RGBE") fail();
+		while (!(line=read_line()).empty()) {
+			if (Str::startswith(line,"FORMAT=")&&line!="FORMAT=32-bit_rle_rgbe") fail();
+		}
+		//	Resolution (only the standard orientation is supported)
+		char size_y[3], size_x[3];
+		unsigned long w, h;
+		if (fscanf(file,"%2s %lu %2s %lu",size_y,&h,size_x,&w)!=4) fail();
+		if (std::strcmp(size_y,"-Y")!=0||std::strcmp(size_x,"+X")!=0||w==0||h==0) fail();
+		if (fgetc(file)!='\n') fail();
+		res[0]=w; res[1]=h;
+
+		//	Scanlines, each either flat or new-style run-length encoded by component
+		result.resize(res[1]*res[0]);
+		std::vector<uint8_t> scanline(4*res[0]);
+		for (size_t j=0;j<res[1];++j) {
+			uint8_t start[4];
+			if (fread(start,1,4,file)!=4) fail();
+			bool rle = res[0]>=8 && res[0]<32768 && start[0]==2 && start[1]==2 && (start[2]&0x80)==0;
+			if (rle) {
+				if ( ((static_cast<size_t>(start[2])<<8)|start[3]) != res[0] ) fail();
+				for (size_t k=0;k<4;++k) {
+					size_t i = 0;
+					while (i<res[0]) {
+						int count = fgetc(file);
+						if (count==EOF) fail();
+						if (count>128) {
+							count -= 128;
+							int value = fgetc(file);
+							if (value==EOF||i+static_cast<size_t>(count)>res[0]) fail();
+							for (int n=0;n<count;++n) scanline[4*(i++)+k]=static_cast<uint8_t>(value);
+						} else {
+							if (count==0||i+static_cast<size_t>(count)>res[0]) fail();
+							for (int n=0;n<count;++n) {
+								int value = fgetc(file);
+								if (value==EOF) fail();
+								scanline[4*(i++)+k] = static_cast<uint8_t>(value);
+							}
+						}
+					}
+				}
+			} else {
+				std::memcpy(scanline.data(),start,4);
+				if (fread(scanline.data()+4,1,4*res[0]-4,file)!=4*res[0]-4) fail();
+			}
+
+			for (size_t i=0;i<res[0];++i) {
+				uint8_t const* rgbe = scanline.data() + 4*i;
+				if (rgbe[3]==0) {
+					result[j*res[0]+i] = lRGB_F32(0.0f);
+				} else {
+					float sc = std::ldexp( 1.0f, static_cast<int>(rgbe[3])-(128+8) );
+					result[j*res[0]+i] = lRGB_F32(rgbe[0],rgbe[1],rgbe[2]) * sc;
+				}
+			}
+		}
+	} else if (Str::endswith(path,".pfm")) {
+		//	Header
+		char type[3];
+		unsigned long w, h;
+		double sc;
+		if (fscanf(file,"%2s %lu %lu %lf",type,&w,&h,&sc)!=4) fail();
+		if (std::strcmp(type,"PF")!=0||w==0||h==0||sc>=0.0) fail(); //Only little-endian RGB
+		fgetc(file);
+		res[0]=w; res[1]=h;
+
+		//	Data, stored from bottom to top
+		result.resize(res[1]*res[0]);
+		for (size_t j=0;j<res[1];++j) {
+			if (fread( result.data()+(res[1]-1-j)*res[0], sizeof(lRGB_F32),res[0], file )!=res[0]) fail();
+		}
+	} else {
+		fail();
+	}
+
+	fclose(file);
+	return result;
+}
+
+
+
+#ifdef RENDER_MODE_SPECTRAL
+EnvironmentLight::EnvironmentLight(SpectralRadiance const& radiance) :
+#else
+EnvironmentLight::EnvironmentLight(RGB_Radiance     const& radiance) :
+#endif
+	mode(MODE::CONSTANT), _constant(radiance), _res{0,0}
+{}
+EnvironmentLight::EnvironmentLight(std::string const& path, float scale/*=1.0f*/) :
+	mode(MODE::IMAGE), _constant(0.0f)
+{
+	_data = _load_hdr_image(path,_res);
+	for (lRGB_F32& lrgb : _data) lrgb=glm::max( lrgb*scale, lRGB_F32(0.0f) );
+
+	//Build the sampling distribution
+	_cdf_rows.resize( _res[1]+1 );
+	_cdf_cols.resize( _res[1]*(_res[0]+1) );
+	_pdf_texels.resize( _res[1]*_res[0] );
+	_cdf_rows[0] = 0.0f;
+	for (size_t j=0;j<_res[1];++j) {
+		float sin_theta = std::sin( Constants::pi<float>*(static_cast<float>(j)+0.5f)/static_cast<float>(_res[1]) );
+		float* cdf = _cdf_cols.data() + j*(_res[0]+1);
+		cdf[0] = 0.0f;
+		for (size_t i=0;i<_res[0];++i) {
+			lRGB_F32 const& lrgb = _data[j*_res[0]+i];
+			float weight = ( 0.2126f*lrgb.r + 0.7152f*lrgb.g + 0.0722f*lrgb.b ) * sin_theta;
+			_pdf_texels[j*_res[0]+i] = weight;
+			cdf[i+1] = cdf[i] + weight;
+		}
+		_cdf_rows[j+1] = _cdf_rows[j] + cdf[_res[0]];
+
+		//Normalize the row
+		if (cdf[_res[0]]>0.0f) for (size_t i=1;i<=_res[0];++i) cdf[i]/=cdf[_res[0]];
+	}
+	float total = _cdf_rows[_res[1]];
+	if (total>0.0f); else {
+		fprintf(stderr,"Environment map \"%s\" is black!\n",path.c_str());
+		throw -1;
+	}
+	for (float& value : _cdf_rows  ) value/=total;
+	float texels = static_cast<float>(_res[1]*_res[0]);
+	for (float& value : _pdf_texels) value*=texels/total;
+}
+
+size_t EnvironmentLight::_get_texel(Dir const& dir) const {
+	float theta = std::acos(glm::clamp( dir.y, -1.0f,1.0f ));
+	float phi   = std::atan2( dir.x, -dir.z );
+	float s = 0.5f + phi*(0.5f/Constants::pi<float>);
+	float t = theta*(1.0f/Constants::pi<float>);
+	size_t i = std::min( static_cast<size_t>(std::max( s*static_cast<float>(_res[0]), 0.0f )), _res[0]-1 );
+	size_t j = std::min( static_cast<size_t>(std::max( t*static_cast<float>(_res[1]), 0.0f )), _res[1]-1 );
+	return j*_res[0] + i;
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+SpectralRadiance::HeroSample EnvironmentLight::evaluate(Dir const& dir, nm lambda_0) const
+#else
+RGB_Radiance                 EnvironmentLight::evaluate(Dir const& dir             ) const
+#endif
+{
+	#ifdef RENDER_MODE_SPECTRAL
+		if (mode==MODE::CONSTANT) return _constant[lambda_0];
+
+		lRGB_F32 const& lrgb = _data[_get_texel(dir)];
+		float sc = std::max({ lrgb.r, lrgb.g, lrgb.b });
+		if (sc>0.0f); else return SpectralRadiance::HeroSample(0.0f);
+		STATS_PHASE(SPECTRAL_CONVERSION);
+		return Color::lrgb_to_specrefl(lrgb/sc,lambda_0) * Color::data->D65_rad[lambda_0] * sc;
+	#else
+		if (mode==MODE::CONSTANT) return _constant;
+
+		return _data[_get_texel(dir)];
+	#endif
+}
+
+void EnvironmentLight::get_rand_toward(Math::RNG& rng, Dir* dir,float* pdf) const {
+	if (mode==MODE::CONSTANT) {
+		*dir = Math::rand_sphere(rng,pdf);
+		return;
+	}
+
+	//Choose a row, and then a column within it, by inverting the CDFs.
+	auto sample_cdf = [](float const* cdf,size_t count, float u, float* offset) -> size_t {
+		size_t k = static_cast<size_t>( std::upper_bound(cdf,cdf+count+1,u) - cdf );
+		k = glm::clamp( k, 1_zu,count ) - 1;
+		float width = cdf[k+1] - cdf[k];
+		*offset = width>0.0f ? glm::clamp( (u-cdf[k])/width, 0.0f,1.0f ) : 0.5f;
+		return k;
+	};
+	float offset_s, offset_t;
+	size_t j = sample_cdf( _cdf_rows.data(),                  _res[1], rand_1f(rng), &offset_t );
+	size_t i = sample_cdf( _cdf_cols.data()+j*(_res[0]+1),    _res[0], rand_1f(rng), &offset_s );
+
+	//Convert to a direction
+	float s = (static_cast<float>(i)+offset_s) / static_cast<float>(_res[0]);
+	float t = (static_cast<float>(j)+offset_t) / static_cast<float>(_res[1]);
+	float theta = t * Constants::pi<float>;
+	float phi   = (s-0.5f) * (2.0f*Constants::pi<float>);
+	float sin_theta = std::sin(theta);
+	*dir = Dir( sin_theta*std::sin(phi), std::cos(theta), -sin_theta*std::cos(phi) );
+
+	//The density over the image, converted to solid angle: dω = 2π² sin(θ) ds dt
+	*pdf = sin_theta>0.0f ? _pdf_texels[j*_res[0]+i]/(2.0f*Constants::pi<float>*Constants::pi<float>*sin_theta) : 0.0f;
+}
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/random.hpp"
+
+#include "spectrum.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Light at infinity surrounding the scene, giving the radiance arriving along rays that escape it.
+//	The radiance is either constant or given by an HDR latitude-longitude image.  The image's ℓRGB
+//	texels are upsampled to spectra the same way as `sRGB_ReflectanceTexture`'s: divided by their
+//	largest component to give a valid reflectance, and that reflectance illuminated by D65 and
+//	scaled back up.
+//	The image's +y direction is up (the top scanline), and its center column faces -z.
+class EnvironmentLight final {
+	public:
+		enum class MODE { CONSTANT, IMAGE } const mode;
+
+	private:
+		//Constant radiance (`MODE::CONSTANT` only)
+		#ifdef RENDER_MODE_SPECTRAL
+			SpectralRadiance _constant;
+		#else
+			RGB_Radiance     _constant;
+		#endif
+
+		//Image resolution and texels, stored in scanlines from top to bottom (`MODE::IMAGE` only)
+		size_t _res[2];
+		std::vector<lRGB_F32> _data;
+
+		//Piecewise-constant 2D distribution over the image, for importance sampling.  Texels are
+		//	weighted by their luminance times the sine of their latitude (which accounts for the
+		//	compression of the map toward the poles).  Sampling chooses a row from the marginal
+		//	CDF `._cdf_rows` (`._res[1]+1` entries), and then a column from that row's conditional
+		//	CDF in `._cdf_cols` (`._res[1]` rows of `._res[0]+1` entries).  The CDFs are normalized.
+		std::vector<float> _cdf_rows;
+		std::vector<float> _cdf_cols;
+		//Density of choosing each texel, relative to uniform over the image
+		std::vector<float> _pdf_texels;
+
+	public:
+		//Environment of constant radiance `radiance`.
+		#ifdef RENDER_MODE_SPECTRAL
+		explicit EnvironmentLight(SpectralRadiance const& radiance);
+		#else
+		explicit EnvironmentLight(RGB_Radiance     const& radiance);
+		#endif
+		//Environment given by the HDR latitude-longitude image at `path` (Radiance ".hdr" or
+		//	".pfm"), with values multiplied by `scale`.
+		explicit EnvironmentLight(std::string const& path, float scale=1.0f);
+		EnvironmentLight(EnvironmentLight const&) = delete;
+		~EnvironmentLight() = default;
+
+	private:
+		//Index of the texel in direction `dir`.
+		size_t _get_texel(Dir const& dir) const;
+
+	public:
+	#ifdef RENDER_MODE_SPECTRAL
+		//Return hero wavelength sample of the radiance arriving from direction `dir` (pointing away
+		//	from the scene) for the hero wavelength `lambda_0`.
+		SpectralRadiance::HeroSample evaluate(Dir const& dir, nm lambda_0) const;
+	#else
+		//Return the radiance arriving from direction `dir` (pointing away from the scene).
+		RGB_Radiance                 evaluate(Dir const& dir             ) const;
+	#endif
+
+		//Get a random direction `dir` toward the environment.  The probability density of choosing
+		//	this direction is returned in `pdf`.
+		void get_rand_toward(Math::RNG& rng, Dir* dir,float* pdf) const;
+};
+
+
+
+RENDER_VARIANT_END
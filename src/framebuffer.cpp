@@ -1,187 +1,590 @@
-#include "framebuffer.hpp"
-
-#include "util/lodepng/lodepng.h"
-#include "util/color.hpp"
-#include "util/string.hpp"
-
-
-
-Framebuffer::Framebuffer(size_t const res[2]) :
-	res{res[0],res[1]}
-{
-	//Create pixel buffer
-	_pixels = new sRGB_A_F32[res[1]*res[0]];
-
-	//Fill it with a checkerboard pattern
-	for (size_t j=0;j<res[1];++j) {
-		for (size_t i=0;i<res[0];++i) {
-			#ifdef WITH_TRANSPARENT_FRAMEBUFFER
-				if (((i/TILE_SIZE)^(j/TILE_SIZE))%2==0) {
-					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(1.0f), 0.5f );
-				} else {
-					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.0f), 0.5f );
-				}
-			#else
-				if (((i/TILE_SIZE)^(j/TILE_SIZE))%2==0) {
-					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.7f), 1.0f );
-				} else {
-					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.3f), 1.0f );
-				}
-			#endif
-		}
-	}
-}
-Framebuffer::~Framebuffer() {
-	//Clean up pixel buffer
-	delete[] _pixels;
-}
-
-void Framebuffer::save(std::string const& path) const {
-	if        (Str::endswith(path,".csv")) {
-		//Save floating-point image in CSV file
-
-		//	Open file
-		FILE* file = fopen(path.c_str(),"wb");
-		assert(file!=nullptr);
-
-		for (size_t j=0;j<res[1];++j) {
-			for (size_t i=0;;++i) {
-				sRGB_A_F32 const& srgba = _pixels[ j*res[0] + i ];
-				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(srgba));
-
-				fprintf(file, "%g,%g,%g",
-					static_cast<double>(lrgb.r),
-					static_cast<double>(lrgb.g),
-					static_cast<double>(lrgb.b)
-				);
-				if (i<res[0]-1) fputc(',',file);
-				else          { fputc('\n',file); break; }
-			}
-		}
-
-		//	Done
-		fclose(file);
-	} else if (Str::endswith(path,".hdr")) {
-		//Save HDR RADIANCE image
-
-		//	Open file
-		FILE* file = fopen(path.c_str(),"wb");
-		assert(file!=nullptr);
-
-		//	Write header
-		fprintf(file,
-			"#?RADIANCE\n"
-			"FORMAT=32-bit_rle_rgbe\n"
-			"EXPOSURE=1.0\n"
-			"SOFTWARE=simple-spectral\n"
-			"\n"
-			"-Y %zu +X %zu\n",
-			res[1], res[0]
-		);
-
-		//	Write data
-		for (size_t j=0;j<res[1];++j) {
-			for (size_t i=0;i<res[0];++i) {
-				sRGB_A_F32 const& srgba = _pixels[ (res[1]-1-j)*res[0] + i ];
-				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(srgba));
-
-				float v = std::max(lrgb.r,std::max(lrgb.g,lrgb.b));
-
-				if (v < 1.0e-32f) {
-					uint32_t zero = 0u;
-					fwrite( &zero, sizeof(uint32_t),1u, file );
-				} else {
-					int e;
-					v = std::frexp(v,&e) * 256.0f/v;
-					e += 128;
-
-					glm::vec3 rgb = glm::round(lrgb*v);
-					uint8_t data[4] = {
-						static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[0])), 0,255 )),
-						static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[1])), 0,255 )),
-						static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[2])), 0,255 )),
-						static_cast<uint8_t>(                                        e                )
-					};
-					fwrite( data, sizeof(uint8_t),4, file );
-				}
-			}
-		}
-
-		//	Done
-		fclose(file);
-	} else if (Str::endswith(path,".pfm")) {
-		//Save PFM image
-
-		//	Open file
-		FILE* file = fopen(path.c_str(),"wb");
-		assert(file!=nullptr);
-
-		//	Write header
-		fprintf(file,
-			"PF\n"
-			"%zu %zu\n"
-			"-1.0\n",
-			res[0], res[1]
-		);
-
-		//	Write data
-		for (size_t j=0;j<res[1];++j) {
-			for (size_t i=0;i<res[0];++i) {
-				//		It's unclear, but the data is supposed to be stored in bottom-to-top order
-				//			in the file, unlike NetPBM.  Note that some reference data gets this
-				//			wrong!
-				sRGB_A_F32 const& srgba = _pixels[ (res[1]-1-j)*res[0] + i ];
-				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(srgba));
-				fwrite( &lrgb, sizeof(float),3, file );
-			}
-		}
-
-		//	Done
-		fclose(file);
-	} else {
-		//Save PNG image
-
-		//	Construct temporary buffer
-		sRGB_A_U8* pixels = new sRGB_A_U8[res[1]*res[0]];
-
-		//	Fill it with pixels byte-quantized from the internal storage.  While we are doing that,
-		//		note we also flip the order of the scanlines so that they are from top to bottom,
-		//		since this is the order the PNG saver expects.
-		for (size_t j=0;j<res[1];++j) {
-			for (size_t i=0;i<res[0];++i) {
-				//Source and destination pixel; note vertical flip
-				sRGB_A_U8&        dst   = pixels [(res[1]-1-j)*res[0]+i];
-				sRGB_A_F32 const& srgba = _pixels[          j *res[0]+i];
-
-				//Convert to bytes
-				sRGB_A_F32 srgba_clipped = glm::clamp( 255.0f*srgba, sRGB_A_F32(0),sRGB_A_F32(255) );
-				dst.r = static_cast<uint8_t>(std::round(srgba_clipped.r));
-				dst.g = static_cast<uint8_t>(std::round(srgba_clipped.g));
-				dst.b = static_cast<uint8_t>(std::round(srgba_clipped.b));
-				dst.a = static_cast<uint8_t>(std::round(srgba_clipped.a));
-			}
-		}
-
-		//	Save the image to disk
-		lodepng::encode(
-			path,
-			reinterpret_cast<uint8_t*>(pixels),
-			static_cast<unsigned>(res[0]), static_cast<unsigned>(res[1]),
-			LCT_RGBA
-		);
-
-		//	Cleanup
-		delete[] pixels;
-	}
-}
-
-#ifdef SUPPORT_WINDOWED
-void Framebuffer::draw() const {
-	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-
-	glDrawPixels(
-		static_cast<GLsizei>(res[0]), static_cast<GLsizei>(res[1]),
-		GL_RGBA, GL_FLOAT, _pixels
-	);
-}
-#endif
+#include "framebuffer.hpp"
+
+#include "util/lodepng/lodepng.h"
+#include "util/color.hpp"
+#include "util/string.hpp"
+
+#ifdef WITH_ZLIB
+	#include <zlib.h>
+#endif
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Tuning parameters for saving
+//	Scanlines are encoded in batches of about this many pixels; the scanlines of a batch are
+//		encoded in parallel, and then written in order.
+#define SAVE_BATCH_PIXELS 1048576_zu
+//	Work of fewer than this many pixels (per thread) is not split across threads
+#define SAVE_PARALLEL_MIN_PIXELS 65536_zu
+//	PNG image data is compressed in parallel in chunks of this many bytes.  (Larger chunks compress
+//		slightly better, since each starts afresh except for a dictionary.)
+#define SAVE_DEFLATE_CHUNK_BYTES 1048576_zu
+
+
+
+//Call `func(begin,end)` over disjoint subranges covering [`begin`,`end`), using multiple threads
+//	if there are at-least `min_count` items for each.
+template <typename Fn> static void _parallel_for(size_t begin,size_t end, size_t min_count, Fn const& func) {
+	size_t count = end - begin;
+	size_t num_threads = std::max( std::thread::hardware_concurrency(), 1u );
+	size_t num_chunks = std::min( num_threads, count/std::max(min_count,1_zu) );
+	if (num_chunks<=1) {
+		func(begin,end);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (size_t k=1;k<num_chunks;++k) {
+		threads.emplace_back( func, begin+count*k/num_chunks, begin+count*(k+1)/num_chunks );
+	}
+	func( begin, begin+count/num_chunks );
+	for (std::thread& thread : threads) thread.join();
+}
+
+#ifdef WITH_ZLIB
+//Save the RGBA image `pixels` (of resolution `res`, with scanlines top-to-bottom) as a PNG image at
+//	`path`.  Scanlines are filtered in parallel, and the image data is compressed in parallel in
+//	chunks (as by pigz): each chunk is compressed separately, with the end of the chunk before as its
+//	dictionary, and all but the last end with a sync flush so that they concatenate into a single
+//	deflate stream.  Returns whether it succeeded (if not, the error has been reported).
+static bool _save_png(std::string const& path, sRGB_A_U8 const* pixels, size_t const res[2]) {
+	//Filter scanlines, choosing for each the filter with the smallest sum of absolute values
+	size_t row_bytes = 1 + 4*res[0];
+	std::vector<uint8_t> filtered( res[1]*row_bytes );
+	_parallel_for( 0,res[1], SAVE_PARALLEL_MIN_PIXELS/res[0], [&](size_t begin,size_t end) -> void {
+		std::vector<uint8_t> zeros(4*res[0],0);
+		std::vector<uint8_t> attempt[5];
+		for (std::vector<uint8_t>& bytes : attempt) bytes.resize(4*res[0]);
+
+		for (size_t j=begin;j<end;++j) {
+			uint8_t const* row  = reinterpret_cast<uint8_t const*>(pixels+j*res[0]);
+			uint8_t const* prev = j>0 ? row-4*res[0] : zeros.data();
+
+			size_t best_sum = ~size_t(0); uint8_t best=0;
+			for (uint8_t type=0;type<5;++type) {
+				size_t sum = 0;
+				for (size_t k=0;k<4*res[0];++k) {
+					int a = k>=4 ? row [k-4] : 0;
+					int b =        prev[k  ];
+					int c = k>=4 ? prev[k-4] : 0;
+					int predicted;
+					switch (type) {
+						case 0:  predicted=0;       break;
+						case 1:  predicted=a;       break;
+						case 2:  predicted=b;       break;
+						case 3:  predicted=(a+b)/2; break;
+						default: {
+							int p=a+b-c, pa=std::abs(p-a), pb=std::abs(p-b), pc=std::abs(p-c);
+							predicted = pa<=pb&&pa<=pc ? a : ( pb<=pc ? b : c );
+							break;
+						}
+					}
+					uint8_t value = static_cast<uint8_t>( row[k] - predicted );
+					attempt[type][k] = value;
+					sum += static_cast<size_t>(std::abs( static_cast<int>(static_cast<int8_t>(value)) ));
+				}
+				if (sum<best_sum) { best_sum=sum; best=type; }
+			}
+
+			filtered[j*row_bytes] = best;
+			std::memcpy( filtered.data()+j*row_bytes+1, attempt[best].data(), 4*res[0] );
+		}
+	});
+
+	//Compress the chunks (as raw deflate data), and compute their checksums
+	size_t size = filtered.size();
+	size_t num_chunks = std::max( (size+SAVE_DEFLATE_CHUNK_BYTES-1)/SAVE_DEFLATE_CHUNK_BYTES, 1_zu );
+	std::vector<std::vector<uint8_t>> compressed(num_chunks);
+	std::vector<uLong> checksums(num_chunks);
+	_parallel_for( 0,num_chunks, 1, [&](size_t begin,size_t end) -> void {
+		for (size_t k=begin;k<end;++k) {
+			size_t chunk_begin = k*SAVE_DEFLATE_CHUNK_BYTES;
+			size_t chunk_size  = std::min( size-chunk_begin, SAVE_DEFLATE_CHUNK_BYTES );
+			bool last = k==num_chunks-1;
+
+			z_stream stream = {};
+			int ret = deflateInit2( &stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY );
+			assert(ret==Z_OK);
+			if (k>0) {
+				size_t dict_size = std::min( chunk_begin, 32768_zu );
+				deflateSetDictionary( &stream, filtered.data()+chunk_begin-dict_size, static_cast<uInt>(dict_size) );
+			}
+
+			//	(The bound doesn't account for the sync flush's empty block, so leave room for it.)
+			compressed[k].resize( deflateBound(&stream,static_cast<uLong>(chunk_size)) + 16 );
+			stream.next_in   = filtered.data() + chunk_begin;
+			stream.avail_in  = static_cast<uInt>(chunk_size);
+			stream.next_out  = compressed[k].data();
+			stream.avail_out = static_cast<uInt>(compressed[k].size());
+			ret = deflate( &stream, last?Z_FINISH:Z_SYNC_FLUSH );
+			assert( last ? ret==Z_STREAM_END : ret==Z_OK ); (void)ret;
+			assert(stream.avail_in==0);
+			compressed[k].resize(stream.total_out);
+			deflateEnd(&stream);
+
+			checksums[k] = adler32( adler32(0L,Z_NULL,0), filtered.data()+chunk_begin, static_cast<uInt>(chunk_size) );
+		}
+	});
+
+	//Assemble the zlib stream: header, chunks, and checksum of the whole
+	std::vector<uint8_t> data = { 0x78, 0x9C };
+	uLong checksum = checksums[0];
+	for (size_t k=0;k<num_chunks;++k) {
+		data.insert( data.end(), compressed[k].begin(),compressed[k].end() );
+		if (k>0) {
+			size_t chunk_size = std::min( size-k*SAVE_DEFLATE_CHUNK_BYTES, SAVE_DEFLATE_CHUNK_BYTES );
+			checksum = adler32_combine( checksum, checksums[k], static_cast<z_off_t>(chunk_size) );
+		}
+	}
+	for (int shift=24;shift>=0;shift-=8) data.push_back(static_cast<uint8_t>( checksum>>shift ));
+
+	//Write the file
+	FILE* file = fopen(path.c_str(),"wb");
+	if (file!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for writing!\n",path.c_str());
+		return false;
+	}
+	auto write_chunk = [&](char const type[4], uint8_t const* bytes,size_t count) -> void {
+		uint8_t header[8] = {
+			static_cast<uint8_t>(count>>24), static_cast<uint8_t>(count>>16),
+			static_cast<uint8_t>(count>> 8), static_cast<uint8_t>(count    ),
+			static_cast<uint8_t>(type[0]), static_cast<uint8_t>(type[1]),
+			static_cast<uint8_t>(type[2]), static_cast<uint8_t>(type[3])
+		};
+		uLong crc = crc32( crc32(0L,Z_NULL,0), header+4, 4 );
+		if (count>0) crc=crc32( crc, bytes, static_cast<uInt>(count) );
+		uint8_t footer[4] = {
+			static_cast<uint8_t>(crc>>24), static_cast<uint8_t>(crc>>16),
+			static_cast<uint8_t>(crc>> 8), static_cast<uint8_t>(crc    )
+		};
+		fwrite( header, 1,8, file );
+		if (count>0) fwrite( bytes, 1,count, file );
+		fwrite( footer, 1,4, file );
+	};
+
+	uint8_t const signature[8] = { 0x89, 'P','N','G', '\r','\n', 0x1A, '\n' };
+	fwrite( signature, 1,8, file );
+
+	uint8_t ihdr[13] = {
+		static_cast<uint8_t>(res[0]>>24), static_cast<uint8_t>(res[0]>>16),
+		static_cast<uint8_t>(res[0]>> 8), static_cast<uint8_t>(res[0]    ),
+		static_cast<uint8_t>(res[1]>>24), static_cast<uint8_t>(res[1]>>16),
+		static_cast<uint8_t>(res[1]>> 8), static_cast<uint8_t>(res[1]    ),
+		8, 6, 0, 0, 0 //8-bit RGBA, deflate, adaptive filtering, not interlaced
+	};
+	write_chunk( "IHDR", ihdr,13 );
+	//	(Chunks are limited to 2³¹-1 bytes.)
+	for (size_t offset=0;offset<data.size();offset+=1_zu<<30) {
+		write_chunk( "IDAT", data.data()+offset,std::min( data.size()-offset, 1_zu<<30 ) );
+	}
+	write_chunk( "IEND", nullptr,0 );
+
+	//	(Failed writes are remembered by the file, so they're checked once, at the end.)
+	bool ok = ferror(file)==0;
+	ok = fclose(file)==0 && ok;
+	if (!ok) fprintf(stderr,"Could not write \"%s\"!\n",path.c_str());
+	return ok;
+}
+#endif
+
+
+
+Framebuffer::Framebuffer(size_t const res[2]) :
+	res{res[0],res[1]}
+{
+	//Create pixel buffer
+	_pixels = new sRGB_A_F32[res[1]*res[0]];
+
+	//Fill it with a checkerboard pattern
+	for (size_t j=0;j<res[1];++j) {
+		for (size_t i=0;i<res[0];++i) {
+			#ifdef WITH_TRANSPARENT_FRAMEBUFFER
+				if (((i/TILE_SIZE)^(j/TILE_SIZE))%2==0) {
+					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(1.0f), 0.5f );
+				} else {
+					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.0f), 0.5f );
+				}
+			#else
+				if (((i/TILE_SIZE)^(j/TILE_SIZE))%2==0) {
+					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.7f), 1.0f );
+				} else {
+					_pixels[j*res[0]+i] = sRGB_A_F32( sRGB_F32(0.3f), 1.0f );
+				}
+			#endif
+		}
+	}
+}
+Framebuffer::~Framebuffer() {
+	//Clean up pixel buffer
+	delete[] _pixels;
+}
+
+void Framebuffer::copy_pixels(Framebuffer const& other) {
+	assert(other.res[0]==res[0]&&other.res[1]==res[1]);
+	std::memcpy( _pixels, other._pixels, res[1]*res[0]*sizeof(sRGB_A_F32) );
+}
+
+bool Framebuffer::save(std::string const& path) const {
+	bool ok;
+	if (ScanlineWriter::is_supported(path)) {
+		//Save CSV, HDR, or PFM image, whose scanlines can be written in order
+		ScanlineWriter writer(path,res);
+		if (writer.is_valid());
+		else {
+			fprintf(stderr,"Could not open \"%s\" for writing!\n",path.c_str());
+			return false;
+		}
+		std::vector<sRGB_A_F32 const*> scanlines(res[1]);
+		for (size_t k=0;k<res[1];++k) {
+			size_t j = writer.bottom_to_top ? k : res[1]-1-k;
+			scanlines[k] = _pixels + j*res[0];
+		}
+		writer.write( scanlines.data(), res[1] );
+		ok = writer.close();
+		if (!ok) fprintf(stderr,"Could not write \"%s\"!\n",path.c_str());
+	} else {
+		//Save PNG image
+
+		//	Construct temporary buffer
+		sRGB_A_U8* pixels = new sRGB_A_U8[res[1]*res[0]];
+
+		//	Fill it with pixels byte-quantized from the internal storage.  While we are doing that,
+		//		note we also flip the order of the scanlines so that they are from top to bottom,
+		//		since this is the order the PNG saver expects.
+		_parallel_for( 0,res[1], SAVE_PARALLEL_MIN_PIXELS/res[0], [&](size_t begin,size_t end) -> void {
+			for (size_t j=begin;j<end;++j) {
+				for (size_t i=0;i<res[0];++i) {
+					//Note vertical flip
+					pixels[(res[1]-1-j)*res[0]+i] = quantize(_pixels[j*res[0]+i]);
+				}
+			}
+		});
+
+		//	Save the image to disk
+		#ifdef WITH_ZLIB
+		ok = _save_png( path, pixels, res );
+		#else
+		unsigned error = lodepng::encode(
+			path,
+			reinterpret_cast<uint8_t*>(pixels),
+			static_cast<unsigned>(res[0]), static_cast<unsigned>(res[1]),
+			LCT_RGBA
+		);
+		ok = error==0;
+		if (!ok) fprintf(stderr,"Could not write \"%s\": %s!\n",path.c_str(),lodepng_error_text(error));
+		#endif
+
+		//	Cleanup
+		delete[] pixels;
+	}
+	return ok;
+}
+
+sRGB_A_U8 Framebuffer::quantize(sRGB_A_F32 const& srgba) {
+	sRGB_A_F32 srgba_clipped = glm::clamp( 255.0f*srgba, sRGB_A_F32(0),sRGB_A_F32(255) );
+	return {
+		static_cast<uint8_t>(std::round(srgba_clipped.r)),
+		static_cast<uint8_t>(std::round(srgba_clipped.g)),
+		static_cast<uint8_t>(std::round(srgba_clipped.b)),
+		static_cast<uint8_t>(std::round(srgba_clipped.a))
+	};
+}
+
+#ifdef SUPPORT_WINDOWED
+void Framebuffer::draw() const {
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+	glDrawPixels(
+		static_cast<GLsizei>(res[0]), static_cast<GLsizei>(res[1]),
+		GL_RGBA, GL_FLOAT, _pixels
+	);
+}
+#endif
+
+bool save_pfm_channel(std::string const& path, float const* values, size_t const res[2]) {
+	FILE* file = fopen(path.c_str(),"wb");
+	if (file!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for writing!\n",path.c_str());
+		return false;
+	}
+	//	(Scanlines are written in the same order as by `.save(...)`, so that the image lines up
+	//		with the framebuffer's own PFM images.)
+	fprintf(file,"Pf\n%zu %zu\n-1.0\n",res[0],res[1]);
+	for (size_t k=0;k<res[1];++k) {
+		fwrite( values+(res[1]-1-k)*res[0], sizeof(float), res[0], file );
+	}
+	bool ok = ferror(file)==0;
+	ok = fclose(file)==0 && ok;
+	if (!ok) fprintf(stderr,"Could not write \"%s\"!\n",path.c_str());
+	return ok;
+}
+
+
+
+ScanlineWriter::ScanlineWriter(std::string const& path, size_t const res[2]) :
+	res{res[0],res[1]},
+	bottom_to_top(Str::endswith(path,".csv")),
+	_format(
+		Str::endswith(path,".csv") ? FORMAT::CSV : (
+		Str::endswith(path,".hdr") ? FORMAT::HDR :
+		                             FORMAT::PFM
+	))
+{
+	assert(is_supported(path));
+
+	//Open file
+	_file = fopen(path.c_str(),"wb");
+	if (_file==nullptr) return;
+
+	//Write header
+	switch (_format) {
+		case FORMAT::CSV:
+			break;
+		case FORMAT::HDR:
+			//	HDR RADIANCE image
+			fprintf(_file,
+				"#?RADIANCE\n"
+				"FORMAT=32-bit_rle_rgbe\n"
+				"EXPOSURE=1.0\n"
+				"SOFTWARE=simple-spectral\n"
+				"\n"
+				"-Y %zu +X %zu\n",
+				res[1], res[0]
+			);
+			break;
+		case FORMAT::PFM:
+			//	PFM image.  It's unclear, but the data is supposed to be stored in bottom-to-top order
+			//		in the file, unlike NetPBM.  Note that some reference data gets this wrong!
+			fprintf(_file,
+				"PF\n"
+				"%zu %zu\n"
+				"-1.0\n",
+				res[0], res[1]
+			);
+			break;
+	}
+}
+ScanlineWriter::~ScanlineWriter() {
+	if (_file!=nullptr) fclose(_file);
+}
+
+bool ScanlineWriter::close() {
+	assert(_file!=nullptr);
+	//	(Failed writes are remembered by the file, so they're checked once, here.)
+	bool ok = ferror(_file)==0;
+	ok = fclose(_file)==0 && ok;
+	_file = nullptr;
+	return ok;
+}
+
+bool ScanlineWriter::is_supported(std::string const& path) {
+	return Str::endswith(path,".csv") || Str::endswith(path,".hdr") || Str::endswith(path,".pfm");
+}
+
+void ScanlineWriter::_encode(sRGB_A_F32 const* scanline, std::string* out) const {
+	switch (_format) {
+		case FORMAT::CSV: {
+			//	(Formatted as by "%g", but much faster.)
+			out->resize( res[0] * 3*16 );
+			char* ptr = &(*out)[0];
+			char* end = ptr + out->size();
+			for (size_t i=0;i<res[0];++i) {
+				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(scanline[i]));
+				for (size_t c=0;c<3;++c) {
+					ptr = std::to_chars( ptr,end, static_cast<double>(lrgb[c]), std::chars_format::general,6 ).ptr;
+					*(ptr++) = c<2||i<res[0]-1 ? ',' : '\n';
+				}
+			}
+			out->resize( static_cast<size_t>(ptr-out->data()) );
+			break;
+		}
+		case FORMAT::HDR: {
+			//	Convert to RGBE, separating the channels (the order in which they are compressed)
+			std::vector<uint8_t> channels(4*res[0]);
+			for (size_t i=0;i<res[0];++i) {
+				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(scanline[i]));
+
+				float v = std::max(lrgb.r,std::max(lrgb.g,lrgb.b));
+
+				if (v < 1.0e-32f) {
+					for (size_t c=0;c<4;++c) channels[c*res[0]+i]=0;
+				} else {
+					int e;
+					v = std::frexp(v,&e) * 256.0f/v;
+					e += 128;
+
+					glm::vec3 rgb = glm::round(lrgb*v);
+					channels[0*res[0]+i] = static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[0])), 0,255 ));
+					channels[1*res[0]+i] = static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[1])), 0,255 ));
+					channels[2*res[0]+i] = static_cast<uint8_t>(glm::clamp( static_cast<int>(std::round(rgb[2])), 0,255 ));
+					channels[3*res[0]+i] = static_cast<uint8_t>(                                        e                );
+				}
+			}
+
+			out->clear();
+			if (res[0]<8 || res[0]>=32768) {
+				//	Scanlines of these widths can't be run-length encoded; store flat pixels
+				for (size_t i=0;i<res[0];++i) {
+					for (size_t c=0;c<4;++c) out->push_back(static_cast<char>( channels[c*res[0]+i] ));
+				}
+				break;
+			}
+
+			//	Run-length encoded scanline (as by Radiance): a marker with the width, then each
+			//		channel as runs of a repeated byte (count+128, byte) and literal spans (count,
+			//		bytes).
+			out->push_back(2); out->push_back(2);
+			out->push_back(static_cast<char>( res[0]>>8 )); out->push_back(static_cast<char>( res[0]&255 ));
+			size_t const min_run = 4;
+			for (size_t c=0;c<4;++c) {
+				uint8_t const* bytes = channels.data() + c*res[0];
+				for (size_t i=0;i<res[0];) {
+					//Find the next run long enough to be worth encoding
+					size_t begin, count=0;
+					for (begin=i;begin<res[0];begin+=count) {
+						for (count=1; count<127&&begin+count<res[0]&&bytes[begin+count]==bytes[begin]; ++count);
+						if (count>=min_run) break;
+					}
+					//Encode the bytes before it: as a short run if they're all the same, or else as
+					//	literal spans
+					if (begin-i>1 && begin-i<min_run && std::all_of(
+						bytes+i,bytes+begin, [&](uint8_t byte) -> bool { return byte==bytes[i]; }
+					)) {
+						out->push_back(static_cast<char>( 128+begin-i ));
+						out->push_back(static_cast<char>( bytes[i]    ));
+						i = begin;
+					}
+					while (i<begin) {
+						size_t span = std::min( begin-i, 128_zu );
+						out->push_back(static_cast<char>(span));
+						out->append( reinterpret_cast<char const*>(bytes+i), span );
+						i += span;
+					}
+					//Encode the run
+					if (count>=min_run) {
+						out->push_back(static_cast<char>( 128+count ));
+						out->push_back(static_cast<char>( bytes[begin] ));
+						i += count;
+					}
+				}
+			}
+			break;
+		}
+		case FORMAT::PFM:
+			out->resize( res[0] * sizeof(lRGB_F32) );
+			for (size_t i=0;i<res[0];++i) {
+				lRGB_F32 lrgb = Color::srgb_to_lrgb(sRGB_F32(scanline[i]));
+				std::memcpy( &(*out)[i*sizeof(lRGB_F32)], &lrgb, sizeof(lRGB_F32) );
+			}
+			break;
+	}
+}
+
+void ScanlineWriter::write(sRGB_A_F32 const* const* scanlines, size_t count) {
+	size_t batch = std::max( SAVE_BATCH_PIXELS/res[0], 1_zu );
+	for (size_t first=0;first<count;first+=batch) {
+		size_t last = std::min( first+batch, count );
+
+		if (_encoded.size()<last-first) _encoded.resize(last-first);
+		_parallel_for( first,last, SAVE_PARALLEL_MIN_PIXELS/res[0], [&](size_t begin,size_t end) -> void {
+			for (size_t k=begin;k<end;++k) _encode( scanlines[k], &_encoded[k-first] );
+		});
+
+		for (size_t k=first;k<last;++k) {
+			std::string const& encoded = _encoded[k-first];
+			fwrite( encoded.data(), sizeof(char),encoded.size(), _file );
+		}
+	}
+}
+
+
+
+FramebufferStream::FramebufferStream(std::string const& path, size_t const res[2], size_t window) :
+	res{res[0],res[1]},
+	_writer(new ScanlineWriter(path,res)), _bottom_to_top(_writer->bottom_to_top),
+	_num_bands( (res[1]+TILE_SIZE-1) / TILE_SIZE ),
+	_window(std::max( std::min(window,_num_bands), 1_zu )),
+	_num_written(0), _aborted(false)
+{
+	_pixels = new sRGB_A_F32[ _window*TILE_SIZE*res[0] ];
+	_remaining.resize(_window);
+	for (size_t k=0;k<_window;++k) _init_slot( k, k );
+}
+FramebufferStream::~FramebufferStream() {
+	delete _writer;
+	delete[] _pixels;
+}
+
+void FramebufferStream::_init_slot(size_t slot, size_t position) {
+	std::fill_n( _pixels+slot*TILE_SIZE*res[0], TILE_SIZE*res[0], sRGB_A_F32(0.0f) );
+	if (position<_num_bands) {
+		size_t band = _bottom_to_top ? position : _num_bands-1-position;
+		_remaining[slot] = std::min( res[1]-band*TILE_SIZE, TILE_SIZE ) * res[0];
+	} else {
+		_remaining[slot] = 0;
+	}
+}
+void FramebufferStream::_write_band(size_t position) {
+	size_t band = _bottom_to_top ? position : _num_bands-1-position;
+	size_t rows = std::min( res[1]-band*TILE_SIZE, TILE_SIZE );
+	sRGB_A_F32 const* pixels = _pixels + (position%_window)*TILE_SIZE*res[0];
+	sRGB_A_F32 const* scanlines[TILE_SIZE];
+	for (size_t k=0;k<rows;++k) {
+		size_t row = _bottom_to_top ? k : rows-1-k;
+		scanlines[k] = pixels + row*res[0];
+	}
+	_writer->write( scanlines, rows );
+}
+
+bool FramebufferStream::wait_for(size_t j) {
+	size_t position = _get_position(j/TILE_SIZE);
+	std::unique_lock<std::mutex> lock(_mutex);
+	_cv.wait( lock, [&]() -> bool { return _aborted || position<_num_written+_window; } );
+	return !_aborted;
+}
+
+void FramebufferStream::complete(size_t j, size_t count) {
+	size_t position = _get_position(j/TILE_SIZE);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	assert(_remaining[position%_window]>=count);
+	_remaining[position%_window] -= count;
+
+	//Write the bands at the start of the window that are complete, moving the window past them
+	bool moved = false;
+	while ( _num_written<_num_bands && _remaining[_num_written%_window]==0 ) {
+		_write_band(_num_written);
+		_init_slot( _num_written%_window, _num_written+_window );
+		++_num_written;
+		moved = true;
+	}
+	if (moved) _cv.notify_all();
+}
+
+void FramebufferStream::abort() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_aborted = true;
+	}
+	_cv.notify_all();
+}
+
+bool FramebufferStream::finish() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (;_num_written<_num_bands;++_num_written) {
+		_write_band(_num_written);
+		_init_slot( _num_written%_window, _num_written+_window );
+	}
+	bool ok = _writer->close();
+	delete _writer;
+	_writer = nullptr;
+	return ok;
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,43 +1,181 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-
-
-//Encapsulates the renderer's framebuffer
-class Framebuffer final {
-	public:
-		//Resolution of framebuffer
-		size_t const res[2];
-
-		//Rectangular region of pixels (useful for dividing up rendering work).
-		class Tile final {
-			public:
-				//Index of top-left pixel
-				size_t pos[2];
-
-				//Width and height of rectangular region
-				size_t res[2];
-		};
-
-	private:
-		//Pixel storage, stored as a flat array of pixels stored in OpenGL order (i.e., scanlines
-		//	ordered bottom to top) for efficiency if drawing is enabled.
-		sRGB_A_F32* _pixels;
-
-	public:
-		explicit Framebuffer(size_t const res[2]);
-		~Framebuffer();
-
-		//Get access to the framebuffer's pixel at coordinate (`i`,`j`).
-		sRGB_A_F32 const& operator()(size_t i,size_t j) const { return _pixels[j*res[0]+i]; }
-		sRGB_A_F32&       operator()(size_t i,size_t j)       { return _pixels[j*res[0]+i]; }
-
-		//Save the framebuffer's contents to the given path `path`.
-		void save(std::string const& path) const;
-
-		#ifdef SUPPORT_WINDOWED
-		//Draw the framebuffer to the current OpenGL window.
-		void draw() const;
-		#endif
-};
+#pragma once
+
+#include "stdafx.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Encapsulates the renderer's framebuffer
+class Framebuffer final {
+	public:
+		//Resolution of framebuffer
+		size_t const res[2];
+
+		//Rectangular region of pixels (useful for dividing up rendering work).
+		class Tile final {
+			public:
+				//Index of top-left pixel
+				size_t pos[2];
+
+				//Width and height of rectangular region
+				size_t res[2];
+		};
+
+	private:
+		//Pixel storage, stored as a flat array of pixels stored in OpenGL order (i.e., scanlines
+		//	ordered bottom to top) for efficiency if drawing is enabled.
+		sRGB_A_F32* _pixels;
+
+	public:
+		explicit Framebuffer(size_t const res[2]);
+		Framebuffer(Framebuffer const&) = delete;
+		~Framebuffer();
+
+		//Get access to the framebuffer's pixel at coordinate (`i`,`j`).
+		sRGB_A_F32 const& operator()(size_t i,size_t j) const { return _pixels[j*res[0]+i]; }
+		sRGB_A_F32&       operator()(size_t i,size_t j)       { return _pixels[j*res[0]+i]; }
+
+		//Copy the pixels of `other`, which must have the same resolution.
+		void copy_pixels(Framebuffer const& other);
+
+		//Save the framebuffer's contents to the given path `path`.  Returns whether it succeeded (if
+		//	not, the error has been reported).
+		bool save(std::string const& path) const;
+
+		//Byte-quantize the pixel value `srgba` (as saved to 8-bit images).
+		static sRGB_A_U8 quantize(sRGB_A_F32 const& srgba);
+
+		#ifdef SUPPORT_WINDOWED
+		//Draw the framebuffer to the current OpenGL window.
+		void draw() const;
+		#endif
+};
+
+//Save the single-channel floating-point image `values`, of resolution `res` and stored in the same
+//	order as `Framebuffer`'s pixels, as a greyscale PFM image at `path` (for data other than color,
+//	which is saved as-is).  Returns whether it succeeded (if not, the error has been reported).
+bool save_pfm_channel(std::string const& path, float const* values, size_t const res[2]);
+
+
+
+//Writes an image to a file one scanline at a time, in the order they are stored in the file, for
+//	formats that allow it (see `.is_supported(...)`).
+class ScanlineWriter final {
+	public:
+		size_t const res[2];
+
+		//Whether scanlines are stored in the file bottom-to-top (else top-to-bottom), in the sense
+		//	of the framebuffer's order (see `Framebuffer`)
+		bool const bottom_to_top;
+
+	private:
+		enum class FORMAT { CSV, HDR, PFM } const _format;
+		FILE* _file;
+
+		//Encoded scanlines of the batch being written (see `.write(...)`)
+		std::vector<std::string> _encoded;
+
+		//Encode the scanline `scanline`, of `.res[0]` pixels, as it is stored in the file, into
+		//	`out`.  Thread-safe, so that scanlines can be encoded in parallel.
+		void _encode(sRGB_A_F32 const* scanline, std::string* out) const;
+
+	public:
+		//Start writing the image at `path`, of resolution `res`.  On failure, `.is_valid()` returns
+		//	false.
+		ScanlineWriter(std::string const& path, size_t const res[2]);
+		ScanlineWriter(ScanlineWriter const&) = delete;
+		~ScanlineWriter();
+
+		//Whether the format of the image at `path` (given by its extension) can be written
+		//	scanline-by-scanline.  Currently CSV, HDR, and PFM can; PNG cannot.
+		static bool is_supported(std::string const& path);
+
+		bool is_valid() const { return _file!=nullptr; }
+
+		//Write the next scanline, `scanline`, of `.res[0]` pixels.
+		void write(sRGB_A_F32 const* scanline) { write(&scanline,1); }
+		//Write the next `count` scanlines, `scanlines[0]` through `scanlines[count-1]`.  Large
+		//	batches are encoded in parallel.
+		void write(sRGB_A_F32 const* const* scanlines, size_t count);
+
+		//Finish writing the image.  Returns whether it (including every `.write(...)`) succeeded.
+		bool close();
+};
+
+//Destination for a frame that keeps only a window of it in memory, writing the rest to the image
+//	file as it completes, so that images far larger than memory can be rendered.
+//	The frame is divided into bands of `TILE_SIZE` scanlines.  Once a band is complete, and all
+//	bands before it in the file have been written, it is written and its storage reused for a
+//	later band.  Bands should be rendered in the order they are stored in the file (see
+//	`.bottom_to_top()`); a band past the window must wait for the bands before it to be written.
+class FramebufferStream final {
+	public:
+		size_t const res[2];
+
+	private:
+		ScanlineWriter* _writer;
+		bool const _bottom_to_top;
+
+		size_t const _num_bands;
+
+		//Storage for `._window` bands, as a ring: the band at position `k` in the file is stored
+		//	in slot `k%._window`.  For each slot, the number of pixels not yet complete.
+		size_t const _window;
+		sRGB_A_F32* _pixels;
+		std::vector<size_t> _remaining;
+
+		//Number of bands written.  The window starts at the next one.
+		size_t _num_written;
+		bool _aborted;
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+
+		size_t _get_position(size_t band) const {
+			return _bottom_to_top ? band : _num_bands-1-band;
+		}
+		//Prepare slot `slot` for the band at file position `position`.
+		void _init_slot(size_t slot, size_t position);
+		//Write the band at file position `position` (from its slot).
+		void _write_band(size_t position);
+
+	public:
+		//Stream the frame to the image at `path` (see `ScanlineWriter`), of resolution `res`,
+		//	keeping `window` bands in memory.  On failure, `.is_valid()` returns false.
+		FramebufferStream(std::string const& path, size_t const res[2], size_t window);
+		FramebufferStream(FramebufferStream const&) = delete;
+		~FramebufferStream();
+
+		bool is_valid() const { return _writer!=nullptr && _writer->is_valid(); }
+
+		//Whether bands should be rendered bottom-to-top (else top-to-bottom)
+		bool bottom_to_top() const { return _bottom_to_top; }
+
+		//Wait until the band of scanline `j` is in the window, so that its pixels may be accessed.
+		//	Returns false if the stream was aborted instead.
+		bool wait_for(size_t j);
+
+		//Get access to the pixel at coordinate (`i`,`j`), whose band must be in the window.
+		sRGB_A_F32& operator()(size_t i,size_t j) {
+			size_t slot = _get_position(j/TILE_SIZE) % _window;
+			return _pixels[ (slot*TILE_SIZE+j%TILE_SIZE)*res[0] + i ];
+		}
+
+		//Mark `count` pixels of the band of scanline `j` complete, writing any bands this completes.
+		void complete(size_t j, size_t count);
+
+		//Stop waiting for bands (see `.wait_for(...)`), e.g. when a render is aborted.
+		void abort();
+
+		//Write the remaining bands, complete or not (if the render was aborted; pixels never
+		//	rendered are zero), and close the file.  Returns whether the image was written
+		//	successfully.
+		bool finish();
+};
+
+
+
+RENDER_VARIANT_END
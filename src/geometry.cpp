@@ -1,158 +1,401 @@
-#include "geometry.hpp"
-
-#include "material.hpp"
-
-
-
-PrimBase::PrimBase(TYPE type, MaterialBase* material) :
-	type(type), material(material), is_light(material->is_emissive())
-{}
-
-
-bool PrimTri:: intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
-	//Robust ray-triangle intersection.  See:
-	//	http://jcgt.org/published/0002/01/05/paper.pdf
-
-	//Dimension where the ray direction is maximal
-	Dir abs_dir = glm::abs(ray.dir);
-	size_t kx, ky, kz;
-	if (abs_dir.x>abs_dir.y) {
-		if (abs_dir.x>abs_dir.z) {
-			kz=0; kx=1; ky=2;
-		} else {
-			kz=2; kx=0; ky=1;
-		}
-	} else {
-		if (abs_dir.y>abs_dir.z) {
-			kz=1; kx=2; ky=0;
-		} else {
-			kz=2; kx=0; ky=1;
-		}
-	}
-	if (ray.dir[kz]<0) std::swap(kx,ky); //Winding order
-
-	//Calculate shear constants
-	float Sx = ray.dir[kx] / ray.dir[kz]; //* ray.dir_inv[kz];
-	float Sy = ray.dir[ky] / ray.dir[kz]; //* ray.dir_inv[kz];
-	float Sz =        1.0f / ray.dir[kz]; //  ray.dir_inv[kz];
-
-	//Vertices relative to ray origin
-	Pos const A = verts[0].pos - ray.orig;
-	Pos const B = verts[1].pos - ray.orig;
-	Pos const C = verts[2].pos - ray.orig;
-
-	//Shear and scale of vertices
-	glm::vec3 ABC_kx = glm::vec3(A[kx],B[kx],C[kx]);
-	glm::vec3 ABC_ky = glm::vec3(A[ky],B[ky],C[ky]);
-	glm::vec3 ABC_kz = glm::vec3(A[kz],B[kz],C[kz]);
-	glm::vec3 ABCx = ABC_kx - Sx*ABC_kz; //Ax, Bx, Cx
-	glm::vec3 ABCy = ABC_ky - Sy*ABC_kz; //Ay, By, Cy
-
-	//Scaled barycentric coordinates and edge tests
-	glm::vec3 UVW = glm::cross( ABCy, ABCx );
-	float const& U = UVW[0];
-	float const& V = UVW[1];
-	float const& W = UVW[2];
-	if (U!=0.0f && V!=0.0f && W!=0.0f) {
-		if ( (U<0.0f||V<0.0f||W<0.0f) && (U>0.0f||V>0.0f||W>0.0f) ) return false;
-	} else {
-		glm::dvec3 UVWd = glm::cross( glm::dvec3(ABCy), glm::dvec3(ABCx) );
-		double const& Ud = UVWd[0];
-		double const& Vd = UVWd[1];
-		double const& Wd = UVWd[2];
-
-		if ( (Ud<0.0||Vd<0.0||Wd<0.0) && (Ud>0.0||Vd>0.0||Wd>0.0) ) return false;
-
-		UVW = glm::vec3(UVWd);
-	}
-
-	//Determinant
-	float det = U + V + W;
-	if (std::abs(det)>EPS);
-	else return false;
-
-	//Calculate scaled z-coordinates of vertices and use them to calculate the hit distance.
-	glm::vec3 ABCz = Sz * ABC_kz;
-	float const T = U*ABCz.x + V*ABCz.y + W*ABCz.z;
-
-	//	Check signs of `det` and `T` match
-	uint32_t det_u; std::memcpy(&det_u,&det, sizeof(float));
-	uint32_t T_u;   std::memcpy(&T_u,  &T,   sizeof(float));
-	bool different = ((det_u&0x80000000u) ^ (T_u&0x80000000u)) > 0;
-	if (different) return false;
-
-	//Normalize U, V, W, and T, then return
-	float det_recip = 1 / det;
-	Dist dist = T * det_recip;
-	assert(!std::isnan(dist));
-	if (dist>=EPS && dist<hitrec->dist) {
-		hitrec->prim   = this;
-
-		glm::vec3 bary = UVW * det_recip;
-		hitrec->normal = normal;
-		hitrec->st     = bary.x*verts[0].st + bary.y*verts[1].st + bary.z*verts[2].st;
-
-		hitrec->dist   = dist;
-
-		return true;
-	}
-
-	return false;
-}
-
-void PrimTri::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
-	//Generate the spherical triangle on the sphere centered on `from`.  Think of this as
-	//	the projection of the primitive onto the space of all possible directions the ray
-	//	could go.
-	Math::SphericalTriangle tri(
-		glm::normalize( verts[0].pos - from ),
-		glm::normalize( verts[1].pos - from ),
-		glm::normalize( verts[2].pos - from )
-	);
-
-	//Sample randomly from that triangle
-	*dir = Math::rand_toward_sphericaltri( rng, tri );
-	*pdf = 1.0f / tri.surface_area;
-}
-
-SphereBound PrimTri::get_bound() const /*override*/ {
-	//Just compute the bounding sphere centered on the centroid.  This is not optimal,
-	//	though it's not terrible.
-	Pos centroid = (verts[0].pos+verts[1].pos+verts[2].pos)*(1.0f/3.0f);
-	float max_dist = 0.0f;
-	for (size_t i=0;i<3;++i) max_dist=std::max(max_dist,glm::length(verts[i].pos-centroid));
-	return { centroid, max_dist };
-}
-
-
-bool PrimQuad::intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
-	//Check for intersection with our triangles.  Note that we assume that only one triangle can be
-	//	hit, implying that the quadrilateral is planar.
-	if (tri0.intersect(ray,hitrec)) goto HIT;
-	if (tri1.intersect(ray,hitrec)) goto HIT;
-	return false;
-
-	HIT:
-	//The hit record has the hit triangle as the hit primitive, instead of us.  Fix that.
-	hitrec->prim = this;
-	return true;
-}
-
-void PrimQuad::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
-	//Choose one of our triangles randomly and get a random ray toward it.
-	( rand_1f(rng)<=0.5f ? tri0 : tri1 ).get_rand_toward(rng,from,dir,pdf);
-	*pdf *= 0.5f;
-}
-
-SphereBound PrimQuad::get_bound() const /*override*/ {
-	//Just compute the bounding sphere centered on the centroid.  This is not optimal,
-	//	though it's not terrible.
-	Pos centroid = (tri0.verts[0].pos+tri0.verts[1].pos+tri0.verts[2].pos+tri1.verts[2].pos)*0.25f;
-	float max_dist = std::max({
-		glm::length(tri0.verts[0].pos-centroid),
-		glm::length(tri0.verts[1].pos-centroid),
-		glm::length(tri0.verts[2].pos-centroid),
-		glm::length(tri1.verts[2].pos-centroid)
-	});
-	return { centroid, max_dist };
-}
+#include "geometry.hpp"
+
+#include "material.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+PrimBase::PrimBase(TYPE type, MaterialBase* material) :
+	type(type), material(material), is_light(material->is_emissive())
+{}
+
+
+PrimTri::PrimTri(
+	MaterialBase* material,
+	Vertex const& vert0, Vertex const& vert1, Vertex const& vert2
+) :
+	PrimBase(TYPE::TRI,material),
+	verts{vert0,vert1,vert2}
+{
+	Dir cross = glm::cross( verts[1].pos-verts[0].pos, verts[2].pos-verts[0].pos );
+	normal = glm::normalize(cross);
+
+	//Square root of the ratio of the areas in ST space and in world space
+	ST st_edge0 = verts[1].st - verts[0].st;
+	ST st_edge1 = verts[2].st - verts[0].st;
+	float area_st = std::abs( st_edge0.x*st_edge1.y - st_edge0.y*st_edge1.x );
+	float area    = glm::length(cross);
+	st_scale = area>0.0f ? std::sqrt(area_st/area) : 0.0f;
+}
+
+bool PrimTri:: intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
+	//Robust ray-triangle intersection.  See:
+	//	http://jcgt.org/published/0002/01/05/paper.pdf
+
+	//Dimension where the ray direction is maximal
+	Dir abs_dir = glm::abs(ray.dir);
+	size_t kx, ky, kz;
+	if (abs_dir.x>abs_dir.y) {
+		if (abs_dir.x>abs_dir.z) {
+			kz=0; kx=1; ky=2;
+		} else {
+			kz=2; kx=0; ky=1;
+		}
+	} else {
+		if (abs_dir.y>abs_dir.z) {
+			kz=1; kx=2; ky=0;
+		} else {
+			kz=2; kx=0; ky=1;
+		}
+	}
+	if (ray.dir[kz]<0) std::swap(kx,ky); //Winding order
+
+	//Calculate shear constants
+	float Sx = ray.dir[kx] / ray.dir[kz]; //* ray.dir_inv[kz];
+	float Sy = ray.dir[ky] / ray.dir[kz]; //* ray.dir_inv[kz];
+	float Sz =        1.0f / ray.dir[kz]; //  ray.dir_inv[kz];
+
+	//Vertices relative to ray origin
+	Pos const A = verts[0].pos - ray.orig;
+	Pos const B = verts[1].pos - ray.orig;
+	Pos const C = verts[2].pos - ray.orig;
+
+	//Shear and scale of vertices
+	glm::vec3 ABC_kx = glm::vec3(A[kx],B[kx],C[kx]);
+	glm::vec3 ABC_ky = glm::vec3(A[ky],B[ky],C[ky]);
+	glm::vec3 ABC_kz = glm::vec3(A[kz],B[kz],C[kz]);
+	glm::vec3 ABCx = ABC_kx - Sx*ABC_kz; //Ax, Bx, Cx
+	glm::vec3 ABCy = ABC_ky - Sy*ABC_kz; //Ay, By, Cy
+
+	//Scaled barycentric coordinates and edge tests
+	glm::vec3 UVW = glm::cross( ABCy, ABCx );
+	float const& U = UVW[0];
+	float const& V = UVW[1];
+	float const& W = UVW[2];
+	if (U!=0.0f && V!=0.0f && W!=0.0f) {
+		if ( (U<0.0f||V<0.0f||W<0.0f) && (U>0.0f||V>0.0f||W>0.0f) ) return false;
+	} else {
+		glm::dvec3 UVWd = glm::cross( glm::dvec3(ABCy), glm::dvec3(ABCx) );
+		double const& Ud = UVWd[0];
+		double const& Vd = UVWd[1];
+		double const& Wd = UVWd[2];
+
+		if ( (Ud<0.0||Vd<0.0||Wd<0.0) && (Ud>0.0||Vd>0.0||Wd>0.0) ) return false;
+
+		UVW = glm::vec3(UVWd);
+	}
+
+	//Determinant
+	float det = U + V + W;
+	if (std::abs(det)>EPS);
+	else return false;
+
+	//Calculate scaled z-coordinates of vertices and use them to calculate the hit distance.
+	glm::vec3 ABCz = Sz * ABC_kz;
+	float const T = U*ABCz.x + V*ABCz.y + W*ABCz.z;
+
+	//	Check signs of `det` and `T` match
+	uint32_t det_u; std::memcpy(&det_u,&det, sizeof(float));
+	uint32_t T_u;   std::memcpy(&T_u,  &T,   sizeof(float));
+	bool different = ((det_u&0x80000000u) ^ (T_u&0x80000000u)) > 0;
+	if (different) return false;
+
+	//Normalize U, V, W, and T, then return
+	float det_recip = 1 / det;
+	Dist dist = T * det_recip;
+	assert(!std::isnan(dist));
+	if (dist>=EPS && dist<hitrec->dist) {
+		hitrec->prim     = this;
+		hitrec->instance = nullptr;
+		hitrec->material = material;
+
+		glm::vec3 bary = UVW * det_recip;
+		hitrec->normal   = normal;
+		hitrec->st       = bary.x*verts[0].st + bary.y*verts[1].st + bary.z*verts[2].st;
+		hitrec->st_scale = st_scale;
+
+		hitrec->dist   = dist;
+
+		return true;
+	}
+
+	return false;
+}
+
+void PrimTri::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
+	//Generate the spherical triangle on the sphere centered on `from`.  Think of this as
+	//	the projection of the primitive onto the space of all possible directions the ray
+	//	could go.
+	Math::SphericalTriangle tri(
+		glm::normalize( verts[0].pos - from ),
+		glm::normalize( verts[1].pos - from ),
+		glm::normalize( verts[2].pos - from )
+	);
+
+	//Sample randomly from that triangle
+	*dir = Math::rand_toward_sphericaltri( rng, tri );
+	*pdf = 1.0f / tri.surface_area;
+}
+
+SphereBound PrimTri::get_bound() const /*override*/ {
+	//Just compute the bounding sphere centered on the centroid.  This is not optimal,
+	//	though it's not terrible.
+	Pos centroid = (verts[0].pos+verts[1].pos+verts[2].pos)*(1.0f/3.0f);
+	float max_dist = 0.0f;
+	for (size_t i=0;i<3;++i) max_dist=std::max(max_dist,glm::length(verts[i].pos-centroid));
+	return { centroid, max_dist };
+}
+AABB        PrimTri::get_aabb () const /*override*/ {
+	AABB result = AABB::get_empty();
+	for (size_t i=0;i<3;++i) result.extend(verts[i].pos);
+	return result;
+}
+
+
+bool PrimQuad::intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
+	//Check for intersection with our triangles.  Note that we assume that only one triangle can be
+	//	hit, implying that the quadrilateral is planar.
+	if (tri0.intersect(ray,hitrec)) goto HIT;
+	if (tri1.intersect(ray,hitrec)) goto HIT;
+	return false;
+
+	HIT:
+	//The hit record has the hit triangle as the hit primitive, instead of us.  Fix that.  Our
+	//	material may also have been changed since the triangles were made.
+	hitrec->prim     = this;
+	hitrec->material = material;
+	return true;
+}
+
+void PrimQuad::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
+	//Choose one of our triangles randomly and get a random ray toward it.
+	( rand_1f(rng)<=0.5f ? tri0 : tri1 ).get_rand_toward(rng,from,dir,pdf);
+	*pdf *= 0.5f;
+}
+
+SphereBound PrimQuad::get_bound() const /*override*/ {
+	//Just compute the bounding sphere centered on the centroid.  This is not optimal,
+	//	though it's not terrible.
+	Pos centroid = (tri0.verts[0].pos+tri0.verts[1].pos+tri0.verts[2].pos+tri1.verts[2].pos)*0.25f;
+	float max_dist = std::max({
+		glm::length(tri0.verts[0].pos-centroid),
+		glm::length(tri0.verts[1].pos-centroid),
+		glm::length(tri0.verts[2].pos-centroid),
+		glm::length(tri1.verts[2].pos-centroid)
+	});
+	return { centroid, max_dist };
+}
+AABB        PrimQuad::get_aabb () const /*override*/ {
+	AABB result = tri0.get_aabb();
+	result.extend(tri1.verts[2].pos);
+	return result;
+}
+
+
+bool PrimSphere::intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
+	//Ray-sphere intersection, arranged to avoid catastrophic cancellation.  See:
+	//	"Precision Improvements for Ray/Sphere Intersection", Ray Tracing Gems, Ch. 7.
+	//	Note the ray direction isn't necessarily normalized (e.g. inside instances).
+	Dir f = ray.orig - center;
+	float a = glm::dot(ray.dir,ray.dir);
+	float b = -glm::dot(f,ray.dir);
+	float c = glm::dot(f,f) - radius*radius;
+
+	Dir l = f + (b/a)*ray.dir;
+	float discr = a*( radius*radius - glm::dot(l,l) );
+	if (discr<0.0f) return false;
+
+	float q = b + std::copysign(std::sqrt(discr),b);
+	if (q==0.0f) return false;
+	Dist dist0 = c / q;
+	Dist dist1 = q / a;
+	if (dist0>dist1) std::swap(dist0,dist1);
+
+	Dist dist;
+	if      (dist0>=EPS) dist=dist0;
+	else if (dist1>=EPS) dist=dist1;
+	else return false;
+	if (dist<hitrec->dist) {
+		hitrec->prim     = this;
+		hitrec->instance = nullptr;
+		hitrec->material = material;
+
+		Dir local = ( ray.at(dist) - center ) / radius;
+		hitrec->normal = glm::normalize(local);
+		hitrec->st     = ST(
+			0.5f + std::atan2(local.z,local.x)*(0.5f/Constants::pi<float>),
+			std::acos(glm::clamp(local.y,-1.0f,1.0f)) * (1.0f/Constants::pi<float>)
+		);
+		//	S changes by "1/(2πr)" per unit distance (at the equator) and T by "1/(πr)"
+		hitrec->st_scale = 1.0f / ( std::sqrt(2.0f)*Constants::pi<float>*radius );
+
+		hitrec->dist   = dist;
+
+		return true;
+	}
+
+	return false;
+}
+
+void PrimSphere::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
+	//Sample the cone of directions the sphere subtends (or every direction, from inside).
+	*dir = Math::rand_toward_sphere( rng, center-from,radius, pdf );
+}
+
+SphereBound PrimSphere::get_bound() const /*override*/ {
+	return { center, radius };
+}
+AABB        PrimSphere::get_aabb () const /*override*/ {
+	return { center-Dir(radius), center+Dir(radius) };
+}
+
+
+PrimDisk::PrimDisk( MaterialBase* material, Pos const& center,Dir const& normal,Dist radius ) :
+	PrimBase(TYPE::DISK,material),
+	center(center), normal(glm::normalize(normal)), radius(radius)
+{
+	//Any tangent will do; build it from whichever axis is least aligned with the normal.
+	Dir abs_normal = glm::abs(this->normal);
+	Dir axis;
+	if      (abs_normal.x<=abs_normal.y&&abs_normal.x<=abs_normal.z) axis=Dir(1,0,0);
+	else if (abs_normal.y<=abs_normal.z                            ) axis=Dir(0,1,0);
+	else                                                             axis=Dir(0,0,1);
+	tangent   = glm::normalize(glm::cross( this->normal, axis ));
+	bitangent = glm::cross( this->normal, tangent );
+}
+
+bool PrimDisk::intersect(Ray const& ray, HitRecord* hitrec) const /*override*/ {
+	float denom = glm::dot(normal,ray.dir);
+	if (denom==0.0f) return false; //Parallel
+
+	Dist dist = glm::dot(center-ray.orig,normal) / denom;
+	if (dist>=EPS && dist<hitrec->dist) {
+		Dir offset = ray.at(dist) - center;
+		if (glm::dot(offset,offset)>radius*radius) return false;
+
+		hitrec->prim     = this;
+		hitrec->instance = nullptr;
+		hitrec->material = material;
+
+		hitrec->normal = normal;
+		hitrec->st     = ST(0.5f) + (0.5f/radius)*ST( glm::dot(offset,tangent), glm::dot(offset,bitangent) );
+		hitrec->st_scale = 0.5f / radius;
+
+		hitrec->dist   = dist;
+
+		return true;
+	}
+
+	return false;
+}
+
+void PrimDisk::get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const /*override*/ {
+	//Choose a point uniformly on the disk, by the concentric mapping of the unit square.  See:
+	//	"A Low Distortion Map Between Disk and Square", Shirley and Chiu 1997.
+	glm::vec2 square = 2.0f*glm::vec2(rand_1f(rng),rand_1f(rng)) - glm::vec2(1.0f);
+	glm::vec2 point_unit;
+	if (square.x==0.0f&&square.y==0.0f) {
+		point_unit = glm::vec2(0.0f);
+	} else if (std::abs(square.x)>std::abs(square.y)) {
+		float phi = (0.25f*Constants::pi<float>) * (square.y/square.x);
+		point_unit = square.x * glm::vec2(std::cos(phi),std::sin(phi));
+	} else {
+		float phi = (0.5f*Constants::pi<float>) - (0.25f*Constants::pi<float>)*(square.x/square.y);
+		point_unit = square.y * glm::vec2(std::cos(phi),std::sin(phi));
+	}
+	Pos point = center + radius*( point_unit.x*tangent + point_unit.y*bitangent );
+
+	//Convert the density from area to solid angle: dω = cos(θ) dA / r²
+	Dir vec = point - from;
+	float dist_sq = glm::dot(vec,vec);
+	*dir = vec / std::sqrt(dist_sq);
+	float cos_theta = std::abs(glm::dot(normal,*dir));
+	float area = Constants::pi<float>*radius*radius;
+	*pdf = cos_theta>0.0f ? dist_sq/(cos_theta*area) : std::numeric_limits<float>::infinity();
+}
+
+SphereBound PrimDisk::get_bound() const /*override*/ {
+	return { center, radius };
+}
+AABB        PrimDisk::get_aabb () const /*override*/ {
+	//The extent along each axis is the radius times the sine of the angle between it and the normal.
+	Dir extent = radius * glm::sqrt(glm::max( Dir(1.0f)-normal*normal, Dir(0.0f) ));
+	return { center-extent, center+extent };
+}
+
+
+Mesh::Mesh(std::vector<PrimBase*>&& primitives, BVH::BuildOptions const& accel_options) :
+	primitives(std::move(primitives))
+{
+	#ifndef NDEBUG
+	for (PrimBase const* prim : this->primitives) assert(prim->type!=PrimBase::TYPE::INSTANCE);
+	#endif
+	bvh = new BVH(this->primitives,accel_options);
+}
+Mesh::~Mesh() {
+	delete bvh;
+}
+
+
+PrimInstance::PrimInstance(Mesh const* mesh, glm::mat4 const& transform, MaterialBase* material/*=nullptr*/) :
+	mesh(mesh), transform(transform), transform_inv(glm::inverse(transform))
+{
+	//Cube root of the volume scale
+	float det = glm::dot( Dir(transform[0]), glm::cross(Dir(transform[1]),Dir(transform[2])) );
+	transform_scale = std::cbrt(std::abs(det));
+
+	type = TYPE::INSTANCE;
+	this->material = material;
+	is_light = false;
+}
+
+bool PrimInstance::intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore) const {
+	//Transform the ray into object space.  The direction is deliberately not renormalized, so that
+	//	distances along the ray are the same in both spaces and `hitrec->dist` needn't change.
+	Ray ray_obj = {
+		Pos( transform_inv * glm::vec4(ray.orig,1.0f) ),
+		Dir( transform_inv * glm::vec4(ray.dir, 0.0f) )
+	};
+
+	if (!mesh->bvh->intersect(ray_obj,hitrec,ignore,nullptr)) return false;
+
+	//Normals transform by the inverse transpose
+	hitrec->normal   = glm::normalize(Dir( glm::transpose(transform_inv) * glm::vec4(hitrec->normal,0.0f) ));
+	hitrec->st_scale /= transform_scale;
+	hitrec->instance = this;
+	if (material!=nullptr) hitrec->material=material;
+	return true;
+}
+
+void PrimInstance::get_rand_toward(Math::RNG& /*rng*/, Pos const& /*from*/, Dir* dir,float* pdf) const /*override*/ {
+	//Instances are never lights (see class comment).
+	assert(false);
+	*dir = Dir(qNaN);
+	*pdf = 0.0f;
+}
+
+SphereBound PrimInstance::get_bound() const /*override*/ {
+	AABB aabb = get_aabb();
+	return { aabb.get_center(), 0.5f*glm::length(aabb.high-aabb.low) };
+}
+AABB        PrimInstance::get_aabb () const /*override*/ {
+	//Box around the transformed corners of the mesh's box
+	AABB aabb_obj = mesh->bvh->get_aabb();
+	AABB result = AABB::get_empty();
+	for (size_t i=0;i<8;++i) {
+		Pos corner = Pos(
+			(i&1u) ? aabb_obj.high.x : aabb_obj.low.x,
+			(i&2u) ? aabb_obj.high.y : aabb_obj.low.y,
+			(i&4u) ? aabb_obj.high.z : aabb_obj.low.z
+		);
+		result.extend(Pos( transform * glm::vec4(corner,1.0f) ));
+	}
+	return result;
+}
+
+
+
+RENDER_VARIANT_END
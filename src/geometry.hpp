@@ -1,104 +1,217 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-#include "util/random.hpp"
-
-
-
-class MaterialBase;
-
-
-
-class Vertex final {
-	public:
-		//Vertex coordinate
-		Pos pos;
-
-		//ST texture coordinate
-		//	Note: if you expected UV, see the definition of `ST` for explanation.
-		ST st;
-};
-
-
-
-//Encapsulates a geometric primitive
-class PrimBase {
-	public:
-		enum class TYPE {
-			TRI,
-			QUAD
-		};
-		TYPE type;
-
-		MaterialBase* material;
-
-		bool is_light;
-
-	protected:
-		PrimBase() = default;
-		PrimBase(TYPE type, MaterialBase* material);
-	public:
-		virtual ~PrimBase() = default;
-
-		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const = 0;
-
-		//Get a random direction `dir` from `from` toward the primitive.  The probability density of
-		//	choosing this direction is returned in `pdf`.
-		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const = 0;
-
-		virtual SphereBound get_bound() const = 0;
-};
-
-
-//Triangle primitive
-class PrimTri final : public PrimBase {
-	public:
-		Vertex verts[3];
-		Dir normal;
-
-	public:
-		PrimTri() = default;
-		PrimTri(
-			MaterialBase* material,
-			Vertex const& vert0, Vertex const& vert1, Vertex const& vert2
-		) :
-			PrimBase(TYPE::TRI,material),
-			verts{vert0,vert1,vert2},
-			normal(glm::normalize(glm::cross( verts[1].pos-verts[0].pos, verts[2].pos-verts[0].pos )))
-		{}
-		virtual ~PrimTri() = default;
-
-		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
-
-		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
-
-		virtual SphereBound get_bound() const override;
-};
-
-//Quadrilateral primitive
-//	Note: should be planar (or else must update `.intersect(...)`).
-//	Implemented as two triangle primitives, although some operations can be optimized slightly.
-class PrimQuad final : public PrimBase {
-	public:
-		PrimTri tri0;
-		PrimTri tri1;
-
-	public:
-		PrimQuad() = default;
-		PrimQuad(
-			MaterialBase* material,
-			Vertex const& vert00, Vertex const& vert10, Vertex const& vert11, Vertex const& vert01
-		) :
-			PrimBase(TYPE::QUAD,material),
-			tri0( material, vert00,vert10,vert11 ),
-			tri1( material, vert00,vert11,vert01 )
-		{}
-		virtual ~PrimQuad() = default;
-
-		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
-
-		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
-
-		virtual SphereBound get_bound() const override;
-};
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/random.hpp"
+
+#include "bvh.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+class MaterialBase;
+
+
+
+class Vertex final {
+	public:
+		//Vertex coordinate
+		Pos pos;
+
+		//ST texture coordinate
+		//	Note: if you expected UV, see the definition of `ST` for explanation.
+		ST st;
+};
+
+
+
+//Encapsulates a geometric primitive
+class PrimBase {
+	public:
+		enum class TYPE {
+			TRI,
+			QUAD,
+			SPHERE,
+			DISK,
+			INSTANCE
+		};
+		TYPE type;
+
+		MaterialBase* material;
+
+		bool is_light;
+
+	protected:
+		PrimBase() = default;
+		PrimBase(TYPE type, MaterialBase* material);
+	public:
+		virtual ~PrimBase() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const = 0;
+
+		//Get a random direction `dir` from `from` toward the primitive.  The probability density of
+		//	choosing this direction is returned in `pdf`.
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const = 0;
+
+		virtual SphereBound get_bound() const = 0;
+		virtual AABB        get_aabb () const = 0;
+};
+
+
+//Triangle primitive
+class PrimTri final : public PrimBase {
+	public:
+		Vertex verts[3];
+		Dir normal;
+		//Rate of change of the texture coordinates per unit distance (see `HitRecord`)
+		float st_scale;
+
+	public:
+		PrimTri() = default;
+		PrimTri(
+			MaterialBase* material,
+			Vertex const& vert0, Vertex const& vert1, Vertex const& vert2
+		);
+		virtual ~PrimTri() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
+
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
+
+		virtual SphereBound get_bound() const override;
+		virtual AABB        get_aabb () const override;
+};
+
+//Quadrilateral primitive
+//	Note: should be planar (or else must update `.intersect(...)`).
+//	Implemented as two triangle primitives, although some operations can be optimized slightly.
+class PrimQuad final : public PrimBase {
+	public:
+		PrimTri tri0;
+		PrimTri tri1;
+
+	public:
+		PrimQuad() = default;
+		PrimQuad(
+			MaterialBase* material,
+			Vertex const& vert00, Vertex const& vert10, Vertex const& vert11, Vertex const& vert01
+		) :
+			PrimBase(TYPE::QUAD,material),
+			tri0( material, vert00,vert10,vert11 ),
+			tri1( material, vert00,vert11,vert01 )
+		{}
+		virtual ~PrimQuad() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
+
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
+
+		virtual SphereBound get_bound() const override;
+		virtual AABB        get_aabb () const override;
+};
+
+
+//Sphere primitive
+//	Intersected exactly, and sampled uniformly over the cone of directions it subtends.
+class PrimSphere final : public PrimBase {
+	public:
+		Pos center;
+		Dist radius;
+
+	public:
+		PrimSphere() = default;
+		PrimSphere( MaterialBase* material, Pos const& center,Dist radius ) :
+			PrimBase(TYPE::SPHERE,material),
+			center(center), radius(radius)
+		{}
+		virtual ~PrimSphere() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
+
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
+
+		virtual SphereBound get_bound() const override;
+		virtual AABB        get_aabb () const override;
+};
+
+//Disk primitive
+//	Intersected exactly, and sampled uniformly by area (with the density converted to solid angle).
+class PrimDisk final : public PrimBase {
+	public:
+		Pos center;
+		Dir normal;
+		Dist radius;
+
+		//Tangent and bitangent, defining the texture coordinates
+		Dir tangent;
+		Dir bitangent;
+
+	public:
+		PrimDisk() = default;
+		PrimDisk( MaterialBase* material, Pos const& center,Dir const& normal,Dist radius );
+		virtual ~PrimDisk() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override;
+
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
+
+		virtual SphereBound get_bound() const override;
+		virtual AABB        get_aabb () const override;
+};
+
+//Geometry shared between any number of instances (see `PrimInstance`).  The primitives are in the
+//	mesh's own (object) space and have their own acceleration structure; this is the bottom level
+//	of a two-level hierarchy whose top level is the scene's acceleration structure.
+//	Note: meshes may not themselves contain instances.
+class Mesh final {
+	public:
+		//The mesh's primitives (not owned; e.g. allocated from `Scene::arena`).
+		std::vector<PrimBase*> primitives;
+		//Acceleration structure over `primitives`.
+		BVH* bvh;
+
+	public:
+		//Builds (or loads) the acceleration structure over `primitives` according to
+		//	`accel_options`.  The primitives must outlive the mesh.
+		Mesh(std::vector<PrimBase*>&& primitives, BVH::BuildOptions const& accel_options);
+		Mesh(Mesh const&) = delete;
+		~Mesh();
+};
+
+//Instance primitive: a placement of a shared `Mesh` in the scene by an affine transform.  Rays are
+//	transformed into the mesh's object space to be intersected, so each instance costs only a few
+//	dozen bytes regardless of the size of the mesh.
+//	Note: instances are not sampled as lights.
+class PrimInstance final : public PrimBase {
+	public:
+		Mesh const* mesh;
+
+		//Object-to-world transform and its inverse
+		glm::mat4 transform;
+		glm::mat4 transform_inv;
+		//Average factor by which the transform scales distances
+		float transform_scale;
+
+	public:
+		//Unless it is `nullptr`, `material` overrides the materials of all the mesh's primitives.
+		PrimInstance(Mesh const* mesh, glm::mat4 const& transform, MaterialBase* material=nullptr);
+		virtual ~PrimInstance() = default;
+
+		virtual bool intersect(Ray const& ray, HitRecord* hitrec) const override {
+			return intersect(ray,hitrec,nullptr);
+		}
+		//As above, but hits on the mesh's primitive `ignore` are skipped.
+		bool intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore) const;
+
+		virtual void get_rand_toward(Math::RNG& rng, Pos const& from, Dir* dir,float* pdf) const override;
+
+		virtual SphereBound get_bound() const override;
+		virtual AABB        get_aabb () const override;
+};
+
+
+
+RENDER_VARIANT_END
@@ -1,361 +1,1283 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-#include "util/color.hpp"
-#include "util/string.hpp"
-
-#include "framebuffer.hpp"
-#include "renderer.hpp"
-
-
-
-#ifdef SUPPORT_WINDOWED
-#ifdef _DEBUG
-inline static void _callback_err_glfw(int /*error*/, char const* description) {
-	fprintf(stderr, "Error: %s\n", description);
-}
-#endif
-
-inline static void _callback_key(GLFWwindow* window, int key,int /*scancode*/, int action, int mods) {
-	if (action==GLFW_PRESS) {
-		switch (key) {
-			case GLFW_KEY_ESCAPE:
-				glfwSetWindowShouldClose(window, GLFW_TRUE);
-				break;
-			default:
-				break;
-		}
-	}
-}
-#endif
-
-inline static void _print_usage() {
-	printf(
-		"Simple Spectral: a simple spectral renderer for demonstration purposes\n"
-		"  Required arguments:\n"
-		"    `--scene=<name>`/`-s=<name>`\n"
-		"          Render the given built-in scene (valid scenes: \"cornell\").\n"
-		"    `--width=<width>`/`-w=<width>`\n"
-		"          Set the width of the render.\n"
-		"    `--height=<height>`/`-h=<height>`\n"
-		"          Set the height of the render.\n"
-		"    `--samples=<samples>`/`-spp=<samples>`\n"
-		"          Set the number of samples per pixel.\n"
-		"    `--output=<output-image-path>\n`/`-o=<output-image-path>`\n"
-		"          Set the path to the output image.\n"
-		"  Optional arguments:\n"
-		"    `--indirect-only`/`-io`\n"
-		"          Render only indirect illumination.\n"
-		#ifdef SUPPORT_WINDOWED
-		"    `--window`/`-w`\n"
-		"          Opens a window to display the ongoing render.\n"
-		#endif
-	);
-}
-
-inline static void _parse_arguments( char const*const argv[],size_t length, Renderer::Options* options ) {
-	std::vector<std::string> args;
-	for (size_t i=0;i<length;++i) args.emplace_back(argv[i]);
-
-	auto get_arg     = [&](std::string const& name, std::string const& shortname="") -> std::string {
-		for (auto iter=args.begin(); iter!=args.end(); ++iter) {
-			std::string const& arg = *iter;
-			if (Str::contains(arg,"=")) {
-				std::vector<std::string> components = Str::split(arg,"=",1);
-
-				if ( components[0]!=name && components[0]!=shortname );
-				else {
-					std::string result = arg;
-					args.erase(iter);
-					return components[1];
-				}
-			} else if ( arg==name || arg==shortname ) {
-				args.erase(iter);
-				return name;
-			}
-		}
-		throw -2; //Argument not found
-	};
-	auto get_arg_req = [&](std::string const& name, std::string const& shortname="") -> std::string {
-		try {
-			return get_arg(name,shortname);
-		} catch (int) {
-			fprintf(stderr,"Required argument `%s`",name.c_str());
-			if (!shortname.empty()) fprintf(stderr,"/`%s`",shortname.c_str());
-			fprintf(stderr," not found!\n");
-			throw;
-		}
-	};
-
-	options->scene_name = get_arg_req("--scene","-s");
-	if      (options->scene_name=="cornell"     );
-	else if (options->scene_name=="cornell-srgb");
-	else if (options->scene_name=="plane-srgb"  );
-	else {
-		fprintf(stderr,
-			"Unrecognized scene \"%s\"!  (Supported scenes: \"cornell\", \"cornell-srgb\", \"plane-srgb\")\n",
-			options->scene_name.c_str()
-		);
-		throw -3;
-	}
-
-	std::string strs_res[2];
-	strs_res[0] = get_arg_req("--width", "-w");
-	strs_res[1] = get_arg_req("--height","-h");
-	try {
-		options->res[0] = Str::to_pos(strs_res[0]);
-		options->res[1] = Str::to_pos(strs_res[1]);
-	} catch (int) {
-		fprintf(stderr,"Invalid width or height!\n");
-		throw;
-	}
-
-	std::string str_spp = get_arg_req("--samples", "-spp");
-	try {
-		options->spp = Str::to_pos(str_spp);
-	} catch (int) {
-		fprintf(stderr,"Invalid number of samples!\n");
-		throw;
-	}
-
-	std::string str_indonly;
-	try {
-		str_indonly = get_arg("--indirect-only", "-io");
-		options->indirect_only = true;
-	} catch (...) {
-		options->indirect_only = false;
-	}
-	if (options->indirect_only) {
-		if (str_indonly=="--indirect-only");
-		else {
-			fprintf(stderr,"`--indirect-only`/`-io` does not take a value!\n");
-			throw -1;
-		}
-	}
-
-	options->output_path = get_arg_req("--output", "-o");
-
-	#ifdef SUPPORT_WINDOWED
-	std::string str_win;
-	try {
-		str_win = get_arg("--window", "-w");
-		options->open_window = true;
-	} catch (...) {
-		options->open_window = false;
-	}
-	if (options->open_window) {
-		if (str_win=="--window");
-		else {
-			fprintf(stderr,"`--window`/`-w` does not take a value!\n");
-			throw -1;
-		}
-	}
-	#endif
-
-	if (args.size()>1) {
-		fprintf(stderr,"Warning: ignoring extraneous argument(s):\n");
-		for (size_t i=1;i<args.size();++i) {
-			fprintf(stderr,"  \"%s\"\n",args[i].c_str());
-		}
-	}
-}
-
-int main(int argc, char* argv[]) {
-	#if defined _WIN32 && defined _DEBUG
-		_CrtSetDbgFlag(0xFFFFFFFF);
-	#endif
-
-	{
-		//Attempt to parse arguments for render
-		Renderer::Options options;
-		try {
-			_parse_arguments( argv,static_cast<size_t>(argc), &options );
-		} catch (int) {
-			_print_usage();
-			return -1;
-		}
-
-		#ifdef RENDER_MODE_SPECTRAL
-		//Initialize color data
-		Color::init();
-		#endif
-
-		//Round-trip error test/demonstration
-		#if 0 && defined RENDER_MODE_SPECTRAL
-		{
-			//	By integration
-			#if 0
-			{
-				lRGB_F32 black   = Color::round_trip_lrgb(lRGB_F32( 0, 0, 0 ));
-				lRGB_F32 blue    = Color::round_trip_lrgb(lRGB_F32( 0, 0, 1 ));
-				lRGB_F32 green   = Color::round_trip_lrgb(lRGB_F32( 0, 1, 0 ));
-				lRGB_F32 cyan    = Color::round_trip_lrgb(lRGB_F32( 0, 1, 1 ));
-				lRGB_F32 red     = Color::round_trip_lrgb(lRGB_F32( 1, 0, 0 ));
-				lRGB_F32 magenta = Color::round_trip_lrgb(lRGB_F32( 1, 0, 1 ));
-				lRGB_F32 yellow  = Color::round_trip_lrgb(lRGB_F32( 1, 1, 0 ));
-				lRGB_F32 white   = Color::round_trip_lrgb(lRGB_F32( 1, 1, 1 ));
-
-				//Put a breakpoint here with your debugger to check the values.
-				int j = 6;
-			}
-			#endif
-
-			//	By Monte Carlo integration
-			#if 0
-			{
-				Math::RNG rng;
-				auto test_round_trip_mc = [&](lRGB_F32 const& lrgb_in, size_t count) -> void {
-					SpectralReflectance reflectance = 
-						Color::data->basis_bt709.r * lrgb_in.r +
-						Color::data->basis_bt709.g * lrgb_in.g +
-						Color::data->basis_bt709.b * lrgb_in.b
-					;
-
-					SpectralRadiance radiance = Color::data->D65_rad * reflectance;
-					#ifdef FLAT_FIELD_CORRECTION
-						//Assume viewing plane perpendicular to incoming ray, or correction is done by sensor
-						SpectralRadiantFlux const& flux = radiance;
-					#else
-						assert(false);
-					#endif
-
-					//Note accumulating must be into a 64-bit value for enough precision.
-					CIEXYZ_64F xyz_out(0);
-					for (size_t k=0;k<count;++k) {
-						nm lambda_0 = LAMBDA_MIN + Math::rand_1f(rng)*LAMBDA_STEP;
-						SpectralRadiantFlux::HeroSample sample = flux[lambda_0];
-						CIEXYZ_32F xyz = Color::specradflux_to_ciexyz( sample, lambda_0 );
-						xyz_out += xyz;
-					}
-					xyz_out /= static_cast<double>(count);
-
-					lRGB_F32 lrgb_out = Color::ciexyz_to_lrgb(xyz_out);
-
-					//Put a breakpoint here with your debugger to check the values.
-					int j = 6;
-				};
-				test_round_trip_mc( lRGB_F32( 0, 1, 1 ), 65536 );
-			}
-			#endif
-
-			//	Check every 24-bit sRGB values for 32-bit round-trip error.  This takes a while;
-			//		with CIE 1931, the expected maximum error is 1.851469⨯10⁻⁵, which is also fairly
-			//		average.  Note that better results are achieved with 64-bit precision (see
-			//		associated HTML file).
-			#if 0
-			float max_error = 0.0f;
-			for (int r=0;r<=255;++r) {
-				for (int g=0;g<=255;++g) {
-					for (int b=0;b<=255;++b) {
-						sRGB_U8 srgb_u8 = {
-							static_cast<uint8_t>(r),
-							static_cast<uint8_t>(g),
-							static_cast<uint8_t>(b)
-						};
-						sRGB_F32 srgb_in = sRGB_F32(srgb_u8.r,srgb_u8.g,srgb_u8.b)*(1.0f/255.0f);
-						sRGB_F32 srgb_out = Color::round_trip_srgb(srgb_in);
-						sRGB_F32 error = glm::abs( srgb_out - srgb_in );
-						max_error = std::max({ max_error, error.r, error.g, error.b });
-					}
-				}
-				printf("\r%d (%e)   ",r,static_cast<double>(max_error));
-			}
-			printf("Maximum error: %f\n",static_cast<double>(max_error));
-			#endif
-		}
-		#endif
-
-		//Create renderer
-		Renderer renderer(options);
-		#ifdef SUPPORT_WINDOWED
-		if (options.open_window) {
-			//Set up window and rendering parameters
-			GLFWwindow* window;
-			{
-				#ifdef _DEBUG
-					glfwSetErrorCallback(_callback_err_glfw);
-				#endif
-
-				glfwInit();
-
-				glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-				glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-				#ifdef _DEBUG
-					glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-				#endif
-
-				glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-
-				#ifdef WITH_TRANSPARENT_FRAMEBUFFER
-					glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, GLFW_TRUE);
-				#endif
-
-				window = glfwCreateWindow(
-					static_cast<int>(options.res[0]), static_cast<int>(options.res[1]),
-					"simple-spectral",
-					nullptr,
-					nullptr
-				);
-
-				glfwSetKeyCallback(window, _callback_key);
-
-				glfwMakeContextCurrent(window);
-				#ifdef _DEBUG
-					//glDebugMessageCallback(_callback_err_gl,nullptr);
-				#endif
-
-				//glfwSwapInterval(0);
-
-				glEnable(GL_BLEND);
-				glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
-			}
-
-			//Start rendering
-			renderer.render_start();
-
-			//Display loop for the ongoing or completed render
-			while (!glfwWindowShouldClose(window)) {
-				glfwPollEvents();
-
-				renderer.framebuffer.draw();
-
-				glfwSwapBuffers(window);
-			}
-
-			//Stop the renderer if it hasn't been already.
-			renderer.render_stop();
-			renderer.render_wait();
-
-			//Clean up
-			glfwDestroyWindow(window);
-
-			glfwTerminate();
-		} else {
-		#endif
-			//Start rendering
-			renderer.render_start();
-
-			//Wait for completion
-			renderer.render_wait ();
-		#ifdef SUPPORT_WINDOWED
-		}
-		#endif
-
-		#ifdef RENDER_MODE_SPECTRAL
-		//Clean up color data
-		Color::deinit();
-		#endif
-	}
-
-	#if defined _WIN32 && defined _DEBUG
-		if (_CrtDumpMemoryLeaks()) {
-			fprintf(stderr,"Memory leaks detected!\n");
-			printf("Press ENTER to exit.\n");
-			getchar();
-		}
-	#endif
-
-	//Return to OS
-	return 0;
-}
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/color.hpp"
+#include "util/console.hpp"
+#include "util/socket.hpp"
+#include "util/string.hpp"
+
+#include "framebuffer.hpp"
+#include "renderer.hpp"
+
+#include <iostream>
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+#ifdef SUPPORT_WINDOWED
+#ifdef _DEBUG
+inline static void _callback_err_glfw(int /*error*/, char const* description) {
+	fprintf(stderr, "Error: %s\n", description);
+}
+#endif
+
+inline static void _callback_key(GLFWwindow* window, int key,int /*scancode*/, int action, int mods) {
+	if (action==GLFW_PRESS) {
+		switch (key) {
+			case GLFW_KEY_ESCAPE:
+				glfwSetWindowShouldClose(window, GLFW_TRUE);
+				break;
+			default:
+				break;
+		}
+	}
+}
+#endif
+
+inline static void _print_usage() {
+	printf(
+		"Simple Spectral: a simple spectral renderer for demonstration purposes\n"
+		"  Required arguments:\n"
+		"    `--scene=<name>`/`-s=<name>`\n"
+		"          Render the given built-in scene (valid scenes: \"cornell\").\n"
+		"    `--width=<width>`/`-w=<width>`\n"
+		"          Set the width of the render.\n"
+		"    `--height=<height>`/`-h=<height>`\n"
+		"          Set the height of the render.\n"
+		"    `--samples=<samples>`/`-spp=<samples>`\n"
+		"          Set the number of samples per pixel.\n"
+		"    `--output=<output-image-path>\n`/`-o=<output-image-path>`\n"
+		"          Set the path to the output image (unless `--frames` is given).\n"
+		"  Optional arguments:\n"
+		"    `--indirect-only`/`-io`\n"
+		"          Render only indirect illumination.\n"
+		"    `--light-sampling=<explicit|implicit>`\n"
+		"          Set whether paths sample rays toward the lights explicitly, or only find them by\n"
+		"          chance.  The default is whichever the scene converges faster with.\n"
+		"    `--max-depth=<depth>`\n"
+		"          Set the maximum length of paths, in rays (including shadow rays).\n"
+		"    `--flat-field=<on|off>`\n"
+		"          Set whether the falloff in brightness toward the edges of the image, due to rays\n"
+		"          leaving the sensor at an angle, is corrected (as real cameras typically do).\n"
+		"    `--bvh=<sah|lbvh>`\n"
+		"          Set the algorithm used to build the acceleration structure.  \"sah\" (the\n"
+		"          default) builds a better tree; \"lbvh\" builds faster, e.g. for previews.\n"
+		"    `--bvh-cache=<directory>`\n"
+		"          Cache built acceleration structures in the given (existing) directory and\n"
+		"          reuse them on later runs with the same geometry.\n"
+		"    `--texture-cache=<directory>`\n"
+		"          Cache decoded textures (with their MIP chains) in the given (existing) directory\n"
+		"          and map them directly on later runs instead of decoding the images again.\n"
+		"    `--envmap=<hdr-image-path>`\n"
+		"          Light the scene with the given latitude-longitude environment map (\".hdr\" or\n"
+		"          \".pfm\"), replacing the scene's own environment (if any).\n"
+		"    `--camera-pos=<x>,<y>,<z>`, `--camera-target=<x>,<y>,<z>`, `--camera-vfov=<degrees>`\n"
+		"          Override the position of the scene's camera, the point it looks at, and/or its\n"
+		"          vertical field of view.\n"
+		"    `--frames=<path>`\n"
+		"          Instead of a single image, render the frames listed in the given text file (for\n"
+		"          animations and turntables), reusing the scene and threads, and saving each frame\n"
+		"          while the next renders.  Each line lists a frame's `--output`/`-o` and optionally\n"
+		"          its camera overrides (as above, relative to the scene's camera), separated by\n"
+		"          spaces.  Empty lines and lines starting with \"#\" are ignored.\n"
+		"    `--stream`\n"
+		"          Write the output image as it renders, keeping only a few bands of scanlines in\n"
+		"          memory instead of the whole image, e.g. for images too large for memory.  The\n"
+		"          output must be \".pfm\", \".hdr\", or \".csv\".  Not with `--distribute`.\n"
+		"    `--pixel-costs`\n"
+		"          Also save the cost of rendering each pixel, as greyscale floating-point images next\n"
+		"          to the output (e.g. for \"out.png\", \"out.cost-time.pfm\" with the time taken in\n"
+		"          µs, \"out.cost-rays.pfm\" with the number of rays traced, and\n"
+		"          \"out.cost-path-length.pfm\" with the average path length), to find expensive\n"
+		"          regions of the image.\n"
+		"    `--perf-counters`\n"
+		"          In the render statistics (in builds with `RENDER_STATISTICS`), also report\n"
+		"          hardware performance counters (cycles, instructions, cache/branch/TLB misses) in\n"
+		"          each phase of the render.  Linux only; where hardware counters are unavailable\n"
+		"          (e.g. in containers), software counters are reported instead.\n"
+		"    `--checkpoint=<path>`\n"
+		"          Periodically record the progress of the render (its accumulated samples) in the\n"
+		"          given file, which is deleted once the render completes.  Not with `--frames`.\n"
+		"    `--resume`\n"
+		"          Continue the render recorded in the `--checkpoint` file (which must be for the\n"
+		"          same scene and arguments) instead of starting over.  The result is the same as if\n"
+		"          the render had not been interrupted.\n"
+		"    `--distribute=<host>:<port>[,<host>:<port>...]`\n"
+		"          Distribute the render between the given worker processes (see below), which may\n"
+		"          be on this or other hosts, and merge their results into the output image.  The\n"
+		"          arguments that shape the render (the scene, resolution, samples, integrator,\n"
+		"          BVH build, and camera) are passed on to the workers, so they may not contain\n"
+		"          spaces.  The result is the same as rendering in one process, however the work is\n"
+		"          divided.  Not with `--frames`, `--checkpoint`, `--stream`, `--envmap`, or\n"
+		"          `--pixel-costs`.\n"
+		"    `--split=<image|samples>`\n"
+		"          With `--distribute`, divide the render between the workers by bands of\n"
+		"          scanlines (\"image\", the default) or by ranges of the samples of each pixel.\n"
+		"    `--worker-timeout=<seconds>`\n"
+		"          With `--distribute`, give up on a worker (and give its part of the render to the\n"
+		"          others) if it makes no progress for this long (by default, 600 seconds).\n"
+		#ifdef SUPPORT_WINDOWED
+		"    `--window`/`-w`\n"
+		"          Opens a window to display the ongoing render.\n"
+		#endif
+		#ifdef RENDER_VARIANT
+		"    `--mode=<name>`\n"
+		"          Render with the given variant of the renderer (rendering mode and number of\n"
+		"          wavelengths); `--mode=list` lists them.  The default is the first.  Workers for\n"
+		"          `--distribute` must be run with the same mode.\n"
+		#endif
+		"  Service mode:\n"
+		"    `--serve`\n"
+		"          Instead of rendering once, read render jobs from standard input, one per line,\n"
+		"          each consisting of the arguments above (which may not contain spaces).  Color\n"
+		"          data and scenes (with their textures and acceleration structures) stay loaded\n"
+		"          between jobs.  For each job, a line \"ok <milliseconds>\" or \"error\" is written\n"
+		"          to standard output; everything else is printed to standard error.  Ends at the\n"
+		"          end of input or a line \"quit\".\n"
+		"  Worker mode:\n"
+		"    `--worker=<port> [--bind=<address>]`\n"
+		"          Instead of rendering once, listen on the given TCP port for parts of renders\n"
+		"          distributed by `--distribute`, keeping scenes loaded between them.  Runs until\n"
+		"          killed.  Listens only on the loopback interface unless given the address of\n"
+		"          another (e.g. \"0.0.0.0\" for all IPv4 interfaces).  Coordinators are not\n"
+		"          authenticated, and can only choose the render (up to a limited size), not read\n"
+		"          or write files; still, only make workers reachable from trusted hosts.  A\n"
+		"          coordinator that sends nothing for 600 seconds is disconnected.\n"
+	);
+}
+
+//Parse `count` comma-separated numbers from the value `str` of argument `name` into `values`.
+inline static void _parse_floats( std::string const& name,std::string const& str, size_t count,float* values ) {
+	std::vector<std::string> components = Str::split(str,",");
+	bool ok = components.size()==count;
+	for (size_t i=0;ok&&i<count;++i) {
+		try {
+			size_t length;
+			values[i] = std::stof(components[i],&length);
+			ok = length==components[i].length();
+		} catch (...) {
+			ok = false;
+		}
+	}
+	if (!ok) {
+		fprintf(stderr,"`%s` requires %zu comma-separated number(s)!\n",name.c_str(),count);
+		throw -1;
+	}
+}
+
+//Parse a line of a frames file (see `_print_usage()`) into `frame`.
+inline static void _parse_frame( std::string const& line, Renderer::Frame* frame ) {
+	frame->camera.pos_given    = false;
+	frame->camera.target_given = false;
+	frame->camera.vfov_given   = false;
+	frame->output_path.clear();
+
+	std::istringstream stream(line);
+	std::string arg;
+	while (stream>>arg) {
+		std::vector<std::string> components = Str::split(arg,"=",1);
+		std::string const& name = components[0];
+		if (components.size()==2);
+		else {
+			fprintf(stderr,"Invalid frame argument \"%s\"!\n",arg.c_str());
+			throw -1;
+		}
+
+		if      (name=="--output"||name=="-o") frame->output_path=components[1];
+		else if (name=="--camera-pos"   ) { _parse_floats( name,components[1], 3,&frame->camera.pos   [0] ); frame->camera.pos_given   =true; }
+		else if (name=="--camera-target") { _parse_floats( name,components[1], 3,&frame->camera.target[0] ); frame->camera.target_given=true; }
+		else if (name=="--camera-vfov"  ) { _parse_floats( name,components[1], 1,&frame->camera.vfov_deg  ); frame->camera.vfov_given  =true; }
+		else {
+			fprintf(stderr,"Unrecognized frame argument \"%s\"!\n",arg.c_str());
+			throw -1;
+		}
+	}
+	if (!frame->output_path.empty());
+	else {
+		fprintf(stderr,"Frame \"%s\" has no `--output`/`-o`!\n",line.c_str());
+		throw -1;
+	}
+}
+
+//Parse the arguments `argv` into `options`.  For `job`s (parts of distributed renders; see
+//	`_is_job_argument(...)`), no output is required (nor produced).
+inline static void _parse_arguments( char const*const argv[],size_t length, Renderer::Options* options, bool job=false ) {
+	std::vector<std::string> args;
+	for (size_t i=0;i<length;++i) args.emplace_back(argv[i]);
+
+	auto get_arg     = [&](std::string const& name, std::string const& shortname="") -> std::string {
+		for (auto iter=args.begin(); iter!=args.end(); ++iter) {
+			std::string const& arg = *iter;
+			if (Str::contains(arg,"=")) {
+				std::vector<std::string> components = Str::split(arg,"=",1);
+
+				if ( components[0]!=name && components[0]!=shortname );
+				else {
+					std::string result = arg;
+					args.erase(iter);
+					return components[1];
+				}
+			} else if ( arg==name || arg==shortname ) {
+				args.erase(iter);
+				return name;
+			}
+		}
+		throw -2; //Argument not found
+	};
+	auto get_arg_req = [&](std::string const& name, std::string const& shortname="") -> std::string {
+		try {
+			return get_arg(name,shortname);
+		} catch (int) {
+			fprintf(stderr,"Required argument `%s`",name.c_str());
+			if (!shortname.empty()) fprintf(stderr,"/`%s`",shortname.c_str());
+			fprintf(stderr," not found!\n");
+			throw;
+		}
+	};
+
+	options->scene_name = get_arg_req("--scene","-s");
+	if      (options->scene_name=="cornell"     );
+	else if (options->scene_name=="cornell-srgb");
+	else if (options->scene_name=="plane-srgb"  );
+	else if (options->scene_name=="instances"   );
+	else {
+		fprintf(stderr,
+			"Unrecognized scene \"%s\"!  (Supported scenes: \"cornell\", \"cornell-srgb\", \"plane-srgb\", \"instances\")\n",
+			options->scene_name.c_str()
+		);
+		throw -3;
+	}
+
+	std::string strs_res[2];
+	strs_res[0] = get_arg_req("--width", "-w");
+	strs_res[1] = get_arg_req("--height","-h");
+	try {
+		options->res[0] = Str::to_pos(strs_res[0]);
+		options->res[1] = Str::to_pos(strs_res[1]);
+	} catch (int) {
+		fprintf(stderr,"Invalid width or height!\n");
+		throw;
+	}
+
+	std::string str_spp = get_arg_req("--samples", "-spp");
+	try {
+		options->spp = Str::to_pos(str_spp);
+	} catch (int) {
+		fprintf(stderr,"Invalid number of samples!\n");
+		throw;
+	}
+
+	std::string str_indonly;
+	try {
+		str_indonly = get_arg("--indirect-only", "-io");
+		options->indirect_only = true;
+	} catch (...) {
+		options->indirect_only = false;
+	}
+	if (options->indirect_only) {
+		if (str_indonly=="--indirect-only");
+		else {
+			fprintf(stderr,"`--indirect-only`/`-io` does not take a value!\n");
+			throw -1;
+		}
+	}
+
+	std::string str_light_sampling;
+	try {
+		str_light_sampling = get_arg("--light-sampling");
+	} catch (...) {
+		str_light_sampling = "scene";
+	}
+	if      (str_light_sampling=="scene"   ) options->integrator.light_sampling=Renderer::Options::Integrator::LIGHT_SAMPLING::SCENE;
+	else if (str_light_sampling=="explicit") options->integrator.light_sampling=Renderer::Options::Integrator::LIGHT_SAMPLING::EXPLICIT;
+	else if (str_light_sampling=="implicit") options->integrator.light_sampling=Renderer::Options::Integrator::LIGHT_SAMPLING::IMPLICIT;
+	else {
+		fprintf(stderr,"Unrecognized light sampling \"%s\"!  (Supported: \"explicit\", \"implicit\")\n",str_light_sampling.c_str());
+		throw -1;
+	}
+	std::string str_max_depth;
+	try {
+		str_max_depth = get_arg("--max-depth");
+	} catch (...) {
+		str_max_depth = std::to_string(MAX_DEPTH);
+	}
+	try {
+		options->integrator.max_depth = Str::to_pos(str_max_depth);
+	} catch (int) {
+		fprintf(stderr,"Invalid maximum depth!\n");
+		throw;
+	}
+	std::string str_flat_field;
+	try {
+		str_flat_field = get_arg("--flat-field");
+	} catch (...) {
+		#ifdef FLAT_FIELD_CORRECTION
+		str_flat_field = "on";
+		#else
+		str_flat_field = "off";
+		#endif
+	}
+	if      (str_flat_field=="on" ) options->integrator.flat_field_correction=true;
+	else if (str_flat_field=="off") options->integrator.flat_field_correction=false;
+	else {
+		fprintf(stderr,"Unrecognized flat-field correction \"%s\"!  (Supported: \"on\", \"off\")\n",str_flat_field.c_str());
+		throw -1;
+	}
+
+	std::string str_bvh;
+	try {
+		str_bvh = get_arg("--bvh");
+	} catch (...) {
+		str_bvh = "sah";
+	}
+	if      (str_bvh=="sah" ) options->bvh.build=BVH::BUILD::SAH;
+	else if (str_bvh=="lbvh") options->bvh.build=BVH::BUILD::LBVH;
+	else {
+		fprintf(stderr,"Unrecognized BVH build \"%s\"!  (Supported builds: \"sah\", \"lbvh\")\n",str_bvh.c_str());
+		throw -1;
+	}
+	try {
+		options->bvh.cache_dir = get_arg("--bvh-cache");
+	} catch (...) {
+		options->bvh.cache_dir.clear();
+	}
+	if (options->bvh.cache_dir=="--bvh-cache") {
+		fprintf(stderr,"`--bvh-cache` requires a directory!\n");
+		throw -1;
+	}
+	try {
+		options->texture_cache_dir = get_arg("--texture-cache");
+	} catch (...) {
+		options->texture_cache_dir.clear();
+	}
+	if (options->texture_cache_dir=="--texture-cache") {
+		fprintf(stderr,"`--texture-cache` requires a directory!\n");
+		throw -1;
+	}
+
+	try {
+		options->envmap_path = get_arg("--envmap");
+	} catch (...) {
+		options->envmap_path.clear();
+	}
+	if (options->envmap_path=="--envmap") {
+		fprintf(stderr,"`--envmap` requires a path!\n");
+		throw -1;
+	}
+
+	auto get_arg_camera = [&](std::string const& name, size_t count, float* values) -> bool {
+		std::string str;
+		try {
+			str = get_arg(name);
+		} catch (...) {
+			return false;
+		}
+		_parse_floats( name,str, count,values );
+		return true;
+	};
+	options->camera.pos_given    = get_arg_camera( "--camera-pos",    3, &options->camera.pos   [0] );
+	options->camera.target_given = get_arg_camera( "--camera-target", 3, &options->camera.target[0] );
+	options->camera.vfov_given   = get_arg_camera( "--camera-vfov",   1, &options->camera.vfov_deg  );
+
+	std::string frames_path;
+	try {
+		frames_path = get_arg("--frames");
+	} catch (...) {
+		frames_path.clear();
+	}
+	if (frames_path=="--frames") {
+		fprintf(stderr,"`--frames` requires a path!\n");
+		throw -1;
+	}
+	options->frames.clear();
+	if (!frames_path.empty()) {
+		std::ifstream file(frames_path);
+		if (!file) {
+			fprintf(stderr,"Could not open frames file \"%s\"!\n",frames_path.c_str());
+			throw -1;
+		}
+		std::string line;
+		while (std::getline(file,line)) {
+			if (Str::endswith(line,"\r")) line.pop_back();
+			if (line.find_first_not_of(" \t")==line.npos || Str::startswith(line,"#")) continue;
+			options->frames.emplace_back();
+			_parse_frame( line, &options->frames.back() );
+		}
+		if (options->frames.empty()) {
+			fprintf(stderr,"Frames file \"%s\" lists no frames!\n",frames_path.c_str());
+			throw -1;
+		}
+	}
+
+	if (options->frames.empty() && !job) options->output_path=get_arg_req("--output", "-o");
+
+	std::string str_costs;
+	try {
+		str_costs = get_arg("--pixel-costs");
+		options->pixel_costs = true;
+	} catch (...) {
+		options->pixel_costs = false;
+	}
+	if (options->pixel_costs && str_costs!="--pixel-costs") {
+		fprintf(stderr,"`--pixel-costs` does not take a value!\n");
+		throw -1;
+	}
+
+	std::string str_perf;
+	try {
+		str_perf = get_arg("--perf-counters");
+		options->perf_counters = true;
+	} catch (...) {
+		options->perf_counters = false;
+	}
+	if (options->perf_counters && str_perf!="--perf-counters") {
+		fprintf(stderr,"`--perf-counters` does not take a value!\n");
+		throw -1;
+	}
+
+	std::string str_stream;
+	try {
+		str_stream = get_arg("--stream");
+		options->stream = true;
+	} catch (...) {
+		options->stream = false;
+	}
+	if (options->stream) {
+		if (str_stream!="--stream") {
+			fprintf(stderr,"`--stream` does not take a value!\n");
+			throw -1;
+		}
+		std::vector<std::string> paths = { options->output_path };
+		if (!options->frames.empty()) {
+			paths.clear();
+			for (Renderer::Frame const& frame : options->frames) paths.emplace_back(frame.output_path);
+		}
+		for (std::string const& path : paths) {
+			if (!ScanlineWriter::is_supported(path)) {
+				fprintf(stderr,"`--stream` requires \".pfm\", \".hdr\", or \".csv\" output (not \"%s\")!\n",path.c_str());
+				throw -1;
+			}
+		}
+	}
+
+	try {
+		options->checkpoint_path = get_arg("--checkpoint");
+	} catch (...) {
+		options->checkpoint_path.clear();
+	}
+	if (options->checkpoint_path=="--checkpoint") {
+		fprintf(stderr,"`--checkpoint` requires a path!\n");
+		throw -1;
+	}
+	if (!options->checkpoint_path.empty()&&!options->frames.empty()) {
+		fprintf(stderr,"`--checkpoint` cannot be used with `--frames`!\n");
+		throw -1;
+	}
+	std::string str_resume;
+	try {
+		str_resume = get_arg("--resume");
+		options->resume = true;
+	} catch (...) {
+		options->resume = false;
+	}
+	if (options->resume) {
+		if (str_resume!="--resume") {
+			fprintf(stderr,"`--resume` does not take a value!\n");
+			throw -1;
+		}
+		if (options->checkpoint_path.empty()) {
+			fprintf(stderr,"`--resume` requires `--checkpoint`!\n");
+			throw -1;
+		}
+	}
+
+	std::string str_distribute;
+	try {
+		str_distribute = get_arg("--distribute");
+	} catch (...) {
+		str_distribute.clear();
+	}
+	if (str_distribute=="--distribute") {
+		fprintf(stderr,"`--distribute` requires a list of workers!\n");
+		throw -1;
+	}
+	options->distribute.workers.clear();
+	if (!str_distribute.empty()) {
+		options->distribute.workers = Str::split(str_distribute,",");
+		for (std::string const& worker : options->distribute.workers) {
+			size_t colon = worker.rfind(':');
+			bool ok = colon!=worker.npos && colon>0;
+			if (ok) {
+				try {
+					ok = Str::to_pos(worker.substr(colon+1))<=65535u;
+				} catch (int) {
+					ok = false;
+				}
+			}
+			if (!ok) {
+				fprintf(stderr,"Invalid worker \"%s\"!  (Expected \"<host>:<port>\")\n",worker.c_str());
+				throw -1;
+			}
+		}
+		if (
+			!options->frames.empty() || !options->checkpoint_path.empty() || options->stream ||
+			!options->envmap_path.empty() || options->pixel_costs
+		) {
+			fprintf(stderr,"`--distribute` cannot be used with `--frames`, `--checkpoint`, `--stream`, `--envmap`, or `--pixel-costs`!\n");
+			throw -1;
+		}
+	}
+	std::string str_split;
+	try {
+		str_split = get_arg("--split");
+	} catch (...) {
+		str_split = "image";
+	}
+	if      (str_split=="image"  ) options->distribute.split=Renderer::Options::Distribute::SPLIT::IMAGE;
+	else if (str_split=="samples") options->distribute.split=Renderer::Options::Distribute::SPLIT::SAMPLES;
+	else {
+		fprintf(stderr,"Unrecognized split \"%s\"!  (Supported splits: \"image\", \"samples\")\n",str_split.c_str());
+		throw -1;
+	}
+	std::string str_timeout;
+	try {
+		str_timeout = get_arg("--worker-timeout");
+	} catch (...) {
+		str_timeout.clear();
+	}
+	if (!str_timeout.empty()) {
+		_parse_floats( "--worker-timeout",str_timeout, 1,&options->distribute.timeout_s );
+		if (options->distribute.timeout_s>0.0f);
+		else {
+			fprintf(stderr,"`--worker-timeout` must be positive!\n");
+			throw -1;
+		}
+	}
+
+	#ifdef SUPPORT_WINDOWED
+	std::string str_win;
+	try {
+		str_win = get_arg("--window", "-w");
+		options->open_window = true;
+	} catch (...) {
+		options->open_window = false;
+	}
+	if (options->open_window) {
+		if (str_win=="--window");
+		else {
+			fprintf(stderr,"`--window`/`-w` does not take a value!\n");
+			throw -1;
+		}
+	}
+	if (options->open_window&&!options->frames.empty()) {
+		fprintf(stderr,"Warning: ignoring `--window`/`-w` with `--frames`!\n");
+		options->open_window = false;
+	}
+	if (options->open_window&&options->stream) {
+		fprintf(stderr,"Warning: ignoring `--window`/`-w` with `--stream`!\n");
+		options->open_window = false;
+	}
+	#endif
+
+	if (args.size()>1) {
+		fprintf(stderr,"Warning: ignoring extraneous argument(s):\n");
+		for (size_t i=1;i<args.size();++i) {
+			fprintf(stderr,"  \"%s\"\n",args[i].c_str());
+		}
+	}
+}
+
+//Find the scene for `options` in `scenes`, which are keyed by everything their loading depends on,
+//	or else load it and add it.  A scene that fails to load (including its textures) isn't added,
+//	so that a later job loads it afresh.
+inline static Scene* _get_scene( std::map<std::string,Scene*>* scenes, Renderer::Options const& options ) {
+	std::string key = options.scene_name + "\n" + std::to_string(static_cast<int>(options.bvh.build)) + "\n" + options.envmap_path;
+	auto iter = scenes->find(key);
+	if (iter==scenes->end()) {
+		Scene* scene = Renderer::get_new_scene(options);
+		try {
+			scene->wait_textures();
+		} catch (...) {
+			delete scene;
+			throw;
+		}
+		iter = scenes->emplace( key, scene ).first;
+	}
+	return iter->second;
+}
+
+//Service mode: render jobs read from standard input (see `_print_usage()`), keeping scenes loaded
+//	between them.
+inline static void _serve() {
+	//Responses go to the original standard output.  Everything else printed there (progress,
+	//	etc.) is redirected to standard error, so that it can't be mistaken for a response.
+	FILE* responses = Console::take_stdout();
+	if (responses!=nullptr); else {
+		fprintf(stderr,"Could not open standard output for responses!\n");
+		return;
+	}
+	auto respond = [&](char const* response) -> void {
+		fprintf(responses,"%s\n",response);
+		fflush(responses);
+	};
+
+	std::map<std::string,Scene*> scenes;
+
+	std::string line;
+	while (std::getline(std::cin,line)) {
+		if (Str::endswith(line,"\r")) line.pop_back();
+		if (line=="quit") break;
+
+		//Parse the job, as if it were the command line
+		std::vector<std::string> args = { "simple-spectral" };
+		{
+			std::istringstream stream(line);
+			std::string arg;
+			while (stream>>arg) args.emplace_back(arg);
+		}
+		if (args.size()==1) continue;
+		std::vector<char const*> argv;
+		for (std::string const& arg : args) argv.emplace_back(arg.c_str());
+
+		//Run the job.  Whatever goes wrong (including failing to save the image), the job fails,
+		//	but the service continues with the next one.
+		std::chrono::steady_clock::time_point time_start;
+		try {
+			Renderer::Options options;
+			_parse_arguments( argv.data(),argv.size(), &options );
+			#ifdef SUPPORT_WINDOWED
+			if (options.open_window) fprintf(stderr,"Warning: ignoring `--window` in service mode!\n");
+			#endif
+
+			time_start = std::chrono::steady_clock::now();
+
+			//Find or load the scene
+			Scene* scene = _get_scene( &scenes, options );
+
+			//Render
+			Renderer renderer(options,scene);
+			if (options.frames.empty()) {
+				renderer.render_start();
+				renderer.render_wait ();
+			} else {
+				renderer.render_frames(options.frames);
+			}
+		} catch (int) {
+			respond("error");
+			continue;
+		} catch (std::exception const& e) {
+			fprintf(stderr,"Error: %s!\n",e.what());
+			respond("error");
+			continue;
+		}
+
+		double ms = static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - time_start
+		).count() ) * 1.0e-6;
+		char response[64];
+		snprintf( response,sizeof(response), "ok %.3f", ms );
+		respond(response);
+	}
+
+	for (auto const& iter : scenes) delete iter.second;
+	fclose(responses);
+}
+
+//Distributed rendering.  The coordinator (`--distribute`) divides the frame into units of work
+//	(`Renderer::WorkRange`s), and sends them to the workers (`--worker`) over TCP as they become
+//	free, each as a line "<row> <row-end> <sample> <sample-end> <arguments...>".  A worker renders
+//	its unit with `Renderer::render_sums(...)` and replies with a `_WorkReply`, followed (if it
+//	succeeded) by the sums of the unit's pixels.  The coordinator adds these up and resolves them.
+//	Workers that fail (or disconnect, or stall, or render something other than was asked) are
+//	dropped, and their unit is given to another.
+class _WorkReply final {
+	public:
+		uint32_t byte_order; //`0x01020304` in the worker's byte order (which must match ours)
+		uint32_t ok;         //Whether the unit rendered successfully
+		//The render and unit as the worker parsed them, which the coordinator checks against its own
+		//	(`Renderer::Options::Distribute::SPLIT`, resolution, samples per pixel, and
+		//	`Renderer::WorkRange`)
+		uint32_t split;
+		uint32_t _pad;
+		uint64_t res[2];
+		uint64_t spp;
+		uint64_t rows   [2];
+		uint64_t samples[2];
+		uint64_t count;      //Number of `glm::dvec4` sums following
+};
+static_assert(sizeof(_WorkReply)==80,"Implementation error!");
+
+//Whether argument `arg` is passed on to (and accepted by) workers.  These are only the arguments
+//	that shape the render; the rest are for the coordinator (e.g. its output), or would have
+//	workers read or write files on behalf of whoever connects to them.
+inline static bool _is_job_argument(std::string const& arg) {
+	if (arg=="--indirect-only"||arg=="-io") return true;
+
+	std::vector<std::string> components = Str::split(arg,"=",1);
+	if (components.size()==2); else return false;
+	for (char const* name : {
+		"--scene","-s", "--width","-w", "--height","-h", "--samples","-spp",
+		"--light-sampling", "--max-depth", "--flat-field", "--bvh",
+		"--camera-pos", "--camera-target", "--camera-vfov",
+		"--split"
+	}) {
+		if (components[0]==name) return true;
+	}
+	return false;
+}
+
+//Worker mode: render units of distributed renders for any coordinator that connects to `port` of
+//	the interface with address `address`.
+inline static void _work(uint16_t port, std::string const& address) {
+	Socket listener(port,address);
+	if (!listener.is_valid()) {
+		fprintf(stderr,"Could not listen on port %u of \"%s\"!\n",static_cast<unsigned>(port),address.c_str());
+		return;
+	}
+	printf("Worker listening on port %u of \"%s\"\n",static_cast<unsigned>(port),address.c_str());
+
+	std::map<std::string,Scene*> scenes;
+	std::vector<glm::dvec4> sums;
+
+	while (true) {
+		Socket* connection = listener.accept();
+		if (connection==nullptr) continue;
+		//	Only one coordinator is served at a time, so don't wait on one that has gone quiet for
+		//		longer than coordinators wait on workers by default (see `--worker-timeout`).
+		if (!connection->set_timeout( Renderer::Options::Distribute().timeout_s )) {
+			delete connection;
+			continue;
+		}
+
+		std::string line;
+		while (connection->recv_line(&line)) {
+			_WorkReply reply = {};
+			reply.byte_order = 0x01020304u;
+			try {
+				//Parse the unit and the arguments of the render
+				Renderer::WorkRange range;
+				std::vector<std::string> args = { "simple-spectral" };
+				{
+					std::istringstream stream(line);
+					if (!( stream >> range.rows[0] >> range.rows[1] >> range.samples[0] >> range.samples[1] )) {
+						fprintf(stderr,"Invalid unit of work!\n");
+						throw -1;
+					}
+					std::string arg;
+					while (stream>>arg) {
+						if (_is_job_argument(arg));
+						else {
+							fprintf(stderr,"Argument \"%s\" is not accepted by workers!\n",arg.c_str());
+							throw -1;
+						}
+						args.emplace_back(arg);
+					}
+				}
+				std::vector<char const*> argv;
+				for (std::string const& arg : args) argv.emplace_back(arg.c_str());
+
+				Renderer::Options options;
+				_parse_arguments( argv.data(),argv.size(), &options, true );
+				reply.split      = static_cast<uint32_t>(options.distribute.split);
+				reply.res[0]     = options.res[0];
+				reply.res[1]     = options.res[1];
+				reply.spp        = options.spp;
+				reply.rows   [0] = range.rows   [0];
+				reply.rows   [1] = range.rows   [1];
+				reply.samples[0] = range.samples[0];
+				reply.samples[1] = range.samples[1];
+
+				//	The unit must be within the frame, and (depending on the split) either all of the
+				//		samples of its rows, or some of the samples of all rows.
+				bool whole = options.distribute.split==Renderer::Options::Distribute::SPLIT::IMAGE ?
+					range.samples[0]==0 && range.samples[1]==options.spp :
+					range.rows   [0]==0 && range.rows   [1]==options.res[1]
+				;
+				if (!(
+					range.rows   [0]<range.rows   [1] && range.rows   [1]<=options.res[1] &&
+					range.samples[0]<range.samples[1] && range.samples[1]<=options.spp    &&
+					whole
+				)) {
+					fprintf(stderr,"Invalid unit of work!\n");
+					throw -1;
+				}
+				if (
+					(range.rows[1]-range.rows[0])*options.res[0] > WORKER_MAX_PIXELS ||
+					options.spp > WORKER_MAX_SPP
+				) {
+					fprintf(stderr,"Unit of work too large!  (At most %zu pixels and %zu samples per pixel)\n",WORKER_MAX_PIXELS,WORKER_MAX_SPP);
+					throw -1;
+				}
+
+				Renderer renderer( options, _get_scene(&scenes,options) );
+				sums.resize( (range.rows[1]-range.rows[0]) * options.res[0] );
+				renderer.render_sums( range, sums.data() );
+
+				reply.ok    = 1u;
+				reply.count = sums.size();
+			} catch (int) {
+			} catch (std::exception const& e) {
+				fprintf(stderr,"Error: %s!\n",e.what());
+			}
+
+			if (!(
+				connection->send( &reply, sizeof(_WorkReply) ) &&
+				connection->send( sums.data(), static_cast<size_t>(reply.count)*sizeof(glm::dvec4) )
+			)) break;
+		}
+
+		delete connection;
+	}
+}
+
+//Render according to `options`, distributed between `options.distribute.workers`, which render
+//	with the arguments `job_args`.
+inline static void _render_distributed( Renderer::Options const& options, std::string const& job_args ) {
+	std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+
+	//Divide the frame into units of work.  There are a few per worker, so that faster workers can
+	//	take more of them.
+	std::vector<Renderer::WorkRange> units;
+	size_t num_units = 4 * options.distribute.workers.size();
+	if (options.distribute.split==Renderer::Options::Distribute::SPLIT::IMAGE) {
+		//	Bands of whole rows of tiles
+		size_t num_bands = ( options.res[1] + TILE_SIZE-1 ) / TILE_SIZE;
+		num_units = std::min( num_units, num_bands );
+		for (size_t k=0;k<num_units;++k) {
+			size_t rows[2] = {
+				std::min( (  k   *num_bands/num_units)*TILE_SIZE, options.res[1] ),
+				std::min( ((k+1u)*num_bands/num_units)*TILE_SIZE, options.res[1] )
+			};
+			units.push_back({ { rows[0],rows[1] }, { 0,options.spp } });
+		}
+	} else {
+		//	Ranges of samples of the whole frame
+		num_units = std::min( num_units, options.spp );
+		for (size_t k=0;k<num_units;++k) {
+			units.push_back({ { 0,options.res[1] }, { k*options.spp/num_units, (k+1u)*options.spp/num_units } });
+		}
+	}
+
+	//Sum of the samples of each pixel, and the number of them
+	std::vector<glm::dvec4> sums  ( options.res[1]*options.res[0], glm::dvec4(0.0) );
+	std::vector<size_t>     counts( options.res[1]*options.res[0], 0               );
+
+	//Units not yet rendered (in reverse order, so that they're taken in order), and the numbers
+	//	being rendered and done.  A worker waits while there are no units left but some being
+	//	rendered, in case they fail and need to be rendered again.
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<size_t> pending;
+	for (size_t k=units.size();k>0;--k) pending.push_back(k-1);
+	size_t num_rendering = 0;
+	size_t num_done      = 0;
+
+	auto threadwork = [&](std::string const& worker) -> void {
+		size_t colon = worker.rfind(':');
+		Socket socket( worker.substr(0,colon), static_cast<uint16_t>(Str::to_pos(worker.substr(colon+1))) );
+		if (!socket.is_valid() || !socket.set_timeout(options.distribute.timeout_s)) {
+			fprintf(stderr,"Warning: could not connect to worker \"%s\"!\n",worker.c_str());
+			return;
+		}
+
+		std::vector<glm::dvec4> unit_sums;
+		while (true) {
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait( lock, [&]() -> bool { return !pending.empty() || num_rendering==0; } );
+				if (pending.empty()) break;
+				index = pending.back();
+				pending.pop_back();
+				++num_rendering;
+			}
+			Renderer::WorkRange const& unit = units[index];
+
+			//Send the unit and receive its sums
+			size_t count = (unit.rows[1]-unit.rows[0]) * options.res[0];
+			unit_sums.resize(count);
+			_WorkReply reply;
+			bool ok =
+				socket.send_line(
+					std::to_string(unit.rows   [0]) + " " + std::to_string(unit.rows   [1]) + " " +
+					std::to_string(unit.samples[0]) + " " + std::to_string(unit.samples[1]) + " " +
+					job_args
+				) &&
+				socket.recv( &reply, sizeof(_WorkReply) ) &&
+				reply.byte_order==0x01020304u && reply.ok!=0u
+			;
+			//	The worker must have rendered the same frame and unit as asked, or the sums would be
+			//		merged into the wrong pixels or with the wrong weights.
+			bool matches = ok &&
+				reply.split==static_cast<uint32_t>(options.distribute.split) &&
+				reply.res[0]==options.res[0] && reply.res[1]==options.res[1] && reply.spp==options.spp &&
+				reply.rows   [0]==unit.rows   [0] && reply.rows   [1]==unit.rows   [1] &&
+				reply.samples[0]==unit.samples[0] && reply.samples[1]==unit.samples[1] &&
+				reply.count==count
+			;
+			if (ok && !matches) {
+				fprintf(stderr,"\nWarning: worker \"%s\" rendered something other than was asked!\n",worker.c_str());
+			}
+			ok = matches && socket.recv( unit_sums.data(), count*sizeof(glm::dvec4) );
+
+			std::lock_guard<std::mutex> lock(mutex);
+			--num_rendering;
+			if (ok) {
+				size_t offset = unit.rows[0] * options.res[0];
+				for (size_t k=0;k<count;++k) {
+					sums  [offset+k] += unit_sums[k];
+					counts[offset+k] += unit.samples[1] - unit.samples[0];
+				}
+				++num_done;
+				printf("\rDistributed render %zu/%zu unit(s) done     ",num_done,units.size());
+				fflush(stdout);
+			} else {
+				fprintf(stderr,"\nWarning: worker \"%s\" failed; no longer using it!\n",worker.c_str());
+				pending.push_back(index);
+			}
+			cv.notify_all();
+			if (!ok) break;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (std::string const& worker : options.distribute.workers) {
+		threads.emplace_back( threadwork, std::cref(worker) );
+	}
+	for (std::thread& thread : threads) thread.join();
+	printf("\n");
+
+	if (num_done<units.size()) {
+		fprintf(stderr,"Could not render the frame; no workers remain!\n");
+		throw -1;
+	}
+
+	//Resolve the pixels and save the image
+	Framebuffer framebuffer(options.res);
+	for (size_t j=0;j<options.res[1];++j) {
+		for (size_t i=0;i<options.res[0];++i) {
+			framebuffer(i,j) = Renderer::resolve( sums[j*options.res[0]+i], counts[j*options.res[0]+i] );
+		}
+	}
+	if (!framebuffer.save(options.output_path)) throw -1;
+
+	double ms = static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - time_start
+	).count() ) * 1.0e-6;
+	printf("Distributed render completed in %.3f ms\n",ms);
+}
+
+//Initialize the color data (in spectral modes).  Returns whether it succeeded; if not (e.g. for lack
+//	of the data files), the error has been reported.
+inline static bool _init_color() {
+	#ifdef RENDER_MODE_SPECTRAL
+	try {
+		Color::init();
+	} catch (int) {
+		return false;
+	}
+	#endif
+	return true;
+}
+
+#ifdef RENDER_VARIANT
+//Entry point of this variant of the renderer (see "variants.cpp")
+int run_variant(int argc, char* argv[]) {
+#else
+int main(int argc, char* argv[]) {
+#endif
+	#if defined _WIN32 && defined _DEBUG
+		_CrtSetDbgFlag(0xFFFFFFFF);
+	#endif
+
+	if (argc==2 && std::string(argv[1])=="--serve") {
+		if (!_init_color()) return -1;
+
+		_serve();
+
+		#ifdef RENDER_MODE_SPECTRAL
+		Color::deinit();
+		#endif
+		return 0;
+	}
+	if ((argc==2||argc==3) && Str::startswith(argv[1],"--worker=")) {
+		unsigned port;
+		try {
+			port = Str::to_pos(std::string(argv[1]).substr(9));
+		} catch (int) {
+			port = 65536u;
+		}
+		if (port>65535u) {
+			fprintf(stderr,"Invalid port!\n");
+			return -1;
+		}
+		std::string address = "127.0.0.1";
+		if (argc==3) {
+			if (Str::startswith(argv[2],"--bind=")) address=std::string(argv[2]).substr(7);
+			else {
+				fprintf(stderr,"Unrecognized worker argument \"%s\"!\n",argv[2]);
+				return -1;
+			}
+		}
+
+		if (!_init_color()) return -1;
+
+		_work( static_cast<uint16_t>(port), address );
+
+		#ifdef RENDER_MODE_SPECTRAL
+		Color::deinit();
+		#endif
+		return -1;
+	}
+
+	int result = 0;
+	{
+		//Attempt to parse arguments for render
+		Renderer::Options options;
+		try {
+			_parse_arguments( argv,static_cast<size_t>(argc), &options );
+		} catch (int) {
+			_print_usage();
+			return -1;
+		}
+
+		//Initialize color data
+		if (!_init_color()) return -1;
+
+		//Distribute the render between worker processes, instead of rendering it here
+		if (!options.distribute.workers.empty()) {
+			int result = 0;
+			try {
+				//	Pass on the arguments that shape the render (the others, such as the output, are
+				//		for this process)
+				std::string job_args;
+				for (int k=1;k<argc;++k) {
+					std::string arg = argv[k];
+					if (!_is_job_argument(arg)) continue;
+					if (arg.find_first_of(" \t")!=arg.npos) {
+						fprintf(stderr,"Arguments may not contain spaces with `--distribute`!\n");
+						throw -1;
+					}
+					job_args += job_args.empty() ? arg : " "+arg;
+				}
+
+				_render_distributed( options, job_args );
+			} catch (int) {
+				result = -1;
+			}
+
+			#ifdef RENDER_MODE_SPECTRAL
+			Color::deinit();
+			#endif
+			return result;
+		}
+
+		//Round-trip error test/demonstration
+		#if 0 && defined RENDER_MODE_SPECTRAL
+		{
+			//	By integration
+			#if 0
+			{
+				lRGB_F32 black   = Color::round_trip_lrgb(lRGB_F32( 0, 0, 0 ));
+				lRGB_F32 blue    = Color::round_trip_lrgb(lRGB_F32( 0, 0, 1 ));
+				lRGB_F32 green   = Color::round_trip_lrgb(lRGB_F32( 0, 1, 0 ));
+				lRGB_F32 cyan    = Color::round_trip_lrgb(lRGB_F32( 0, 1, 1 ));
+				lRGB_F32 red     = Color::round_trip_lrgb(lRGB_F32( 1, 0, 0 ));
+				lRGB_F32 magenta = Color::round_trip_lrgb(lRGB_F32( 1, 0, 1 ));
+				lRGB_F32 yellow  = Color::round_trip_lrgb(lRGB_F32( 1, 1, 0 ));
+				lRGB_F32 white   = Color::round_trip_lrgb(lRGB_F32( 1, 1, 1 ));
+
+				//Put a breakpoint here with your debugger to check the values.
+				int j = 6;
+			}
+			#endif
+
+			//	By Monte Carlo integration
+			#if 0
+			{
+				Math::RNG rng;
+				auto test_round_trip_mc = [&](lRGB_F32 const& lrgb_in, size_t count) -> void {
+					SpectralReflectance reflectance = 
+						Color::data->basis_bt709.r * lrgb_in.r +
+						Color::data->basis_bt709.g * lrgb_in.g +
+						Color::data->basis_bt709.b * lrgb_in.b
+					;
+
+					SpectralRadiance radiance = Color::data->D65_rad * reflectance;
+					#ifdef FLAT_FIELD_CORRECTION
+						//Assume viewing plane perpendicular to incoming ray, or correction is done by sensor
+						SpectralRadiantFlux const& flux = radiance;
+					#else
+						assert(false);
+					#endif
+
+					//Note accumulating must be into a 64-bit value for enough precision.
+					CIEXYZ_64F xyz_out(0);
+					for (size_t k=0;k<count;++k) {
+						nm lambda_0 = LAMBDA_MIN + Math::rand_1f(rng)*LAMBDA_STEP;
+						SpectralRadiantFlux::HeroSample sample = flux[lambda_0];
+						CIEXYZ_32F xyz = Color::specradflux_to_ciexyz( sample, lambda_0 );
+						xyz_out += xyz;
+					}
+					xyz_out /= static_cast<double>(count);
+
+					lRGB_F32 lrgb_out = Color::ciexyz_to_lrgb(xyz_out);
+
+					//Put a breakpoint here with your debugger to check the values.
+					int j = 6;
+				};
+				test_round_trip_mc( lRGB_F32( 0, 1, 1 ), 65536 );
+			}
+			#endif
+
+			//	Check every 24-bit sRGB values for 32-bit round-trip error.  This takes a while;
+			//		with CIE 1931, the expected maximum error is 1.851469⨯10⁻⁵, which is also fairly
+			//		average.  Note that better results are achieved with 64-bit precision (see
+			//		associated HTML file).
+			#if 0
+			float max_error = 0.0f;
+			for (int r=0;r<=255;++r) {
+				for (int g=0;g<=255;++g) {
+					for (int b=0;b<=255;++b) {
+						sRGB_U8 srgb_u8 = {
+							static_cast<uint8_t>(r),
+							static_cast<uint8_t>(g),
+							static_cast<uint8_t>(b)
+						};
+						sRGB_F32 srgb_in = sRGB_F32(srgb_u8.r,srgb_u8.g,srgb_u8.b)*(1.0f/255.0f);
+						sRGB_F32 srgb_out = Color::round_trip_srgb(srgb_in);
+						sRGB_F32 error = glm::abs( srgb_out - srgb_in );
+						max_error = std::max({ max_error, error.r, error.g, error.b });
+					}
+				}
+				printf("\r%d (%e)   ",r,static_cast<double>(max_error));
+			}
+			printf("Maximum error: %f\n",static_cast<double>(max_error));
+			#endif
+		}
+		#endif
+
+		//Create renderer (which fails if e.g. one of the scene's textures can't be loaded)
+		std::unique_ptr<Renderer> renderer_ptr;
+		try {
+			renderer_ptr.reset(new Renderer(options));
+		} catch (int) {
+			#ifdef RENDER_MODE_SPECTRAL
+			Color::deinit();
+			#endif
+			return -1;
+		}
+		Renderer& renderer = *renderer_ptr;
+		#ifdef SUPPORT_WINDOWED
+		if (options.open_window) {
+			//Set up window and rendering parameters
+			GLFWwindow* window;
+			{
+				#ifdef _DEBUG
+					glfwSetErrorCallback(_callback_err_glfw);
+				#endif
+
+				glfwInit();
+
+				glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+				glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+				#ifdef _DEBUG
+					glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+				#endif
+
+				glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+				#ifdef WITH_TRANSPARENT_FRAMEBUFFER
+					glfwWindowHint(GLFW_TRANSPARENT_FRAMEBUFFER, GLFW_TRUE);
+				#endif
+
+				window = glfwCreateWindow(
+					static_cast<int>(options.res[0]), static_cast<int>(options.res[1]),
+					"simple-spectral",
+					nullptr,
+					nullptr
+				);
+
+				glfwSetKeyCallback(window, _callback_key);
+
+				glfwMakeContextCurrent(window);
+				#ifdef _DEBUG
+					//glDebugMessageCallback(_callback_err_gl,nullptr);
+				#endif
+
+				//glfwSwapInterval(0);
+
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+			}
+
+			//Start rendering
+			renderer.render_start();
+
+			//Display loop for the ongoing or completed render
+			while (!glfwWindowShouldClose(window)) {
+				glfwPollEvents();
+
+				renderer.framebuffer.draw();
+
+				glfwSwapBuffers(window);
+			}
+
+			//Stop the renderer if it hasn't been already.  (An error saving the image has been
+			//	reported.)
+			renderer.render_stop();
+			try {
+				renderer.render_wait();
+			} catch (int) {
+				result = -1;
+			}
+
+			//Clean up
+			glfwDestroyWindow(window);
+
+			glfwTerminate();
+		} else {
+		#endif
+			try {
+				if (options.frames.empty()) {
+					//Start rendering
+					renderer.render_start();
+
+					//Wait for completion
+					renderer.render_wait ();
+				} else {
+					//Render and save each frame
+					renderer.render_frames(options.frames);
+				}
+			} catch (int) {
+				//(The error, e.g. in saving the image, has been reported.)
+				result = -1;
+			}
+		#ifdef SUPPORT_WINDOWED
+		}
+		#endif
+
+		#ifdef RENDER_MODE_SPECTRAL
+		//Clean up color data
+		Color::deinit();
+		#endif
+	}
+
+	#if defined _WIN32 && defined _DEBUG
+		if (_CrtDumpMemoryLeaks()) {
+			fprintf(stderr,"Memory leaks detected!\n");
+			printf("Press ENTER to exit.\n");
+			getchar();
+		}
+	#endif
+
+	//Return to OS
+	return result;
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,167 +1,477 @@
-#include "material.hpp"
-
-#include "util/lodepng/lodepng.h"
-#include "util/color.hpp"
-
-#include "util/math-helpers.hpp"
-
-
-
-sRGB_ReflectanceTexture::sRGB_ReflectanceTexture(std::string const& path) {
-	//Load data from file
-	std::vector<unsigned char> out;
-	unsigned w, h;
-	lodepng::decode( out, w,h, path, LCT_RGB );
-	if (!out.empty()); else {
-		fprintf(stderr,"Could not load texture \"%s\"\n",path.c_str());
-		throw -1;
-	}
-
-	//Set resolution
-	res[0] = w;
-	res[1] = h;
-
-	//Allocate pixels
-	_data = new sRGB_U8[res[1]*res[0]];
-
-	//Copy loaded data into pixels
-	std::memcpy(_data,out.data(),3*res[1]*res[0]);
-}
-sRGB_ReflectanceTexture::sRGB_ReflectanceTexture(sRGB_ReflectanceTexture const& other) :
-	res{other.res[0],other.res[1]}
-{
-	//Allocate pixels
-	_data = new sRGB_U8[res[1]*res[0]];
-
-	//Copy `other`'s data into pixels
-	std::memcpy(_data,other._data,3*res[1]*res[0]);
-}
-sRGB_ReflectanceTexture::~sRGB_ReflectanceTexture() {
-	//Clean up pixel data
-	delete[] _data;
-}
-
-#ifdef RENDER_MODE_SPECTRAL
-SpectralReflectance::HeroSample sRGB_ReflectanceTexture::sample( size_t i,size_t j, nm lambda_0 ) const
-#else
-RGB_Reflectance                 sRGB_ReflectanceTexture::sample( size_t i,size_t j              ) const
-#endif
-{
-	//Load sRGB data and convert to floating-point.
-	sRGB_U8 const& srgb_u8 = _data[j*res[0]+i];
-	sRGB_F32 srgb = sRGB_F32(srgb_u8.r,srgb_u8.g,srgb_u8.b)*(1.0f/255.0f);
-
-	//Undo the gamma transform to get ℓRGB.
-	RGB_Reflectance lrgb = Color::srgb_to_lrgb(srgb);
-
-	#ifdef RENDER_MODE_SPECTRAL
-	//Sample the reflection spectrum corresponding to this ℓRGB triple.  See paper for details on
-	//	what "corresponding" means.
-	return Color::lrgb_to_specrefl(lrgb,lambda_0);
-	#else
-	return                         lrgb;
-	#endif
-}
-#ifdef RENDER_MODE_SPECTRAL
-SpectralReflectance::HeroSample sRGB_ReflectanceTexture::sample( ST const& st,      nm lambda_0 ) const
-#else
-RGB_Reflectance                 sRGB_ReflectanceTexture::sample( ST const& st                   ) const
-#endif
-{
-	#if 1
-		//Convert from ST space to UV space.
-		UV uv = st * glm::vec2(res[0],res[1]);
-
-		//Convert from UV space to index space
-		glm::vec2 index = glm::vec2(
-			         uv.x,
-			res[1] - uv.y
-		);
-
-		//Convert to integer (clamped nearest-neighbor sample)
-		int i = static_cast<int>(std::floor(index.x));
-		int j = static_cast<int>(std::floor(index.y));
-		i = glm::clamp( i, 0,static_cast<int>(res[0]-1) );
-		j = glm::clamp( j, 0,static_cast<int>(res[1]-1) );
-
-		//Sample the texture
-		#ifdef RENDER_MODE_SPECTRAL
-		return sample( static_cast<size_t>(i),static_cast<size_t>(j), lambda_0 );
-		#else
-		return sample( static_cast<size_t>(i),static_cast<size_t>(j)           );
-		#endif
-	#else
-		//Return the ST coordinates as a spectral reflectance.
-		return Color::lrgb_to_specrefl(lRGB_F32(st,0),lambda_0);
-	#endif
-}
-
-
-bool MaterialBase::is_emissive() const {
-	#ifdef RENDER_MODE_SPECTRAL
-		return SpectralRadiance::integrate(emission) > 0.0f;
-	#else
-		return emission.r>0.0f || emission.g>0.0f || emission.b>0.0f;
-	#endif
-}
-
-
-MaterialSimpleAlbedoBase::~MaterialSimpleAlbedoBase() {
-	#ifdef RENDER_MODE_SPECTRAL
-		if (mode==MODE::CONSTANT) delete albedo.constant;
-		else                      delete albedo.texture;
-	#else
-		if (mode==MODE::CONSTANT);
-		else                      delete albedo.texture;
-	#endif
-}
-
-
-void MaterialLambertian::evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const /*override*/ {
-	#ifdef RENDER_MODE_SPECTRAL
-		if (mode==MODE::CONSTANT) evaluation->f_s=(*albedo.constant      )[               evaluation->lambda_0];
-		else                      evaluation->f_s=  albedo.texture->sample(evaluation->st,evaluation->lambda_0);
-	#else
-		if (mode==MODE::CONSTANT) evaluation->f_s=albedo.constant;
-		else                      evaluation->f_s=albedo.texture->sample(evaluation->st);
-	#endif
-	evaluation->f_s /= Constants::pi<float>;
-}
-void MaterialLambertian::interact_bsdf(struct BSDF_Interaction* interaction) const /*override*/ {
-	//Importance-sample the geometry term
-	interaction->w_i = Math::rand_coshemi(interaction->rng,&interaction->pdf_w_i);
-	interaction->w_i = Math::get_rotated_to(interaction->w_i,interaction->N);
-
-	#ifdef RENDER_MODE_SPECTRAL
-		if (mode==MODE::CONSTANT) interaction->f_s=(*albedo.constant      )[                interaction->lambda_0];
-		else                      interaction->f_s=  albedo.texture->sample(interaction->st,interaction->lambda_0);
-	#else
-		if (mode==MODE::CONSTANT) interaction->f_s=albedo.constant;
-		else                      interaction->f_s=albedo.texture->sample(interaction->st);
-	#endif
-	interaction->f_s /= Constants::pi<float>;
-}
-
-
-void MaterialMirror::evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const /*override*/ {
-	//Impossible to hit a Dirac δ function.
-	#ifdef RENDER_MODE_SPECTRAL
-		evaluation->f_s = SpectralRadiance::HeroSample(0.0f);
-	#else
-		evaluation->f_s = RGB_RecipSR                 (0.0f);
-	#endif
-}
-void MaterialMirror::interact_bsdf(struct BSDF_Interaction* interaction) const /*override*/ {
-	//Importance-sample the Dirac δ function
-	interaction->w_i = Math::reflect(interaction->w_o,interaction->N);
-	interaction->pdf_w_i = INF;
-
-	//Note: value represents a Dirac δ function.
-	#ifdef RENDER_MODE_SPECTRAL
-		if (mode==MODE::CONSTANT) interaction->f_s=(*albedo.constant      )[                interaction->lambda_0];
-		else                      interaction->f_s=  albedo.texture->sample(interaction->st,interaction->lambda_0);
-	#else
-		if (mode==MODE::CONSTANT) interaction->f_s=albedo.constant;
-		else                      interaction->f_s=albedo.texture->sample(interaction->st);
-	#endif
-}
+#include "material.hpp"
+
+#include "util/lodepng/lodepng.h"
+#include "util/color.hpp"
+
+#include "util/mapped-file.hpp"
+#include "util/math-helpers.hpp"
+#include "util/page-alloc.hpp"
+#include "util/string.hpp"
+
+#include "resources.hpp"
+#include "stats.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+#ifdef TEXTURE_TILE_SIZE
+static_assert(
+	TEXTURE_TILE_SIZE>0 && (TEXTURE_TILE_SIZE&(TEXTURE_TILE_SIZE-1))==0,
+	"`TEXTURE_TILE_SIZE` must be a power of two!"
+);
+#endif
+
+//Version of the texture cache file format.  Increment whenever the format or the MIP chain
+//	construction changes.
+#define TEXTURE_CACHE_VERSION 1u
+
+
+
+/*
+Cache file layout.  All values are in native byte order; files from another platform are rejected
+by the check on `.byte_order`.
+
+	_TextureCacheHeader
+	`sRGB_A_U8` × `.num_texels`        (at `.offset_texels`, aligned to a page)
+
+The texels are all levels' storage, exactly as laid out in memory (see `_Level`).
+*/
+class _TextureCacheHeader final {
+	public:
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t tile_size;
+		uint32_t _pad;
+		uint64_t key;
+		uint64_t res[2];
+		uint64_t num_texels;
+		uint64_t offset_texels;
+};
+static_assert(sizeof(_TextureCacheHeader)==64,"Implementation error!");
+static char const _cache_magic[8] = { 'S','S','-','T','E','X','\0','\0' };
+#ifdef TEXTURE_TILE_SIZE
+static uint32_t const _cache_tile_size = static_cast<uint32_t>(TEXTURE_TILE_SIZE);
+#else
+static uint32_t const _cache_tile_size = 0u;
+#endif
+
+sRGB_ReflectanceTexture::sRGB_ReflectanceTexture(std::string const& path, std::string const& cache_dir/*=""*/) :
+	_data(nullptr), _cache(nullptr),
+	_loaded(false)
+{
+	res[0]=0; res[1]=0;
+
+	//Load on a separate thread, so that the scene (including its other textures) can continue
+	//	loading in the meantime.
+	_loading = std::async( std::launch::async, [this,path,cache_dir]() -> void {
+		_load(path,cache_dir);
+	} ).share();
+}
+sRGB_ReflectanceTexture::~sRGB_ReflectanceTexture() {
+	//Loading refers to this object, so it must finish first
+	_loading.wait();
+
+	//Clean up pixel data
+	if (_cache!=nullptr) delete _cache;
+	else                 Mem::free_pages(_data);
+}
+
+void sRGB_ReflectanceTexture::_load(std::string const& path, std::string const& cache_dir) {
+	std::string cache_path;
+	uint64_t key = 0;
+	if (!cache_dir.empty()) {
+		std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+
+		//The texture depends only on the image file's contents and the storage layout, so those
+		//	are the key.  Hash them with 64-bit FNV-1a, as for BVH caches.
+		uint64_t hash = 14695981039346656037ull;
+		auto add_bytes = [&](void const* bytes, size_t count) -> void {
+			for (size_t i=0;i<count;++i) {
+				hash ^= static_cast<uint64_t>(static_cast<uint8_t const*>(bytes)[i]);
+				hash *= 1099511628211ull;
+			}
+		};
+		uint32_t header[3] = { TEXTURE_CACHE_VERSION, _cache_tile_size, static_cast<uint32_t>(sizeof(sRGB_A_U8)) };
+		add_bytes( header, sizeof(header) );
+		{
+			MappedFile file( path, MappedFile::MODE::READ );
+			//	A missing file gets the key of an empty one, and is then reported when decoding it.
+			if (file.is_valid()) add_bytes( file.get_data(), file.get_size() );
+			uint64_t size = file.get_size();
+			add_bytes( &size, sizeof(uint64_t) );
+		}
+		key = hash;
+
+		char name[64];
+		snprintf( name,sizeof(name), "texture-%016llx.bin", static_cast<unsigned long long>(key) );
+		cache_path = cache_dir;
+		if (!Str::endswith(cache_path,"/")&&!Str::endswith(cache_path,"\\")) cache_path+="/";
+		cache_path += name;
+
+		if (_load_cache(cache_path,key)) {
+			double ms = static_cast<double>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - time_start
+			).count() ) * 1.0e-6;
+			printf(
+				"Texture \"%s\" loaded from cache \"%s\": %zu⨯%zu, %zu level(s) in %.3f ms\n",
+				path.c_str(), cache_path.c_str(), res[0],res[1], _levels.size(), ms
+			);
+			_loaded.store( true, std::memory_order_release );
+			return;
+		}
+	}
+
+	_decode(path);
+
+	if (!cache_path.empty()) _save_cache(cache_path,key);
+	_loaded.store( true, std::memory_order_release );
+}
+void sRGB_ReflectanceTexture::_decode(std::string const& path) {
+	//Load data from file
+	std::vector<unsigned char> out;
+	unsigned w, h;
+	lodepng::decode( out, w,h, path, LCT_RGB );
+	if (!out.empty()); else {
+		fprintf(stderr,"Could not load texture \"%s\"\n",path.c_str());
+		throw -1;
+	}
+
+	//Set resolution
+	res[0] = w;
+	res[1] = h;
+
+	//Allocate pixels and copy loaded data into the first level, then build the rest.
+	size_t count = _init_levels();
+	#ifdef TEXTURE_HUGE_PAGES
+	_data = static_cast<sRGB_A_U8*>(Mem::alloc_pages( sizeof(sRGB_A_U8)*count, true  ));
+	#else
+	_data = static_cast<sRGB_A_U8*>(Mem::alloc_pages( sizeof(sRGB_A_U8)*count, false ));
+	#endif
+	if (_data!=nullptr); else {
+		fprintf(stderr,"Could not allocate texture storage!\n");
+		throw -1;
+	}
+	_set_data(_data);
+	for (size_t j=0;j<res[1];++j) {
+		for (size_t i=0;i<res[0];++i) {
+			unsigned char const* texel = out.data() + 3*(j*res[0]+i);
+			_levels[0].data[_levels[0].get_index(i,j)] = { texel[0], texel[1], texel[2], 255 };
+		}
+	}
+	float srgb_to_lrgb_lut[256];
+	for (size_t i=0;i<256;++i) srgb_to_lrgb_lut[i]=Color::srgb_to_lrgb(sRGB_F32(static_cast<float>(i)/255.0f)).r;
+	for (size_t k=1;k<_levels.size();++k) {
+		_Level const& src = _levels[k-1];
+		_Level const& dst = _levels[k  ];
+
+		//Average 2⨯2 blocks (clamped at the edges of odd-sized levels) in linear space.
+		for (size_t j=0;j<dst.res[1];++j) {
+			size_t j0=std::min(2*j,src.res[1]-1), j1=std::min(2*j+1,src.res[1]-1);
+			for (size_t i=0;i<dst.res[0];++i) {
+				size_t i0=std::min(2*i,src.res[0]-1), i1=std::min(2*i+1,src.res[0]-1);
+				lRGB_F32 sum(0.0f);
+				for (size_t index : { src.get_index(i0,j0), src.get_index(i1,j0), src.get_index(i0,j1), src.get_index(i1,j1) }) {
+					sRGB_A_U8 const& texel = src.data[index];
+					sum += lRGB_F32( srgb_to_lrgb_lut[texel.r], srgb_to_lrgb_lut[texel.g], srgb_to_lrgb_lut[texel.b] );
+				}
+				sRGB_F32 srgb = glm::clamp( 255.0f*Color::lrgb_to_srgb(0.25f*sum), sRGB_F32(0),sRGB_F32(255) );
+				dst.data[dst.get_index(i,j)] = {
+					static_cast<uint8_t>(std::round(srgb.r)),
+					static_cast<uint8_t>(std::round(srgb.g)),
+					static_cast<uint8_t>(std::round(srgb.b)),
+					255
+				};
+			}
+		}
+	}
+}
+
+size_t sRGB_ReflectanceTexture::_init_levels() {
+	//Compute the levels' resolutions and offsets.
+	size_t level_res[2] = { res[0], res[1] };
+	size_t count = 0;
+	while (true) {
+		_Level level;
+		level.res[0] = level_res[0];
+		level.res[1] = level_res[1];
+		#ifdef TEXTURE_TILE_SIZE
+		level.num_tiles[0] = ( level_res[0] + TEXTURE_TILE_SIZE-1 ) / TEXTURE_TILE_SIZE;
+		level.num_tiles[1] = ( level_res[1] + TEXTURE_TILE_SIZE-1 ) / TEXTURE_TILE_SIZE;
+		#endif
+		level.data = nullptr;
+		_levels.push_back(level);
+		count += level.get_count();
+
+		if (level_res[0]==1&&level_res[1]==1) break;
+		level_res[0] = std::max( level_res[0]/2, 1_zu );
+		level_res[1] = std::max( level_res[1]/2, 1_zu );
+	}
+	return count;
+}
+void sRGB_ReflectanceTexture::_set_data(sRGB_A_U8* data) {
+	for (_Level& level : _levels) {
+		level.data = data;
+		data += level.get_count();
+	}
+}
+
+bool sRGB_ReflectanceTexture::_load_cache(std::string const& path, uint64_t key) {
+	MappedFile* file = new MappedFile( path, MappedFile::MODE::READ );
+	if (!file->is_valid()) { delete file; return false; }
+
+	//Validate
+	bool valid = false;
+	_TextureCacheHeader const* header = static_cast<_TextureCacheHeader const*>(file->get_data());
+	if (file->get_size()>=sizeof(_TextureCacheHeader)) {
+		valid =
+			std::memcmp(header->magic,_cache_magic,8)==0 &&
+			header->version    == TEXTURE_CACHE_VERSION &&
+			header->byte_order == 0x01020304u &&
+			header->tile_size  == _cache_tile_size &&
+			header->key        == key &&
+			header->res[0]>0 && header->res[1]>0 &&
+			header->offset_texels%alignof(sRGB_A_U8)==0 &&
+			header->offset_texels <= file->get_size() &&
+			header->num_texels    <= ( file->get_size() - header->offset_texels )/sizeof(sRGB_A_U8)
+		;
+	}
+	if (valid) {
+		res[0] = static_cast<size_t>(header->res[0]);
+		res[1] = static_cast<size_t>(header->res[1]);
+		if (_init_levels()!=header->num_texels) {
+			_levels.clear();
+			valid = false;
+		}
+	}
+	if (!valid) {
+		fprintf(stderr,"Warning: ignoring stale or invalid texture cache file \"%s\"!\n",path.c_str());
+		delete file;
+		return false;
+	}
+
+	//Use the data in-place
+	_data = reinterpret_cast<sRGB_A_U8*>( static_cast<uint8_t*>(file->get_data()) + header->offset_texels );
+	_set_data(_data);
+	_cache = file;
+	return true;
+}
+void sRGB_ReflectanceTexture::_save_cache(std::string const& path, uint64_t key) const {
+	size_t num_texels = 0;
+	for (_Level const& level : _levels) num_texels+=level.get_count();
+
+	_TextureCacheHeader header;
+	std::memcpy(header.magic,_cache_magic,8);
+	header.version    = TEXTURE_CACHE_VERSION;
+	header.byte_order = 0x01020304u;
+	header.tile_size  = _cache_tile_size;
+	header._pad       = 0u;
+	header.key        = key;
+	header.res[0]     = res[0];
+	header.res[1]     = res[1];
+	header.num_texels = num_texels;
+	//	Page-aligned, so that the mapped texels are too
+	header.offset_texels = 4096;
+	static_assert(sizeof(_TextureCacheHeader)<=4096,"Implementation error!");
+	uint8_t padding[4096-sizeof(_TextureCacheHeader)] = {};
+
+	//Write to a temporary file and then move it into place, so that concurrent jobs sharing the
+	//	cache never see a partially-written file.
+	std::string path_tmp = path + "." + std::to_string(std::random_device()()) + ".tmp";
+	FILE* file = fopen(path_tmp.c_str(),"wb");
+	if (file==nullptr) {
+		fprintf(stderr,"Warning: could not write texture cache file \"%s\"!\n",path.c_str());
+		return;
+	}
+	bool ok =
+		fwrite( &header, sizeof(_TextureCacheHeader),1,          file )==1          &&
+		fwrite( padding, sizeof(padding            ),1,          file )==1          &&
+		fwrite( _data,   sizeof(sRGB_A_U8          ),num_texels, file )==num_texels
+	;
+	ok = fclose(file)==0 && ok;
+	if (ok) {
+		#ifdef _WIN32
+		std::remove(path.c_str()); //Windows cannot rename over an existing file
+		#endif
+		ok = std::rename(path_tmp.c_str(),path.c_str())==0;
+	}
+	if (ok) {
+		printf("Texture written to cache \"%s\"\n",path.c_str());
+	} else {
+		std::remove(path_tmp.c_str());
+		fprintf(stderr,"Warning: could not write texture cache file \"%s\"!\n",path.c_str());
+	}
+}
+
+void sRGB_ReflectanceTexture::_wait() const {
+	//Blocks until loading has finished, and rethrows its error if it failed
+	_loading.get();
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+SpectralReflectance::HeroSample sRGB_ReflectanceTexture::sample( size_t i,size_t j, nm lambda_0, size_t level/*=0*/ ) const
+#else
+RGB_Reflectance                 sRGB_ReflectanceTexture::sample( size_t i,size_t j,              size_t level/*=0*/ ) const
+#endif
+{
+	STATS_COUNT(TEXTURE_LOOKUPS);
+
+	//Load sRGB data and convert to floating-point.
+	sRGB_A_U8 const& srgb_u8 = get_texel(i,j,level);
+	sRGB_F32 srgb = sRGB_F32(srgb_u8.r,srgb_u8.g,srgb_u8.b)*(1.0f/255.0f);
+
+	//Undo the gamma transform to get ℓRGB.
+	RGB_Reflectance lrgb = Color::srgb_to_lrgb(srgb);
+
+	#ifdef RENDER_MODE_SPECTRAL
+	//Sample the reflection spectrum corresponding to this ℓRGB triple.  See paper for details on
+	//	what "corresponding" means.
+	STATS_PHASE(SPECTRAL_CONVERSION);
+	return Color::lrgb_to_specrefl(lrgb,lambda_0);
+	#else
+	return                         lrgb;
+	#endif
+}
+#ifdef RENDER_MODE_SPECTRAL
+SpectralReflectance::HeroSample sRGB_ReflectanceTexture::sample( ST const& st,float st_width, nm lambda_0 ) const
+#else
+RGB_Reflectance                 sRGB_ReflectanceTexture::sample( ST const& st,float st_width              ) const
+#endif
+{
+	wait();
+
+	#if 1
+		//Choose the level whose texels are closest in size to the footprint.
+		size_t level = 0;
+		if (st_width>0.0f) {
+			float lod = std::log2( st_width*static_cast<float>(std::max(res[0],res[1])) );
+			if (lod>0.5f) level=std::min( static_cast<size_t>(lod+0.5f), _levels.size()-1 );
+		}
+		_Level const& lvl = _levels[level];
+
+		//Convert from ST space to UV space.
+		UV uv = st * glm::vec2(lvl.res[0],lvl.res[1]);
+
+		//Convert from UV space to index space
+		glm::vec2 index = glm::vec2(
+			             uv.x,
+			lvl.res[1] - uv.y
+		);
+
+		//Convert to integer (clamped nearest-neighbor sample)
+		int i = static_cast<int>(std::floor(index.x));
+		int j = static_cast<int>(std::floor(index.y));
+		i = glm::clamp( i, 0,static_cast<int>(lvl.res[0]-1) );
+		j = glm::clamp( j, 0,static_cast<int>(lvl.res[1]-1) );
+
+		//Sample the texture
+		#ifdef RENDER_MODE_SPECTRAL
+		return sample( static_cast<size_t>(i),static_cast<size_t>(j), lambda_0, level );
+		#else
+		return sample( static_cast<size_t>(i),static_cast<size_t>(j),           level );
+		#endif
+	#else
+		//Return the ST coordinates as a spectral reflectance.
+		return Color::lrgb_to_specrefl(lRGB_F32(st,0),lambda_0);
+	#endif
+}
+
+
+bool MaterialBase::is_emissive() const {
+	#ifdef RENDER_MODE_SPECTRAL
+		return SpectralRadiance::integrate(emission) > 0.0f;
+	#else
+		return emission.r>0.0f || emission.g>0.0f || emission.b>0.0f;
+	#endif
+}
+
+
+#ifdef RENDER_MODE_SPECTRAL
+MaterialSimpleAlbedoBase::MaterialSimpleAlbedoBase(                         ) : mode(MODE::CONSTANT) {
+	albedo.constant = Resources::get_spectrum(SpectralReflectance(1.0f));
+}
+#else
+MaterialSimpleAlbedoBase::MaterialSimpleAlbedoBase(                         ) : mode(MODE::CONSTANT) {
+	albedo.constant = RGB_Reflectance(1.0f);
+}
+#endif
+MaterialSimpleAlbedoBase::MaterialSimpleAlbedoBase(std::string const& path) : mode(MODE::TEXTURE ) {
+	albedo.texture = Resources::get_texture(path);
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+void MaterialSimpleAlbedoBase::set_albedo(SpectralReflectance const& constant) {
+	assert(mode==MODE::CONSTANT);
+	albedo.constant = Resources::get_spectrum(constant);
+}
+#else
+void MaterialSimpleAlbedoBase::set_albedo(RGB_Reflectance     const& constant) {
+	assert(mode==MODE::CONSTANT);
+	albedo.constant = constant;
+}
+#endif
+
+
+void MaterialLambertian::evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const /*override*/ {
+	STATS_COUNT(BSDF_EVALUATE_LAMBERTIAN);
+
+	#ifdef RENDER_MODE_SPECTRAL
+		if (mode==MODE::CONSTANT) evaluation->f_s=(*albedo.constant      )[               evaluation->lambda_0];
+		else                      evaluation->f_s=  albedo.texture->sample(evaluation->st,evaluation->st_width,evaluation->lambda_0);
+	#else
+		if (mode==MODE::CONSTANT) evaluation->f_s=albedo.constant;
+		else                      evaluation->f_s=albedo.texture->sample(evaluation->st,evaluation->st_width);
+	#endif
+	evaluation->f_s /= Constants::pi<float>;
+}
+void MaterialLambertian::interact_bsdf(struct BSDF_Interaction* interaction) const /*override*/ {
+	STATS_COUNT(BSDF_SAMPLE_LAMBERTIAN);
+
+	//Importance-sample the geometry term
+	interaction->w_i = Math::rand_coshemi(interaction->rng,&interaction->pdf_w_i);
+	interaction->w_i = Math::get_rotated_to(interaction->w_i,interaction->N);
+
+	#ifdef RENDER_MODE_SPECTRAL
+		if (mode==MODE::CONSTANT) interaction->f_s=(*albedo.constant      )[                interaction->lambda_0];
+		else                      interaction->f_s=  albedo.texture->sample(interaction->st,interaction->st_width,interaction->lambda_0);
+	#else
+		if (mode==MODE::CONSTANT) interaction->f_s=albedo.constant;
+		else                      interaction->f_s=albedo.texture->sample(interaction->st,interaction->st_width);
+	#endif
+	interaction->f_s /= Constants::pi<float>;
+}
+
+
+void MaterialMirror::evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const /*override*/ {
+	STATS_COUNT(BSDF_EVALUATE_MIRROR);
+
+	//Impossible to hit a Dirac δ function.
+	#ifdef RENDER_MODE_SPECTRAL
+		evaluation->f_s = SpectralRadiance::HeroSample(0.0f);
+	#else
+		evaluation->f_s = RGB_RecipSR                 (0.0f);
+	#endif
+}
+void MaterialMirror::interact_bsdf(struct BSDF_Interaction* interaction) const /*override*/ {
+	STATS_COUNT(BSDF_SAMPLE_MIRROR);
+
+	//Importance-sample the Dirac δ function
+	interaction->w_i = Math::reflect(interaction->w_o,interaction->N);
+	interaction->pdf_w_i = INF;
+
+	//Note: value represents a Dirac δ function.
+	#ifdef RENDER_MODE_SPECTRAL
+		if (mode==MODE::CONSTANT) interaction->f_s=(*albedo.constant      )[                interaction->lambda_0];
+		else                      interaction->f_s=  albedo.texture->sample(interaction->st,interaction->st_width,interaction->lambda_0);
+	#else
+		if (mode==MODE::CONSTANT) interaction->f_s=albedo.constant;
+		else                      interaction->f_s=albedo.texture->sample(interaction->st,interaction->st_width);
+	#endif
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,178 +1,271 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-#include "util/random.hpp"
-
-#include "spectrum.hpp"
-
-
-
-//Texture defining reflectance data
-//	The data is stored in sRGB texels, but using our algorithm (see paper for details) can be
-//	sampled with hero wavelength sampling, returning spectral reflectance on-the-fly.
-class sRGB_ReflectanceTexture final {
-	public:
-		//Resolution
-		size_t res[2];
-
-	private:
-		//Internal data storage stored in scanlines from top to bottom
-		sRGB_U8* _data;
-
-	public:
-		explicit sRGB_ReflectanceTexture(std::string const& path);
-		sRGB_ReflectanceTexture(sRGB_ReflectanceTexture const& other);
-		~sRGB_ReflectanceTexture();
-
-	#ifdef RENDER_MODE_SPECTRAL
-		//Return hero wavelength sample of the texture at the coordinates given by pixel index
-		//	(`i`,`j`) for the hero wavelength `lambda_0`.  Note that scanlines are stored top-to-
-		//	bottom.
-		SpectralReflectance::HeroSample sample( size_t i,size_t j, nm lambda_0 ) const;
-		//Return hero wavelength sample of the texture at the coordinates given by ST coordinate
-		//	`st` for the hero wavelength `lambda_0`.
-		SpectralReflectance::HeroSample sample( ST const& st,      nm lambda_0 ) const;
-	#else
-		//Return RGB sample of the texture at the coordinates given by pixel index (`i`,`j`).  Note
-		//	that scanlines are stored top-to-bottom.
-		RGB_Reflectance                 sample( size_t i,size_t j              ) const;
-		//Return RGB sample of the texture at the coordinates given by ST coordinate `st`.
-		RGB_Reflectance                 sample( ST const& st                   ) const;
-	#endif
-};
-
-
-
-//Material base class
-class MaterialBase {
-	public:
-		//Emission (default zeros).
-		#ifdef RENDER_MODE_SPECTRAL
-			SpectralRadiance emission;
-		#else
-			RGB_Radiance     emission;
-		#endif
-
-		//Encapsulates the state of a BSDF evaluation (that is, given the input, output, and normal
-		//	vectors, return the BSDF's value).
-		struct BSDF_Evaluation  final {
-			ST const st;
-			#ifdef RENDER_MODE_SPECTRAL
-			nm const lambda_0;
-			#endif
-
-			Dir const w_o;
-			Dir const N;
-			Dir const w_i;
-
-			#ifdef RENDER_MODE_SPECTRAL
-				SpectralRadiance::HeroSample f_s;
-			#else
-				RGB_RecipSR                  f_s;
-			#endif
-		};
-		//Encapsulates the state of a BSDF interaction (that is, given the output and normal
-		//	vectors, return a randomly sampled input vector, the PDF of choosing it, and the BSDF's
-		//	value).
-		struct BSDF_Interaction final {
-			ST const st;
-			#ifdef RENDER_MODE_SPECTRAL
-			nm const lambda_0;
-			#endif
-
-			Dir const w_o;
-			Dir const N;
-			Dir w_i; float pdf_w_i; Math::RNG& rng;
-
-			#ifdef RENDER_MODE_SPECTRAL
-				SpectralRadiance::HeroSample f_s;
-			#else
-				RGB_RecipSR                  f_s;
-			#endif
-		};
-
-	protected:
-		MaterialBase() : emission(0.0f) {}
-	public:
-		virtual ~MaterialBase() = default;
-
-	#ifdef RENDER_MODE_SPECTRAL
-		SpectralRadiance::HeroSample evaluate_emission(ST const& st, nm lambda_0, Dir const& w_0) const {
-			return emission[lambda_0];
-		}
-	#else
-		RGB_Radiance                 evaluate_emission(ST const& st,              Dir const& w_0) const {
-			return emission;
-		}
-	#endif
-		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const = 0;
-		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const = 0;
-
-		bool is_emissive() const;
-};
-
-//Material with a simple albedo that can be either a constant (spectrum or RGB, determined by the
-//	rendering mode) or keyed by an sRGB texture.
-class MaterialSimpleAlbedoBase : public MaterialBase {
-	public:
-		enum MODE { CONSTANT, TEXTURE } const mode;
-		union Albedo final {
-			#ifdef RENDER_MODE_SPECTRAL
-			SpectralReflectance*const     constant;
-			#else
-			RGB_Reflectance               constant;
-			#endif
-			sRGB_ReflectanceTexture*const texture;
-
-		#ifdef RENDER_MODE_SPECTRAL
-			Albedo(                                ) : constant(new SpectralReflectance    (1.0f  )) {}
-			Albedo(SpectralReflectance const* other) : constant(new SpectralReflectance    (*other)) {}
-		#else
-			Albedo(                                ) : constant(    RGB_Reflectance        (1.0f  )) {}
-			Albedo(RGB_Reflectance const& other    ) : constant(    RGB_Reflectance        ( other)) {}
-		#endif
-			Albedo(std::string             const& path ) : texture(new sRGB_ReflectanceTexture(path  )) {}
-			Albedo(sRGB_ReflectanceTexture const* other) : texture(new sRGB_ReflectanceTexture(*other)) {}
-		} albedo;
-
-	protected:
-		//Constant albedo
-		         MaterialSimpleAlbedoBase(                                     ) : mode(MODE::CONSTANT), albedo(    ) {}
-		//Albedo keyed by sRGB texture
-		explicit MaterialSimpleAlbedoBase(std::string              const& path ) : mode(MODE::TEXTURE ), albedo(path) {}
-		//Copy from another material
-		         MaterialSimpleAlbedoBase(MaterialSimpleAlbedoBase const& other) :
-			mode(other.mode), albedo(mode==MODE::CONSTANT?Albedo(other.albedo.constant):Albedo(other.albedo.texture))
-		{}
-	public:
-		virtual ~MaterialSimpleAlbedoBase();
-};
-
-//Lambertian material
-class MaterialLambertian final : public MaterialSimpleAlbedoBase {
-	public:
-		//Lambertian material with emission (default zeros) and reflectance (default ones).
-		MaterialLambertian(                       ) : MaterialSimpleAlbedoBase(    ) {}
-		//Lambertian material with emission (default zeros) and spectral reflectance given by image
-		//	loaded from sRGB texture specified by `path`.
-		MaterialLambertian(std::string const& path) : MaterialSimpleAlbedoBase(path) {}
-		virtual ~MaterialLambertian() = default;
-
-		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const override;
-		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const override;
-};
-
-//Mirror material
-class MaterialMirror final : public MaterialSimpleAlbedoBase {
-	public:
-		//Lambertian material with emission (default zeros) and reflectance (default ones).
-		MaterialMirror(                       ) : MaterialSimpleAlbedoBase(    ) {}
-		//Lambertian material with emission (default zeros) and spectral reflectance given by image
-		//	loaded from sRGB texture specified by `path`.
-		MaterialMirror(std::string const& path) : MaterialSimpleAlbedoBase(path) {}
-		virtual ~MaterialMirror() = default;
-
-		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const override;
-		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const override;
-};
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/random.hpp"
+
+#include "spectrum.hpp"
+
+
+class MappedFile;
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Texture defining reflectance data
+//	The data is stored in sRGB texels, but using our algorithm (see paper for details) can be
+//	sampled with hero wavelength sampling, returning spectral reflectance on-the-fly.
+//	A MIP chain is built at load time, so that lookups with a large footprint touch a level with
+//	about one texel per footprint instead of scattering across the full-resolution image.
+//	Texels are padded to four bytes and (if `TEXTURE_TILE_SIZE` is defined) stored in tiles.
+//	Textures load in the background, so that several can be decoded in parallel (and with the rest
+//	of the scene); lookups wait for the texture to finish loading.  Renderers wait for their scene's
+//	textures before rendering (see `Scene::wait_textures()`), so that errors are reported there.
+class sRGB_ReflectanceTexture final {
+	public:
+		//Resolution (valid once loaded; see `.wait()`)
+		size_t res[2];
+
+	private:
+		//MIP level: resolution, and pointer into `._data` of its texels.  Level 0 is the image
+		//	itself, and each subsequent level halves the resolution (rounding down, to a minimum of
+		//	one), with texels box-filtered in linear space.
+		class _Level final { public:
+			size_t res[2];
+			#ifdef TEXTURE_TILE_SIZE
+			size_t num_tiles[2];
+			#endif
+			sRGB_A_U8* data;
+
+			//Number of texels of storage, including padding.
+			size_t get_count() const {
+				#ifdef TEXTURE_TILE_SIZE
+					return num_tiles[1]*num_tiles[0] * (TEXTURE_TILE_SIZE*TEXTURE_TILE_SIZE);
+				#else
+					return res[1]*res[0];
+				#endif
+			}
+			//Index into `.data` of the texel at (`i`,`j`).  Scanlines run top-to-bottom.
+			size_t get_index(size_t i,size_t j) const {
+				#ifdef TEXTURE_TILE_SIZE
+					size_t tile   = (j/TEXTURE_TILE_SIZE)*num_tiles[0] + i/TEXTURE_TILE_SIZE;
+					size_t within = (j%TEXTURE_TILE_SIZE)*TEXTURE_TILE_SIZE + i%TEXTURE_TILE_SIZE;
+					return tile*(TEXTURE_TILE_SIZE*TEXTURE_TILE_SIZE) + within;
+				#else
+					return j*res[0] + i;
+				#endif
+			}
+		};
+		std::vector<_Level> _levels;
+
+		//Internal data storage for all levels (the alpha channel is padding).  Either allocated with
+		//	`Mem::alloc_pages(...)`, or, if `._cache` is non-null, pointing into the mapped cache file.
+		sRGB_A_U8* _data;
+		MappedFile* _cache;
+
+		//Background loading: `._loaded` is set once it has succeeded, and `._loading` completes
+		//	when it has finished (rethrowing the error, if it failed).
+		std::atomic<bool> _loaded;
+		std::shared_future<void> _loading;
+
+		//Load the texture (called on the background thread).
+		void _load(std::string const& path, std::string const& cache_dir);
+		//Decode the image at `path` into owned storage, and build the MIP chain.
+		void _decode(std::string const& path);
+
+		//Compute the levels for resolution `.res`, returning the number of texels of storage needed
+		//	for all of them.
+		size_t _init_levels();
+		//Point the levels into the storage `data`.
+		void _set_data(sRGB_A_U8* data);
+
+		//Map the texture from the cache file at `path`, if it exists and matches `key`.
+		bool _load_cache(std::string const& path, uint64_t key);
+		//Write the (owned) texture to the cache file at `path`.
+		void _save_cache(std::string const& path, uint64_t key) const;
+
+		void _wait() const;
+
+	public:
+		//Start loading the texture from the sRGB image at `path`.  If `cache_dir` is nonempty, the
+		//	decoded texture (with its MIP chain) is cached in that directory, and later runs map it
+		//	directly instead of decoding the image again.  Errors are reported when waiting.
+		explicit sRGB_ReflectanceTexture(std::string const& path, std::string const& cache_dir="");
+		sRGB_ReflectanceTexture(sRGB_ReflectanceTexture const&) = delete;
+		~sRGB_ReflectanceTexture();
+
+		//Wait for the texture to finish loading.  Throws if loading failed.
+		void wait() const {
+			if (!_loaded.load(std::memory_order_acquire)) _wait();
+		}
+
+		size_t get_num_levels() const { wait(); return _levels.size(); }
+
+		//Return the texel at pixel index (`i`,`j`) of MIP level `level`.  Note that scanlines are
+		//	stored top-to-bottom.  The alpha channel is padding.
+		sRGB_A_U8 const& get_texel( size_t i,size_t j, size_t level=0 ) const {
+			wait();
+			_Level const& lvl = _levels[level];
+			return lvl.data[lvl.get_index(i,j)];
+		}
+
+	#ifdef RENDER_MODE_SPECTRAL
+		//Return hero wavelength sample of the texture at the coordinates given by pixel index
+		//	(`i`,`j`) of MIP level `level` for the hero wavelength `lambda_0`.  Note that scanlines
+		//	are stored top-to-bottom.
+		SpectralReflectance::HeroSample sample( size_t i,size_t j, nm lambda_0, size_t level=0 ) const;
+		//Return hero wavelength sample of the texture at the coordinates given by ST coordinate
+		//	`st` for the hero wavelength `lambda_0`.  The MIP level is chosen to match the width of
+		//	the lookup's footprint in ST space, `st_width` (zero for the full-resolution image).
+		SpectralReflectance::HeroSample sample( ST const& st,float st_width, nm lambda_0 ) const;
+	#else
+		//Return RGB sample of the texture at the coordinates given by pixel index (`i`,`j`) of MIP
+		//	level `level`.  Note that scanlines are stored top-to-bottom.
+		RGB_Reflectance                 sample( size_t i,size_t j,              size_t level=0 ) const;
+		//Return RGB sample of the texture at the coordinates given by ST coordinate `st`.  The MIP
+		//	level is chosen to match the width of the lookup's footprint in ST space, `st_width`
+		//	(zero for the full-resolution image).
+		RGB_Reflectance                 sample( ST const& st,float st_width              ) const;
+	#endif
+};
+
+
+
+//Material base class
+class MaterialBase {
+	public:
+		//Emission (default zeros).
+		#ifdef RENDER_MODE_SPECTRAL
+			SpectralRadiance emission;
+		#else
+			RGB_Radiance     emission;
+		#endif
+
+		//Encapsulates the state of a BSDF evaluation (that is, given the input, output, and normal
+		//	vectors, return the BSDF's value).
+		struct BSDF_Evaluation  final {
+			ST const st; float const st_width;
+			#ifdef RENDER_MODE_SPECTRAL
+			nm const lambda_0;
+			#endif
+
+			Dir const w_o;
+			Dir const N;
+			Dir const w_i;
+
+			#ifdef RENDER_MODE_SPECTRAL
+				SpectralRadiance::HeroSample f_s;
+			#else
+				RGB_RecipSR                  f_s;
+			#endif
+		};
+		//Encapsulates the state of a BSDF interaction (that is, given the output and normal
+		//	vectors, return a randomly sampled input vector, the PDF of choosing it, and the BSDF's
+		//	value).
+		struct BSDF_Interaction final {
+			ST const st; float const st_width;
+			#ifdef RENDER_MODE_SPECTRAL
+			nm const lambda_0;
+			#endif
+
+			Dir const w_o;
+			Dir const N;
+			Dir w_i; float pdf_w_i; Math::RNG& rng;
+
+			#ifdef RENDER_MODE_SPECTRAL
+				SpectralRadiance::HeroSample f_s;
+			#else
+				RGB_RecipSR                  f_s;
+			#endif
+		};
+
+	protected:
+		MaterialBase() : emission(0.0f) {}
+	public:
+		virtual ~MaterialBase() = default;
+
+	#ifdef RENDER_MODE_SPECTRAL
+		SpectralRadiance::HeroSample evaluate_emission(ST const& st, nm lambda_0, Dir const& w_0) const {
+			return emission[lambda_0];
+		}
+	#else
+		RGB_Radiance                 evaluate_emission(ST const& st,              Dir const& w_0) const {
+			return emission;
+		}
+	#endif
+		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const = 0;
+		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const = 0;
+
+		bool is_emissive() const;
+};
+
+//Material with a simple albedo that can be either a constant (spectrum or RGB, determined by the
+//	rendering mode) or keyed by an sRGB texture.
+class MaterialSimpleAlbedoBase : public MaterialBase {
+	public:
+		enum MODE { CONSTANT, TEXTURE } const mode;
+		//The albedo data, according to `.mode`.  The spectrum and texture are immutable and shared
+		//	through `Resources`, so copying a material (or loading a texture for several materials)
+		//	doesn't copy them.  To change the albedo, assign a new handle.
+		class Albedo final { public:
+			#ifdef RENDER_MODE_SPECTRAL
+			std::shared_ptr<SpectralReflectance     const> constant;
+			#else
+			RGB_Reflectance                                constant;
+			#endif
+			std::shared_ptr<sRGB_ReflectanceTexture const> texture;
+		} albedo;
+
+	protected:
+		//Constant albedo (ones)
+		         MaterialSimpleAlbedoBase(                                     );
+		//Albedo keyed by sRGB texture
+		explicit MaterialSimpleAlbedoBase(std::string              const& path );
+		//Copy from another material (sharing its albedo data)
+		         MaterialSimpleAlbedoBase(MaterialSimpleAlbedoBase const& other) = default;
+	public:
+		virtual ~MaterialSimpleAlbedoBase() = default;
+
+	#ifdef RENDER_MODE_SPECTRAL
+		//Set a constant albedo (the material must be in `MODE::CONSTANT`).
+		void set_albedo(SpectralReflectance const& constant);
+	#else
+		//Set a constant albedo (the material must be in `MODE::CONSTANT`).
+		void set_albedo(RGB_Reflectance     const& constant);
+	#endif
+};
+
+//Lambertian material
+class MaterialLambertian final : public MaterialSimpleAlbedoBase {
+	public:
+		//Lambertian material with emission (default zeros) and reflectance (default ones).
+		MaterialLambertian(                       ) : MaterialSimpleAlbedoBase(    ) {}
+		//Lambertian material with emission (default zeros) and spectral reflectance given by image
+		//	loaded from sRGB texture specified by `path`.
+		MaterialLambertian(std::string const& path) : MaterialSimpleAlbedoBase(path) {}
+		virtual ~MaterialLambertian() = default;
+
+		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const override;
+		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const override;
+};
+
+//Mirror material
+class MaterialMirror final : public MaterialSimpleAlbedoBase {
+	public:
+		//Lambertian material with emission (default zeros) and reflectance (default ones).
+		MaterialMirror(                       ) : MaterialSimpleAlbedoBase(    ) {}
+		//Lambertian material with emission (default zeros) and spectral reflectance given by image
+		//	loaded from sRGB texture specified by `path`.
+		MaterialMirror(std::string const& path) : MaterialSimpleAlbedoBase(path) {}
+		virtual ~MaterialMirror() = default;
+
+		virtual void evaluate_bsdf(struct BSDF_Evaluation*  evaluation ) const override;
+		virtual void interact_bsdf(struct BSDF_Interaction* interaction) const override;
+};
+
+
+
+RENDER_VARIANT_END
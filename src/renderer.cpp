@@ -1,430 +1,985 @@
-﻿#include "renderer.hpp"
-
-#include "util/color.hpp"
-#include "util/math-helpers.hpp"
-
-#include "geometry.hpp"
-#include "material.hpp"
-#include "scene.hpp"
-
-
-
-Renderer::Renderer(Options const& options) :
-	options(options),
-	framebuffer(options.res)
-{
-	//Load the scene
-	if        (options.scene_name=="cornell"     ) {
-		scene = Scene::get_new_cornell     ();
-		#ifndef EXPLICIT_LIGHT_SAMPLING
-			fprintf(stderr,"Warning: Cornell converges much faster with explicit light sampling!  (See \"stdafx.hpp\" to enable.)\n");
-		#endif
-	} else if (options.scene_name=="cornell-srgb") {
-		scene = Scene::get_new_cornell_srgb();
-		#ifndef EXPLICIT_LIGHT_SAMPLING
-			fprintf(stderr,"Warning: Cornell converges much faster with explicit light sampling!  (See \"stdafx.hpp\" to enable.)\n");
-		#endif
-	} else if (options.scene_name=="plane-srgb"  ) {
-		scene = Scene::get_new_plane_srgb  ();
-		#ifdef EXPLICIT_LIGHT_SAMPLING
-			fprintf(stderr,"Warning: Plane converges much faster without explicit light sampling!  (See \"stdafx.hpp\" to disable.)\n");
-		#endif
-	} else {
-		fprintf(stderr,
-			"Unrecognized scene \"%s\"!  (Supported scenes: \"cornell\", \"cornell-srgb\", \"plane-srgb\")\n",
-			options.scene_name.c_str()
-		);
-		throw -3;
-	}
-
-	//Allocate space for threads
-	#if 0
-		fprintf(stderr,"Warning: only using one thread!\n");
-		_threads.resize(1);
-	#else
-		_threads.resize(std::thread::hardware_concurrency());
-	#endif
-}
-Renderer::~Renderer() {
-	//Cleanup scene
-	delete scene;
-}
-
-void Renderer::_print_progress() const {
-	//Prints `secs` as a count of days, hours, minutes, and seconds.
-	auto pretty_print_time = [](double secs) -> void {
-		double days  = std::floor(secs/86400.0);
-		secs -= 86400.0 * days;
-		double hours = std::floor(secs/ 3600.0);
-		secs -=  3600.0 * hours;
-		double mins  = std::floor(secs/   60.0);
-		secs -=    60.0 * mins;
-
-		if (days>0.0) printf("%d days + ",static_cast<int>(days));
-		printf(
-			"%02d:%02d:%06.3f",
-			static_cast<int>(hours),
-			static_cast<int>(mins ),
-			secs
-		);
-	};
-
-	std::chrono::steady_clock::time_point time_now = std::chrono::steady_clock::now();
-
-	double time_since_start = static_cast<double>(
-		std::chrono::duration_cast<std::chrono::nanoseconds>(time_now-_time_start).count()
-	) * 1.0e-9;
-
-	//Fraction of the tiles that have been rendered (or are being rendered).  So, roughly the
-	//	overall fraction of the render that is completed.
-	double part = static_cast<double>(_num_tiles_start-_tiles.size()) / static_cast<double>(_num_tiles_start);
-
-	if (part<1.0) {
-		if (part>0.0) {
-			//Middle of render.  Print fraction and expected time based on a simple extrapolation.
-			double expected_time_total = time_since_start / part;
-			double expected_time_remaining = expected_time_total - time_since_start;
-			printf("\rRender %.3f%% (ETA ",part*100.0);
-			pretty_print_time(expected_time_remaining);
-			printf(")           ");
-			fflush(stdout);
-		} else {
-			//Start of render.
-			printf("\rRender started                               ");
-		}
-	} else {
-		//End of render.  Print elapsed time.
-		printf("\rRender completed in ");
-		pretty_print_time(time_since_start);
-		printf("             \n");
-	}
-}
-
-#ifdef RENDER_MODE_SPECTRAL
-CIEXYZ_A_32F Renderer::_render_sample(Math::RNG& rng, size_t i,size_t j)
-#else
-lRGB_A_F32   Renderer::_render_sample(Math::RNG& rng, size_t i,size_t j)
-#endif
-{
-	//Render sample within pixel (`i`,`j`).
-
-	//	Location within the framebuffer
-	//		Compute with `double`-precision, which helps for large framebuffers.
-	glm::dvec2 subpixel(rand_1d(rng),rand_1d(rng));
-	glm::dvec2 framebuffer_st(
-		(static_cast<double>(i)+subpixel.x) / static_cast<double>(framebuffer.res[0]),
-		(static_cast<double>(j)+subpixel.y) / static_cast<double>(framebuffer.res[1])
-	);
-	//	Normalized device coordinates (to borrow OpenGL terminology)
-	glm::dvec2 framebuffer_ndc = framebuffer_st*2.0 - glm::dvec2(1.0);
-
-	//	Camera ray through pixel.  This is a pinhole camera model (bad) with the framebuffer
-	//		semantically in-front of the center of projection (bogus).  Nevertheless, it is just-
-	//		about the simplest-possible camera model.
-	//		Note: this, and especially the normalize, must be computed in `double`-precision.  GLM
-	//			decides to use inverse square root to normalize, which means lots of precision is
-	//			lost, leading to stair-step artifacts.
-	Dir camera_ray_dir;
-	{
-		glm::dvec4 point = scene->camera.matr_PV_inv * glm::dvec4( framebuffer_ndc, 0.0, 1.0 );
-		point /= point.w;
-		camera_ray_dir = Dir(glm::normalize( glm::dvec3(point) - glm::dvec3(scene->camera.pos) ));
-	}
-
-	#ifdef RENDER_MODE_SPECTRAL
-	//	Hero wavelength sampling.
-	//		First, the spectrum is divided into some number of regions.  Then, the hero wavelength
-	//			is selected randomly from the first region.
-	nm lambda_0 = LAMBDA_MIN + rand_1f(rng)*LAMBDA_STEP;
-	//		Subsequent wavelengths are defined implicitly as multiples of `LAMBDA_STEP` above
-	//			`lambda_0`.  The vector of these wavelengths are the wavelengths that the light
-	//			transport is computed along.
-	#endif
-
-	//	Main radiance-gathering function used for recursive path tracing
-	bool hit_anything = false;
-	#ifdef RENDER_MODE_SPECTRAL
-	std::function<SpectralRadiance::HeroSample(Ray const&,bool,unsigned,PrimBase const*)> L = [&](
-		Ray const& ray, bool last_was_delta, unsigned depth, PrimBase const* ignore
-	) -> SpectralRadiance::HeroSample
-	#else
-	std::function<RGB_Radiance(Ray const&,bool,unsigned,PrimBase const*)> L = [&](
-		Ray const& ray, bool last_was_delta, unsigned depth, PrimBase const* ignore
-	) -> RGB_Radiance
-	#endif
-	{
-		#ifdef RENDER_MODE_SPECTRAL
-		SpectralRadiance::HeroSample radiance(0);
-		#else
-		RGB_Radiance                 radiance(0);
-		#endif
-
-		HitRecord hitrec;
-		if (scene->intersect( ray,&hitrec, ignore )) {
-			hit_anything = true;
-
-			//Emission
-			#ifdef EXPLICIT_LIGHT_SAMPLING
-			//Only add if could not have been sampled on previous)
-			if (last_was_delta&&(!options.indirect_only||depth>0u)) {
-			#endif
-				auto emitted_radiance = hitrec.prim->material->evaluate_emission( hitrec.st, SPECTRAL_ONLY(lambda_0 COMMA) -ray.dir );
-				radiance += emitted_radiance;
-			#ifdef EXPLICIT_LIGHT_SAMPLING
-			}
-			#endif
-
-			//If more rays are allowed . . .
-			if (depth+1u<MAX_DEPTH) {
-				//Hit position of ray
-				Pos hit_pos = ray.at(hitrec.dist);
-
-				#ifdef EXPLICIT_LIGHT_SAMPLING
-				//Direct lighting
-				if (!options.indirect_only||depth>0u) {
-					//Get random ray toward random light
-					Dir shad_ray_dir;
-					PrimBase const* light;
-					float shad_pdf;
-					scene->get_rand_toward_light( rng, hit_pos, &shad_ray_dir,&light,&shad_pdf );
-
-					float n_dot_l = glm::dot(shad_ray_dir,hitrec.normal);
-					if (n_dot_l>0.0f) {
-						//Cast the shadow ray
-						Ray ray_shad = { hit_pos, shad_ray_dir };
-						HitRecord hitrec_shad;
-						scene->intersect(ray_shad,&hitrec_shad,hitrec.prim);
-
-						if (hitrec_shad.prim == light) {
-							//If the only thing we hit was the light we were shooting at, then we're
-							//	not shadowed.  Add the radiance contribution.
-
-							//	Emitted radiance
-							auto emitted_radiance = hitrec_shad.prim->material->evaluate_emission(
-								hitrec_shad.st, SPECTRAL_ONLY(lambda_0 COMMA) -shad_ray_dir
-							);
-
-							//	Evaluation of BSDF
-							struct MaterialBase::BSDF_Evaluation evalbsdf = {
-								hitrec.st, SPECTRAL_ONLY(lambda_0 COMMA)
-								-ray.dir, hitrec.normal, shad_ray_dir,
-								{}
-							};
-							hitrec.prim->material->evaluate_bsdf(&evalbsdf);
-
-							//	Monte Carlo radiance estimate
-							radiance += emitted_radiance * n_dot_l * evalbsdf.f_s / shad_pdf;
-						}
-					}
-				}
-				#endif
-
-				//Indirect lighting
-				//	Random sample from BSDF
-				struct MaterialBase::BSDF_Interaction sampbsdf = {
-					hitrec.st, SPECTRAL_ONLY(lambda_0 COMMA)
-					-ray.dir, hitrec.normal, Dir(qNaN), qNaN, rng,
-					{}
-				};
-				hitrec.prim->material->interact_bsdf(&sampbsdf);
-				//	Recurse in sampled direction if BSDF is nonzero
-				if (glm::dot(sampbsdf.f_s,sampbsdf.f_s)>0.0f) {
-					//	And if the direction has nonzero contribution via the geometry term.
-					float n_dot_l;
-					if (std::isfinite(sampbsdf.pdf_w_i)) {
-						n_dot_l = glm::dot(sampbsdf.w_i,hitrec.normal);
-					} else {
-						//		Dirac δ function.  BSDFs that are δ functions are posed having an
-						//			inverse geometry term so that it cancels out in the rendering
-						//			equation.  Instead of doing that, it's more numerically precise
-						//			to just ignore the geometry term entirely.
-						n_dot_l = 1.0f;
-						sampbsdf.pdf_w_i = 1.0f;
-					}
-					if (n_dot_l>0.0f) {
-						//Trace the ray recursively and use in Monte-Carlo estimate of rendering
-						//	equation.
-						Ray ray_next = { hit_pos, sampbsdf.w_i };
-						radiance += L(ray_next,false,depth+1u,hitrec.prim) * n_dot_l * sampbsdf.f_s / sampbsdf.pdf_w_i;
-					}
-				}
-			}
-		}
-
-		return radiance;
-	};
-
-	Ray ray_camera = { scene->camera.pos, camera_ray_dir };
-	auto pixel_rad_est = L(ray_camera,true,0u,nullptr);
-
-	//Value of Monte-Carlo estimator for the radiant flux incident on the pixel due to paths of any
-	//	length.
-	#ifdef FLAT_FIELD_CORRECTION
-		auto pixel_flux_est = pixel_rad_est;
-	#else
-		auto pixel_flux_est = pixel_rad_est * glm::dot( camera_ray_dir, scene->camera.dir );
-	#endif
-
-	#ifdef RENDER_MODE_SPECTRAL
-		//Convert each wavelength sample to CIE XYZ and average.
-		CIEXYZ_32F ciexyz_avg = Color::specradflux_to_ciexyz( pixel_flux_est, lambda_0 );
-
-		return CIEXYZ_A_32F( ciexyz_avg,     hit_anything?1.0f:0.0f );
-	#else
-		//Die inside.
-		return lRGB_A_F32  ( pixel_flux_est, hit_anything?1.0f:0.0f );
-	#endif
-}
-void       Renderer::_render_pixel (Math::RNG& rng, size_t i,size_t j) {
-	#ifdef RENDER_MODE_SPECTRAL
-		/*
-		Accumulate samples into CIE XYZ instead of a spectrum (probably `SpectralRadiantFlux`).
-		This way we avoid quantization artifacts and a large memory overhead per-pixel (in a more-
-		sophisticated renderer, the pixel data would be stored for longer, e.g. to do nontrivial
-		reconstruction filtering), for the (small) cost of having to do the conversion to CIE XYZ
-		for each sample.
-
-		Note accumulating must be into a 64-bit value is necessary to have adequate precision for
-		high sample counts.  We also scale the values before accumulating them to keep the precision
-		in a better range.
-		*/
-
-		CIEXYZ_A_64F avg( 0,0,0, 0 );
-		for (size_t k=0;k<options.spp;++k) {
-			avg += _render_sample(rng, i,j) * 0.001f;
-		}
-		avg *= 1000.0 / static_cast<double>(options.spp);
-
-		framebuffer(i,j) = sRGB_A_F32( Color::ciexyz_to_srgb(CIEXYZ_32F(avg)), avg.a );
-	#else
-		lRGB_A_F64   avg( 0,0,0, 0 );
-		for (size_t k=0;k<options.spp;++k) {
-			avg += _render_sample(rng, i,j);
-		}
-		avg /= static_cast<double>(options.spp);
-
-		framebuffer(i,j) = sRGB_A_F32( Color::lrgb_to_srgb  (lRGB_F32  (avg)), avg.a );
-	#endif
-}
-void Renderer::_render_threadwork() {
-	//Add ourself to the count of rendering threads
-	uint32_t thread_index = _num_rendering++;
-
-	/*
-	Random number generator for each thread.  Note that this must be per-thread data; making it
-	threadsafe and shared would be too slow, and making it simply shared (which is, unfortunately,
-	what many simplistic implementations do with e.g. `rand()`) risks producing bogus results due to
-	race conditions.
-
-	There are several ways to make thread local variables (such as e.g. C++ `thread_local`), but
-	just making a local variable in the thread function is probably the clearest, if not the
-	cleanest.
-	*/
-	Math::RNG rng;
-	/*
-	Seed the RNG with some kind of data.  Since many RNGs will produce similar starting sequences
-	given similar seeds, and it is desirable for different threads to have different sequences, it
-	is desirable for seeds to vary substantially between threads.
-
-	A simple way to do this is to scramble the thread's index with a hash function, though on some
-	platforms `std::hash` is the identity so we have to implement this ourselves to ensure it
-	actually works.  Passing zero for the seed is also not allowed, so we choose `1` if that's the
-	case.  Note that that potential increment comes after the hashing, so it is not particularly
-	likely to result in two threads receiving the same seed.
-	*/
-	size_t seed = get_hashed(thread_index);
-	if (seed==0) ++seed;
-	rng.seed(static_cast<Math::RNG::result_type>(seed));
-
-	//Main render thread loop
-	while (_render_continue) {
-		//Atomically pull the next tile of un-rendered pixels off the list of un-rendered tiles.  If
-		//	there are none, terminate the loop.  Also print the progress (inside the mutex so that
-		//	it's threadsafe) every 10ms.
-
-		Framebuffer::Tile tile;
-
-		std::chrono::steady_clock::time_point time_now = std::chrono::steady_clock::now();
-
-		_tiles_mutex.lock();
-
-		if (!_tiles.empty()) {
-			float time_since_last_print = static_cast<float>(
-				std::chrono::duration_cast<std::chrono::nanoseconds>(time_now-_time_last_print).count()
-			) * 1.0e-9f;
-			if (time_since_last_print>0.01f) {
-				_print_progress();
-				_time_last_print = time_now;
-			}
-
-			tile = _tiles.back();
-			_tiles.pop_back();
-
-			_tiles_mutex.unlock();
-		} else {
-			_tiles_mutex.unlock();
-
-			//	Minor optimization
-			_render_continue = false;
-
-			break;
-		}
-
-		//Render each pixel of the tile
-		for (size_t j=tile.pos[1];j<tile.pos[1]+tile.res[1];++j) {
-			for (size_t i=tile.pos[0];i<tile.pos[0]+tile.res[0];++i) {
-				_render_pixel(rng, i,j);
-			}
-		}
-	}
-
-	//Remove ourself from the count of rendering threads
-	assert(_num_rendering>0u);
-	--_num_rendering;
-
-	//If we're the last thread to finish, no threads can be touching the image anymore.  We are
-	//	responsible for removing any un-rendered tiles (such as if the render was aborted) and
-	//	saving the image to disk.
-	if (_num_rendering==0u) {
-		_tiles.clear();
-
-		_print_progress();
-
-		framebuffer.save(options.output_path);
-	}
-}
-void Renderer::render_start() {
-	//Create the list of tiles of un-rendered pixels
-	assert(_tiles.empty());
-	for (size_t j=0;j<options.res[1];j+=TILE_SIZE) {
-		for (size_t i=0;i<options.res[0];i+=TILE_SIZE) {
-			_tiles.push_back({
-				{ i, j },
-				{ std::min(options.res[0]-i,TILE_SIZE), std::min(options.res[1]-j,TILE_SIZE) }
-			});
-		}
-	}
-	//	Rearrange so that the lower tiles are at the end of the list (and thereby are pulled off and
-	//		rendered first).
-	std::reverse(_tiles.begin(),_tiles.end());
-
-	//Starting information for timing
-	_num_tiles_start = _tiles.size();
-	_time_start      = std::chrono::steady_clock::now();
-	_time_last_print = _time_start - std::chrono::seconds(1);
-
-	//Create render threads (which also starts them working)
-	_num_rendering = 0u;
-	_render_continue = true;
-	for (std::thread*& thread : _threads) {
-		thread = new std::thread( &Renderer::_render_threadwork, this );
-	}
-}
-void Renderer::render_wait () {
-	//Wait for each render thread to terminate and clean up
-	for (std::thread* thread : _threads) {
-		thread->join();
-		delete thread;
-	}
-	assert(_num_rendering==0u);
-}
+﻿#include "renderer.hpp"
+
+#include "util/color.hpp"
+#include "util/mapped-file.hpp"
+#include "util/math-helpers.hpp"
+
+#include "environment.hpp"
+#include "geometry.hpp"
+#include "material.hpp"
+#include "resources.hpp"
+#include "scene.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Version of the checkpoint file format.  Increment whenever the format, or how a render's result
+//	depends on its inputs (e.g. the seeding of tiles), changes.
+#define CHECKPOINT_VERSION 3u
+
+
+
+//Resolution of the framebuffers for `options`.  They are unused (and so empty) when streaming, or
+//	when there's no output to save (as when rendering into memory).
+static size_t const _no_res[2] = { 0, 0 };
+static size_t const* _get_framebuffer_res(Renderer::Options const& options) {
+	bool unused = options.stream || ( options.output_path.empty() && options.frames.empty() );
+	return unused ? _no_res : options.res;
+}
+
+
+
+Renderer::Renderer(Options const& options, Scene* scene/*=nullptr*/) :
+	options(options),
+	framebuffer(_get_framebuffer_res(options)),
+	scene(scene!=nullptr ? scene : get_new_scene(options)),
+	_owned_scene(scene==nullptr ? this->scene : nullptr),
+	_output_path(options.output_path),
+	_framebuffer_saving(_get_framebuffer_res(options)),
+	_stream(nullptr),
+	_range{ { 0,options.res[1] }, { 0,options.spp } }, _sums(nullptr), _target(nullptr),
+	_frame_index(0), _frame_done(true), _exit(false),
+	_checkpoint(nullptr), _checkpoint_done(nullptr), _checkpoint_sums(nullptr)
+{
+	//Wait for the scene's textures, so that an error loading one is reported here, on the calling
+	//	thread, rather than on whichever render thread first looks it up.
+	this->scene->wait_textures();
+
+	camera = _get_camera(options.camera);
+
+	//Choose the specialization of the integrator
+	switch (options.integrator.light_sampling) {
+		case Options::Integrator::LIGHT_SAMPLING::SCENE:    _explicit_light_sampling=this->scene->explicit_light_sampling; break;
+		case Options::Integrator::LIGHT_SAMPLING::EXPLICIT: _explicit_light_sampling=true;                                 break;
+		case Options::Integrator::LIGHT_SAMPLING::IMPLICIT: _explicit_light_sampling=false;                                break;
+	}
+	if (_explicit_light_sampling!=this->scene->explicit_light_sampling) {
+		fprintf(stderr,
+			"Warning: the scene converges much faster %s explicit light sampling!\n",
+			this->scene->explicit_light_sampling ? "with" : "without"
+		);
+	}
+	static decltype(_render_pixel_specialized) const specializations[2][2] = {
+		{ &Renderer::_render_pixel<false,false>, &Renderer::_render_pixel<false,true> },
+		{ &Renderer::_render_pixel<true, false>, &Renderer::_render_pixel<true, true> }
+	};
+	_render_pixel_specialized = specializations[_explicit_light_sampling][options.integrator.flat_field_correction];
+
+	//Performance counters are opened by each worker thread, for itself.  Report which are
+	//	available here.
+	if (options.perf_counters) {
+		#ifdef RENDER_STATISTICS
+		PerfCounters probe;
+		if (probe.get_source()!=PerfCounters::SOURCE::HARDWARE) {
+			fprintf(stderr,
+				"Warning: hardware performance counters are unavailable; using %s counters instead!\n",
+				PerfCounters::get_source_name(probe.get_source())
+			);
+		}
+		#else
+		fprintf(stderr,"Warning: performance counters require a build with `RENDER_STATISTICS`; ignoring!\n");
+		#endif
+	}
+
+	if (options.pixel_costs) _pixel_costs.resize( options.res[0]*options.res[1] );
+
+	if (!options.checkpoint_path.empty()) _open_checkpoint();
+
+	//Create the worker threads, which wait for the first frame
+	#if 0
+		fprintf(stderr,"Warning: only using one thread!\n");
+		_threads.resize(1);
+	#else
+		_threads.resize(std::max(std::thread::hardware_concurrency(),1u));
+	#endif
+	_num_rendering = 0u;
+	_num_rays = 0u;
+	_save_failed = false;
+	_render_continue = false;
+	for (size_t k=0;k<_threads.size();++k) {
+		_threads[k] = new std::thread( &Renderer::_render_threadwork, this );
+	}
+}
+Renderer::~Renderer() {
+	//Stop the worker threads and clean up
+	{
+		std::lock_guard<std::mutex> lock(_frame_mutex);
+		assert(_frame_done);
+		_exit = true;
+	}
+	_frame_cv.notify_all();
+	for (std::thread* thread : _threads) {
+		thread->join();
+		delete thread;
+	}
+	if (_saving.valid()) _saving.wait();
+
+	delete _stream;
+	delete _checkpoint;
+
+	//(An owned scene is deleted with `._owned_scene`.)
+}
+
+Scene* Renderer::get_new_scene(Options const& options) {
+	//Load the scene.  Its textures finish loading in the background.
+	Scene* scene;
+	Resources::set_texture_cache_dir(options.texture_cache_dir);
+	if        (options.scene_name=="cornell"     ) {
+		scene = Scene::get_new_cornell     (options.bvh);
+	} else if (options.scene_name=="cornell-srgb") {
+		scene = Scene::get_new_cornell_srgb(options.bvh);
+	} else if (options.scene_name=="plane-srgb"  ) {
+		scene = Scene::get_new_plane_srgb  (options.bvh);
+	} else if (options.scene_name=="instances"   ) {
+		scene = Scene::get_new_instances   (options.bvh);
+	} else {
+		fprintf(stderr,
+			"Unrecognized scene \"%s\"!  (Supported scenes: \"cornell\", \"cornell-srgb\", \"plane-srgb\", \"instances\")\n",
+			options.scene_name.c_str()
+		);
+		throw -3;
+	}
+	//	Replace its environment, if requested.  (If the map can't be loaded, the scene is freed
+	//		before reporting it.)
+	if (!options.envmap_path.empty()) {
+		EnvironmentLight* environment;
+		try {
+			environment = new EnvironmentLight(options.envmap_path);
+		} catch (...) {
+			delete scene;
+			throw;
+		}
+		delete scene->environment;
+		scene->environment = environment;
+	}
+
+	return scene;
+}
+
+Scene::Camera Renderer::_get_camera(CameraOverride const& overrides) const {
+	//With an override, the projection also takes the aspect ratio of the render, since the view
+	//	is no longer the scene's own.
+	Scene::Camera result = scene->camera;
+	if (overrides.pos_given||overrides.target_given||overrides.vfov_given) {
+		if (overrides.pos_given   ) result.pos      = overrides.pos;
+		if (overrides.target_given) result.dir      = glm::normalize( overrides.target - result.pos );
+		if (overrides.vfov_given  ) result.vfov_deg = overrides.vfov_deg;
+		result.res[0] = options.res[0];
+		result.res[1] = options.res[1];
+		result.update_matrices();
+	}
+	return result;
+}
+
+/*
+Checkpoint file layout.  All values are in native byte order; files from another platform are
+rejected by the check on `.byte_order`.
+
+	_CheckpointHeader
+	`uint8_t`    × `.num_tiles`            (at `.offset_done`; nonzero for complete tiles)
+	`glm::dvec4` × `.res[0]`⨯`.res[1]`     (at `.offset_sums`, aligned to a page; scanline order)
+*/
+class _CheckpointHeader final {
+	public:
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint64_t key;
+		uint64_t res[2];
+		uint64_t num_tiles;
+		uint64_t offset_done;
+		uint64_t offset_sums;
+};
+static_assert(sizeof(_CheckpointHeader)==64,"Implementation error!");
+static char const _checkpoint_magic[8] = { 'S','S','-','C','K','P','T','\0' };
+
+void Renderer::_open_checkpoint() {
+	//The result depends on the configuration, the scene, the camera, and the sampling, so those
+	//	are the key.  Hash them with 64-bit FNV-1a, as for BVH caches.
+	uint64_t hash = 14695981039346656037ull;
+	auto add_bytes = [&](void const* bytes, size_t count) -> void {
+		for (size_t i=0;i<count;++i) {
+			hash ^= static_cast<uint64_t>(static_cast<uint8_t const*>(bytes)[i]);
+			hash *= 1099511628211ull;
+		}
+	};
+	uint64_t header[10] = {
+		CHECKPOINT_VERSION, TILE_SIZE,
+		#ifdef RENDER_MODE_SPECTRAL
+		RENDER_MODE_SPECTRAL_ALGNUM, SAMPLE_WAVELENGTHS, CIE_OBSERVER,
+		#else
+		0, 0, 0,
+		#endif
+		_explicit_light_sampling?1ull:0ull, options.integrator.max_depth, options.integrator.flat_field_correction?1ull:0ull,
+		options.spp, options.indirect_only?1ull:0ull
+	};
+	add_bytes( header, sizeof(header) );
+	add_bytes( options.scene_name .c_str(), options.scene_name .size()+1 );
+	add_bytes( options.envmap_path.c_str(), options.envmap_path.size()+1 );
+	add_bytes( &camera.matr_PV_inv[0][0], 16*sizeof(double) );
+	double pos[3] = { camera.pos.x, camera.pos.y, camera.pos.z };
+	add_bytes( pos, sizeof(pos) );
+	uint64_t key = hash;
+
+	size_t num_tiles   = ( (options.res[0]+TILE_SIZE-1)/TILE_SIZE ) * ( (options.res[1]+TILE_SIZE-1)/TILE_SIZE );
+	size_t offset_sums = ( sizeof(_CheckpointHeader)+num_tiles + 4095 ) / 4096 * 4096;
+	size_t size        = offset_sums + options.res[1]*options.res[0]*sizeof(glm::dvec4);
+
+	if (options.resume) {
+		MappedFile* file = new MappedFile( options.checkpoint_path, MappedFile::MODE::READ_WRITE );
+		if (file->is_valid()) {
+			//Validate.  Unlike caches, a checkpoint that doesn't match is an error, since it is
+			//	probably for some other render, and continuing would overwrite it.
+			_CheckpointHeader const* header = static_cast<_CheckpointHeader const*>(file->get_data());
+			bool valid =
+				file->get_size() == size &&
+				std::memcmp(header->magic,_checkpoint_magic,8)==0 &&
+				header->version     == CHECKPOINT_VERSION &&
+				header->byte_order  == 0x01020304u &&
+				header->key         == key &&
+				header->res[0]      == options.res[0] &&
+				header->res[1]      == options.res[1] &&
+				header->num_tiles   == num_tiles &&
+				header->offset_done == sizeof(_CheckpointHeader) &&
+				header->offset_sums == offset_sums
+			;
+			if (!valid) {
+				fprintf(stderr,
+					"Checkpoint \"%s\" is invalid, or is for a different render!\n",
+					options.checkpoint_path.c_str()
+				);
+				delete file;
+				throw -1;
+			}
+			_checkpoint = file;
+		} else {
+			fprintf(stderr,
+				"Warning: checkpoint \"%s\" not found; starting the render from the beginning!\n",
+				options.checkpoint_path.c_str()
+			);
+			delete file;
+		}
+	}
+	if (_checkpoint==nullptr) {
+		MappedFile* file = new MappedFile( options.checkpoint_path, MappedFile::MODE::CREATE, size );
+		if (!file->is_valid()) {
+			fprintf(stderr,"Could not create checkpoint \"%s\"!\n",options.checkpoint_path.c_str());
+			delete file;
+			throw -1;
+		}
+
+		//The file is created zero-filled, so all tiles are incomplete.
+		_CheckpointHeader* header = static_cast<_CheckpointHeader*>(file->get_data());
+		std::memcpy(header->magic,_checkpoint_magic,8);
+		header->version     = CHECKPOINT_VERSION;
+		header->byte_order  = 0x01020304u;
+		header->key         = key;
+		header->res[0]      = options.res[0];
+		header->res[1]      = options.res[1];
+		header->num_tiles   = num_tiles;
+		header->offset_done = sizeof(_CheckpointHeader);
+		header->offset_sums = offset_sums;
+		file->flush();
+		_checkpoint = file;
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(_checkpoint->get_data());
+	_checkpoint_done = data + sizeof(_CheckpointHeader);
+	_checkpoint_sums = reinterpret_cast<glm::dvec4*>( data + offset_sums );
+	_time_last_flush = std::chrono::steady_clock::now();
+}
+
+size_t Renderer::_get_tile_index(Framebuffer::Tile const& tile) const {
+	size_t num_tiles_x = ( options.res[0] + TILE_SIZE-1 ) / TILE_SIZE;
+	return (tile.pos[1]/TILE_SIZE)*num_tiles_x + tile.pos[0]/TILE_SIZE;
+}
+
+void Renderer::_print_progress() const {
+	//Prints `secs` as a count of days, hours, minutes, and seconds.
+	auto pretty_print_time = [](double secs) -> void {
+		double days  = std::floor(secs/86400.0);
+		secs -= 86400.0 * days;
+		double hours = std::floor(secs/ 3600.0);
+		secs -=  3600.0 * hours;
+		double mins  = std::floor(secs/   60.0);
+		secs -=    60.0 * mins;
+
+		if (days>0.0) printf("%d days + ",static_cast<int>(days));
+		printf(
+			"%02d:%02d:%06.3f",
+			static_cast<int>(hours),
+			static_cast<int>(mins ),
+			secs
+		);
+	};
+
+	std::chrono::steady_clock::time_point time_now = std::chrono::steady_clock::now();
+
+	double time_since_start = static_cast<double>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(time_now-_time_start).count()
+	) * 1.0e-9;
+
+	//Fraction of the tiles that have been rendered (or are being rendered).  So, roughly the
+	//	overall fraction of the render that is completed.
+	double part = static_cast<double>(_num_tiles_start-_tiles.size()) / static_cast<double>(_num_tiles_start);
+
+	if (part<1.0) {
+		if (part>0.0) {
+			//Middle of render.  Print fraction and expected time based on a simple extrapolation.
+			double expected_time_total = time_since_start / part;
+			double expected_time_remaining = expected_time_total - time_since_start;
+			printf("\rRender %.3f%% (ETA ",part*100.0);
+			pretty_print_time(expected_time_remaining);
+			printf(")           ");
+			fflush(stdout);
+		} else {
+			//Start of render.
+			printf("\rRender started                               ");
+		}
+	} else {
+		//End of render.  Print elapsed time.
+		printf("\rRender completed in ");
+		pretty_print_time(time_since_start);
+		printf("             \n");
+	}
+}
+//Path `path` without its extension (for the paths of files saved next to an image)
+inline static std::string _get_path_stem(std::string const& path) {
+	size_t slash = path.find_last_of("/\\");
+	size_t dot   = path.find_last_of('.');
+	if (dot!=path.npos && slash!=path.npos && dot<slash) dot=path.npos;
+	return path.substr(0,dot);
+}
+#ifdef RENDER_STATISTICS
+void Renderer::_save_statistics() const {
+	std::string path = _get_path_stem(_output_path) + ".stats.json";
+
+	FILE* file = fopen(path.c_str(),"w");
+	if (file!=nullptr); else {
+		fprintf(stderr,"Could not open \"%s\" for writing!\n",path.c_str());
+		return;
+	}
+	double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - _time_start ).count();
+	_stats.write_json( file, seconds, _threads.size() );
+	fclose(file);
+}
+#endif
+bool Renderer::_save_pixel_costs() const {
+	std::string stem = _get_path_stem(_output_path);
+	std::vector<float> values(_pixel_costs.size());
+	for (auto [name,member] : {
+		std::make_pair( ".cost-time.pfm",        &PixelCost::time_us     ),
+		std::make_pair( ".cost-rays.pfm",        &PixelCost::rays        ),
+		std::make_pair( ".cost-path-length.pfm", &PixelCost::path_length )
+	}) {
+		for (size_t k=0;k<values.size();++k) values[k]=_pixel_costs[k].*member;
+		if (!save_pfm_channel( stem+name, values.data(), options.res )) return false;
+	}
+	return true;
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+template <bool explicit_light_sampling, bool flat_field_correction>
+CIEXYZ_A_32F Renderer::_render_sample(Math::RNG& rng, size_t i,size_t j, unsigned* path_segments)
+#else
+template <bool explicit_light_sampling, bool flat_field_correction>
+lRGB_A_F32   Renderer::_render_sample(Math::RNG& rng, size_t i,size_t j, unsigned* path_segments)
+#endif
+{
+	//Render sample within pixel (`i`,`j`).
+
+	//	Location within the framebuffer
+	//		Compute with `double`-precision, which helps for large framebuffers.
+	glm::dvec2 subpixel(rand_1d(rng),rand_1d(rng));
+	glm::dvec2 framebuffer_st(
+		(static_cast<double>(i)+subpixel.x) / static_cast<double>(options.res[0]),
+		(static_cast<double>(j)+subpixel.y) / static_cast<double>(options.res[1])
+	);
+	//	Normalized device coordinates (to borrow OpenGL terminology)
+	glm::dvec2 framebuffer_ndc = framebuffer_st*2.0 - glm::dvec2(1.0);
+
+	//	Camera ray through pixel.  This is a pinhole camera model (bad) with the framebuffer
+	//		semantically in-front of the center of projection (bogus).  Nevertheless, it is just-
+	//		about the simplest-possible camera model.
+	//		Note: this, and especially the normalize, must be computed in `double`-precision.  GLM
+	//			decides to use inverse square root to normalize, which means lots of precision is
+	//			lost, leading to stair-step artifacts.
+	Dir camera_ray_dir;
+	{
+		glm::dvec4 point = camera.matr_PV_inv * glm::dvec4( framebuffer_ndc, 0.0, 1.0 );
+		point /= point.w;
+		camera_ray_dir = Dir(glm::normalize( glm::dvec3(point) - glm::dvec3(camera.pos) ));
+	}
+
+	#ifdef RENDER_MODE_SPECTRAL
+	//	Hero wavelength sampling.
+	//		First, the spectrum is divided into some number of regions.  Then, the hero wavelength
+	//			is selected randomly from the first region.
+	nm lambda_0 = LAMBDA_MIN + rand_1f(rng)*LAMBDA_STEP;
+	//		Subsequent wavelengths are defined implicitly as multiples of `LAMBDA_STEP` above
+	//			`lambda_0`.  The vector of these wavelengths are the wavelengths that the light
+	//			transport is computed along.
+	#endif
+
+	//	Footprint of the sample, for filtering textures.  Each path is treated as a cone (e.g.
+	//		"Texture Level of Detail Strategies for Real-Time Ray Tracing", Akenine-Möller et al.
+	//		2019) whose apex is the camera and whose spread angle is that of a pixel.  The cone
+	//		isn't widened by bounces, so it approximates the camera's footprint at each vertex, as
+	//		for a chain of flat mirrors.  Since the samples within a pixel also average over the
+	//		texture, the cone is narrowed as the sample count increases.
+	float cone_spread = glm::radians(camera.vfov_deg) / static_cast<float>(options.res[1]);
+	cone_spread *= std::max( 0.125f, 1.0f/std::sqrt(static_cast<float>(options.spp)) );
+
+	//	Main radiance-gathering function used for recursive path tracing
+	bool hit_anything = false;
+	#ifdef RENDER_MODE_SPECTRAL
+	std::function<SpectralRadiance::HeroSample(Ray const&,Dist,bool,unsigned,PrimBase const*,PrimInstance const*)> L = [&](
+		Ray const& ray, Dist path_length, bool last_was_delta, unsigned depth, PrimBase const* ignore,PrimInstance const* ignore_instance
+	) -> SpectralRadiance::HeroSample
+	#else
+	std::function<RGB_Radiance(Ray const&,Dist,bool,unsigned,PrimBase const*,PrimInstance const*)> L = [&](
+		Ray const& ray, Dist path_length, bool last_was_delta, unsigned depth, PrimBase const* ignore,PrimInstance const* ignore_instance
+	) -> RGB_Radiance
+	#endif
+	{
+		#ifdef RENDER_MODE_SPECTRAL
+		SpectralRadiance::HeroSample radiance(0);
+		#else
+		RGB_Radiance                 radiance(0);
+		#endif
+
+		//	(Since paths don't branch, except for shadow rays, the last segment traced is the
+		//		deepest.)
+		*path_segments = depth + 1u;
+
+		HitRecord hitrec;
+		if (scene->intersect( ray,&hitrec, ignore,ignore_instance )) {
+			hit_anything = true;
+
+			//Emission (with explicit light sampling, only added if it could not have been sampled
+			//	at the previous vertex)
+			if (!explicit_light_sampling||( last_was_delta&&(!options.indirect_only||depth>0u) )) {
+				auto emitted_radiance = hitrec.material->evaluate_emission( hitrec.st, SPECTRAL_ONLY(lambda_0 COMMA) -ray.dir );
+				radiance += emitted_radiance;
+			}
+
+			//If more rays are allowed . . .
+			if (depth+1u<options.integrator.max_depth) {
+				//Hit position of ray
+				Pos hit_pos = ray.at(hitrec.dist);
+
+				//Width of the footprint in ST space.  The cone's cross-section is stretched over the
+				//	surface by "1/cos(θ)" in one direction; this is the width of the isotropic
+				//	footprint of the same area.
+				float cos_theta = std::max( std::abs(glm::dot(ray.dir,hitrec.normal)), 0.01f );
+				float st_width = cone_spread*(path_length+hitrec.dist) * hitrec.st_scale / std::sqrt(cos_theta);
+
+				//Direct lighting
+				if (explicit_light_sampling&&(!options.indirect_only||depth>0u)) {
+					//Get random ray toward random light
+					Dir shad_ray_dir;
+					PrimBase const* light;
+					float shad_pdf;
+					scene->get_rand_toward_light( rng, hit_pos, &shad_ray_dir,&light,&shad_pdf );
+
+					float n_dot_l = glm::dot(shad_ray_dir,hitrec.normal);
+					if (n_dot_l>0.0f&&shad_pdf>0.0f) {
+						//Cast the shadow ray
+						Ray ray_shad = { hit_pos, shad_ray_dir };
+						HitRecord hitrec_shad;
+						STATS_COUNT(RAYS_SHADOW);
+						scene->intersect(ray_shad,&hitrec_shad,hitrec.prim,hitrec.instance);
+
+						if (hitrec_shad.prim == light) {
+							//If the only thing we hit was the light we were shooting at (or, for
+							//	the environment, nothing at all), then we're not shadowed.  Add the
+							//	radiance contribution.
+
+							//	Emitted radiance
+							auto emitted_radiance = light!=nullptr ?
+								hitrec_shad.material->evaluate_emission(
+									hitrec_shad.st, SPECTRAL_ONLY(lambda_0 COMMA) -shad_ray_dir
+								) :
+								scene->environment->evaluate( shad_ray_dir SPECTRAL_ONLY(COMMA lambda_0) )
+							;
+
+							//	Evaluation of BSDF
+							struct MaterialBase::BSDF_Evaluation evalbsdf = {
+								hitrec.st, st_width, SPECTRAL_ONLY(lambda_0 COMMA)
+								-ray.dir, hitrec.normal, shad_ray_dir,
+								{}
+							};
+							hitrec.material->evaluate_bsdf(&evalbsdf);
+
+							//	Monte Carlo radiance estimate
+							radiance += emitted_radiance * n_dot_l * evalbsdf.f_s / shad_pdf;
+						}
+					}
+				}
+
+				//Indirect lighting
+				//	Random sample from BSDF
+				struct MaterialBase::BSDF_Interaction sampbsdf = {
+					hitrec.st, st_width, SPECTRAL_ONLY(lambda_0 COMMA)
+					-ray.dir, hitrec.normal, Dir(qNaN), qNaN, rng,
+					{}
+				};
+				hitrec.material->interact_bsdf(&sampbsdf);
+				//	Recurse in sampled direction if BSDF is nonzero
+				if (dot(sampbsdf.f_s,sampbsdf.f_s)>0.0f) {
+					//	And if the direction has nonzero contribution via the geometry term.
+					float n_dot_l;
+					bool is_delta = !std::isfinite(sampbsdf.pdf_w_i);
+					if (!is_delta) {
+						n_dot_l = glm::dot(sampbsdf.w_i,hitrec.normal);
+					} else {
+						//		Dirac δ function.  BSDFs that are δ functions are posed having an
+						//			inverse geometry term so that it cancels out in the rendering
+						//			equation.  Instead of doing that, it's more numerically precise
+						//			to just ignore the geometry term entirely.
+						n_dot_l = 1.0f;
+						sampbsdf.pdf_w_i = 1.0f;
+					}
+					if (n_dot_l>0.0f) {
+						//Trace the ray recursively and use in Monte-Carlo estimate of rendering
+						//	equation.  (Light sampling can't have sampled a direction chosen by a δ
+						//	BSDF, so with it, the emission found along the ray is added only then.)
+						Ray ray_next = { hit_pos, sampbsdf.w_i };
+						STATS_COUNT(RAYS_BOUNCE);
+						radiance += L(ray_next,path_length+hitrec.dist,is_delta,depth+1u,hitrec.prim,hitrec.instance) * n_dot_l * sampbsdf.f_s / sampbsdf.pdf_w_i;
+					}
+				}
+			}
+		} else if (scene->environment!=nullptr) {
+			hit_anything = true;
+
+			//Emission from the environment (as above)
+			if (!explicit_light_sampling||( last_was_delta&&(!options.indirect_only||depth>0u) )) {
+				radiance += scene->environment->evaluate( ray.dir SPECTRAL_ONLY(COMMA lambda_0) );
+			}
+		}
+
+		return radiance;
+	};
+
+	Ray ray_camera = { camera.pos, camera_ray_dir };
+	STATS_COUNT(RAYS_CAMERA);
+	auto pixel_rad_est = L(ray_camera,0.0f,true,0u,nullptr,nullptr);
+	STATS_ONLY( Stats::count_path_length(*path_segments); )
+
+	//Value of Monte-Carlo estimator for the radiant flux incident on the pixel due to paths of any
+	//	length.
+	auto pixel_flux_est = pixel_rad_est;
+	if (!flat_field_correction) pixel_flux_est*=glm::dot( camera_ray_dir, camera.dir );
+
+	#ifdef RENDER_MODE_SPECTRAL
+		//Convert each wavelength sample to CIE XYZ and average.
+		STATS_PHASE(SPECTRAL_CONVERSION);
+		CIEXYZ_32F ciexyz_avg = Color::specradflux_to_ciexyz( pixel_flux_est, lambda_0 );
+
+		return CIEXYZ_A_32F( ciexyz_avg,     hit_anything?1.0f:0.0f );
+	#else
+		//Die inside.
+		return lRGB_A_F32  ( pixel_flux_est, hit_anything?1.0f:0.0f );
+	#endif
+}
+template <bool explicit_light_sampling, bool flat_field_correction>
+void       Renderer::_render_pixel (Math::RNG& rng, size_t frame_index, size_t i,size_t j) {
+	/*
+	Seed the RNG for each sample with some kind of data.  Since many RNGs will produce similar
+	starting sequences given similar seeds, and it is desirable for different samples to have
+	different sequences, it is desirable for seeds to vary substantially between samples.  Seeding
+	each sample by its own identity (rather than e.g. each thread) makes the result independent of
+	which thread, or process, renders which samples, so that a render resumed from a checkpoint or
+	divided between processes produces the same image as an uninterrupted one.
+
+	A simple way to do this is to scramble the sample's index, along with its pixel's and frame's,
+	with a hash function, though on some platforms `std::hash` is the identity so we have to
+	implement this ourselves to ensure it actually works.  The hash is used for PCG's full 64-bit
+	state (the increment is left at its default, which is nonzero, as required).
+	*/
+	STATS_PHASE(SHADING);
+
+	size_t seed_pixel = get_hashed( j*options.res[0]+i, get_hashed(frame_index) );
+	auto seed = [&](size_t k) -> void {
+		rng.seed( static_cast<uint64_t>(get_hashed(k,seed_pixel)), 0xDA3E39CB94B95BDBull );
+	};
+
+	//	(For the cost of the pixel, if recorded)
+	std::chrono::steady_clock::time_point time_start;
+	if (!_pixel_costs.empty()) time_start=std::chrono::steady_clock::now();
+	uint64_t num_rays_start = Scene::num_rays_thread;
+	unsigned path_segments;
+	size_t path_segments_sum = 0;
+
+	#ifdef RENDER_MODE_SPECTRAL
+		/*
+		Accumulate samples into CIE XYZ instead of a spectrum (probably `SpectralRadiantFlux`).
+		This way we avoid quantization artifacts and a large memory overhead per-pixel (in a more-
+		sophisticated renderer, the pixel data would be stored for longer, e.g. to do nontrivial
+		reconstruction filtering), for the (small) cost of having to do the conversion to CIE XYZ
+		for each sample.
+
+		Note accumulating must be into a 64-bit value is necessary to have adequate precision for
+		high sample counts.  We also scale the values before accumulating them to keep the precision
+		in a better range.
+		*/
+
+		CIEXYZ_A_64F sum( 0,0,0, 0 );
+		for (size_t k=_range.samples[0];k<_range.samples[1];++k) {
+			seed(k);
+			sum += _render_sample<explicit_light_sampling,flat_field_correction>(rng, i,j, &path_segments) * 0.001f;
+			path_segments_sum += path_segments;
+		}
+	#else
+		lRGB_A_F64   sum( 0,0,0, 0 );
+		for (size_t k=_range.samples[0];k<_range.samples[1];++k) {
+			seed(k);
+			sum += _render_sample<explicit_light_sampling,flat_field_correction>(rng, i,j, &path_segments);
+			path_segments_sum += path_segments;
+		}
+	#endif
+	_resolve_pixel( i,j, sum );
+
+	//Record the cost of the pixel (see `Options::pixel_costs`)
+	if (!_pixel_costs.empty()) {
+		auto time_end = std::chrono::steady_clock::now();
+		size_t num_samples = _range.samples[1] - _range.samples[0];
+		_pixel_costs[ j*options.res[0] + i ] = {
+			static_cast<float>( std::chrono::duration<double,std::micro>(time_end-time_start).count() ),
+			static_cast<float>( Scene::num_rays_thread - num_rays_start ),
+			static_cast<float>(path_segments_sum) / static_cast<float>(std::max(num_samples,1_zu))
+		};
+	}
+}
+#ifdef RENDER_MODE_SPECTRAL
+void Renderer::_resolve_pixel(size_t i,size_t j, CIEXYZ_A_64F const& sum)
+#else
+void Renderer::_resolve_pixel(size_t i,size_t j, lRGB_A_F64   const& sum)
+#endif
+{
+	STATS_PHASE(FRAMEBUFFER);
+
+	if (_sums!=nullptr) {
+		_sums[ (j-_range.rows[0])*options.res[0] + i ] = sum;
+		return;
+	}
+	if (_target!=nullptr) {
+		//	(Note vertical flip.)
+		uint8_t* scanline = static_cast<uint8_t*>(_target->pixels) + (options.res[1]-1-j)*_target->stride;
+		switch (_target->format) {
+			case Target::FORMAT::sRGB_A_U8:
+				reinterpret_cast<sRGB_A_U8 *>(scanline)[i] = Framebuffer::quantize(resolve( sum, options.spp ));
+				break;
+			case Target::FORMAT::lRGB_F32:
+				reinterpret_cast<lRGB_F32  *>(scanline)[i] = Color::srgb_to_lrgb(sRGB_F32(resolve( sum, options.spp )));
+				break;
+			case Target::FORMAT::SUMS:
+				reinterpret_cast<glm::dvec4*>(scanline)[i] = sum;
+				break;
+		}
+		return;
+	}
+
+	if (_checkpoint!=nullptr) _checkpoint_sums[ j*options.res[0] + i ] = sum;
+
+	if (_stream!=nullptr) (*_stream)(i,j) = resolve( sum, options.spp );
+	else                    framebuffer(i,j) = resolve( sum, options.spp );
+}
+sRGB_A_F32 Renderer::resolve(glm::dvec4 const& sum, size_t count) {
+	#ifdef RENDER_MODE_SPECTRAL
+		//(See `._render_pixel(...)` for the scale.)
+		CIEXYZ_A_64F avg = sum * ( 1000.0 / static_cast<double>(count) );
+
+		return sRGB_A_F32( Color::ciexyz_to_srgb(CIEXYZ_32F(avg)), avg.a );
+	#else
+		lRGB_A_F64   avg = sum /            static_cast<double>(count)  ;
+
+		return sRGB_A_F32( Color::lrgb_to_srgb  (lRGB_F32  (avg)), avg.a );
+	#endif
+}
+void Renderer::_render_tiles(Math::RNG& rng, size_t frame_index) {
+	//Main render loop
+	while (_render_continue) {
+		//Atomically pull the next tile of un-rendered pixels off the list of un-rendered tiles.  If
+		//	there are none, terminate the loop.  Also print the progress (inside the mutex so that
+		//	it's threadsafe) every 10ms.
+
+		Framebuffer::Tile tile;
+
+		std::chrono::steady_clock::time_point time_now = std::chrono::steady_clock::now();
+
+		_tiles_mutex.lock();
+
+		if (!_tiles.empty()) {
+			float time_since_last_print = static_cast<float>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(time_now-_time_last_print).count()
+			) * 1.0e-9f;
+			if (time_since_last_print>0.01f) {
+				_print_progress();
+				_time_last_print = time_now;
+			}
+
+			tile = _tiles.back();
+			_tiles.pop_back();
+
+			_tiles_mutex.unlock();
+		} else {
+			_tiles_mutex.unlock();
+
+			//	Minor optimization
+			_render_continue = false;
+
+			break;
+		}
+
+		//If streaming, wait for the tile's band to be in the stream's window
+		if (_stream!=nullptr && !_stream->wait_for(tile.pos[1])) break;
+
+		//Render each pixel of the tile (or, if it was completed before the render was resumed,
+		//	resolve its stored sums)
+		bool done = _checkpoint!=nullptr && _checkpoint_done[_get_tile_index(tile)];
+		for (size_t j=tile.pos[1];j<tile.pos[1]+tile.res[1];++j) {
+			for (size_t i=tile.pos[0];i<tile.pos[0]+tile.res[0];++i) {
+				if (done) _resolve_pixel( i,j, _checkpoint_sums[ j*options.res[0] + i ] );
+				else      (this->*_render_pixel_specialized)(rng, frame_index, i,j);
+			}
+		}
+
+		if (_stream!=nullptr) _stream->complete( tile.pos[1], tile.res[0]*tile.res[1] );
+
+		if (_target!=nullptr && _target->on_tile) {
+			_target->on_tile({
+				{ tile.pos[0], options.res[1]-tile.pos[1]-tile.res[1] },
+				{ tile.res[0], tile.res[1] }
+			});
+		}
+
+		if (_checkpoint!=nullptr && !done) {
+			//Mark the tile complete.  The flag is only written after the tile's sums (the fence
+			//	keeps it from becoming visible first), so a flushed flag always has its sums.
+			std::atomic_thread_fence(std::memory_order_release);
+			_checkpoint_done[_get_tile_index(tile)] = 1;
+
+			//Periodically write the checkpoint to disk.  This is done by whichever thread notices
+			//	it's due, outside the lock so the other threads keep rendering meanwhile.
+			bool flush = false;
+			time_now = std::chrono::steady_clock::now();
+			_tiles_mutex.lock();
+			float time_since_last_flush = static_cast<float>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(time_now-_time_last_flush).count()
+			) * 1.0e-9f;
+			if (time_since_last_flush>CHECKPOINT_FLUSH_INTERVAL) {
+				_time_last_flush = time_now;
+				flush = true;
+			}
+			_tiles_mutex.unlock();
+			if (flush) _checkpoint->flush();
+		}
+	}
+}
+void Renderer::_render_threadwork() {
+	/*
+	Random number generator for each thread.  Note that this must be per-thread data; making it
+	threadsafe and shared would be too slow, and making it simply shared (which is, unfortunately,
+	what many simplistic implementations do with e.g. `rand()`) risks producing bogus results due to
+	race conditions.
+
+	There are several ways to make thread local variables (such as e.g. C++ `thread_local`), but
+	just making a local variable in the thread function is probably the clearest, if not the
+	cleanest.  It is reseeded for each sample (see `._render_pixel(...)`).
+	*/
+	Math::RNG rng;
+
+	#ifdef RENDER_STATISTICS
+	//	Performance counters of this thread (see `Options::perf_counters`)
+	std::unique_ptr<PerfCounters> perf( options.perf_counters ? new PerfCounters : nullptr );
+	#endif
+
+	size_t frame_index = 0;
+	while (true) {
+		//Wait for the next frame to start (or to be told to exit)
+		{
+			std::unique_lock<std::mutex> lock(_frame_mutex);
+			_frame_cv.wait( lock, [&]() -> bool { return _exit || _frame_index!=frame_index; } );
+			if (_exit) break;
+			frame_index = _frame_index;
+		}
+
+		uint64_t num_rays_before = Scene::num_rays_thread;
+		STATS_ONLY( Stats::begin_thread(perf.get()); )
+		_render_tiles(rng,frame_index);
+		_num_rays += Scene::num_rays_thread - num_rays_before;
+		#ifdef RENDER_STATISTICS
+		{
+			Stats::Counters counters = Stats::end_thread();
+			std::lock_guard<std::mutex> lock(_stats_mutex);
+			_stats += counters;
+		}
+		#endif
+
+		//Remove ourself from the count of rendering threads
+		assert(_num_rendering>0u);
+		if (--_num_rendering==0u) {
+			//We're the last thread to finish, so no threads can be touching the image anymore.  We
+			//	are responsible for removing any un-rendered tiles (such as if the render was
+			//	aborted) and starting to save the image (unless it was rendered into sums or into
+			//	memory).  It is saved from a copy, on another thread, so that the next frame can
+			//	start rendering in the meantime.
+			_tiles.clear();
+
+			_print_progress();
+
+			if (_sums==nullptr && _target==nullptr && !_output_path.empty()) {
+				#ifdef RENDER_STATISTICS
+				_save_statistics();
+				#endif
+				if (!_pixel_costs.empty() && !_save_pixel_costs()) _save_failed=true;
+			}
+
+			if (_checkpoint!=nullptr) _checkpoint->flush();
+
+			if        (_stream!=nullptr) {
+				//	The image has been written as it rendered; just finish it.
+				if (!_stream->finish()) {
+					fprintf(stderr,"Could not write \"%s\"!\n",_output_path.c_str());
+					_save_failed = true;
+				}
+			} else if (_sums==nullptr && _target==nullptr) {
+				if (_saving.valid()) _saving.wait();
+				_framebuffer_saving.copy_pixels(framebuffer);
+				_saving = std::async( std::launch::async, [this,path=_output_path]() -> void {
+					if (!_framebuffer_saving.save(path)) _save_failed=true;
+				} );
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_frame_mutex);
+				_frame_done = true;
+			}
+			_frame_cv.notify_all();
+		}
+	}
+}
+void Renderer::render_stop () {
+	_render_continue = false;
+	if (_stream!=nullptr) _stream->abort();
+}
+void Renderer::_wait_rendered() {
+	std::unique_lock<std::mutex> lock(_frame_mutex);
+	_frame_cv.wait( lock, [&]() -> bool { return _frame_done; } );
+}
+void Renderer::render_start() {
+	assert( _sums!=nullptr || _target!=nullptr || !_output_path.empty() );
+
+	//If streaming, start writing the image
+	if (options.stream) {
+		delete _stream;
+		//	The window holds the bands the threads are rendering in, with some slack.
+		_stream = new FramebufferStream( _output_path, options.res, _threads.size()+2 );
+		if (!_stream->is_valid()) {
+			fprintf(stderr,"Could not open \"%s\" for writing!\n",_output_path.c_str());
+			delete _stream;
+			_stream = nullptr;
+			throw -1;
+		}
+	}
+
+	//Create the list of tiles of un-rendered pixels
+	assert(_tiles.empty());
+	for (size_t j=_range.rows[0];j<_range.rows[1];j+=TILE_SIZE) {
+		for (size_t i=0;i<options.res[0];i+=TILE_SIZE) {
+			_tiles.push_back({
+				{ i, j },
+				{ std::min(options.res[0]-i,TILE_SIZE), std::min(_range.rows[1]-j,TILE_SIZE) }
+			});
+		}
+	}
+	//	Rearrange so that the lower tiles are at the end of the list (and thereby are pulled off and
+	//		rendered first).  If streaming to an image stored top-to-bottom, the upper tiles must be
+	//		rendered first instead, so that the bands complete in order.
+	if (_stream==nullptr || _stream->bottom_to_top()) std::reverse(_tiles.begin(),_tiles.end());
+
+	//Starting information for timing
+	_num_tiles_start = _tiles.size();
+	STATS_ONLY( _stats = Stats::Counters(); )
+	std::fill( _pixel_costs.begin(),_pixel_costs.end(), PixelCost{ 0.0f, 0.0f, 0.0f } );
+	_time_start      = std::chrono::steady_clock::now();
+	_time_last_print = _time_start - std::chrono::seconds(1);
+
+	//Set the worker threads rendering
+	_num_rendering = static_cast<uint32_t>(_threads.size());
+	_render_continue = true;
+	{
+		std::lock_guard<std::mutex> lock(_frame_mutex);
+		assert(_frame_done);
+		_frame_done = false;
+		++_frame_index;
+	}
+	_frame_cv.notify_all();
+}
+void Renderer::render_wait () {
+	//Wait for the worker threads to finish the frame, and then for it to be saved
+	_wait_rendered();
+	if (_saving.valid()) _saving.wait();
+	assert(_num_rendering==0u);
+	bool saved = !_save_failed.exchange(false);
+
+	//If the render completed (rather than being aborted) and was saved, its checkpoint is no
+	//	longer needed
+	if (_checkpoint!=nullptr && saved) {
+		size_t num_tiles = static_cast<_CheckpointHeader const*>(_checkpoint->get_data())->num_tiles;
+		if (std::all_of( _checkpoint_done,_checkpoint_done+num_tiles, [](uint8_t done){return done!=0;} )) {
+			delete _checkpoint;
+			_checkpoint=nullptr; _checkpoint_done=nullptr; _checkpoint_sums=nullptr;
+			std::remove(options.checkpoint_path.c_str());
+		}
+	}
+
+	if (!saved) throw -1;
+}
+
+void Renderer::render_frames(std::vector<Frame> const& frames) {
+	for (Frame const& frame : frames) {
+		camera       = _get_camera(frame.camera);
+		_output_path = frame.output_path;
+
+		//Only wait for rendering; the frame is saved while the next renders
+		render_start();
+		_wait_rendered();
+	}
+	if (_saving.valid()) _saving.wait();
+
+	if (_save_failed.exchange(false)) throw -1;
+}
+void Renderer::render_sums(WorkRange const& range, glm::dvec4* sums) {
+	assert(_checkpoint==nullptr);
+	assert(range.rows   [0]<range.rows   [1] && range.rows   [1]<=options.res[1]);
+	assert(range.samples[0]<range.samples[1] && range.samples[1]<=options.spp   );
+
+	_range = range;
+	_sums  = sums;
+
+	render_start();
+	_wait_rendered();
+
+	_range = { { 0,options.res[1] }, { 0,options.spp } };
+	_sums  = nullptr;
+}
+void Renderer::render_into(Target const& target) {
+	assert(_checkpoint==nullptr && !options.stream);
+
+	_target = &target;
+
+	render_start();
+	_wait_rendered();
+
+	_target = nullptr;
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,82 +1,333 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-#include "util/random.hpp"
-
-#include "framebuffer.hpp"
-
-
-
-class Scene;
-
-class Renderer final {
-	public:
-		//Render options
-		class Options final { public:
-			std::string scene_name;
-
-			size_t res[2]; //Resolution of image
-			size_t spp;    //Samples per pixel
-
-			bool indirect_only; //Whether only indirect illumination should be rendered
-
-			std::string output_path;
-
-			#ifdef SUPPORT_WINDOWED
-			bool open_window;
-			#endif
-		};
-		Options const options;
-
-		Framebuffer framebuffer;
-
-		Scene* scene;
-
-	private:
-		//Concurrent list of pixel tiles in the framebuffer that remain to be rendered
-		std::mutex _tiles_mutex;
-		std::vector<Framebuffer::Tile> _tiles;
-
-		//Worker threads
-		std::vector<std::thread*> _threads;
-		//Number of threads currently rendering
-		std::atomic<uint32_t> _num_rendering;
-
-		//Internal data used for calculating statistics
-		size_t _num_tiles_start;
-		std::chrono::steady_clock::time_point _time_start;
-		std::chrono::steady_clock::time_point _time_last_print;
-
-		//Whether the render should continue
-		bool volatile _render_continue;
-
-	public:
-		explicit Renderer(Options const& options);
-		~Renderer();
-
-	private:
-		//Prints the status of an ongoing render.
-		void _print_progress() const;
-
-		//Calculate a single sample for pixel (`i`,`j`).
-		#ifdef RENDER_MODE_SPECTRAL
-		CIEXYZ_A_32F _render_sample(Math::RNG& rng, size_t i,size_t j);
-		#else
-		lRGB_A_F32   _render_sample(Math::RNG& rng, size_t i,size_t j);
-		#endif
-		//Calculate all samples for pixel (`i`,`j`) and store the reconstructed value into the
-		//	framebuffer.  Called internally by the thread worker.
-		void       _render_pixel (Math::RNG& rng, size_t i,size_t j);
-		//Member function called by each thread
-		void _render_threadwork();
-	public:
-		//Creates the worker threads and sets them rendering
-		void render_start();
-		//Tells the worker threads to abort the render
-		void render_stop () { _render_continue=false; }
-		//Waits for the worker threads to terminate
-		void render_wait ();
-
-		bool is_rendering() const { return _num_rendering>0u; }
-};
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/random.hpp"
+
+#include "bvh.hpp"
+#include "framebuffer.hpp"
+#include "scene.hpp"
+#include "stats.hpp"
+
+
+
+class MappedFile;
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+class Renderer final {
+	public:
+		//Overrides of the scene's camera (each only if given).  The camera looks at `.target`.
+		class CameraOverride final { public:
+			bool pos_given    = false; Pos   pos;
+			bool target_given = false; Pos   target;
+			bool vfov_given   = false; float vfov_deg;
+		};
+		//Frame of a batch render: overrides of the scene's camera, and the path to save the frame
+		//	to.
+		class Frame final { public:
+			CameraOverride camera;
+			std::string output_path;
+		};
+
+		//Part of a frame: the scanlines [`.rows[0]`,`.rows[1]`), and the samples
+		//	[`.samples[0]`,`.samples[1]`) of each of their pixels.
+		class WorkRange final { public:
+			size_t rows[2];
+			size_t samples[2];
+		};
+
+		//Cost of rendering a pixel (see `Options::pixel_costs`): the time taken (µs), and the number of
+		//	rays traced (including shadow rays), for all its samples, and the average number of
+		//	segments of their paths (not counting shadow rays).  Pixels resolved from a checkpoint
+		//	rather than rendered cost nothing.
+		class PixelCost final { public:
+			float time_us;
+			float rays;
+			float path_length;
+		};
+
+		//Destination of a frame rendered into memory (see `.render_into(...)`)
+		class Target final { public:
+			enum class FORMAT {
+				sRGB_A_U8, //`sRGB_A_U8` (as saved to 8-bit images)
+				lRGB_F32,  //`lRGB_F32` (as saved to floating-point images)
+				SUMS       //`glm::dvec4` sums of the samples (as by `.render_sums(...)`; see `.resolve(...)`)
+			} format;
+			//The caller's storage for the pixels: `.res[1]` scanlines of `.res[0]` pixels, stored
+			//	top-to-bottom, each `.stride` bytes after the one before.
+			void*  pixels;
+			size_t stride;
+			//If set, called as each tile of pixels is stored, with the tile (in the coordinates of
+			//	`.pixels`).  Called from the worker threads, possibly concurrently.
+			std::function<void(Framebuffer::Tile const&)> on_tile;
+		};
+
+		//Render options.  When used as a library, the scene (`.scene_name`, `.bvh`,
+		//	`.texture_cache_dir`, `.envmap_path`) may instead be given to the renderer directly, and
+		//	the output (`.output_path`, `.frames`, etc.) may be left empty and the frame rendered into
+		//	memory (see `.render_into(...)`).
+		class Options final { public:
+			std::string scene_name;
+
+			size_t res[2]; //Resolution of image
+			size_t spp;    //Samples per pixel
+
+			bool indirect_only = false; //Whether only indirect illumination should be rendered
+
+			//How paths are traced.  The choices other than `.max_depth` are compile-time parameters
+			//	of the integrator, which is compiled for each combination of them (see
+			//	`._render_pixel<...>(...)`); the renderer chooses among these specializations.
+			class Integrator final { public:
+				//Whether to use explicit light sampling (ELS): sample a shadow ray toward a light at
+				//	each vertex of a path, and count emission reached otherwise only after δ BSDFs.
+				//	By default, the scene's preference (see `Scene::explicit_light_sampling`).
+				enum class LIGHT_SAMPLING { SCENE, EXPLICIT, IMPLICIT } light_sampling = LIGHT_SAMPLING::SCENE;
+				//Maximum depth of paths (including shadow rays)
+				unsigned max_depth = MAX_DEPTH;
+				//Whether to compensate for the cosine-factor falloff of the camera (see
+				//	`FLAT_FIELD_CORRECTION`)
+				#ifdef FLAT_FIELD_CORRECTION
+				bool flat_field_correction = true;
+				#else
+				bool flat_field_correction = false;
+				#endif
+			} integrator;
+
+			BVH::BuildOptions bvh; //How the scene's acceleration structure is built
+
+			std::string texture_cache_dir; //Directory in which decoded textures are cached (if nonempty)
+
+			std::string envmap_path; //HDR image replacing the scene's environment (if nonempty)
+
+			CameraOverride camera; //Overrides of the scene's camera
+
+			std::string output_path;
+			std::vector<Frame> frames; //Frames of a batch render, instead of `.output_path` (if nonempty)
+			//Whether to write the image as it renders, keeping only part of it in memory, instead of
+			//	saving it at the end (see `FramebufferStream`).  The framebuffer is then left empty.
+			bool stream = false;
+
+			//Whether to also attribute performance counters (e.g. instructions, cache misses; see
+			//	`PerfCounters`) to the phases of the render in its statistics.  Requires a build with
+			//	`RENDER_STATISTICS` (see `Stats`).
+			bool perf_counters = false;
+
+			//Whether to record the cost of rendering each pixel (see `PixelCost`), and save it as
+			//	floating-point images next to the image (e.g. "output.cost-time.pfm",
+			//	"output.cost-rays.pfm", and "output.cost-path-length.pfm" for "output.png").
+			bool pixel_costs = false;
+
+			std::string checkpoint_path; //File recording the progress of the render (if nonempty)
+			bool resume = false; //Whether to continue the render recorded in `.checkpoint_path`
+
+			//Worker processes to distribute the render between (if any; see `main.cpp`), each as
+			//	"<host>:<port>", whether to split the frame between them by scanlines or samples, and
+			//	how long to wait on a worker (e.g. for its reply) before giving up on it.
+			class Distribute final { public:
+				std::vector<std::string> workers;
+				enum class SPLIT { IMAGE, SAMPLES } split = SPLIT::IMAGE;
+				float timeout_s = 600.0f;
+			} distribute;
+
+			#ifdef SUPPORT_WINDOWED
+			bool open_window = false;
+			#endif
+		};
+		Options const options;
+
+		//The frame (empty if streaming, or if there's no output; see `Options::stream` and
+		//	`.render_into(...)`)
+		Framebuffer framebuffer;
+
+		Scene* scene;
+		//The scene's camera, with the overrides in `.options` applied
+		Scene::Camera camera;
+
+	private:
+		//`.scene`, if it was loaded by (and so is deleted with) the renderer.  (Held from right after
+		//	it's loaded, so that it's also deleted if the rest of construction fails.)
+		std::unique_ptr<Scene> _owned_scene;
+
+		//Whether explicit light sampling is used (`Options::Integrator::light_sampling`, resolved),
+		//	and the specialization of `._render_pixel<...>(...)` for the integrator's choices.
+		bool _explicit_light_sampling;
+		void (Renderer::*_render_pixel_specialized)(Math::RNG& rng, size_t frame_index, size_t i,size_t j);
+
+		//Path the current frame is saved to
+		std::string _output_path;
+		//Copy of the last completed frame, which is saved in the background (`._saving`) so that
+		//	the next frame can render meanwhile.
+		Framebuffer _framebuffer_saving;
+		std::future<void> _saving;
+		//Whether saving a frame (or its pixel costs) failed since this was last reported
+		std::atomic<bool> _save_failed;
+
+		//If streaming (see `Options::stream`), the destination of the frame being rendered
+		FramebufferStream* _stream;
+
+		//Part of the frame being rendered, and if non-null, where the sums of the samples of its
+		//	pixels are stored instead of resolving them into the framebuffer (see
+		//	`.render_sums(...)`).
+		WorkRange _range;
+		glm::dvec4* _sums;
+		//If non-null, where the frame is stored instead of into the framebuffer (see
+		//	`.render_into(...)`)
+		Target const* _target;
+
+		//Concurrent list of pixel tiles in the framebuffer that remain to be rendered
+		std::mutex _tiles_mutex;
+		std::vector<Framebuffer::Tile> _tiles;
+
+		//Worker threads.  These are created with the renderer and wait between frames, so that
+		//	rendering many frames doesn't create threads for each.
+		std::vector<std::thread*> _threads;
+		//Number of threads currently rendering
+		std::atomic<uint32_t> _num_rendering;
+		//Number of rays traced by the workers (added as each finishes a frame)
+		std::atomic<uint64_t> _num_rays;
+		//Costs of the pixels of the current (or last) frame, in the framebuffer's order (empty
+		//	unless `Options::pixel_costs`)
+		std::vector<PixelCost> _pixel_costs;
+		#ifdef RENDER_STATISTICS
+		//Statistics of the current (or last) frame, merged from the workers' as each finishes it
+		std::mutex _stats_mutex;
+		Stats::Counters _stats;
+		#endif
+		//Signaling between the renderer and the workers: `._frame_index` counts the frames
+		//	started (the workers start rendering when it changes), `._frame_done` is whether the
+		//	latest has finished rendering, and `._exit` is whether the workers should exit.
+		std::mutex _frame_mutex;
+		std::condition_variable _frame_cv;
+		size_t _frame_index;
+		bool _frame_done;
+		bool _exit;
+
+		//Checkpoint of the render (`nullptr` if none; see `Options::checkpoint_path`): a mapped file
+		//	holding whether each tile is complete, and the sum of the samples of each pixel of the
+		//	complete tiles.  Tiles are written as they complete, and the file is flushed to disk
+		//	periodically.
+		MappedFile* _checkpoint;
+		uint8_t*    _checkpoint_done;
+		glm::dvec4* _checkpoint_sums;
+		std::chrono::steady_clock::time_point _time_last_flush;
+
+		//Internal data used for calculating statistics
+		size_t _num_tiles_start;
+		std::chrono::steady_clock::time_point _time_start;
+		std::chrono::steady_clock::time_point _time_last_print;
+
+		//Whether the render should continue
+		std::atomic<bool> _render_continue;
+
+	public:
+		//Renderer for `scene`, which is not owned (so it may be shared between renderers), or, if
+		//	it's `nullptr`, for a new scene loaded according to `options`.
+		explicit Renderer(Options const& options, Scene* scene=nullptr);
+		~Renderer();
+
+		//Load the scene described by `options` (see `.scene_name`, `.bvh`, `.texture_cache_dir`,
+		//	and `.envmap_path`).  The caller owns the result.
+		static Scene* get_new_scene(Options const& options);
+
+	private:
+		//The scene's camera with the overrides `overrides` applied
+		Scene::Camera _get_camera(CameraOverride const& overrides) const;
+
+		//Create the checkpoint file, or if resuming, map the existing one.
+		void _open_checkpoint();
+
+		//Index of tile `tile` in the frame, in scanline order.
+		size_t _get_tile_index(Framebuffer::Tile const& tile) const;
+
+		//Prints the status of an ongoing render.
+		void _print_progress() const;
+
+		#ifdef RENDER_STATISTICS
+		//Write the statistics of the frame next to its image (e.g. "output.stats.json" for
+		//	"output.png").
+		void _save_statistics() const;
+		#endif
+		//Write the costs of the frame's pixels next to its image (see `Options::pixel_costs`).
+		//	Returns whether it succeeded.
+		bool _save_pixel_costs() const;
+
+		//Calculate a single sample for pixel (`i`,`j`), with the integrator choices given (see
+		//	`Options::Integrator`).  The number of segments of its path (not counting shadow rays) is
+		//	returned in `path_segments`.
+		#ifdef RENDER_MODE_SPECTRAL
+		template <bool explicit_light_sampling, bool flat_field_correction>
+		CIEXYZ_A_32F _render_sample(Math::RNG& rng, size_t i,size_t j, unsigned* path_segments);
+		#else
+		template <bool explicit_light_sampling, bool flat_field_correction>
+		lRGB_A_F32   _render_sample(Math::RNG& rng, size_t i,size_t j, unsigned* path_segments);
+		#endif
+		//Calculate the samples in `._range` for pixel (`i`,`j`) of frame `frame_index` and resolve
+		//	them.  Called internally by the thread worker, through `._render_pixel_specialized`.
+		template <bool explicit_light_sampling, bool flat_field_correction>
+		void       _render_pixel (Math::RNG& rng, size_t frame_index, size_t i,size_t j);
+		//Store the sum of the samples for pixel (`i`,`j`), `sum`, into `._sums` or `._target` (if
+		//	non-null), or else into the checkpoint (if any) and the reconstructed value into the
+		//	framebuffer.
+		#ifdef RENDER_MODE_SPECTRAL
+		void _resolve_pixel(size_t i,size_t j, CIEXYZ_A_64F const& sum);
+		#else
+		void _resolve_pixel(size_t i,size_t j, lRGB_A_F64   const& sum);
+		#endif
+		//Render tiles of the frame `frame_index` until none remain (or the render is stopped).
+		void _render_tiles(Math::RNG& rng, size_t frame_index);
+		//Member function called by each thread
+		void _render_threadwork();
+
+		//Waits for the worker threads to finish rendering the frame
+		void _wait_rendered();
+	public:
+		//Sets the worker threads rendering the frame
+		void render_start();
+		//Tells the worker threads to abort the render
+		void render_stop ();
+		//Waits for the worker threads to finish rendering the frame, and for it to be saved.  Throws
+		//	if it could not be saved (the error having been reported).
+		void render_wait ();
+
+		//Render `frames` in sequence, with the same scene and worker threads.  Each frame is saved
+		//	while the next one renders.  Throws if any could not be saved (after rendering them all).
+		void render_frames(std::vector<Frame> const& frames);
+
+		//Render only `range` of the frame, storing the sum of the samples of each of its pixels into
+		//	`sums` (in scanline order, starting from the first scanline of `range`) instead of
+		//	resolving them into the framebuffer, which isn't saved.  Each sample is seeded by its
+		//	pixel and index alone, so the sums of any division of the frame add up to those of the
+		//	whole frame.  Used to distribute a frame between processes.
+		void render_sums(WorkRange const& range, glm::dvec4* sums);
+		//Reconstruct the value of a pixel from the sum `sum` of `count` of its samples (as stored by
+		//	`.render_sums(...)`).
+		static sRGB_A_F32 resolve(glm::dvec4 const& sum, size_t count);
+
+		//Render the frame into `target` (of resolution `Options::res`), instead of into the
+		//	framebuffer (which isn't saved), and wait for it to finish.  The pixels of each tile are
+		//	stored as it completes.  Not compatible with checkpointing or streaming.
+		void render_into(Target const& target);
+
+		bool is_rendering() const { return _num_rendering>0u; }
+
+		//Number of rays traced in all frames rendered so far (including shadow rays).
+		uint64_t get_num_rays() const { return _num_rays; }
+
+		//Costs of the pixels of the last frame rendered, stored like `.framebuffer` (if
+		//	`Options::pixel_costs`; else empty).
+		std::vector<PixelCost> const& get_pixel_costs() const { return _pixel_costs; }
+
+		#ifdef RENDER_STATISTICS
+		//Statistics of the last frame rendered (see `Stats`).
+		Stats::Counters const& get_statistics() const { return _stats; }
+		#endif
+};
+
+
+
+RENDER_VARIANT_END
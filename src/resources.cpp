@@ -0,0 +1,106 @@
+#include "resources.hpp"
+
+#include "material.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+namespace Resources {
+
+
+
+static std::mutex _mutex;
+
+static std::string _texture_cache_dir;
+static std::map<std::string,std::weak_ptr<sRGB_ReflectanceTexture const>> _textures;
+#ifdef RENDER_MODE_SPECTRAL
+//	Keyed by hash; spectra with colliding hashes share a list.  Lists are removed once empty.
+static std::map<size_t,std::vector<std::weak_ptr<SpectralReflectance const>>> _spectra;
+//	Number of lists after spectra no longer used were last dropped (see `get_spectrum(...)`)
+static size_t _num_spectra_swept = 0;
+#endif
+
+
+
+void set_texture_cache_dir(std::string const& dir) {
+	std::lock_guard<std::mutex> lock(_mutex);
+	_texture_cache_dir = dir;
+}
+
+std::shared_ptr<sRGB_ReflectanceTexture const> get_texture(std::string const& path) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto iter = _textures.find(path);
+	if (iter!=_textures.end()) {
+		std::shared_ptr<sRGB_ReflectanceTexture const> existing = iter->second.lock();
+		if (existing!=nullptr) return existing;
+	}
+
+	//Not loaded, or no longer used.  Drop the entries of textures no longer used (so that a
+	//	long-running process that loads many scenes does not keep them all), then load it.  The
+	//	texture loads in the background, so this returns quickly, and several textures requested
+	//	in turn load in parallel.
+	for (iter=_textures.begin();iter!=_textures.end();) {
+		if (iter->second.expired()) iter=_textures.erase(iter);
+		else                        ++iter;
+	}
+	std::shared_ptr<sRGB_ReflectanceTexture const> result = std::make_shared<sRGB_ReflectanceTexture const>(path,_texture_cache_dir);
+	_textures[path] = result;
+	return result;
+}
+
+#ifdef RENDER_MODE_SPECTRAL
+std::shared_ptr<SpectralReflectance const> get_spectrum(SpectralReflectance const& spectrum) {
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size_t hash = spectrum.get_hash();
+	auto iter = _spectra.find(hash);
+	if (iter!=_spectra.end()) {
+		std::vector<std::weak_ptr<SpectralReflectance const>>& entries = iter->second;
+		for (size_t i=0;i<entries.size();) {
+			std::shared_ptr<SpectralReflectance const> existing = entries[i].lock();
+			if (existing!=nullptr) {
+				if (*existing==spectrum) return existing;
+				++i;
+			} else {
+				//Expired; remove it
+				entries[i] = entries.back();
+				entries.pop_back();
+			}
+		}
+		if (entries.empty()) _spectra.erase(iter);
+	}
+
+	//Not registered, or no longer used.  Drop the spectra no longer used, as for textures, but
+	//	only once the number of lists has doubled since last time, so that registering the many
+	//	spectra of a large scene in turn doesn't take quadratic time.
+	if (_spectra.size()>=2*_num_spectra_swept) {
+		for (iter=_spectra.begin();iter!=_spectra.end();) {
+			std::vector<std::weak_ptr<SpectralReflectance const>>& entries = iter->second;
+			entries.erase(
+				std::remove_if( entries.begin(),entries.end(), [](std::weak_ptr<SpectralReflectance const> const& entry) -> bool {
+					return entry.expired();
+				}),
+				entries.end()
+			);
+			if (entries.empty()) iter=_spectra.erase(iter);
+			else                 ++iter;
+		}
+		_num_spectra_swept = _spectra.size();
+	}
+	std::shared_ptr<SpectralReflectance const> result = std::make_shared<SpectralReflectance const>(spectrum);
+	_spectra[hash].emplace_back(result);
+	return result;
+}
+#endif
+
+
+
+}
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "spectrum.hpp"
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+class sRGB_ReflectanceTexture;
+
+
+
+//Registry of immutable resources shared between materials.  Requesting a resource that is already
+//	alive returns another reference to it instead of a copy, so that (e.g.) many materials using the
+//	same texture load and store it only once.  Textures are keyed by path, and spectra by content.
+//	The registry holds only weak references; a resource is freed when the last material using it
+//	is.  It is safe to use from multiple threads.
+namespace Resources {
+
+
+
+//Set the directory in which decoded textures are cached between runs (empty, the default, to
+//	disable).  Affects textures loaded afterward.
+void set_texture_cache_dir(std::string const& dir);
+
+//Return the texture loaded from the sRGB image at `path`, starting to load it if necessary (see
+//	`sRGB_ReflectanceTexture`; the texture may not have finished loading).
+std::shared_ptr<sRGB_ReflectanceTexture const> get_texture(std::string const& path);
+
+#ifdef RENDER_MODE_SPECTRAL
+//Return a shared spectrum identical to `spectrum`.
+std::shared_ptr<SpectralReflectance const> get_spectrum(SpectralReflectance const& spectrum);
+#endif
+
+
+
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,445 +1,527 @@
-﻿#include "scene.hpp"
-
-#include "util/color.hpp"
-
-#include "geometry.hpp"
-#include "material.hpp"
-
-
-
-Scene::~Scene() {
-	for (auto iter : materials) delete iter.second;
-
-	for (PrimBase const* iter : primitives) delete iter;
-}
-
-void Scene::_init() {
-	//Compute camera matrices.
-	camera.matr_P = glm::perspectiveFov(
-		glm::radians(camera.vfov_deg),
-		static_cast<float>(camera.res[0]), static_cast<float>(camera.res[1]),
-		camera.near, camera.far
-	);
-	camera.matr_V = glm::lookAt( camera.pos, camera.pos+camera.dir, camera.up );
-	camera.matr_PV_inv = glm::inverse( camera.matr_P * camera.matr_V );
-
-	//Make a list of all the lights so that we can sample them later.
-	for (PrimBase* prim : primitives) {
-		if (prim->is_light) lights.emplace_back(prim);
-	}
-	assert(!lights.empty());
-}
-Scene* Scene::get_new_cornell     () {
-	//http://www.graphics.cornell.edu/online/box/data.html
-	Scene* result = new Scene;
-
-	{
-		result->camera.pos = Pos(278,273,-800);
-		result->camera.dir = glm::normalize(Dir(0,0,1));
-		result->camera.up  = Dir(0,1,0);
-
-		result->camera.res[0] = 512;
-		result->camera.res[1] = 512;
-		result->camera.near=0.1f; result->camera.far=1.0f;
-		result->camera.vfov_deg = 39.0f;
-		//focal = 0.035f;
-		//size
-	}
-
-	{
-		#ifdef RENDER_MODE_SPECTRAL
-			std::vector<std::vector<float>> data = load_spectral_data("data/scenes/cornell/white-green-red.csv");
-			if (data.size()==3); else { fprintf(stderr,"Invalid data in file!\n"); throw -1; }
-
-			MaterialLambertian* white_back      = new MaterialLambertian;
-			*white_back->albedo.constant = SpectralReflectance( data[0], 400,700 );
-			//*white_back->albedo.constant = SpectralReflectance( 1.0f );
-
-			MaterialLambertian* white_blocks    = new MaterialLambertian(*white_back);
-
-			MaterialLambertian* white_floorceil = new MaterialLambertian(*white_back);
-
-			MaterialLambertian* green           = new MaterialLambertian;
-			*green->albedo.constant      = SpectralReflectance( data[1], 400,700 );
-
-			MaterialLambertian* red             = new MaterialLambertian;
-			*red->albedo.constant        = SpectralReflectance( data[2], 400,700 );
-		#else
-			MaterialLambertian* white_back      = new MaterialLambertian;
-			white_back->albedo.constant  = RGB_Reflectance(1,1,1);
-
-			MaterialLambertian* white_blocks    = new MaterialLambertian(*white_back);
-
-			MaterialLambertian* white_floorceil = new MaterialLambertian(*white_back);
-
-			MaterialLambertian* green           = new MaterialLambertian;
-			green->     albedo.constant  = RGB_Reflectance(0.07f,0.38f,0.07f); //Set heuristically.  There is no correct way to set it.
-
-			MaterialLambertian* red             = new MaterialLambertian;
-			red->       albedo.constant  = RGB_Reflectance(1,0,0);
-		#endif
-
-		result->materials["white-back"     ] = white_back;
-		result->materials["white-blocks"   ] = white_blocks;
-		result->materials["white-floorceil"] = white_floorceil;
-		result->materials["green"          ] = green;
-		result->materials["red"            ] = red;
-	}
-
-	{
-		MaterialLambertian* light = new MaterialLambertian;
-		#ifdef RENDER_MODE_SPECTRAL
-			std::vector<std::vector<float>> data = load_spectral_data("data/scenes/cornell/light.csv");
-			if (data.size()==1); else { fprintf(stderr,"Invalid data in file!\n"); throw -1; }
-
-			light->emission         = SpectralRadiance( data[0], 400,700 ) * 200.0f;
-			//light->emission         = Color::data->D65_rad * 0.5f;
-			//light->emission         = Color::data->D65_rad * 5.0f;
-			*light->albedo.constant = SpectralReflectance( 0.78f );
-		#else
-			light->emission         = RGB_Radiance(1,1,1) * 200.0f;
-			light->albedo.constant  = RGB_Reflectance( 0.78f );
-		#endif
-
-		result->materials["light"] = light;
-	}
-
-	{
-		//Floor
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-			{ Pos( 552.8f, 0.0f,   0.0f ), ST(1,0) },
-			{ Pos(   0.0f, 0.0f,   0.0f ), ST(0,0) },
-			{ Pos(   0.0f, 0.0f, 559.2f ), ST(0,1) },
-			{ Pos( 549.6f, 0.0f, 559.2f ), ST(1,1) }
-		));
-
-		#if 0
-			//Shift the light downward a bit
-
-			//Light (note moved down 0.1 so not on ceiling)
-			result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-				{ Pos( 343.0f, 548.7f, 227.0f ), ST(1,0) },
-				{ Pos( 343.0f, 548.7f, 332.0f ), ST(1,1) },
-				{ Pos( 213.0f, 548.7f, 332.0f ), ST(0,1) },
-				{ Pos( 213.0f, 548.7f, 227.0f ), ST(0,0) }
-			));
-
-			//Ceiling
-			result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-				{ Pos( 556.0f, 548.8f,   0.0f ), ST(1,0) },
-				{ Pos( 556.0f, 548.8f, 559.2f ), ST(1,1) },
-				{ Pos(   0.0f, 548.8f, 559.2f ), ST(0,1) },
-				{ Pos(   0.0f, 548.8f,   0.0f ), ST(0,0) }
-			));
-		#else
-			/*
-			Actually cut a hole in the ceiling for the light:
-
-				A-------B    Left <-----+
-				| E---F |               |
-				| |   | |               |
-				| G---H |               v
-				C-------D             Front
-			*/
-
-			Pos A = Pos(   0.0f, 548.8f, 559.2f );
-			Pos B = Pos( 556.0f, 548.8f, 559.2f );
-			Pos C = Pos(   0.0f, 548.8f,   0.0f );
-			Pos D = Pos( 556.0f, 548.8f,   0.0f );
-			Pos E = Pos( 213.0f, 548.8f, 332.0f );
-			Pos F = Pos( 343.0f, 548.8f, 332.0f );
-			Pos G = Pos( 213.0f, 548.8f, 227.0f );
-			Pos H = Pos( 343.0f, 548.8f, 227.0f );
-
-			/*
-			This reduces variance for explicit light sampling significantly because rays can't get
-			onto the ceiling behind the light and sample the large solid angle (near-hemisphere)
-			toward it.
-			*/
-
-			//Light (H,F,E,G)
-			result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-				{ H, ST(1,0) },
-				{ F, ST(1,1) },
-				{ E, ST(0,1) },
-				{ G, ST(0,0) }
-			));
-
-			//Ceiling
-			result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-				{ D, ST(0,0) },
-				{ B, ST(0,0) },
-				{ F, ST(0,0) },
-				{ H, ST(0,0) }
-			));
-			result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-				{ B, ST(0,0) },
-				{ A, ST(0,0) },
-				{ E, ST(0,0) },
-				{ F, ST(0,0) }
-			));
-			result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-				{ A, ST(0,0) },
-				{ C, ST(0,0) },
-				{ G, ST(0,0) },
-				{ E, ST(0,0) }
-			));
-			result->primitives.emplace_back(new PrimQuad(result->materials["white-floorceil"],
-				{ C, ST(0,0) },
-				{ D, ST(0,0) },
-				{ H, ST(0,0) },
-				{ G, ST(0,0) }
-			));
-		#endif
-
-		//Back wall
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-back"],
-			{ Pos( 549.6f,   0.0f, 559.2f ), ST(0,0) },
-			{ Pos(   0.0f,   0.0f, 559.2f ), ST(1,0) },
-			{ Pos(   0.0f, 548.8f, 559.2f ), ST(1,1) },
-			{ Pos( 556.0f, 548.8f, 559.2f ), ST(0,1) }
-		));
-
-		//Right wall
-		result->primitives.emplace_back(new PrimQuad(result->materials["green"],
-			{ Pos( 0.0f,   0.0f, 559.2f ), ST(1,0) },
-			{ Pos( 0.0f,   0.0f,   0.0f ), ST(0,0) },
-			{ Pos( 0.0f, 548.8f,   0.0f ), ST(0,1) },
-			{ Pos( 0.0f, 548.8f, 559.2f ), ST(1,1) }
-		));
-
-		//Left wall
-		result->primitives.emplace_back(new PrimQuad(result->materials["red"  ],
-			{ Pos( 552.8f,   0.0f,   0.0f ), ST(0,0) },
-			{ Pos( 549.6f,   0.0f, 559.2f ), ST(1,0) },
-			{ Pos( 556.0f, 548.8f, 559.2f ), ST(1,1) },
-			{ Pos( 556.0f, 548.8f,   0.0f ), ST(0,1) }
-		));
-
-		//Short block
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
-			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
-			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
-			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 290.0f,   0.0f, 114.0f ), ST(0,0) },
-			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) },
-			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
-			{ Pos( 240.0f,   0.0f, 272.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 130.0f,   0.0f,  65.0f ), ST(0,0) },
-			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
-			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) },
-			{ Pos( 290.0f,   0.0f, 114.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos(  82.0f,   0.0f, 225.0f ), ST(0,0) },
-			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
-			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
-			{ Pos( 130.0f,   0.0f,  65.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 240.0f,   0.0f, 272.0f ), ST(0,0) },
-			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
-			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
-			{ Pos(  82.0f,   0.0f, 225.0f ), ST(0,0) }
-		));
-
-		//Tall block
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
-			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
-			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
-			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 423.0f,   0.0f, 247.0f ), ST(0,0) },
-			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
-			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) },
-			{ Pos( 472.0f,   0.0f, 406.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 472.0f,   0.0f, 406.0f ), ST(0,0) },
-			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) },
-			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
-			{ Pos( 314.0f,   0.0f, 456.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 314.0f,   0.0f, 456.0f ), ST(0,0) },
-			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
-			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
-			{ Pos( 265.0f,   0.0f, 296.0f ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["white-blocks"],
-			{ Pos( 265.0f,   0.0f, 296.0f ), ST(0,0) },
-			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
-			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
-			{ Pos( 423.0f,   0.0f, 247.0f ), ST(0,0) }
-		));
-	}
-
-	result->_init();
-
-	return result;
-}
-Scene* Scene::get_new_cornell_srgb() {
-	Scene* result = Scene::get_new_cornell();
-
-	//MaterialBase* mtl_tex = new MaterialLambertian("data/scenes/crystal-lizard-512.png"); float lightsc=30.0f;
-	MaterialBase* mtl_tex = new MaterialLambertian("data/scenes/crystal-lizard-4096.png"); float lightsc=30.0f;
-	//MaterialBase* mtl_tex = new MaterialLambertian("data/scenes/test-img.png"); float lightsc=20.0f;
-	result->materials["srgb"] = mtl_tex;
-
-	MaterialLambertian* mtl_white1 = new MaterialLambertian;
-	#ifdef RENDER_MODE_SPECTRAL
-		*mtl_white1->albedo.constant = SpectralReflectance( 1.0f );
-	#else
-		 mtl_white1->albedo.constant = RGB_Reflectance    ( 1.0f );
-	#endif
-	result->materials["white1"] = mtl_white1;
-
-	for (PrimBase* prim : result->primitives) {
-		if      (prim->material==result->materials["white-blocks"   ]) prim->material=mtl_white1;
-		else if (prim->material==result->materials["white-floorceil"]) prim->material=mtl_white1;
-		else if (prim->material==result->materials["red"            ]) prim->material=mtl_tex;
-	}
-
-	static_cast<MaterialLambertian*>(result->materials["light"])->emission =
-		#ifdef RENDER_MODE_SPECTRAL
-			Color::data->D65_rad * lightsc
-		#else
-			RGB_Radiance(1,1,1)  * lightsc;
-		#endif
-	;
-
-	return result;
-}
-Scene* Scene::get_new_plane_srgb  () {
-	Scene* result = new Scene;
-
-	{
-		result->camera.pos = Pos(0,0,5);
-		//result->camera.pos = Pos(50,30,20);
-		result->camera.dir = glm::normalize(Pos(0)-result->camera.pos);
-		result->camera.up  = Dir(0,1,0);
-
-		result->camera.res[0] = 512;
-		result->camera.res[1] = 512;
-		result->camera.near=0.1f; result->camera.far=1.0f;
-		result->camera.vfov_deg = glm::degrees(2.0f*std::atan2( 1.0f, result->camera.pos.z ));
-	}
-
-	{
-		MaterialLambertian* mtl_light = new MaterialLambertian;
-		#ifdef RENDER_MODE_SPECTRAL
-			*mtl_light->albedo.constant = SpectralReflectance(0.0f);
-			 mtl_light->emission = Color::data->D65_rad;
-		#else
-			 mtl_light->albedo.constant = RGB_Reflectance    (0.0f);
-			 mtl_light->emission = RGB_Radiance(1,1,1);
-		#endif
-		result->materials["light"] = mtl_light;
-
-		MaterialSimpleAlbedoBase* mtl_tex = new
-			#ifdef EXPLICIT_LIGHT_SAMPLING
-			MaterialLambertian(
-			#else
-			//Both `MaterialLambertian` and `MaterialMirror` converge to the same render (as long as
-			//	explicit light sampling isn't used; light sampling will never hit a δ BRDF).
-			//	However, the mirror material converges much faster because the ray direction is not
-			//	a random variable.
-			MaterialMirror(
-			#endif
-				#if 1 //Lizard texture
-				"data/scenes/crystal-lizard-4096.png"
-				#else //A helpful 64⨯64 test image I made
-				"data/scenes/test-img.png"
-				#endif
-			);
-		result->materials["tex"] = mtl_tex;
-	}
-
-	{
-		result->primitives.emplace_back(new PrimQuad(result->materials["tex"],
-			{ Pos( -1, -1, 0 ), ST(0,0) },
-			{ Pos(  1, -1, 0 ), ST(1,0) },
-			{ Pos(  1,  1, 0 ), ST(1,1) },
-			{ Pos( -1,  1, 0 ), ST(0,1) }
-		));
-
-		float size = 10.0f;
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos( -size, -size,  size ), ST(0,0) },
-			{ Pos( -size, -size, -size ), ST(0,0) },
-			{ Pos( -size,  size, -size ), ST(0,0) },
-			{ Pos( -size,  size,  size ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos(  size, -size, -size ), ST(0,0) },
-			{ Pos(  size, -size,  size ), ST(0,0) },
-			{ Pos(  size,  size,  size ), ST(0,0) },
-			{ Pos(  size,  size, -size ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos( -size, -size,  size ), ST(0,0) },
-			{ Pos(  size, -size,  size ), ST(0,0) },
-			{ Pos(  size, -size, -size ), ST(0,0) },
-			{ Pos( -size, -size, -size ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos(  size,  size,  size ), ST(0,0) },
-			{ Pos( -size,  size,  size ), ST(0,0) },
-			{ Pos( -size,  size, -size ), ST(0,0) },
-			{ Pos(  size,  size, -size ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos( -size, -size, -size ), ST(0,0) },
-			{ Pos(  size, -size, -size ), ST(0,0) },
-			{ Pos(  size,  size, -size ), ST(0,0) },
-			{ Pos( -size,  size, -size ), ST(0,0) }
-		));
-		result->primitives.emplace_back(new PrimQuad(result->materials["light"],
-			{ Pos(  size, -size,  size ), ST(0,0) },
-			{ Pos( -size, -size,  size ), ST(0,0) },
-			{ Pos( -size,  size,  size ), ST(0,0) },
-			{ Pos(  size,  size,  size ), ST(0,0) }
-		));
-	}
-
-	result->_init();
-
-	return result;
-}
-
-void Scene::get_rand_toward_light(Math::RNG& rng, Pos const& from, Dir* dir,PrimBase const** light,float* pdf ) {
-	*light = lights[ rand_choice(rng,lights.size()) ];
-
-	#if 0 //Sample the bounding sphere of the light
-		SphereBound bound = (*light)->get_bound();
-
-		Dir vec_to_sph_cen = bound.center - from;
-
-		*dir = Math::rand_toward_sphere( rng, vec_to_sph_cen,bound.radius, pdf );
-	#else //Sample the primitive directly
-		(*light)->get_rand_toward( rng, from, dir,pdf );
-	#endif
-
-	*pdf /= static_cast<float>(lights.size());
-}
-
-bool Scene::intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore/*=nullptr*/) const {
-	hitrec->prim = nullptr;
-	hitrec->dist = INF;
-
-	bool hit = false;
-	for (PrimBase const* prim : primitives) {
-		if (prim!=ignore) {
-			hit |= prim->intersect(ray, hitrec);
-		}
-	}
-
-	return hit;
-}
+﻿#include "scene.hpp"
+
+#include "util/color.hpp"
+
+#include "environment.hpp"
+#include "geometry.hpp"
+#include "material.hpp"
+#include "stats.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+thread_local uint64_t Scene::num_rays_thread = 0;
+
+Scene::~Scene() {
+	delete bvh;
+
+	delete environment;
+
+	//Materials, primitives, and meshes are released with `.arena`.
+}
+
+void Scene::Camera::update_matrices() {
+	matr_P = glm::perspectiveFov(
+		glm::radians(vfov_deg),
+		static_cast<float>(res[0]), static_cast<float>(res[1]),
+		near, far
+	);
+	matr_V = glm::lookAt( pos, pos+dir, up );
+	matr_PV_inv = glm::inverse( matr_P * matr_V );
+}
+
+void Scene::init(BVH::BuildOptions const& accel_options/*=BVH::BuildOptions()*/) {
+	//Compute camera matrices.
+	camera.update_matrices();
+
+	//Make a list of all the lights so that we can sample them later.
+	for (PrimBase* prim : primitives) {
+		if (prim->is_light) lights.emplace_back(prim);
+	}
+	assert(!lights.empty()||environment!=nullptr);
+
+	//Build (or load) the acceleration structure.
+	bvh = new BVH(primitives,accel_options);
+}
+void Scene::wait_textures() const {
+	for (auto const& iter : materials) {
+		auto material = dynamic_cast<MaterialSimpleAlbedoBase const*>(iter.second);
+		if (material!=nullptr && material->albedo.texture!=nullptr) material->albedo.texture->wait();
+	}
+}
+Scene* Scene::get_new_empty() {
+	return new Scene;
+}
+Scene* Scene::get_new_cornell     (BVH::BuildOptions const& accel_options) {
+	//http://www.graphics.cornell.edu/online/box/data.html
+	Scene* result = new Scene;
+
+	{
+		result->camera.pos = Pos(278,273,-800);
+		result->camera.dir = glm::normalize(Dir(0,0,1));
+		result->camera.up  = Dir(0,1,0);
+
+		result->camera.res[0] = 512;
+		result->camera.res[1] = 512;
+		result->camera.near=0.1f; result->camera.far=1.0f;
+		result->camera.vfov_deg = 39.0f;
+		//focal = 0.035f;
+		//size
+	}
+
+	{
+		#ifdef RENDER_MODE_SPECTRAL
+			std::vector<std::vector<float>> data = load_spectral_data("data/scenes/cornell/white-green-red.csv");
+			if (data.size()==3); else { fprintf(stderr,"Invalid data in file!\n"); throw -1; }
+
+			MaterialLambertian* white_back      = result->arena.make<MaterialLambertian>();
+			white_back->set_albedo(SpectralReflectance( data[0], 400,700 ));
+			//white_back->set_albedo(SpectralReflectance( 1.0f ));
+
+			MaterialLambertian* white_blocks    = result->arena.make<MaterialLambertian>(*white_back);
+
+			MaterialLambertian* white_floorceil = result->arena.make<MaterialLambertian>(*white_back);
+
+			MaterialLambertian* green           = result->arena.make<MaterialLambertian>();
+			green->     set_albedo(SpectralReflectance( data[1], 400,700 ));
+
+			MaterialLambertian* red             = result->arena.make<MaterialLambertian>();
+			red->       set_albedo(SpectralReflectance( data[2], 400,700 ));
+		#else
+			MaterialLambertian* white_back      = result->arena.make<MaterialLambertian>();
+			white_back->set_albedo(RGB_Reflectance(1,1,1));
+
+			MaterialLambertian* white_blocks    = result->arena.make<MaterialLambertian>(*white_back);
+
+			MaterialLambertian* white_floorceil = result->arena.make<MaterialLambertian>(*white_back);
+
+			MaterialLambertian* green           = result->arena.make<MaterialLambertian>();
+			green->     set_albedo(RGB_Reflectance(0.07f,0.38f,0.07f)); //Set heuristically.  There is no correct way to set it.
+
+			MaterialLambertian* red             = result->arena.make<MaterialLambertian>();
+			red->       set_albedo(RGB_Reflectance(1,0,0));
+		#endif
+
+		result->materials["white-back"     ] = white_back;
+		result->materials["white-blocks"   ] = white_blocks;
+		result->materials["white-floorceil"] = white_floorceil;
+		result->materials["green"          ] = green;
+		result->materials["red"            ] = red;
+	}
+
+	{
+		MaterialLambertian* light = result->arena.make<MaterialLambertian>();
+		#ifdef RENDER_MODE_SPECTRAL
+			std::vector<std::vector<float>> data = load_spectral_data("data/scenes/cornell/light.csv");
+			if (data.size()==1); else { fprintf(stderr,"Invalid data in file!\n"); throw -1; }
+
+			light->emission         = SpectralRadiance( data[0], 400,700 ) * 200.0f;
+			//light->emission         = Color::data->D65_rad * 0.5f;
+			//light->emission         = Color::data->D65_rad * 5.0f;
+			light->set_albedo(SpectralReflectance( 0.78f ));
+		#else
+			light->emission         = RGB_Radiance(1,1,1) * 200.0f;
+			light->set_albedo(RGB_Reflectance( 0.78f ));
+		#endif
+
+		result->materials["light"] = light;
+	}
+
+	{
+		//Floor
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+			{ Pos( 552.8f, 0.0f,   0.0f ), ST(1,0) },
+			{ Pos(   0.0f, 0.0f,   0.0f ), ST(0,0) },
+			{ Pos(   0.0f, 0.0f, 559.2f ), ST(0,1) },
+			{ Pos( 549.6f, 0.0f, 559.2f ), ST(1,1) }
+		)));
+
+		#if 0
+			//Shift the light downward a bit
+
+			//Light (note moved down 0.1 so not on ceiling)
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["light"],
+				{ Pos( 343.0f, 548.7f, 227.0f ), ST(1,0) },
+				{ Pos( 343.0f, 548.7f, 332.0f ), ST(1,1) },
+				{ Pos( 213.0f, 548.7f, 332.0f ), ST(0,1) },
+				{ Pos( 213.0f, 548.7f, 227.0f ), ST(0,0) }
+			)));
+
+			//Ceiling
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+				{ Pos( 556.0f, 548.8f,   0.0f ), ST(1,0) },
+				{ Pos( 556.0f, 548.8f, 559.2f ), ST(1,1) },
+				{ Pos(   0.0f, 548.8f, 559.2f ), ST(0,1) },
+				{ Pos(   0.0f, 548.8f,   0.0f ), ST(0,0) }
+			)));
+		#else
+			/*
+			Actually cut a hole in the ceiling for the light:
+
+				A-------B    Left <-----+
+				| E---F |               |
+				| |   | |               |
+				| G---H |               v
+				C-------D             Front
+			*/
+
+			Pos A = Pos(   0.0f, 548.8f, 559.2f );
+			Pos B = Pos( 556.0f, 548.8f, 559.2f );
+			Pos C = Pos(   0.0f, 548.8f,   0.0f );
+			Pos D = Pos( 556.0f, 548.8f,   0.0f );
+			Pos E = Pos( 213.0f, 548.8f, 332.0f );
+			Pos F = Pos( 343.0f, 548.8f, 332.0f );
+			Pos G = Pos( 213.0f, 548.8f, 227.0f );
+			Pos H = Pos( 343.0f, 548.8f, 227.0f );
+
+			/*
+			This reduces variance for explicit light sampling significantly because rays can't get
+			onto the ceiling behind the light and sample the large solid angle (near-hemisphere)
+			toward it.
+			*/
+
+			//Light (H,F,E,G)
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["light"],
+				{ H, ST(1,0) },
+				{ F, ST(1,1) },
+				{ E, ST(0,1) },
+				{ G, ST(0,0) }
+			)));
+
+			//Ceiling
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+				{ D, ST(0,0) },
+				{ B, ST(0,0) },
+				{ F, ST(0,0) },
+				{ H, ST(0,0) }
+			)));
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+				{ B, ST(0,0) },
+				{ A, ST(0,0) },
+				{ E, ST(0,0) },
+				{ F, ST(0,0) }
+			)));
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+				{ A, ST(0,0) },
+				{ C, ST(0,0) },
+				{ G, ST(0,0) },
+				{ E, ST(0,0) }
+			)));
+			result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-floorceil"],
+				{ C, ST(0,0) },
+				{ D, ST(0,0) },
+				{ H, ST(0,0) },
+				{ G, ST(0,0) }
+			)));
+		#endif
+
+		//Back wall
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-back"],
+			{ Pos( 549.6f,   0.0f, 559.2f ), ST(0,0) },
+			{ Pos(   0.0f,   0.0f, 559.2f ), ST(1,0) },
+			{ Pos(   0.0f, 548.8f, 559.2f ), ST(1,1) },
+			{ Pos( 556.0f, 548.8f, 559.2f ), ST(0,1) }
+		)));
+
+		//Right wall
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["green"],
+			{ Pos( 0.0f,   0.0f, 559.2f ), ST(1,0) },
+			{ Pos( 0.0f,   0.0f,   0.0f ), ST(0,0) },
+			{ Pos( 0.0f, 548.8f,   0.0f ), ST(0,1) },
+			{ Pos( 0.0f, 548.8f, 559.2f ), ST(1,1) }
+		)));
+
+		//Left wall
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["red"  ],
+			{ Pos( 552.8f,   0.0f,   0.0f ), ST(0,0) },
+			{ Pos( 549.6f,   0.0f, 559.2f ), ST(1,0) },
+			{ Pos( 556.0f, 548.8f, 559.2f ), ST(1,1) },
+			{ Pos( 556.0f, 548.8f,   0.0f ), ST(0,1) }
+		)));
+
+		//Short block
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
+			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
+			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
+			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 290.0f,   0.0f, 114.0f ), ST(0,0) },
+			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) },
+			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
+			{ Pos( 240.0f,   0.0f, 272.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 130.0f,   0.0f,  65.0f ), ST(0,0) },
+			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
+			{ Pos( 290.0f, 165.0f, 114.0f ), ST(0,0) },
+			{ Pos( 290.0f,   0.0f, 114.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos(  82.0f,   0.0f, 225.0f ), ST(0,0) },
+			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
+			{ Pos( 130.0f, 165.0f,  65.0f ), ST(0,0) },
+			{ Pos( 130.0f,   0.0f,  65.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 240.0f,   0.0f, 272.0f ), ST(0,0) },
+			{ Pos( 240.0f, 165.0f, 272.0f ), ST(0,0) },
+			{ Pos(  82.0f, 165.0f, 225.0f ), ST(0,0) },
+			{ Pos(  82.0f,   0.0f, 225.0f ), ST(0,0) }
+		)));
+
+		//Tall block
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
+			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
+			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
+			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 423.0f,   0.0f, 247.0f ), ST(0,0) },
+			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
+			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) },
+			{ Pos( 472.0f,   0.0f, 406.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 472.0f,   0.0f, 406.0f ), ST(0,0) },
+			{ Pos( 472.0f, 330.0f, 406.0f ), ST(0,0) },
+			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
+			{ Pos( 314.0f,   0.0f, 456.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 314.0f,   0.0f, 456.0f ), ST(0,0) },
+			{ Pos( 314.0f, 330.0f, 456.0f ), ST(0,0) },
+			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
+			{ Pos( 265.0f,   0.0f, 296.0f ), ST(0,0) }
+		)));
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white-blocks"],
+			{ Pos( 265.0f,   0.0f, 296.0f ), ST(0,0) },
+			{ Pos( 265.0f, 330.0f, 296.0f ), ST(0,0) },
+			{ Pos( 423.0f, 330.0f, 247.0f ), ST(0,0) },
+			{ Pos( 423.0f,   0.0f, 247.0f ), ST(0,0) }
+		)));
+	}
+
+	result->init(accel_options);
+
+	return result;
+}
+Scene* Scene::get_new_cornell_srgb(BVH::BuildOptions const& accel_options) {
+	Scene* result = Scene::get_new_cornell(accel_options);
+
+	//MaterialBase* mtl_tex = result->arena.make<MaterialLambertian>("data/scenes/crystal-lizard-512.png"); float lightsc=30.0f;
+	MaterialBase* mtl_tex = result->arena.make<MaterialLambertian>("data/scenes/crystal-lizard-4096.png"); float lightsc=30.0f;
+	//MaterialBase* mtl_tex = result->arena.make<MaterialLambertian>("data/scenes/test-img.png"); float lightsc=20.0f;
+	result->materials["srgb"] = mtl_tex;
+
+	MaterialLambertian* mtl_white1 = result->arena.make<MaterialLambertian>();
+	#ifdef RENDER_MODE_SPECTRAL
+		mtl_white1->set_albedo(SpectralReflectance( 1.0f ));
+	#else
+		mtl_white1->set_albedo(RGB_Reflectance    ( 1.0f ));
+	#endif
+	result->materials["white1"] = mtl_white1;
+
+	for (PrimBase* prim : result->primitives) {
+		if      (prim->material==result->materials["white-blocks"   ]) prim->material=mtl_white1;
+		else if (prim->material==result->materials["white-floorceil"]) prim->material=mtl_white1;
+		else if (prim->material==result->materials["red"            ]) prim->material=mtl_tex;
+	}
+
+	static_cast<MaterialLambertian*>(result->materials["light"])->emission =
+		#ifdef RENDER_MODE_SPECTRAL
+			Color::data->D65_rad * lightsc
+		#else
+			RGB_Radiance(1,1,1)  * lightsc;
+		#endif
+	;
+
+	return result;
+}
+Scene* Scene::get_new_plane_srgb  (BVH::BuildOptions const& accel_options) {
+	Scene* result = new Scene;
+
+	{
+		result->camera.pos = Pos(0,0,5);
+		//result->camera.pos = Pos(50,30,20);
+		result->camera.dir = glm::normalize(Pos(0)-result->camera.pos);
+		result->camera.up  = Dir(0,1,0);
+
+		result->camera.res[0] = 512;
+		result->camera.res[1] = 512;
+		result->camera.near=0.1f; result->camera.far=1.0f;
+		result->camera.vfov_deg = glm::degrees(2.0f*std::atan2( 1.0f, result->camera.pos.z ));
+	}
+
+	{
+		//Both `MaterialLambertian` and `MaterialMirror` converge to the same render.  However, the
+		//	mirror material converges much faster because the ray direction is not a random
+		//	variable.  (For the same reason, explicit light sampling doesn't help, since light
+		//	sampling will never hit a δ BRDF.)
+		MaterialSimpleAlbedoBase* mtl_tex = result->arena.make<MaterialMirror>(
+			#if 1 //Lizard texture
+			"data/scenes/crystal-lizard-4096.png"
+			#else //A helpful 64⨯64 test image I made
+			"data/scenes/test-img.png"
+			#endif
+		);
+		result->materials["tex"] = mtl_tex;
+	}
+
+	{
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["tex"],
+			{ Pos( -1, -1, 0 ), ST(0,0) },
+			{ Pos(  1, -1, 0 ), ST(1,0) },
+			{ Pos(  1,  1, 0 ), ST(1,1) },
+			{ Pos( -1,  1, 0 ), ST(0,1) }
+		)));
+	}
+
+	//Uniform white surroundings
+	#ifdef RENDER_MODE_SPECTRAL
+		result->environment = new EnvironmentLight( Color::data->D65_rad );
+	#else
+		result->environment = new EnvironmentLight( RGB_Radiance(1,1,1) );
+	#endif
+	result->explicit_light_sampling = false;
+
+	result->init(accel_options);
+
+	return result;
+}
+
+Scene* Scene::get_new_instances   (BVH::BuildOptions const& accel_options) {
+	Scene* result = new Scene;
+
+	{
+		result->camera.pos = Pos(0,14,22);
+		result->camera.dir = glm::normalize(Pos(0,0,2)-result->camera.pos);
+		result->camera.up  = Dir(0,1,0);
+
+		result->camera.res[0] = 512;
+		result->camera.res[1] = 512;
+		result->camera.near=0.1f; result->camera.far=1.0f;
+		result->camera.vfov_deg = 50.0f;
+	}
+
+	{
+		MaterialLambertian* light = result->arena.make<MaterialLambertian>();
+		MaterialLambertian* white = result->arena.make<MaterialLambertian>();
+		MaterialLambertian* red   = result->arena.make<MaterialLambertian>();
+		#ifdef RENDER_MODE_SPECTRAL
+			std::vector<std::vector<float>> data = load_spectral_data("data/scenes/cornell/white-green-red.csv");
+			if (data.size()==3); else { fprintf(stderr,"Invalid data in file!\n"); throw -1; }
+
+			light->set_albedo(SpectralReflectance(0.0f));
+			light->emission = Color::data->D65_rad * 8.0f;
+			white->set_albedo(SpectralReflectance( data[0], 400,700 ));
+			red  ->set_albedo(SpectralReflectance( data[2], 400,700 ));
+		#else
+			light->set_albedo(RGB_Reflectance(0.0f));
+			light->emission = RGB_Radiance(1,1,1) * 8.0f;
+			white->set_albedo(RGB_Reflectance(1,1,1));
+			red  ->set_albedo(RGB_Reflectance(1,0,0));
+		#endif
+		result->materials["light"] = light;
+		result->materials["white"] = white;
+		result->materials["red"  ] = red;
+	}
+
+	{
+		//Floor
+		result->primitives.emplace_back(result->arena.add(PrimQuad(result->materials["white"],
+			{ Pos(  20.0f, 0.0f, -20.0f ), ST(1,0) },
+			{ Pos( -20.0f, 0.0f, -20.0f ), ST(0,0) },
+			{ Pos( -20.0f, 0.0f,  20.0f ), ST(0,1) },
+			{ Pos(  20.0f, 0.0f,  20.0f ), ST(1,1) }
+		)));
+
+		//Lights: disk (facing down) and a small sphere
+		result->primitives.emplace_back(result->arena.make<PrimDisk>(result->materials["light"],
+			Pos( 0.0f, 12.0f, 0.0f ), Dir(0,-1,0), 4.5f
+		));
+		result->primitives.emplace_back(result->arena.make<PrimSphere>(result->materials["light"],
+			Pos( 6.0f, 5.0f, 6.0f ), 0.5f
+		));
+
+		//Mesh: unit box standing on the origin
+		std::vector<PrimBase*> box;
+		auto add_face = [&](Pos const& center, Dir const& u,Dir const& v) -> void {
+			//Normal is along `cross(u,v)`
+			box.emplace_back(result->arena.add(PrimQuad(result->materials["white"],
+				{ center-u-v, ST(0,0) },
+				{ center+u-v, ST(1,0) },
+				{ center+u+v, ST(1,1) },
+				{ center-u+v, ST(0,1) }
+			)));
+		};
+		Dir x=Dir(0.5f,0,0), y=Dir(0,0.5f,0), z=Dir(0,0,0.5f);
+		add_face( Pos(0,0.5f,0)+x, y,z ); add_face( Pos(0,0.5f,0)-x, z,y );
+		add_face( Pos(0,0.5f,0)+y, z,x ); add_face( Pos(0,0.5f,0)-y, x,z );
+		add_face( Pos(0,0.5f,0)+z, x,y ); add_face( Pos(0,0.5f,0)-z, y,x );
+		Mesh* mesh = result->arena.make<Mesh>( std::move(box), accel_options );
+		result->meshes.emplace_back(mesh);
+
+		//Instances of the box on a grid, with (repeatable) random rotations and heights, and every
+		//	seventh overriding the material.
+		Math::RNG rng;
+		for (int j=-12;j<12;++j) {
+			for (int i=-12;i<12;++i) {
+				glm::mat4 transform = glm::translate( glm::mat4(1.0f), Pos( 1.5f*(static_cast<float>(i)+0.5f), 0.0f, 1.5f*(static_cast<float>(j)+0.5f) ) );
+				transform = glm::rotate( transform, 2.0f*Constants::pi<float>*rand_1f(rng), Dir(0,1,0) );
+				transform = glm::scale ( transform, Dir( 0.8f, 0.5f+2.0f*rand_1f(rng), 0.8f ) );
+				bool recolor = ((i+12)+24*(j+12))%7==0;
+				result->primitives.emplace_back(result->arena.make<PrimInstance>( mesh, transform, recolor?result->materials["red"]:nullptr ));
+			}
+		}
+	}
+
+	result->init(accel_options);
+
+	return result;
+}
+void Scene::get_rand_toward_light(Math::RNG& rng, Pos const& from, Dir* dir,PrimBase const** light,float* pdf ) {
+	//The environment, if any, is chosen as-if it were one more light.
+	size_t num_lights = lights.size() + (environment!=nullptr?1:0);
+	size_t index = rand_choice(rng,num_lights);
+	if (index==lights.size()) {
+		*light = nullptr;
+		environment->get_rand_toward( rng, dir,pdf );
+		*pdf /= static_cast<float>(num_lights);
+		return;
+	}
+	*light = lights[index];
+
+	#if 0 //Sample the bounding sphere of the light
+		SphereBound bound = (*light)->get_bound();
+
+		Dir vec_to_sph_cen = bound.center - from;
+
+		*dir = Math::rand_toward_sphere( rng, vec_to_sph_cen,bound.radius, pdf );
+	#else //Sample the primitive directly
+		(*light)->get_rand_toward( rng, from, dir,pdf );
+	#endif
+
+	*pdf /= static_cast<float>(num_lights);
+}
+
+bool Scene::intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore/*=nullptr*/,PrimInstance const* ignore_instance/*=nullptr*/) const {
+	++num_rays_thread;
+	STATS_PHASE(INTERSECTION);
+
+	hitrec->prim     = nullptr;
+	hitrec->instance = nullptr;
+	hitrec->material = nullptr;
+	hitrec->dist     = INF;
+
+	return bvh->intersect(ray,hitrec,ignore,ignore_instance);
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,67 +1,121 @@
-#pragma once
-
-#include "stdafx.hpp"
-
-#include "util/random.hpp"
-
-
-
-class MaterialBase;
-
-//Encapsulates a simple scene
-class Scene final {
-	public:
-		//Camera parameters.  A simple pinhole camera projection model is used, similar to classic
-		//	OpenGL.
-		struct {
-			//Position, look-at, and up vectors (same meaning as `gluLookat(...)`).
-			Pos pos;
-			Dir dir;
-			Dir up;
-
-			//Screen resolution
-			size_t res[2];
-			//Near and far clipping planes (not really relevant; used for projection matrix).
-			float near, far;
-			//Vertical field of view (°)
-			float vfov_deg;
-
-			//Projection, view, and inverse-projection-times-view matrices.
-			glm::dmat4x4 matr_P;
-			glm::dmat4x4 matr_V;
-			glm::dmat4x4 matr_PV_inv;
-		} camera;
-
-		//Backing store of materials.  Map of their names onto the materials themselves.
-		std::map<std::string,MaterialBase*> materials;
-
-		//Backing store of all primitives.
-		std::vector<PrimBase*> primitives;
-		//Convenience view of all primitives that have emissive materials (i.e. are lights).
-		std::vector<PrimBase*> lights;
-
-	private:
-		Scene() = default;
-	public:
-		~Scene();
-
-	private:
-		//Common method to precompute some scene data.
-		void _init();
-	public:
-		//Construct new scenes from hard-coded parameters.
-		//	Cornell box with original data
-		static Scene* get_new_cornell     ();
-		//	Cornell box with some walls replaced by white and others by textures
-		static Scene* get_new_cornell_srgb();
-		//	Camera exactly looking at plane in white environment box
-		static Scene* get_new_plane_srgb  ();
-
-		//Get a random direction `dir` from `from` to a randomly chosen light returned in `light`.
-		//	The probability density of choosing this direction is returned in `pdf`.
-		void get_rand_toward_light(Math::RNG& rng, Pos const& from, Dir* dir,PrimBase const** light,float* pdf );
-
-		//Intersect ray `ray` with the scene.  Returns whether anything was hit, with data in
-		//	`hitrec`.  `ignore` can be passed to ignore hits from that primitive.
-		bool intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore=nullptr) const;
-};
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/arena.hpp"
+#include "util/random.hpp"
+
+#include "bvh.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+class EnvironmentLight;
+class MaterialBase;
+class Mesh;
+class PrimInstance;
+
+//Encapsulates a simple scene
+class Scene final {
+	public:
+		//Camera parameters.  A simple pinhole camera projection model is used, similar to classic
+		//	OpenGL.
+		class Camera final { public:
+			//Position, look-at, and up vectors (same meaning as `gluLookat(...)`).
+			Pos pos;
+			Dir dir;
+			Dir up;
+
+			//Screen resolution
+			size_t res[2];
+			//Near and far clipping planes (not really relevant; used for projection matrix).
+			float near, far;
+			//Vertical field of view (°)
+			float vfov_deg;
+
+			//Projection, view, and inverse-projection-times-view matrices.
+			glm::dmat4x4 matr_P;
+			glm::dmat4x4 matr_V;
+			glm::dmat4x4 matr_PV_inv;
+
+			//Compute the matrices from the parameters above.
+			void update_matrices();
+		} camera;
+
+		//Storage of the scene's materials, meshes, and primitives (including meshes' primitives),
+		//	which are allocated from it.  Objects of each type are packed together, and all are
+		//	released at once with the scene.
+		Arena arena;
+
+		//Materials.  Map of their names onto the materials themselves.
+		std::map<std::string,MaterialBase*> materials;
+
+		//Meshes, which are placed in the scene by `PrimInstance`s.
+		std::vector<Mesh*> meshes;
+
+		//All primitives (including instances, but not meshes' primitives).
+		std::vector<PrimBase*> primitives;
+		//Convenience view of all primitives that have emissive materials (i.e. are lights).
+		std::vector<PrimBase*> lights;
+
+		//Light surrounding the scene, seen by rays that escape it (owned; `nullptr` if none).
+		EnvironmentLight* environment;
+
+		//Acceleration structure over `primitives` (the top level, over instances and all other
+		//	primitives).
+		BVH* bvh;
+
+		//Whether the scene converges faster with explicit light sampling (the default for renders
+		//	of it; see `Renderer::Options::Integrator`).  It does for small lights, but not for
+		//	e.g. large, uniform surroundings.
+		bool explicit_light_sampling;
+
+	private:
+		Scene() : environment(nullptr), bvh(nullptr), explicit_light_sampling(true) {}
+	public:
+		~Scene();
+
+		//Precompute some scene data, including the acceleration structure (built or loaded
+		//	according to `accel_options`).  Called once the scene is complete, by the constructors
+		//	below or (for a scene constructed programmatically) by the caller.
+		void init(BVH::BuildOptions const& accel_options=BVH::BuildOptions());
+
+		//Wait for the materials' textures to finish loading (they load in the background; see
+		//	`sRGB_ReflectanceTexture`).  Throws if any failed to load.
+		void wait_textures() const;
+
+		//Construct a new, empty scene, to be constructed programmatically: set `.camera`, add
+		//	materials, meshes, and primitives (allocated from `.arena`), and optionally an
+		//	`.environment` (there must be a light or an environment), and then call `.init(...)`.
+		static Scene* get_new_empty();
+		//Construct new scenes from hard-coded parameters.  The acceleration structure is built or
+		//	loaded according to `accel_options`.
+		//	Cornell box with original data
+		static Scene* get_new_cornell     (BVH::BuildOptions const& accel_options=BVH::BuildOptions());
+		//	Cornell box with some walls replaced by white and others by textures
+		static Scene* get_new_cornell_srgb(BVH::BuildOptions const& accel_options=BVH::BuildOptions());
+		//	Camera exactly looking at plane in white environment
+		static Scene* get_new_plane_srgb  (BVH::BuildOptions const& accel_options=BVH::BuildOptions());
+		//	Field of many instances of the same mesh under disk and sphere lights
+		static Scene* get_new_instances   (BVH::BuildOptions const& accel_options=BVH::BuildOptions());
+
+		//Get a random direction `dir` from `from` to a randomly chosen light returned in `light`
+		//	(`nullptr` if the environment was chosen).  The probability density of choosing this
+		//	direction is returned in `pdf`.
+		void get_rand_toward_light(Math::RNG& rng, Pos const& from, Dir* dir,PrimBase const** light,float* pdf );
+
+		//Intersect ray `ray` with the scene.  Returns whether anything was hit, with data in
+		//	`hitrec`.  `ignore` can be passed to ignore hits from that primitive (with
+		//	`ignore_instance` as the instance it was hit in, if any, as in `HitRecord`).
+		bool intersect(Ray const& ray, HitRecord* hitrec, PrimBase const* ignore=nullptr,PrimInstance const* ignore_instance=nullptr) const;
+
+		//Number of rays the calling thread has intersected with any scene (see `.intersect(...)`).
+		static thread_local uint64_t num_rays_thread;
+};
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,57 @@
+#pragma once
+
+//Interface of the renderer as a library (the "simple-spectral-core" target), for embedding it in
+//	other programs instead of running the executable and reading its output files back.
+//
+//	Usage:
+//		Initialize the global data with `SimpleSpectral::init()` (and finally clean it up with
+//			`SimpleSpectral::deinit()`).  In spectral modes, the data is loaded from "data/",
+//			relative to the working directory.
+//		Load one of the built-in scenes with `Renderer::get_new_scene(...)`, or construct one
+//			programmatically (see `Scene::get_new_empty()`).
+//		Create a `Renderer` for the scene, with `Renderer::Options` giving at-least the resolution
+//			and samples per pixel (and no output path).  Render frames with
+//			`Renderer::render_into(...)`, into storage of your own in any of several formats,
+//			optionally being notified as each tile completes.  The camera can be changed between
+//			frames (`Renderer::camera`), and several renderers may share a scene.
+
+#include "stdafx.hpp"
+
+#include "util/color.hpp"
+
+#include "environment.hpp"
+#include "geometry.hpp"
+#include "material.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+namespace SimpleSpectral {
+
+
+
+//Initialization of global data, before creating any scenes
+inline void   init() {
+	#ifdef RENDER_MODE_SPECTRAL
+	Color::init();
+	#endif
+}
+//Cleanup of global data, after destroying all scenes and renderers
+inline void deinit() {
+	#ifdef RENDER_MODE_SPECTRAL
+	Color::deinit();
+	#endif
+}
+
+
+
+}
+
+
+
+RENDER_VARIANT_END
@@ -1,85 +1,142 @@
-﻿#pragma once
-
-#include "stdafx.hpp"
-
-
-
-#ifdef RENDER_MODE_SPECTRAL
-
-
-
-//Encapsulates a spectrum defined by sequence of "n" values over a wavelength range "[λₘᵢₙ,λₘₐₓ]".
-class _Spectrum final {
-	public:
-		//Sample value at some wavelength "λ₀" (specified by context), with "n-1" additional sample
-		//	values "λ₁" through "λₙ₋₁" at wavelengths "λᵢ = λ₀ + i (λₘₐₓ-λₘᵢₙ)/n".  I.e., hero
-		//	wavelength sampling.
-		typedef glm::vec<SAMPLE_WAVELENGTHS,float> HeroSample;
-
-	private:
-		//Sequence of values defining the spectrum.  The first value is at wavelength "λₘᵢₙ" (i.e.
-		//	`._low`).  The last value is at wavelength `._high` (i.e. "λₘₐₓ").  The rest are evenly
-		//	spaced in-between.
-		std::vector<float> _data;
-		nm _low, _high;
-
-		//Values used internally.  Equal to "(λₘₐₓ-λₘᵢₙ)/n" and "n/(λₘₐₓ-λₘᵢₙ)".
-		float _delta_lambda;
-		float _delta_lambda_recip;
-
-		//Method used to reconstruct the spectrum when sampled.
-		typedef float(_Spectrum::*SpectrumSampler)(nm)const;
-		SpectrumSampler _sampler = &_Spectrum::_sample_linear;
-
-	public:
-		//Empty spectrum (invalid)
-		_Spectrum() = default;
-		//Spectrum is constant value of `data` over range [`LAMBDA_MIN`,`LAMBDA_MAX`].
-		explicit _Spectrum(float data);
-		//Spectrum takes values given by `data` sampled over the wavelength range [`low`,`high`].
-		_Spectrum(std::vector<float> const& data, nm low,nm high);
-		~_Spectrum() = default;
-
-		//Set the reconstruction method.
-		void set_filter_nearest() { _sampler=&_Spectrum::_sample_nearest; }
-		void set_filter_linear () { _sampler=&_Spectrum::_sample_linear;  }
-
-		//Sample the spectrum given the hero wavelength "λ₀" given by `lambda_0`.
-	private:
-		float _sample_nearest(nm lambda) const;
-		float _sample_linear (nm lambda) const;
-	public:
-		HeroSample operator[](nm lambda_0) const;
-
-		//Multiplication of this spectrum by a constant scalar `sc`, returning a new spectrum.
-		_Spectrum operator*(float sc) const;
-		//Multiplication of this spectrum by another spectrum.
-		_Spectrum operator*(_Spectrum const& other) const;
-		//Addition of this spectrum to another spectrum.
-		_Spectrum operator+(_Spectrum const& other) const;
-
-		//Compute the integral of the spectrum with respect to wavelength.
-		static float integrate(_Spectrum const& spec                         );
-		static float integrate(_Spectrum const& spec0, _Spectrum const& spec1);
-};
-
-//Spectral radiance (note units: kW·sr⁻¹·m⁻²·nm⁻¹)
-typedef _Spectrum SpectralRadiance;
-//Spectral radiant flux (note units: kW·nm⁻¹)
-typedef _Spectrum SpectralRadiantFlux;
-//Spectral reciprocal-steradians (sr⁻¹)
-typedef _Spectrum SpectralRecipSR;
-//Spectral reflectance (dimensionless, between "0" and "1")
-typedef _Spectrum SpectralReflectance;
-//Unspecified meaning (probably bogus dimensions)
-typedef _Spectrum SpectrumUnspecified;
-
-
-
-//Loads spectral data from a CSV file.  The data is in rows, and is therefore returned as a list of
-//	column vectors.
-std::vector<std::vector<float>> load_spectral_data(std::string const& csv_path);
-
-
-
-#endif
+﻿#pragma once
+
+#include "stdafx.hpp"
+
+
+
+#ifdef RENDER_MODE_SPECTRAL
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Hero wavelength sample of more than four wavelengths (GLM's vectors stop at four).  Elementwise
+//	arithmetic like that of GLM's vectors, with the values aligned so that the loops vectorize.
+template <size_t n> class alignas( std::min(n*sizeof(float)&~(n*sizeof(float)-1),64_zu) ) _HeroSample final {
+	private:
+		float _values[n];
+
+	public:
+		_HeroSample() = default;
+		explicit _HeroSample(float value) { for (size_t i=0;i<n;++i) _values[i]=value; }
+
+		float      & operator[](size_t i)       { return _values[i]; }
+		float const& operator[](size_t i) const { return _values[i]; }
+
+		#define HERO_SAMPLE_OP(OP)\
+			_HeroSample& operator OP##=(_HeroSample const& other) { for (size_t i=0;i<n;++i) _values[i] OP##= other._values[i]; return *this; }\
+			_HeroSample& operator OP##=(float              sc   ) { for (size_t i=0;i<n;++i) _values[i] OP##= sc;              return *this; }\
+			friend _HeroSample operator OP(_HeroSample a, _HeroSample const& b) { return a OP##= b; }\
+			friend _HeroSample operator OP(_HeroSample a, float              b) { return a OP##= b; }\
+			friend _HeroSample operator OP(float a, _HeroSample const& b) {\
+				_HeroSample result; for (size_t i=0;i<n;++i) result._values[i]=a OP b._values[i]; return result;\
+			}
+		HERO_SAMPLE_OP(+)
+		HERO_SAMPLE_OP(-)
+		HERO_SAMPLE_OP(*)
+		HERO_SAMPLE_OP(/)
+		#undef HERO_SAMPLE_OP
+
+		friend float dot(_HeroSample const& a, _HeroSample const& b) {
+			float result = 0.0f;
+			for (size_t i=0;i<n;++i) result+=a._values[i]*b._values[i];
+			return result;
+		}
+};
+
+
+
+//Encapsulates a spectrum defined by sequence of "n" values over a wavelength range "[λₘᵢₙ,λₘₐₓ]".
+class _Spectrum final {
+	public:
+		//Sample value at some wavelength "λ₀" (specified by context), with "n-1" additional sample
+		//	values "λ₁" through "λₙ₋₁" at wavelengths "λᵢ = λ₀ + i (λₘₐₓ-λₘᵢₙ)/n".  I.e., hero
+		//	wavelength sampling.
+		//	Up to four wavelengths, this is a GLM vector.
+		typedef std::conditional_t<
+			SAMPLE_WAVELENGTHS<=4, glm::vec<std::min(SAMPLE_WAVELENGTHS,4_zu),float>, _HeroSample<SAMPLE_WAVELENGTHS>
+		> HeroSample;
+
+	private:
+		//Sequence of values defining the spectrum.  The first value is at wavelength "λₘᵢₙ" (i.e.
+		//	`._low`).  The last value is at wavelength `._high` (i.e. "λₘₐₓ").  The rest are evenly
+		//	spaced in-between.
+		std::vector<float> _data;
+		nm _low, _high;
+
+		//Values used internally.  Equal to "(λₘₐₓ-λₘᵢₙ)/n" and "n/(λₘₐₓ-λₘᵢₙ)".
+		float _delta_lambda;
+		float _delta_lambda_recip;
+
+		//Method used to reconstruct the spectrum when sampled.
+		typedef float(_Spectrum::*SpectrumSampler)(nm)const;
+		SpectrumSampler _sampler = &_Spectrum::_sample_linear;
+
+	public:
+		//Empty spectrum (invalid)
+		_Spectrum() = default;
+		//Spectrum is constant value of `data` over range [`LAMBDA_MIN`,`LAMBDA_MAX`].
+		explicit _Spectrum(float data);
+		//Spectrum takes values given by `data` sampled over the wavelength range [`low`,`high`].
+		_Spectrum(std::vector<float> const& data, nm low,nm high);
+		~_Spectrum() = default;
+
+		//The samples and the wavelength range they span.
+		std::vector<float> const& get_data() const { return _data; }
+		nm get_low () const { return _low;  }
+		nm get_high() const { return _high; }
+
+		//Set the reconstruction method.
+		void set_filter_nearest() { _sampler=&_Spectrum::_sample_nearest; }
+		void set_filter_linear () { _sampler=&_Spectrum::_sample_linear;  }
+
+		//Sample the spectrum given the hero wavelength "λ₀" given by `lambda_0`.
+	private:
+		float _sample_nearest(nm lambda) const;
+		float _sample_linear (nm lambda) const;
+	public:
+		HeroSample operator[](nm lambda_0) const;
+
+		//Whether this spectrum is identical to `other` (same samples, range, and reconstruction).
+		bool operator==(_Spectrum const& other) const;
+		//Hash of the bytes of the spectrum's contents.
+		size_t get_hash() const;
+
+		//Multiplication of this spectrum by a constant scalar `sc`, returning a new spectrum.
+		_Spectrum operator*(float sc) const;
+		//Multiplication of this spectrum by another spectrum.
+		_Spectrum operator*(_Spectrum const& other) const;
+		//Addition of this spectrum to another spectrum.
+		_Spectrum operator+(_Spectrum const& other) const;
+
+		//Compute the integral of the spectrum with respect to wavelength.
+		static float integrate(_Spectrum const& spec                         );
+		static float integrate(_Spectrum const& spec0, _Spectrum const& spec1);
+};
+
+//Spectral radiance (note units: kW·sr⁻¹·m⁻²·nm⁻¹)
+typedef _Spectrum SpectralRadiance;
+//Spectral radiant flux (note units: kW·nm⁻¹)
+typedef _Spectrum SpectralRadiantFlux;
+//Spectral reciprocal-steradians (sr⁻¹)
+typedef _Spectrum SpectralRecipSR;
+//Spectral reflectance (dimensionless, between "0" and "1")
+typedef _Spectrum SpectralReflectance;
+//Unspecified meaning (probably bogus dimensions)
+typedef _Spectrum SpectrumUnspecified;
+
+
+
+//Loads spectral data from a CSV file.  The data is in rows, and is therefore returned as a list of
+//	column vectors.
+std::vector<std::vector<float>> load_spectral_data(std::string const& csv_path);
+
+
+
+RENDER_VARIANT_END
+
+
+
+#endif
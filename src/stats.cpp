@@ -0,0 +1,149 @@
+#include "stats.hpp"
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+namespace Stats {
+
+
+
+#ifdef RENDER_STATISTICS
+
+thread_local ThreadState thread_state;
+
+//Names of the counters in the report, as group and name within it (`nullptr` if ungrouped)
+static char const*const _counter_names[static_cast<size_t>(COUNTER::NUM)][2] = {
+	{ "rays", "camera" }, { "rays", "bounce" }, { "rays", "shadow" },
+	{ "intersection_tests", "nodes" }, { "intersection_tests", "primitives" },
+	{ "bsdf_evaluations", "lambertian" }, { "bsdf_evaluations", "mirror" },
+	{ "bsdf_samples",     "lambertian" }, { "bsdf_samples",     "mirror" },
+	{ "texture_lookups", nullptr }
+};
+static char const*const _phase_names[static_cast<size_t>(PHASE::NUM)] = {
+	"other", "intersection", "shading", "spectral_conversion", "framebuffer"
+};
+
+Counters& Counters::operator+=(Counters const& other) {
+	for (size_t k=0;k<static_cast<size_t>(COUNTER::NUM);++k) counts      [k]+=other.counts      [k];
+	for (size_t k=0;k<STATS_PATH_LENGTHS;               ++k) path_lengths[k]+=other.path_lengths[k];
+	for (size_t k=0;k<static_cast<size_t>(PHASE::NUM  );++k) phase_ns    [k]+=other.phase_ns    [k];
+
+	//	(Threads' performance counters normally have the same source; if not, only the first's
+	//		counts are kept.)
+	if (perf_source==PerfCounters::SOURCE::NONE) {
+		perf_source     = other.perf_source;
+		perf_num_events = other.perf_num_events;
+		std::copy( other.perf_names, other.perf_names+PerfCounters::MAX_EVENTS, perf_names );
+	}
+	if (other.perf_source==perf_source) {
+		for (size_t k=0;k<static_cast<size_t>(PHASE::NUM);++k) {
+			for (size_t l=0;l<perf_num_events;++l) perf_counts[k][l]+=other.perf_counts[k][l];
+		}
+	}
+	return *this;
+}
+
+void Counters::write_json(FILE* file, double seconds, size_t num_threads) const {
+	fprintf(file,"{\n\t\"seconds\": %.6f,\n\t\"threads\": %zu",seconds,num_threads);
+
+	//Counters, grouped into objects
+	for (size_t k=0;k<static_cast<size_t>(COUNTER::NUM);++k) {
+		char const* group = _counter_names[k][0];
+		char const* name  = _counter_names[k][1];
+		if (name==nullptr) {
+			fprintf(file,",\n\t\"%s\": %llu",group,static_cast<unsigned long long>(counts[k]));
+			continue;
+		}
+		bool first = k==0 || std::strcmp(_counter_names[k-1][0],group)!=0;
+		bool last  = k+1==static_cast<size_t>(COUNTER::NUM) || std::strcmp(_counter_names[k+1][0],group)!=0;
+		if (first) fprintf(file,",\n\t\"%s\": { ",group);
+		else       fprintf(file,", ");
+		fprintf(file,"\"%s\": %llu",name,static_cast<unsigned long long>(counts[k]));
+		if (last ) fprintf(file," }");
+	}
+
+	//	Paths of each length, starting from one
+	fprintf(file,",\n\t\"path_lengths\": [ ");
+	for (size_t k=0;k<STATS_PATH_LENGTHS;++k) {
+		fprintf(file,"%s%llu",k>0?", ":"",static_cast<unsigned long long>(path_lengths[k]));
+	}
+	fprintf(file," ]");
+
+	//	Time in each phase, summed over the threads
+	fprintf(file,",\n\t\"thread_seconds\": { ");
+	for (size_t k=0;k<static_cast<size_t>(PHASE::NUM);++k) {
+		fprintf(file,"%s\"%s\": %.6f",k>0?", ":"",_phase_names[k],static_cast<double>(phase_ns[k])*1.0e-9);
+	}
+	fprintf(file," }");
+
+	//	Performance counters in each phase, summed over the threads, with instructions per cycle
+	//		if both are counted
+	if (perf_source!=PerfCounters::SOURCE::NONE) {
+		size_t index_cycles=perf_num_events, index_instructions=perf_num_events;
+		for (size_t l=0;l<perf_num_events;++l) {
+			if (std::strcmp(perf_names[l],"cycles"      )==0) index_cycles      =l;
+			if (std::strcmp(perf_names[l],"instructions")==0) index_instructions=l;
+		}
+
+		fprintf(file,",\n\t\"perf\": {\n\t\t\"source\": \"%s\"",PerfCounters::get_source_name(perf_source));
+		for (size_t k=0;k<static_cast<size_t>(PHASE::NUM);++k) {
+			fprintf(file,",\n\t\t\"%s\": { ",_phase_names[k]);
+			for (size_t l=0;l<perf_num_events;++l) {
+				fprintf(file,"%s\"%s\": %llu",l>0?", ":"",perf_names[l],static_cast<unsigned long long>(perf_counts[k][l]));
+			}
+			if (index_cycles<perf_num_events && index_instructions<perf_num_events) {
+				uint64_t cycles = perf_counts[k][index_cycles];
+				double ipc = cycles>0 ? static_cast<double>(perf_counts[k][index_instructions])/static_cast<double>(cycles) : 0.0;
+				fprintf(file,", \"ipc\": %.4f",ipc);
+			}
+			fprintf(file," }");
+		}
+		fprintf(file,"\n\t}");
+	}
+
+	fprintf(file,"\n}\n");
+}
+
+void charge_perf(ThreadState& state) {
+	//	(If the counters can't be read, the counts since are charged at the next reading instead.)
+	uint64_t values[PerfCounters::MAX_EVENTS];
+	if (!state.perf->read(values)) return;
+
+	uint64_t* counts = state.counters.perf_counts[static_cast<size_t>(state.phase)];
+	for (size_t l=0;l<state.counters.perf_num_events;++l) {
+		counts[l] += values[l] - state.perf_start[l];
+		state.perf_start[l] = values[l];
+	}
+}
+
+void begin_thread(PerfCounters const* perf/*=nullptr*/) {
+	thread_state.counters    = Counters();
+	thread_state.phase       = PHASE::OTHER;
+	thread_state.phase_start = std::chrono::steady_clock::now();
+
+	//	(Performance counters that can't be read initially aren't used.)
+	thread_state.perf = perf!=nullptr && perf->read(thread_state.perf_start) ? perf : nullptr;
+	if (thread_state.perf!=nullptr) {
+		Counters& counters = thread_state.counters;
+		counters.perf_source     = perf->get_source();
+		counters.perf_num_events = perf->get_num_events();
+		for (size_t l=0;l<counters.perf_num_events;++l) counters.perf_names[l]=perf->get_name(l);
+	}
+}
+Counters end_thread() {
+	set_phase(PHASE::OTHER);
+	return thread_state.counters;
+}
+
+#endif
+
+
+
+}
+
+
+
+RENDER_VARIANT_END
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "util/perf-counters.hpp"
+
+#include <chrono>
+
+
+
+RENDER_VARIANT_BEGIN
+
+
+
+//Statistics of where a render's work and time go (built only with `RENDER_STATISTICS`; see
+//	"CMakeLists.txt").  Each thread counts into its own `Stats::thread_state`, without
+//	synchronization, and the renderer merges the threads' counts at the end of each frame and
+//	writes them next to the image (see `Renderer`).  The hot paths use the macros below, which
+//	expand to nothing when statistics are disabled.
+//	Time is attributed to phases: each thread is in one phase at a time, and time is charged to a
+//	phase from when the thread enters it until it enters another (so that e.g. the intersections of
+//	a path's bounces aren't also counted in shading it).  Optionally, performance counters (see
+//	`PerfCounters`) are attributed to the phases the same way.
+namespace Stats {
+
+
+
+#ifdef RENDER_STATISTICS
+
+//Counted events
+enum class COUNTER : size_t {
+	RAYS_CAMERA, RAYS_BOUNCE, RAYS_SHADOW,
+	//	Visits of acceleration structure nodes, and intersection tests of (non-instance) primitives
+	TESTS_NODE, TESTS_PRIM,
+	//	BSDF evaluations, and samplings, by material type
+	BSDF_EVALUATE_LAMBERTIAN, BSDF_EVALUATE_MIRROR,
+	BSDF_SAMPLE_LAMBERTIAN,   BSDF_SAMPLE_MIRROR,
+	TEXTURE_LOOKUPS,
+	NUM
+};
+
+//Phases to which time is attributed
+enum class PHASE : size_t {
+	OTHER, //Not rendering pixels (e.g. waiting for tiles)
+	INTERSECTION, SHADING, SPECTRAL_CONVERSION, FRAMEBUFFER,
+	NUM
+};
+
+//Number of bins of the histogram of path lengths (number of segments, not counting shadow rays).
+//	The last bin also counts longer paths.
+#define STATS_PATH_LENGTHS 32_zu
+
+//Counts of one thread, or merged from several.
+class Counters final {
+	public:
+		uint64_t counts[static_cast<size_t>(COUNTER::NUM)] = {};
+		uint64_t path_lengths[STATS_PATH_LENGTHS] = {};
+		//Time in each phase (ns)
+		uint64_t phase_ns[static_cast<size_t>(PHASE::NUM)] = {};
+
+		//Performance counters, if used: their source and names, and their counts in each phase
+		PerfCounters::SOURCE perf_source = PerfCounters::SOURCE::NONE;
+		size_t perf_num_events = 0;
+		char const* perf_names[PerfCounters::MAX_EVENTS] = {};
+		uint64_t perf_counts[static_cast<size_t>(PHASE::NUM)][PerfCounters::MAX_EVENTS] = {};
+
+	public:
+		Counters& operator+=(Counters const& other);
+
+		//Write the counts as a JSON document to `file`, with the wall-clock duration of the render
+		//	`seconds` and number of threads `num_threads` (the times of the phases are summed over
+		//	the threads).
+		void write_json(FILE* file, double seconds, size_t num_threads) const;
+};
+
+//Counting state of a thread
+class ThreadState final { public:
+	Counters counters;
+	PHASE phase;
+	std::chrono::steady_clock::time_point phase_start;
+
+	//The thread's performance counters (if used), and their values at the start of the phase
+	PerfCounters const* perf;
+	uint64_t perf_start[PerfCounters::MAX_EVENTS];
+};
+extern thread_local ThreadState thread_state;
+
+//Charge the performance counters since the last change of phase to the current phase.
+void charge_perf(ThreadState& state);
+
+inline void count(COUNTER counter) {
+	++thread_state.counters.counts[static_cast<size_t>(counter)];
+}
+inline void count_path_length(unsigned length) {
+	++thread_state.counters.path_lengths[ std::clamp(static_cast<size_t>(length),1_zu,STATS_PATH_LENGTHS)-1 ];
+}
+
+//Enter phase `phase`, charging the time since the last change to the previous phase, which is
+//	returned.
+inline PHASE set_phase(PHASE phase) {
+	ThreadState& state = thread_state;
+	auto now = std::chrono::steady_clock::now();
+	state.counters.phase_ns[static_cast<size_t>(state.phase)] += static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(now-state.phase_start).count()
+	);
+	state.phase_start = now;
+	if (state.perf!=nullptr) charge_perf(state);
+
+	PHASE previous = state.phase;
+	state.phase = phase;
+	return previous;
+}
+//Enter a phase for the lifetime of the object, then return to the previous one.
+class PhaseScope final {
+	private:
+		PHASE const _previous;
+	public:
+		explicit PhaseScope(PHASE phase) : _previous(set_phase(phase)) {}
+		PhaseScope(PhaseScope const&) = delete;
+		~PhaseScope() { set_phase(_previous); }
+};
+
+//Start counting afresh on the calling thread (in `PHASE::OTHER`), including, if non-null, the
+//	performance counters `perf` (opened on this thread).
+void begin_thread(PerfCounters const* perf=nullptr);
+//Stop counting on the calling thread, returning its counts.
+Counters end_thread();
+
+#endif
+
+
+
+}
+
+
+
+//Code only compiled with statistics, counting event `Stats::COUNTER::NAME`, and entering phase
+//	`Stats::PHASE::NAME` for the rest of the enclosing scope
+#ifdef RENDER_STATISTICS
+	#define STATS_ONLY(CODE) CODE
+	#define STATS_COUNT(NAME) Stats::count(Stats::COUNTER::NAME)
+	#define STATS_PHASE(NAME) Stats::PhaseScope _stats_phase(Stats::PHASE::NAME)
+#else
+	#define STATS_ONLY(CODE)
+	#define STATS_COUNT(NAME)
+	#define STATS_PHASE(NAME)
+#endif
+
+
+
+RENDER_VARIANT_END
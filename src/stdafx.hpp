@@ -1,295 +1,384 @@
-﻿#pragma once
-
-
-
-//Includes
-
-//	C Standard Library
-#include <cassert>
-#include <cstdio>
-#include <cstring>
-
-//	C++ Standard Library
-#include <algorithm>
-#include <array>
-#include <atomic>
-#include <functional>
-#include <fstream>
-#include <map>
-#include <mutex>
-#include <random>
-#include <set>
-#include <sstream>
-#include <thread>
-#include <vector>
-
-//	GLM
-#define GLM_FORCE_SIZE_T_LENGTH
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/vec3.hpp>
-#include <glm/vec4.hpp>
-
-#ifdef SUPPORT_WINDOWED
-	//	GLFW
-	#include <GLFW/glfw3.h>
-#endif
-
-
-
-//Configuration
-
-//	(Note also usage of user-defined literals, defined below.)
-
-//	Use explicit light sampling (ELS) when path tracing.
-#define EXPLICIT_LIGHT_SAMPLING
-
-//	Maximum depth of path trace integrator (including shadow rays).
-#define MAX_DEPTH 10u
-
-//	Work items during the path trace are square tiles of pixels.  This is their width and height.
-#define TILE_SIZE 8_zu
-
-//	If enabled, compensates for the cosine-factor falloff due to viewing rays leaving the camera
-//		sensor at an angle by brightening those areas by an inverse factor.  This is quite typical
-//		for real-world cameras (indeed, many people don't know this is even necessary).
-#define FLAT_FIELD_CORRECTION
-
-//	Epsilon, used for a variety of numerical tests.
-#define EPS 0.001f
-
-//	Whether to use spectral rendering (correct), and if so which variant to use (our paper, the work
-//		by Meng et al. 2015, or the work by Jakob and Hanika 2019) or RGB mode (what many people do
-//		instead).
-#if 1
-	#define RENDER_MODE_SPECTRAL
-
-	#define RENDER_MODE_SPECTRAL_ALGNUM 1
-	#if    RENDER_MODE_SPECTRAL_ALGNUM == 1
-		#define RENDER_MODE_SPECTRAL_OURS
-	#elif  RENDER_MODE_SPECTRAL_ALGNUM == 2
-		#define RENDER_MODE_SPECTRAL_MENG
-	#elif  RENDER_MODE_SPECTRAL_ALGNUM == 3
-		#define RENDER_MODE_SPECTRAL_JH
-	#else
-		#error
-	#endif
-
-	//		The CIE observer standard to use.  The 1931 version is the CIE 1931 2° standard
-	//			observer, and the 2006 version is the CIE 2006 10° standard observer.  The former is
-	//			based on 1920s experiments and is well-established.  The latter is based on updated
-	//			data, a wider field of view, and a denser sampling.  The latter is probably what one
-	//			should be using.
-	#if 1
-		#define CIE_OBSERVER 1931
-	#else
-		#define CIE_OBSERVER 2006
-	#endif
-
-	//		Number of wavelengths sampled by a single sample.  When more than one is used, hero
-	//			wavelength sampling is done.
-	#define SAMPLE_WAVELENGTHS 4_zu
-#else
-	#define RENDER_MODE_RGB
-#endif
-
-#ifdef SUPPORT_WINDOWED
-	//Whether to make the un-rendered pixels partially transparent.  Disabled by default because on
-	//	Windows 10, current GLFW has a bug which prevents it from working correctly:
-	//		https://github.com/glfw/glfw/issues/1237
-	//#define WITH_TRANSPARENT_FRAMEBUFFER
-#endif
-
-
-
-//Computed values
-
-#ifdef RENDER_MODE_SPECTRAL
-	#if !defined RENDER_MODE_SPECTRAL_OURS && CIE_OBSERVER!=1931
-		#error "Only our algorithm currently implements support for the newest CIE standard observer!"
-	#endif
-
-	//	Shortest and longest wavelengths, in nanometers, considered during the rendering.  It only
-	//		makes sense to sample wavelengths where the observer can see anything (and maybe then,
-	//		perhaps even slightly less than that, since at the extreme wavelengths we cannot see
-	//		very well).  The values here are simply the ranges of the respective observer functions.
-	#if   CIE_OBSERVER == 1931
-		#define LAMBDA_MIN 380_nm
-		#define LAMBDA_MAX 780_nm
-	#elif CIE_OBSERVER == 2006
-		#define LAMBDA_MIN 390_nm
-		#define LAMBDA_MAX 830_nm
-	#else
-		#error "Implementation error!"
-	#endif
-#endif
-
-
-
-//Common Types
-
-#ifdef RENDER_MODE_SPECTRAL
-	//	CIE XYZ tristimulus values
-	typedef glm:: vec3 CIEXYZ_32F;
-	typedef glm::dvec3 CIEXYZ_64F;
-	typedef glm:: vec4 CIEXYZ_A_32F;
-	typedef glm::dvec4 CIEXYZ_A_64F;
-
-	//	Nanometers
-	typedef float nm;
-	constexpr inline float operator""_nm(long double        x) { return static_cast<float>(x); }
-	constexpr inline float operator""_nm(unsigned long long x) { return static_cast<float>(x); }
-
-	//	Kelvin scale (kelvin, K)
-	typedef float kelvin;
-#endif
-
-//	BT.709 color
-//		Linear (pre-gamma) RGB, floating-point
-typedef glm::vec3  lRGB_F32;
-//		Linear (pre-gamma) RGB and linear alpha, floating-point
-typedef glm:: vec4 lRGB_A_F32;
-typedef glm::dvec4 lRGB_A_F64;
-//		Post-gamma RGB, floating-point
-typedef glm:: vec3 sRGB_F32;
-//		Post-gamma RGB and linear alpha, floating-point
-typedef glm:: vec4 sRGB_A_F32;
-//		Post-gamma RGB, byte
-class sRGB_U8 final { public: uint8_t r, g, b;      };
-static_assert(sizeof(sRGB_U8  )==3,"Implementation error!");
-//		Post-gamma RGB and linear alpha, byte
-class sRGB_A_U8 final { public: uint8_t r, g, b, a; };
-static_assert(sizeof(sRGB_A_U8)==4,"Implementation error!");
-
-//	Position
-typedef glm::vec3 Pos;
-//	Direction
-typedef glm::vec3 Dir;
-//	Distance
-typedef float Dist;
-
-//	Angle
-typedef float radians;
-
-//	ST and UV coordinates.  Many graphics people call mesh texture coordinates "UV"s, but strictly
-//		speaking they're "ST"-coordinates.  That is, they are normalized to the [0,1] range.  The
-//		"UV" space is actually the coordinates within the texture space, and is not normalized by
-//		the resolution of the texture.
-typedef glm::vec2 ST;
-typedef glm::vec2 UV;
-
-#ifndef RENDER_MODE_SPECTRAL
-	//Absolute madness, I say
-	typedef lRGB_F32 RGB_Radiance;
-	typedef lRGB_F32 RGB_RadiantFlux;
-	typedef lRGB_F32 RGB_RecipSR;
-#endif
-typedef lRGB_F32 RGB_Reflectance;
-
-
-
-//Common stuff
-
-namespace Constants {
-
-//	π
-//		Value is given to perfect machine precision with 80-bit `long double`.
-template <typename T> constexpr T pi = T(3.14159265358979323846L);
-
-//	k_B, the Boltzmann constant (J⋅K⁻¹)
-//		Value is given to known precision.
-template <typename T> constexpr T k_B = T(1.38064852e-23L);
-
-//	h, the Planck constant (J⋅s)
-//		Value is a precise definition.
-template <typename T> constexpr T h = T(6.62607015e-34L);
-
-//	c, the speed of light (m⋅s⁻¹)
-//		Value is a precise definition.
-template <typename T> constexpr T c = T(299'792'458.0L);
-
-}
-
-//	Ray structure
-class Ray final {
-	public:
-		Pos orig;
-		Dir dir;
-
-	public:
-		Pos at(Dist dist) const { return orig + dist*dir; }
-};
-
-//	Hit record
-class PrimBase;
-class HitRecord final {
-	public:
-		PrimBase const* prim;
-
-		Dir normal;
-		ST st;
-
-		Dist dist;
-};
-
-//	Bounding sphere
-class SphereBound final {
-	public:
-		Pos center;
-		Dist radius;
-};
-
-//	Hash functions
-template <typename type> inline size_t get_hashed(type const& item                     ) {
-	if constexpr (std::is_integral_v<type>) {
-		//On some platforms, the `std::hash` for integral types is the identity function.  Choose
-		//	something that implements more randomness.  This hash takes ideas from MSVC.
-		uint8_t tmp[sizeof(type)]; std::memcpy(tmp,&item,sizeof(item));
-		size_t hash;
-		if constexpr (sizeof(size_t)==sizeof(uint32_t)) {
-			hash = 2166136261u;
-			for (size_t i=0;i<sizeof(type);++i) {
-				hash ^= static_cast<size_t>(tmp[i]);
-				hash *= 16777619u;
-			}
-		} else {
-			static_assert(sizeof(size_t)==sizeof(uint64_t),"Not implemented!");
-			hash = 14695981039346656037ull;
-			for (size_t i=0;i<sizeof(type);++i) {
-				hash ^= static_cast<size_t>(tmp[i]);
-				hash *= 1099511628211ull;
-			}
-		}
-		return hash;
-	} else {
-		std::hash<type> hasher;
-		return hasher(item);
-	}
-}
-template <typename type> inline size_t get_hashed(type const& item, size_t combine_with) {
-	//http://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
-	return combine_with^( get_hashed(item) + 0x9E3779B9 + (combine_with<<6) + (combine_with>>2) );
-}
-
-//	Definition of `size_t` literal
-constexpr inline size_t operator""_zu(unsigned long long x) { return static_cast<size_t>(x); }
-
-
-
-//Helpful macros
-
-//	Needed for technical reasons when using certain macros
-#define COMMA ,
-
-//	Constants.  TODO: move to `Constants::`?
-#define qNaN std::numeric_limits<float>::quiet_NaN()
-#define INF  std::numeric_limits<float>::infinity();
-
-#ifdef RENDER_MODE_SPECTRAL
-	//	The size of the wavelength band each wavelength in a hero sample is responsible for
-	#define LAMBDA_STEP ( (LAMBDA_MAX-LAMBDA_MIN) / static_cast<nm>(SAMPLE_WAVELENGTHS) )
-
-	//	Code that's only present when doing spectral rendering
-	#define SPECTRAL_ONLY(CODE) CODE
-#else
-	#define SPECTRAL_ONLY(CODE)
-#endif
+﻿#pragma once
+
+
+
+//Includes
+
+//	C Standard Library
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+//	C++ Standard Library
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <functional>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//	GLM
+#define GLM_FORCE_SIZE_T_LENGTH
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#ifdef SUPPORT_WINDOWED
+	//	GLFW
+	#include <GLFW/glfw3.h>
+#endif
+
+
+
+//Configuration
+
+//	(Note also usage of user-defined literals, defined below.)
+
+//	Default maximum depth of path trace integrator (including shadow rays).  Like whether to use
+//		explicit light sampling (which by default is each scene's preference), this can be chosen
+//		per render (see `Renderer::Options::Integrator`).
+#define MAX_DEPTH 10u
+
+//	Work items during the path trace are square tiles of pixels.  This is their width and height.
+#define TILE_SIZE 8_zu
+
+//	When checkpointing a render, the interval (in seconds) at which the checkpoint is written to
+//		disk.  (The OS also writes it back on its own schedule.)
+#define CHECKPOINT_FLUSH_INTERVAL 30.0f
+
+//	Largest units of distributed renders that workers (see "main.cpp") accept, so that whoever
+//		connects to one can't make it allocate without bound: the number of pixels (whose sums,
+//		at 32 bytes each, are held in memory), and the number of samples per pixel.
+#define WORKER_MAX_PIXELS ( 1_zu << 26 )
+#define WORKER_MAX_SPP    ( 1_zu << 20 )
+
+//	Texels of textures are padded to four bytes, and, if enabled, stored in square tiles of this
+//		width and height (a power of two) instead of in whole scanlines, so that lookups near each
+//		other in any direction share cache lines and pages.  This is disabled by default: in
+//		measurements ("bench/texture-access.cpp"), tiles sped up only coherent lookups, and slowed
+//		down incoherent ones (such as diffuse bounces make).
+//#define TEXTURE_TILE_SIZE 8_zu
+
+//	If enabled, large textures are backed by huge pages (where supported by the OS), reducing
+//		TLB misses for incoherent lookups.  Disabled by default, like tiles, until it is shown to
+//		help renders.
+//#define TEXTURE_HUGE_PAGES
+
+//	If enabled, compensates for the cosine-factor falloff due to viewing rays leaving the camera
+//		sensor at an angle by brightening those areas by an inverse factor.  This is quite typical
+//		for real-world cameras (indeed, many people don't know this is even necessary).  This is
+//		the default, which can be overridden per render (see `Renderer::Options::Integrator`).
+#define FLAT_FIELD_CORRECTION
+
+//	Epsilon, used for a variety of numerical tests.
+#define EPS 0.001f
+
+//	Whether to use spectral rendering (correct), and if so which variant to use (our paper, the work
+//		by Meng et al. 2015, or the work by Jakob and Hanika 2019) or RGB mode (what many people do
+//		instead).  When several variants of the renderer are built into one program (see
+//		`RENDER_VARIANT` below), the build sets these for each instead: the algorithm number ("0"
+//		for RGB mode) and the number of wavelengths.
+#ifdef RENDER_VARIANT
+	#if RENDER_MODE_SPECTRAL_ALGNUM != 0
+		#define RENDER_MODE_SPECTRAL
+	#endif
+#elif 1
+	#define RENDER_MODE_SPECTRAL
+
+	#define RENDER_MODE_SPECTRAL_ALGNUM 1
+#endif
+#ifdef RENDER_MODE_SPECTRAL
+	#if    RENDER_MODE_SPECTRAL_ALGNUM == 1
+		#define RENDER_MODE_SPECTRAL_OURS
+	#elif  RENDER_MODE_SPECTRAL_ALGNUM == 2
+		#define RENDER_MODE_SPECTRAL_MENG
+	#elif  RENDER_MODE_SPECTRAL_ALGNUM == 3
+		#define RENDER_MODE_SPECTRAL_JH
+	#else
+		#error
+	#endif
+
+	//		The CIE observer standard to use.  The 1931 version is the CIE 1931 2° standard
+	//			observer, and the 2006 version is the CIE 2006 10° standard observer.  The former is
+	//			based on 1920s experiments and is well-established.  The latter is based on updated
+	//			data, a wider field of view, and a denser sampling.  The latter is probably what one
+	//			should be using.
+	#if 1
+		#define CIE_OBSERVER 1931
+	#else
+		#define CIE_OBSERVER 2006
+	#endif
+
+	//		Number of wavelengths sampled by a single sample.  When more than one is used, hero
+	//			wavelength sampling is done.
+	#ifndef SAMPLE_WAVELENGTHS
+		#define SAMPLE_WAVELENGTHS 4_zu
+	#endif
+#else
+	#define RENDER_MODE_RGB
+#endif
+
+//	Several variants of the renderer (differing in the rendering mode, above) can be built into one
+//		program and chosen between at runtime (see "CMakeLists.txt" and "variants.cpp").  Each is
+//		compiled separately, with its code in the namespace `RENDER_VARIANT`; only the utilities that
+//		don't depend on the mode are shared.
+#ifdef RENDER_VARIANT
+	#define RENDER_VARIANT_BEGIN namespace RENDER_VARIANT {
+	#define RENDER_VARIANT_END   }
+#else
+	#define RENDER_VARIANT_BEGIN
+	#define RENDER_VARIANT_END
+#endif
+
+#ifdef SUPPORT_WINDOWED
+	//Whether to make the un-rendered pixels partially transparent.  Disabled by default because on
+	//	Windows 10, current GLFW has a bug which prevents it from working correctly:
+	//		https://github.com/glfw/glfw/issues/1237
+	//#define WITH_TRANSPARENT_FRAMEBUFFER
+#endif
+
+
+
+//Computed values
+
+#ifdef RENDER_MODE_SPECTRAL
+	#if !defined RENDER_MODE_SPECTRAL_OURS && CIE_OBSERVER!=1931
+		#error "Only our algorithm currently implements support for the newest CIE standard observer!"
+	#endif
+
+	//	Shortest and longest wavelengths, in nanometers, considered during the rendering.  It only
+	//		makes sense to sample wavelengths where the observer can see anything (and maybe then,
+	//		perhaps even slightly less than that, since at the extreme wavelengths we cannot see
+	//		very well).  The values here are simply the ranges of the respective observer functions.
+	#if   CIE_OBSERVER == 1931
+		#define LAMBDA_MIN 380_nm
+		#define LAMBDA_MAX 780_nm
+	#elif CIE_OBSERVER == 2006
+		#define LAMBDA_MIN 390_nm
+		#define LAMBDA_MAX 830_nm
+	#else
+		#error "Implementation error!"
+	#endif
+#endif
+
+
+
+//Common Types
+
+#ifdef RENDER_MODE_SPECTRAL
+	//	CIE XYZ tristimulus values
+	typedef glm:: vec3 CIEXYZ_32F;
+	typedef glm::dvec3 CIEXYZ_64F;
+	typedef glm:: vec4 CIEXYZ_A_32F;
+	typedef glm::dvec4 CIEXYZ_A_64F;
+
+	//	Nanometers
+	typedef float nm;
+	constexpr inline float operator""_nm(long double        x) { return static_cast<float>(x); }
+	constexpr inline float operator""_nm(unsigned long long x) { return static_cast<float>(x); }
+
+	//	Kelvin scale (kelvin, K)
+	typedef float kelvin;
+#endif
+
+//	BT.709 color
+//		Linear (pre-gamma) RGB, floating-point
+typedef glm::vec3  lRGB_F32;
+//		Linear (pre-gamma) RGB and linear alpha, floating-point
+typedef glm:: vec4 lRGB_A_F32;
+typedef glm::dvec4 lRGB_A_F64;
+//		Post-gamma RGB, floating-point
+typedef glm:: vec3 sRGB_F32;
+//		Post-gamma RGB and linear alpha, floating-point
+typedef glm:: vec4 sRGB_A_F32;
+//		Post-gamma RGB, byte
+class sRGB_U8 final { public: uint8_t r, g, b;      };
+static_assert(sizeof(sRGB_U8  )==3,"Implementation error!");
+//		Post-gamma RGB and linear alpha, byte
+class sRGB_A_U8 final { public: uint8_t r, g, b, a; };
+static_assert(sizeof(sRGB_A_U8)==4,"Implementation error!");
+
+//	Position
+typedef glm::vec3 Pos;
+//	Direction
+typedef glm::vec3 Dir;
+//	Distance
+typedef float Dist;
+
+//	Angle
+typedef float radians;
+
+//	ST and UV coordinates.  Many graphics people call mesh texture coordinates "UV"s, but strictly
+//		speaking they're "ST"-coordinates.  That is, they are normalized to the [0,1] range.  The
+//		"UV" space is actually the coordinates within the texture space, and is not normalized by
+//		the resolution of the texture.
+typedef glm::vec2 ST;
+typedef glm::vec2 UV;
+
+#ifndef RENDER_MODE_SPECTRAL
+	//Absolute madness, I say
+	typedef lRGB_F32 RGB_Radiance;
+	typedef lRGB_F32 RGB_RadiantFlux;
+	typedef lRGB_F32 RGB_RecipSR;
+#endif
+typedef lRGB_F32 RGB_Reflectance;
+
+
+
+//Common stuff
+
+namespace Constants {
+
+//	π
+//		Value is given to perfect machine precision with 80-bit `long double`.
+template <typename T> constexpr T pi = T(3.14159265358979323846L);
+
+//	k_B, the Boltzmann constant (J⋅K⁻¹)
+//		Value is given to known precision.
+template <typename T> constexpr T k_B = T(1.38064852e-23L);
+
+//	h, the Planck constant (J⋅s)
+//		Value is a precise definition.
+template <typename T> constexpr T h = T(6.62607015e-34L);
+
+//	c, the speed of light (m⋅s⁻¹)
+//		Value is a precise definition.
+template <typename T> constexpr T c = T(299'792'458.0L);
+
+}
+
+//	Ray structure
+class Ray final {
+	public:
+		Pos orig;
+		Dir dir;
+
+	public:
+		Pos at(Dist dist) const { return orig + dist*dir; }
+};
+
+//	Hit record
+RENDER_VARIANT_BEGIN
+class MaterialBase;
+class PrimBase;
+class PrimInstance;
+class HitRecord final {
+	public:
+		//Primitive hit.  If it belongs to a mesh, `.instance` is the instance of the mesh that was
+		//	hit, and otherwise `nullptr`.
+		PrimBase     const* prim;
+		PrimInstance const* instance;
+		//Material at the hit (which can be overridden by the instance)
+		MaterialBase const* material;
+
+		Dir normal;
+		ST st;
+		//Rate of change of `.st` per unit distance across the surface, for filtering textures
+		float st_scale;
+
+		Dist dist;
+};
+RENDER_VARIANT_END
+
+//	Bounding sphere
+class SphereBound final {
+	public:
+		Pos center;
+		Dist radius;
+};
+
+//	Axis-aligned bounding box
+class AABB final {
+	public:
+		Pos low;
+		Pos high;
+
+	public:
+		//Box containing nothing; extending it by anything produces a box tightly containing that.
+		static AABB get_empty() {
+			float inf = std::numeric_limits<float>::infinity();
+			return { Pos(inf), Pos(-inf) };
+		}
+
+		void extend(Pos  const& point) { low=glm::min(low,point     ); high=glm::max(high,point     ); }
+		void extend(AABB const& other) { low=glm::min(low,other.low ); high=glm::max(high,other.high); }
+
+		Pos get_center() const { return 0.5f*(low+high); }
+		//Index of the axis along which the box is longest.
+		size_t get_max_axis() const {
+			Dir extent = high - low;
+			if (extent.x>extent.y) return extent.x>extent.z ? 0 : 2;
+			else                   return extent.y>extent.z ? 1 : 2;
+		}
+		float get_surface_area() const {
+			Dir extent = high - low;
+			if (extent.x<0.0f) return 0.0f; //Empty
+			return 2.0f*( extent.x*extent.y + extent.y*extent.z + extent.z*extent.x );
+		}
+};
+
+//	Hash functions
+template <typename type> inline size_t get_hashed(type const& item                     ) {
+	if constexpr (std::is_integral_v<type>) {
+		//On some platforms, the `std::hash` for integral types is the identity function.  Choose
+		//	something that implements more randomness.  This hash takes ideas from MSVC.
+		uint8_t tmp[sizeof(type)]; std::memcpy(tmp,&item,sizeof(item));
+		size_t hash;
+		if constexpr (sizeof(size_t)==sizeof(uint32_t)) {
+			hash = 2166136261u;
+			for (size_t i=0;i<sizeof(type);++i) {
+				hash ^= static_cast<size_t>(tmp[i]);
+				hash *= 16777619u;
+			}
+		} else {
+			static_assert(sizeof(size_t)==sizeof(uint64_t),"Not implemented!");
+			hash = 14695981039346656037ull;
+			for (size_t i=0;i<sizeof(type);++i) {
+				hash ^= static_cast<size_t>(tmp[i]);
+				hash *= 1099511628211ull;
+			}
+		}
+		return hash;
+	} else {
+		std::hash<type> hasher;
+		return hasher(item);
+	}
+}
+template <typename type> inline size_t get_hashed(type const& item, size_t combine_with) {
+	//http://stackoverflow.com/questions/2590677/how-do-i-combine-hash-values-in-c0x
+	return combine_with^( get_hashed(item) + 0x9E3779B9 + (combine_with<<6) + (combine_with>>2) );
+}
+
+//	Definition of `size_t` literal
+constexpr inline size_t operator""_zu(unsigned long long x) { return static_cast<size_t>(x); }
+
+
+
+//Helpful macros
+
+//	Needed for technical reasons when using certain macros
+#define COMMA ,
+
+//	Constants.  TODO: move to `Constants::`?
+#define qNaN std::numeric_limits<float>::quiet_NaN()
+#define INF  std::numeric_limits<float>::infinity();
+
+#ifdef RENDER_MODE_SPECTRAL
+	//	The size of the wavelength band each wavelength in a hero sample is responsible for
+	#define LAMBDA_STEP ( (LAMBDA_MAX-LAMBDA_MIN) / static_cast<nm>(SAMPLE_WAVELENGTHS) )
+
+	//	Code that's only present when doing spectral rendering
+	#define SPECTRAL_ONLY(CODE) CODE
+#else
+	#define SPECTRAL_ONLY(CODE)
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+#include <new>
+#include <typeindex>
+
+
+
+//Arena of objects of arbitrary types, with a separate pool for each type.  Each pool stores its
+//	objects contiguously, in chunks of geometrically increasing size, so objects of the same type
+//	(e.g. the primitives of a scene) are packed together regardless of the order in which they were
+//	allocated.  Objects cannot be freed individually; they are destroyed and their memory released
+//	in bulk, by `.release()` or when the arena is destroyed.
+//	Note: not thread-safe.
+class Arena final {
+	private:
+		class _PoolBase {
+			public:
+				virtual ~_PoolBase() = default;
+		};
+		template <class T> class _Pool final : public _PoolBase {
+			private:
+				//Raw storage of each chunk, and the number of objects in it.  Only the last chunk is
+				//	partially filled.
+				class _Chunk final { public:
+					T* data;
+					size_t capacity;
+					size_t count;
+				};
+				std::vector<_Chunk> _chunks;
+
+			public:
+				_Pool() = default;
+				_Pool(_Pool const&) = delete;
+				virtual ~_Pool() {
+					for (_Chunk const& chunk : _chunks) {
+						if constexpr (!std::is_trivially_destructible_v<T>) {
+							for (size_t i=0;i<chunk.count;++i) chunk.data[i].~T();
+						}
+						::operator delete( chunk.data, std::align_val_t(alignof(T)) );
+					}
+				}
+
+				template <class... Args> T* make(Args&&... args) {
+					if (_chunks.empty()||_chunks.back().count==_chunks.back().capacity) {
+						//Start a new chunk, twice as large as the last (and at least a page).
+						size_t capacity = _chunks.empty() ? std::max( 4096_zu/sizeof(T), 1_zu ) : 2*_chunks.back().capacity;
+						T* data = static_cast<T*>(::operator new( capacity*sizeof(T), std::align_val_t(alignof(T)) ));
+						_chunks.push_back({ data, capacity, 0 });
+					}
+					_Chunk& chunk = _chunks.back();
+					T* result = new (chunk.data+chunk.count) T(std::forward<Args>(args)...);
+					++chunk.count;
+					return result;
+				}
+		};
+		std::map<std::type_index,_PoolBase*> _pools;
+
+	public:
+		Arena() = default;
+		Arena(Arena const&) = delete;
+		~Arena() { release(); }
+
+		//Construct an object of type `T` from `args` in the pool of `T`s.
+		template <class T, class... Args> T* make(Args&&... args) {
+			_PoolBase*& pool = _pools[std::type_index(typeid(T))];
+			if (pool==nullptr) pool=new _Pool<T>;
+			return static_cast<_Pool<T>*>(pool)->make(std::forward<Args>(args)...);
+		}
+
+		//Move (or copy) `object` into the pool of its type.  This is convenient for types whose
+		//	constructors take braced initializer lists, which can't be forwarded by `.make(...)`.
+		template <class T> std::decay_t<T>* add(T&& object) {
+			return make<std::decay_t<T>>(std::forward<T>(object));
+		}
+
+		//Destroy all objects and release all memory.
+		void release() {
+			for (auto iter : _pools) delete iter.second;
+			_pools.clear();
+		}
+};
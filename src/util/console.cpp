@@ -0,0 +1,29 @@
+#include "console.hpp"
+
+#ifdef _WIN32
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
+
+
+
+namespace Console {
+
+
+
+FILE* take_stdout() {
+	fflush(stdout);
+	#ifdef _WIN32
+	FILE* result = _fdopen( _dup(_fileno(stdout)), "w" );
+	_dup2( _fileno(stderr), _fileno(stdout) );
+	#else
+	FILE* result =  fdopen(  dup(STDOUT_FILENO ), "w" );
+	 dup2(  STDERR_FILENO,       STDOUT_FILENO  );
+	#endif
+	return result;
+}
+
+
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+
+
+namespace Console {
+
+
+
+//Take the process's standard output for output read by other programs (e.g. responses or results):
+//	return a stream writing to the original standard output, and redirect everything else printed
+//	there (e.g. progress) to standard error, so that it can't be mixed up with that output.
+//	Returns `nullptr` on failure.
+FILE* take_stdout();
+
+
+
+}
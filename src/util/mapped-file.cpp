@@ -0,0 +1,108 @@
+#include "mapped-file.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const& path, MODE mode, size_t size/*=0*/) :
+	_data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+{
+	bool writable = mode!=MODE::READ;
+
+	HANDLE file = CreateFileA(
+		path.c_str(),
+		writable ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		mode==MODE::CREATE ? CREATE_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr
+	);
+	if (file==INVALID_HANDLE_VALUE) return;
+	_file = file;
+
+	if (mode!=MODE::CREATE) {
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file,&file_size)) return;
+		size = static_cast<size_t>(file_size.QuadPart);
+	}
+	if (size==0) return; //Cannot map empty files
+
+	uint64_t size64 = size;
+	HANDLE mapping = CreateFileMappingA(
+		file, nullptr, writable?PAGE_READWRITE:PAGE_READONLY,
+		static_cast<DWORD>(size64>>32), static_cast<DWORD>(size64&0xFFFFFFFFull),
+		nullptr
+	);
+	if (mapping==nullptr) return;
+	_mapping = mapping;
+
+	_data = MapViewOfFile( mapping, writable?FILE_MAP_WRITE:FILE_MAP_READ, 0,0, size );
+	if (_data!=nullptr) _size=size;
+}
+MappedFile::~MappedFile() {
+	if (_data   !=nullptr             ) UnmapViewOfFile(_data);
+	if (_mapping!=nullptr             ) CloseHandle(_mapping);
+	if (_file   !=INVALID_HANDLE_VALUE) CloseHandle(_file);
+}
+
+void MappedFile::flush() {
+	if (_data==nullptr) return;
+	FlushViewOfFile(_data,_size);
+	FlushFileBuffers(_file);
+}
+
+#else
+
+MappedFile::MappedFile(std::string const& path, MODE mode, size_t size/*=0*/) :
+	_data(nullptr), _size(0), _file(-1)
+{
+	bool writable = mode!=MODE::READ;
+
+	int flags;
+	switch (mode) {
+		case MODE::READ:       flags=O_RDONLY;               break;
+		case MODE::READ_WRITE: flags=O_RDWR;                 break;
+		case MODE::CREATE:     flags=O_RDWR|O_CREAT|O_TRUNC; break;
+		default: assert(false); return;
+	}
+	_file = open( path.c_str(), flags, 0644 );
+	if (_file<0) return;
+
+	if (mode==MODE::CREATE) {
+		if (ftruncate(_file,static_cast<off_t>(size))!=0) return;
+	} else {
+		struct stat info;
+		if (fstat(_file,&info)!=0) return;
+		size = static_cast<size_t>(info.st_size);
+	}
+	if (size==0) return; //Cannot map empty files
+
+	void* data = mmap( nullptr, size, writable?PROT_READ|PROT_WRITE:PROT_READ, MAP_SHARED, _file, 0 );
+	if (data==MAP_FAILED) return;
+
+	_data = data;
+	_size = size;
+}
+MappedFile::~MappedFile() {
+	if (_data!=nullptr) munmap(_data,_size);
+	if (_file>=0      ) close(_file);
+}
+
+void MappedFile::flush() {
+	if (_data==nullptr) return;
+	msync(_data,_size,MS_SYNC);
+}
+
+#endif
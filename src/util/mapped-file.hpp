@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+
+
+//A file mapped into memory.  The mapping is shared with the OS page cache, so mapping a file that
+//	has recently been read or written is nearly free, and pages are only loaded as they are touched.
+class MappedFile final {
+	public:
+		enum class MODE {
+			//Map an existing file read-only
+			READ,
+			//Map an existing file read-write.  Changes are written back to the file.
+			READ_WRITE,
+			//Create (or truncate) the file to a given size and map it read-write
+			CREATE
+		};
+
+	private:
+		void* _data;
+		size_t _size;
+
+		#ifdef _WIN32
+		void* _file;
+		void* _mapping;
+		#else
+		int _file;
+		#endif
+
+	public:
+		//Map the file at `path`.  With `MODE::CREATE`, the file is created with size `size`.  On
+		//	failure, `.is_valid()` returns false.
+		MappedFile(std::string const& path, MODE mode, size_t size=0);
+		MappedFile(MappedFile const&) = delete;
+		~MappedFile();
+
+		bool is_valid() const { return _data!=nullptr; }
+
+		void      * get_data()       { return _data; }
+		void const* get_data() const { return _data; }
+		size_t      get_size() const { return _size; }
+
+		//Write dirty pages back to the file and wait for completion.
+		void flush();
+};
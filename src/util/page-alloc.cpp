@@ -0,0 +1,48 @@
+#include "page-alloc.hpp"
+
+#ifdef _WIN32
+	#include <malloc.h>
+#else
+	#include <cstdlib>
+	#include <sys/mman.h>
+#endif
+
+
+
+namespace Mem {
+
+
+
+void* alloc_pages(size_t size, bool huge) {
+	size_t const page_size      = 4096;
+	size_t const huge_page_size = 2048*1024;
+
+	#ifdef _WIN32
+		//Large pages on Windows require the "lock pages in memory" privilege, which ordinary users
+		//	don't have; just use ordinary pages.
+		(void)huge; (void)huge_page_size;
+		return _aligned_malloc( std::max(size,1_zu), page_size );
+	#else
+		//Only bother with huge pages for allocations that would fill at least one.
+		huge = huge && size>=huge_page_size;
+		size_t alignment = huge ? huge_page_size : page_size;
+		size = ( std::max(size,1_zu) + alignment-1 ) / alignment * alignment;
+
+		void* result = std::aligned_alloc( alignment, size );
+		#ifdef MADV_HUGEPAGE
+		if (huge&&result!=nullptr) madvise( result, size, MADV_HUGEPAGE );
+		#endif
+		return result;
+	#endif
+}
+void free_pages(void* ptr) {
+	#ifdef _WIN32
+		_aligned_free(ptr);
+	#else
+		std::free(ptr);
+	#endif
+}
+
+
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+
+
+namespace Mem {
+
+
+
+//Allocate `size` bytes of page-aligned memory.  If `huge` is true and the allocation is large
+//	enough, it is aligned and padded to huge pages (2 MiB) and the OS is asked to back it with
+//	them, which reduces TLB misses for scattered accesses.  This is only a hint; if huge pages are
+//	unavailable, the memory is backed by ordinary pages.  Returns `nullptr` on failure.
+void* alloc_pages(size_t size, bool huge);
+//Free memory returned by `alloc_pages(...)`.
+void free_pages(void* ptr);
+
+
+
+}
@@ -0,0 +1,209 @@
+#include "perf-counters.hpp"
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/mman.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <ctime>
+	#include <unistd.h>
+
+	//	Hardware counters can be read with `rdpmc` on x86, if the kernel allows it
+	#if defined(__x86_64__) || defined(__i386__)
+		#include <x86intrin.h>
+		#define PERF_COUNTERS_RDPMC
+	#endif
+#endif
+
+
+
+#ifdef __linux__
+
+class _Event final { public:
+	uint32_t type;
+	uint64_t config;
+	char const* name;
+};
+static _Event const _events_hardware[] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,    "cycles"        },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,  "instructions"  },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,  "cache_misses"  },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses" },
+	{ PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ<<8) | (PERF_COUNT_HW_CACHE_RESULT_MISS<<16),
+		"dtlb_load_misses"
+	}
+};
+static _Event const _events_software[] = {
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,       "task_clock_ns"    },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page_faults"      },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context_switches" },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "cpu_migrations"   }
+};
+static char const*const _names_rusage[] = { "cpu_time_ns", "page_faults", "context_switches" };
+
+//Open `event` on the calling thread, in the group led by `group_fd` (or, if -1, as the leader of a
+//	new group).  Returns the file descriptor, or -1 on failure.
+static int _open_event(_Event const& event, int group_fd) {
+	perf_event_attr attr = {};
+	attr.size           = sizeof(attr);
+	attr.type           = event.type;
+	attr.config         = event.config;
+	attr.read_format    = PERF_FORMAT_GROUP;
+	//	User space only (which unprivileged users may be restricted to anyway)
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	//	The group is always on the PMU, rather than multiplexed with others (whose readings would
+	//		have to be scaled).
+	attr.pinned         = group_fd==-1 ? 1 : 0;
+	return static_cast<int>(syscall( SYS_perf_event_open, &attr, 0,-1, group_fd, PERF_FLAG_FD_CLOEXEC ));
+}
+
+//Read the `count` counters of the group led by `fd` into `values`.  Returns whether it succeeded
+//	(a pinned group that can't be scheduled on the PMU reads nothing).
+static bool _read_group(int fd, size_t count, uint64_t* values) {
+	uint64_t buffer[1+PerfCounters::MAX_EVENTS];
+	ssize_t size = ::read( fd, buffer, (1+count)*sizeof(uint64_t) );
+	if (size!=static_cast<ssize_t>((1+count)*sizeof(uint64_t)) || buffer[0]!=count) return false;
+	std::memcpy( values, buffer+1, count*sizeof(uint64_t) );
+	return true;
+}
+
+#ifdef PERF_COUNTERS_RDPMC
+//Read the counter whose control page is `page` with `rdpmc` (the protocol is described in
+//	"linux/perf_event.h").
+static uint64_t _read_rdpmc(perf_event_mmap_page const volatile* page) {
+	uint64_t count;
+	uint32_t seq;
+	do {
+		seq = page->lock;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+
+		count = static_cast<uint64_t>(page->offset);
+		uint32_t index = page->index;
+		if (index!=0) {
+			//	(The counter is `.pmc_width` bits wide, and sign-extended.)
+			unsigned shift = 64u - page->pmc_width;
+			int64_t value = static_cast<int64_t>( static_cast<uint64_t>(__rdpmc(static_cast<int>(index-1))) << shift ) >> shift;
+			count += static_cast<uint64_t>(value);
+		}
+
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	} while (page->lock!=seq);
+	return count;
+}
+#endif
+
+#endif
+
+
+
+PerfCounters::PerfCounters() : _source(SOURCE::NONE), _num_events(0) {
+	for (size_t k=0;k<MAX_EVENTS;++k) { _names[k]=nullptr; _fds[k]=-1; _pages[k]=nullptr; }
+
+	#ifdef __linux__
+		//Open a group of `events`.  The first (the leader) is required; others the system lacks are
+		//	left out.
+		auto open_group = [&](_Event const* events, size_t count) -> bool {
+			for (size_t k=0;k<count;++k) {
+				int fd = _open_event( events[k], _num_events==0?-1:_fds[0] );
+				if (fd>=0); else {
+					if (_num_events==0) return false;
+					continue;
+				}
+				_fds  [_num_events] = fd;
+				_names[_num_events] = events[k].name;
+				++_num_events;
+			}
+
+			uint64_t values[MAX_EVENTS];
+			if (_read_group( _fds[0], _num_events, values )) return true;
+
+			for (size_t k=0;k<_num_events;++k) { close(_fds[k]); _fds[k]=-1; }
+			_num_events = 0;
+			return false;
+		};
+
+		if        (open_group( _events_hardware, sizeof(_events_hardware)/sizeof(_Event) )) {
+			_source = SOURCE::HARDWARE;
+
+			#ifdef PERF_COUNTERS_RDPMC
+			//Map the counters' control pages, to read them with `rdpmc` if the kernel allows it
+			//	(else, they are read with a system call).
+			size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			bool rdpmc = true;
+			for (size_t k=0;k<_num_events;++k) {
+				void* page = mmap( nullptr, page_size, PROT_READ, MAP_SHARED, _fds[k], 0 );
+				if (page==MAP_FAILED) { rdpmc=false; break; }
+				_pages[k] = page;
+				rdpmc = rdpmc && static_cast<perf_event_mmap_page const*>(page)->cap_user_rdpmc;
+			}
+			if (!rdpmc) {
+				for (size_t k=0;k<_num_events;++k) {
+					if (_pages[k]!=nullptr) { munmap(_pages[k],page_size); _pages[k]=nullptr; }
+				}
+			}
+			#endif
+		} else if (open_group( _events_software, sizeof(_events_software)/sizeof(_Event) )) {
+			_source = SOURCE::SOFTWARE;
+		} else {
+			//Perf events are unavailable entirely (e.g. forbidden by a container's seccomp policy)
+			_source = SOURCE::RUSAGE;
+			_num_events = sizeof(_names_rusage)/sizeof(char const*);
+			for (size_t k=0;k<_num_events;++k) _names[k]=_names_rusage[k];
+		}
+	#endif
+}
+PerfCounters::~PerfCounters() {
+	#ifdef __linux__
+	size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	for (size_t k=0;k<MAX_EVENTS;++k) {
+		if (_pages[k]!=nullptr) munmap(_pages[k],page_size);
+		if (_fds  [k]>=0      ) close (_fds[k]);
+	}
+	#endif
+}
+
+char const* PerfCounters::get_source_name(SOURCE source) {
+	switch (source) {
+		case SOURCE::HARDWARE: return "hardware";
+		case SOURCE::SOFTWARE: return "software";
+		case SOURCE::RUSAGE:   return "rusage";
+		case SOURCE::NONE:     return "none";
+	}
+	return "none";
+}
+
+bool PerfCounters::read(uint64_t* values) const {
+	#ifdef __linux__
+		switch (_source) {
+			case SOURCE::HARDWARE:
+				#ifdef PERF_COUNTERS_RDPMC
+				if (_pages[0]!=nullptr) {
+					for (size_t k=0;k<_num_events;++k) {
+						values[k] = _read_rdpmc(static_cast<perf_event_mmap_page const volatile*>(_pages[k]));
+					}
+					return true;
+				}
+				#endif
+				[[fallthrough]];
+			case SOURCE::SOFTWARE:
+				return _read_group( _fds[0], _num_events, values );
+			case SOURCE::RUSAGE: {
+				timespec time;
+				clock_gettime( CLOCK_THREAD_CPUTIME_ID, &time );
+				rusage usage;
+				getrusage( RUSAGE_THREAD, &usage );
+				values[0] = static_cast<uint64_t>(time.tv_sec)*1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+				values[1] = static_cast<uint64_t>( usage.ru_minflt + usage.ru_majflt );
+				values[2] = static_cast<uint64_t>( usage.ru_nvcsw  + usage.ru_nivcsw );
+				return true;
+			}
+			case SOURCE::NONE:
+				break;
+		}
+	#else
+		(void)values;
+	#endif
+	return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+
+
+//Performance counters of the calling thread.  On Linux, these are a group of hardware events
+//	opened with `perf_event_open(...)` (cycles, instructions, cache misses, branch misses, and data
+//	TLB misses), counted in user space only.  Where hardware events are unavailable (e.g. in
+//	containers and virtual machines, or if `perf_event_paranoid` forbids them), software counters
+//	are used instead: the kernel's software events (task clock, page faults, context switches, CPU
+//	migrations), or, failing those too, the thread's CPU time and resource usage.  Elsewhere, there
+//	are no counters.
+//	Counters are read often (see `Stats`), so where the kernel allows it, hardware counters are read
+//	directly with `rdpmc` instead of with a system call.
+class PerfCounters final {
+	public:
+		//Maximum number of counters
+		static constexpr size_t MAX_EVENTS = 5;
+
+		//Where the counters come from (in order of preference)
+		enum class SOURCE { HARDWARE, SOFTWARE, RUSAGE, NONE };
+
+	private:
+		SOURCE _source;
+
+		size_t _num_events;
+		char const* _names[MAX_EVENTS];
+
+		//File descriptors of the group's events (the first is the leader), and if reading with
+		//	`rdpmc`, their mapped control pages.
+		int _fds[MAX_EVENTS];
+		void* _pages[MAX_EVENTS];
+
+	public:
+		//Open the counters, counting from now on the calling thread only.
+		PerfCounters();
+		PerfCounters(PerfCounters const&) = delete;
+		~PerfCounters();
+
+		SOURCE get_source() const { return _source; }
+		static char const* get_source_name(SOURCE source);
+
+		size_t get_num_events() const { return _num_events; }
+		//Name of counter `index` (e.g. "instructions")
+		char const* get_name(size_t index) const { return _names[index]; }
+
+		//Read the current values of the counters into `values` (`.get_num_events()` of them).  Must
+		//	be called on the thread that opened them.  Returns whether it succeeded; if not (e.g. the
+		//	group couldn't be scheduled on the PMU), `values` is left unchanged.
+		bool read(uint64_t* values) const;
+};
@@ -0,0 +1,194 @@
+#include "socket.hpp"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <WinSock2.h>
+	#include <WS2tcpip.h>
+#else
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+	#include <unistd.h>
+#endif
+
+
+
+#ifdef _WIN32
+	#define INVALID_SOCKET_VALUE static_cast<uintptr_t>(INVALID_SOCKET)
+	#define close_socket closesocket
+	typedef int send_size_t;
+
+	//Winsock must be initialized before use (once per process)
+	static void _init_sockets() {
+		static bool initialized = []() -> bool {
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2,2),&data)==0;
+		}();
+		(void)initialized;
+	}
+#else
+	#define INVALID_SOCKET_VALUE (-1)
+	#define close_socket close
+	typedef size_t send_size_t;
+
+	static void _init_sockets() {}
+#endif
+
+//	Longest line `Socket::recv_line(...)` accepts, so that a peer can't make it buffer without bound.
+#define SOCKET_MAX_LINE ( 1_zu << 16 )
+
+//	Don't raise `SIGPIPE` when the other end has disconnected; `.send(...)` just fails instead.
+#ifdef MSG_NOSIGNAL
+	#define SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define SEND_FLAGS 0
+#endif
+
+
+
+Socket::Socket(std::string const& host, uint16_t port) : _socket(INVALID_SOCKET_VALUE) {
+	_init_sockets();
+
+	addrinfo hints = {};
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses;
+	if (getaddrinfo( host.c_str(), std::to_string(port).c_str(), &hints, &addresses )!=0) return;
+
+	//Try each address the host resolved to
+	for (addrinfo* address=addresses; address!=nullptr; address=address->ai_next) {
+		auto sock = ::socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+		if (sock==INVALID_SOCKET_VALUE) continue;
+		if (::connect( sock, address->ai_addr, static_cast<int>(address->ai_addrlen) )==0) {
+			//Messages are small requests and large replies; don't delay the requests.
+			int no_delay = 1;
+			setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&no_delay), sizeof(int) );
+
+			_socket = sock;
+			break;
+		}
+		close_socket(sock);
+	}
+
+	freeaddrinfo(addresses);
+}
+Socket::Socket(uint16_t port, std::string const& address) : _socket(INVALID_SOCKET_VALUE) {
+	_init_sockets();
+
+	addrinfo hints = {};
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_PASSIVE;
+	addrinfo* addresses;
+	if (getaddrinfo( address.c_str(), std::to_string(port).c_str(), &hints, &addresses )!=0) return;
+
+	//Listen on the first address it resolved to that works
+	for (addrinfo* iter=addresses; iter!=nullptr; iter=iter->ai_next) {
+		auto sock = ::socket( iter->ai_family, iter->ai_socktype, iter->ai_protocol );
+		if (sock==INVALID_SOCKET_VALUE) continue;
+
+		//Allow restarting a listener immediately on the same port
+		int reuse = 1;
+		setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const*>(&reuse), sizeof(int) );
+
+		if (
+			::bind( sock, iter->ai_addr, static_cast<int>(iter->ai_addrlen) )==0 &&
+			::listen( sock, 4 )==0
+		) {
+			_socket = sock;
+			break;
+		}
+		close_socket(sock);
+	}
+
+	freeaddrinfo(addresses);
+}
+Socket::~Socket() {
+	if (_socket!=INVALID_SOCKET_VALUE) close_socket(_socket);
+}
+
+bool Socket::is_valid() const {
+	return _socket!=INVALID_SOCKET_VALUE;
+}
+
+bool Socket::set_timeout(double seconds) {
+	#ifdef _WIN32
+	DWORD timeout = static_cast<DWORD>( seconds * 1000.0 );
+	#else
+	timeval timeout;
+	timeout.tv_sec  = static_cast<time_t>(seconds);
+	timeout.tv_usec = static_cast<suseconds_t>( (seconds-static_cast<double>(timeout.tv_sec)) * 1.0e6 );
+	#endif
+	return
+		setsockopt( _socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char const*>(&timeout), sizeof(timeout) )==0 &&
+		setsockopt( _socket, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<char const*>(&timeout), sizeof(timeout) )==0
+	;
+}
+
+Socket* Socket::accept() {
+	auto sock = ::accept( _socket, nullptr, nullptr );
+	if (sock==INVALID_SOCKET_VALUE) return nullptr;
+
+	int no_delay = 1;
+	setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&no_delay), sizeof(int) );
+
+	return new Socket(sock);
+}
+
+bool Socket::send(void const* data, size_t size) {
+	char const* ptr = static_cast<char const*>(data);
+	while (size>0) {
+		//	(Sent in pieces, since Winsock takes an `int` size.)
+		size_t count = std::min( size, 1_zu<<30 );
+		auto sent = ::send( _socket, ptr, static_cast<send_size_t>(count), SEND_FLAGS );
+		if (sent<=0) return false;
+		ptr  += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+bool Socket::send_line(std::string const& line) {
+	std::string data = line + "\n";
+	return send( data.c_str(), data.size() );
+}
+
+bool Socket::recv(void* data, size_t size) {
+	char* ptr = static_cast<char*>(data);
+
+	//Data already received (while looking for the end of a line)
+	size_t count = std::min( size, _buffer.size() );
+	std::memcpy( ptr, _buffer.data(), count );
+	_buffer.erase( 0, count );
+	ptr  += count;
+	size -= count;
+
+	while (size>0) {
+		count = std::min( size, 1_zu<<30 );
+		auto received = ::recv( _socket, ptr, static_cast<send_size_t>(count), 0 );
+		if (received<=0) return false;
+		ptr  += received;
+		size -= static_cast<size_t>(received);
+	}
+	return true;
+}
+bool Socket::recv_line(std::string* line) {
+	while (true) {
+		size_t end = _buffer.find('\n');
+		if (end!=_buffer.npos) {
+			*line = _buffer.substr(0,end);
+			_buffer.erase(0,end+1);
+			if (!line->empty() && line->back()=='\r') line->pop_back();
+			return true;
+		}
+
+		if (_buffer.size()>SOCKET_MAX_LINE) return false;
+
+		char chunk[4096];
+		auto received = ::recv( _socket, chunk, sizeof(chunk), 0 );
+		if (received<=0) return false;
+		_buffer.append( chunk, static_cast<size_t>(received) );
+	}
+}
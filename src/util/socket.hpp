@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../stdafx.hpp"
+
+
+
+//A TCP socket: either a connection, or one listening for connections.  Sends and receives are
+//	blocking, and complete entirely or fail (e.g. if the other end disconnects).
+class Socket final {
+	private:
+		#ifdef _WIN32
+		uintptr_t _socket;
+		#else
+		int _socket;
+		#endif
+
+		//Data received but not yet returned (by `.recv_line(...)`)
+		std::string _buffer;
+
+		#ifdef _WIN32
+		explicit Socket(uintptr_t socket) : _socket(socket) {}
+		#else
+		explicit Socket(int       socket) : _socket(socket) {}
+		#endif
+
+	public:
+		//Connect to `host` (a name or address) on port `port`.  On failure, `.is_valid()` returns
+		//	false.
+		Socket(std::string const& host, uint16_t port);
+		//Listen for connections on port `port` of the interface with address `address` (by default,
+		//	loopback, so that only processes on this host can connect; e.g. "0.0.0.0" for all IPv4
+		//	interfaces).  On failure, `.is_valid()` returns false.
+		explicit Socket(uint16_t port, std::string const& address="127.0.0.1");
+		Socket(Socket const&) = delete;
+		~Socket();
+
+		bool is_valid() const;
+
+		//Make sends and receives fail if they make no progress for `seconds` (instead of blocking
+		//	indefinitely, e.g. on a peer that has hung).  Returns whether it succeeded.
+		bool set_timeout(double seconds);
+
+		//Wait for a connection to the (listening) socket.  Returns `nullptr` on failure.
+		Socket* accept();
+
+		//Send the `size` bytes at `data`.  Returns whether it succeeded.
+		bool send(void const* data, size_t size);
+		//Send `line` followed by a newline.  Returns whether it succeeded.
+		bool send_line(std::string const& line);
+
+		//Receive exactly `size` bytes into `data`.  Returns whether it succeeded.
+		bool recv(void* data, size_t size);
+		//Receive a line (without its newline) into `line`.  Returns whether it succeeded; it fails on
+		//	lines longer than 64 KiB.
+		bool recv_line(std::string* line);
+};
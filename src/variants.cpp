@@ -0,0 +1,73 @@
+#include "stdafx.hpp"
+
+#include "util/string.hpp"
+
+
+
+//Entry point of a program with several variants of the renderer built into it (see
+//	`RENDER_VARIANT` in "stdafx.hpp").  Each variant is the whole renderer, compiled for one
+//	rendering mode; this just chooses one with `--mode=<name>` and passes the other arguments on.
+
+//	The variants, as `RENDER_VARIANT_ENTRY(name,namespace,algorithm,wavelengths)` (generated by
+//		"CMakeLists.txt").  The first is the default.
+#define RENDER_VARIANT_ENTRY(NAME,NAMESPACE,ALGNUM,WAVELENGTHS)\
+	namespace NAMESPACE { int run_variant(int argc, char* argv[]); }
+#include "render-variants.inl"
+#undef RENDER_VARIANT_ENTRY
+
+class _Variant final { public:
+	char const* name;
+	int(*run)(int argc, char* argv[]);
+	unsigned algnum;
+	size_t wavelengths;
+};
+static _Variant const _variants[] = {
+	#define RENDER_VARIANT_ENTRY(NAME,NAMESPACE,ALGNUM,WAVELENGTHS)\
+		{ NAME, &NAMESPACE::run_variant, ALGNUM, WAVELENGTHS },
+	#include "render-variants.inl"
+	#undef RENDER_VARIANT_ENTRY
+};
+
+inline static void _print_variants(FILE* file) {
+	fprintf(file,"Modes:\n");
+	for (_Variant const& variant : _variants) {
+		switch (variant.algnum) {
+			case 0:  fprintf(file,"  \"%s\": RGB\n",variant.name); continue;
+			case 1:  fprintf(file,"  \"%s\": spectral (ours)",                    variant.name); break;
+			case 2:  fprintf(file,"  \"%s\": spectral (Meng et al. 2015)",        variant.name); break;
+			case 3:  fprintf(file,"  \"%s\": spectral (Jakob and Hanika 2019)",   variant.name); break;
+			default: assert(false);
+		}
+		fprintf(file,", %zu wavelengths per sample\n",variant.wavelengths);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	_Variant const* variant = &_variants[0];
+
+	std::vector<char*> args;
+	for (int i=0;i<argc;++i) {
+		if (i>0 && Str::startswith(argv[i],"--mode=")) {
+			std::string name = std::string(argv[i]).substr(7);
+			if (name=="list") {
+				_print_variants(stdout);
+				return 0;
+			}
+
+			variant = nullptr;
+			for (_Variant const& iter : _variants) {
+				if (name==iter.name) variant=&iter;
+			}
+			if (variant!=nullptr); else {
+				fprintf(stderr,"Unrecognized mode \"%s\"!  ",name.c_str());
+				_print_variants(stderr);
+				return -1;
+			}
+		} else {
+			args.emplace_back(argv[i]);
+		}
+	}
+	args.emplace_back(nullptr);
+
+	return variant->run( static_cast<int>(args.size()-1), args.data() );
+}